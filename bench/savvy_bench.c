@@ -0,0 +1,760 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "dbms.h"
+#include "catalog.h"
+#include "query.h"
+#include "aggregate.h"
+#include "join.h"
+#include "segment.h"
+
+// Measures the in-memory engine and snapshot files on a synthetic table.
+// The first column is always a unique, ordered INTEGER key, the others cycle
+// through the type mix. Every operation is timed on its own for the percentiles.
+
+typedef enum
+{
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_CSV
+} OutputFormat;
+
+typedef struct
+{
+    int rows;
+    int columns;
+    const char *mix;
+    int repeat;
+    uint64_t seed;
+    const char *snapshot;
+    OutputFormat format;
+    int threads; // For the parallel aggregates
+} BenchConfig;
+
+typedef struct
+{
+    const char *name;
+    int ops;
+    long long rowsPerOp;
+    double seconds;
+    double p50;
+    double p99;
+} BenchResult;
+
+#define MAX_RESULTS 32
+
+static BenchResult results[MAX_RESULTS];
+static int numResults = 0;
+
+// Distinct values of dictionary encoded columns
+#define DICTIONARY_VALUES 16
+
+// Build side memory of the spilled join
+#define JOIN_SPILL_MEMORY ((size_t)64 << 10)
+
+static uint64_t randomState;
+
+// xorshift64, so runs with the same seed use the same data
+static uint64_t next_random(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Record an operation from its per-op latencies, which are sorted in place
+static void add_result(const char *name, uint64_t *latencies, int ops, long long rowsPerOp)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < ops; i++)
+    {
+        total += latencies[i];
+    }
+    qsort(latencies, ops, sizeof(uint64_t), compare_ns);
+
+    BenchResult *result = &results[numResults++];
+    result->name = name;
+    result->ops = ops;
+    result->rowsPerOp = rowsPerOp;
+    result->seconds = total / 1e9;
+    result->p50 = ops > 0 ? latencies[(size_t)(0.50 * (ops - 1))] / 1e3 : 0;
+    result->p99 = ops > 0 ? latencies[(size_t)(0.99 * (ops - 1))] / 1e3 : 0;
+}
+
+static ColumnType mix_type(char c)
+{
+    switch (c)
+    {
+    case 's':
+    case 'd':
+        return STRING;
+    case 'b':
+        return BOOLEAN;
+    case 'f':
+        return FLOAT;
+    default:
+        return INTEGER;
+    }
+}
+
+// Text form of a random value for a column, the key column gets key itself
+static void random_value(const Column *column, int colIndex, long long key, char *buffer, size_t size)
+{
+    if (colIndex == 0)
+    {
+        snprintf(buffer, size, "%lld", key);
+        return;
+    }
+
+    uint64_t r = next_random();
+    switch (column->type)
+    {
+    case INTEGER:
+        snprintf(buffer, size, "%lld", (long long)(r % 1000000));
+        break;
+    case STRING:
+        if (column->isDictionary)
+            snprintf(buffer, size, "v%llu", (unsigned long long)(r % DICTIONARY_VALUES));
+        else
+            snprintf(buffer, size, "s%llx", (unsigned long long)(r % 0xffffffffull));
+        break;
+    case BOOLEAN:
+        snprintf(buffer, size, "%s", (r & 1) ? "true" : "false");
+        break;
+    case FLOAT:
+        snprintf(buffer, size, "%.3f", (double)(r % 1000000) / 1000.0);
+        break;
+    }
+}
+
+static void random_row(const Table *table, long long key, char *buffer, const char **values)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        values[i] = buffer + i * MAX_INPUT;
+        random_value(&table->columns[i], i, key, buffer + i * MAX_INPUT, MAX_INPUT);
+    }
+}
+
+static Table *create_bench_table(Catalog *catalog, const BenchConfig *config)
+{
+    DatabaseNode *dbNode = insert_database(catalog, "bench");
+    TableNode *tableNode = dbNode ? insert_table(dbNode, "data") : NULL;
+    Column *columns = malloc(config->columns * sizeof(Column));
+    if (!tableNode || !columns)
+    {
+        free(columns);
+        return NULL;
+    }
+
+    size_t mixLength = strlen(config->mix);
+    for (int i = 0; i < config->columns; i++)
+    {
+        snprintf(columns[i].name, sizeof(columns[i].name), "c%d", i);
+        columns[i].type = i == 0 ? INTEGER : mix_type(config->mix[(i - 1) % mixLength]);
+        columns[i].isUnique = i == 0;
+        columns[i].isOrdered = i == 0;
+        columns[i].isDictionary = i > 0 && config->mix[(i - 1) % mixLength] == 'd';
+    }
+
+    int ok = set_table_columns(&tableNode->table, columns, config->columns);
+    free(columns);
+    return ok ? &tableNode->table : NULL;
+}
+
+// Time reading every row of a query, up to its LIMIT. Returns 0 if it does not compile.
+static uint64_t time_query(Table *table, const char *text)
+{
+    Query *query = query_parse(text, NULL, 0);
+    if (!query || !query_bind(query, table, NULL, 0))
+    {
+        query_free(query);
+        return 0;
+    }
+
+    QueryCursor cursor;
+    query_cursor_init(&cursor);
+    long long count = 0;
+    uint64_t start = now_ns();
+    while ((query->limit < 0 || count < query->limit) && query_next(query, table, &cursor) >= 0)
+    {
+        count++;
+    }
+    uint64_t elapsed = now_ns() - start;
+    query_cursor_free(&cursor);
+    query_free(query);
+    return elapsed > 0 ? elapsed : 1;
+}
+
+// Time computing an aggregate's groups on up to threads threads. Returns 0 if it does not compile.
+static uint64_t time_aggregate(Table *table, const char *text, int threads)
+{
+    Query *query = query_parse(text, NULL, 0);
+    if (!query || !query_bind(query, table, NULL, 0))
+    {
+        query_free(query);
+        return 0;
+    }
+    query->threads = threads;
+
+    AggregateResult result;
+    uint64_t start = now_ns();
+    int ok = aggregate_run(query, table, &result);
+    uint64_t elapsed = now_ns() - start;
+    if (ok)
+    {
+        aggregate_free(&result);
+    }
+    query_free(query);
+    return ok && elapsed > 0 ? elapsed : ok;
+}
+
+// Time reading every pair of a JOIN with the build side limited to memory
+// bytes, 0 for no limit. Returns 0 if it does not compile or fails.
+static uint64_t time_join(Table *left, Table *right, const char *text, size_t memory)
+{
+    Query *query = query_parse(text, NULL, 0);
+    if (!query || !query_bind_join(query, left, right, NULL, 0))
+    {
+        query_free(query);
+        return 0;
+    }
+    query->joinMemory = memory;
+
+    JoinRun run;
+    int slots[2];
+    uint64_t start = now_ns();
+    join_init(&run, query, left, right);
+    int ok = join_start(&run);
+    while (ok && join_next(&run, slots))
+    {
+    }
+    ok = ok && run.error == JOIN_OK;
+    uint64_t elapsed = now_ns() - start;
+    join_free(&run);
+    query_free(query);
+    return ok && elapsed > 0 ? elapsed : ok;
+}
+
+static int run_benchmarks(const BenchConfig *config)
+{
+    Catalog catalog;
+    catalog_init(&catalog);
+    Table *table = create_bench_table(&catalog, config);
+    int count = config->rows > config->repeat ? config->rows : config->repeat;
+    uint64_t *latencies = malloc(count * sizeof(uint64_t));
+    char *buffer = malloc(config->columns * MAX_INPUT);
+    const char **values = malloc(config->columns * sizeof(char *));
+    if (!table || !latencies || !buffer || !values)
+    {
+        fprintf(stderr, "Failed to set up the benchmark table.\n");
+        free(latencies);
+        free(buffer);
+        free(values);
+        free_databases(&catalog);
+        return 0;
+    }
+
+    int rows = config->rows;
+    char key[MAX_INPUT];
+    uint64_t start;
+
+    for (int i = 0; i < rows; i++)
+    {
+        random_row(table, i, buffer, values);
+        start = now_ns();
+        if (insert_rows(table, values, 1) != 1)
+        {
+            fprintf(stderr, "Insert of row %d failed.\n", i);
+            rows = i;
+            break;
+        }
+        latencies[i] = now_ns() - start;
+    }
+    add_result("insert", latencies, rows, 1);
+
+    // Look up a row by its key and read every value of it
+    char cell[MAX_INPUT];
+    for (int i = 0; i < rows; i++)
+    {
+        snprintf(key, sizeof(key), "%lld", (long long)(next_random() % rows));
+        start = now_ns();
+        int slot = find_row_by_value(table, 0, key);
+        for (int j = 0; slot >= 0 && j < table->numColumns; j++)
+        {
+            format_cell(table, slot, j, cell, sizeof(cell));
+        }
+        latencies[i] = now_ns() - start;
+    }
+    add_result("point_lookup", latencies, rows, 1);
+
+    // Find the row through a statement parsed and bound for each key, then
+    // through one prepared with the key as a parameter
+    Query *prepared = query_parse("SELECT * FROM data WHERE c0 = ?", NULL, 0);
+    if (prepared && query_set_param(prepared, 1, "0") && query_bind(prepared, table, NULL, 0))
+    {
+        char lookupText[64];
+        QueryCursor cursor;
+        for (int i = 0; i < rows; i++)
+        {
+            snprintf(lookupText, sizeof(lookupText), "SELECT * FROM data WHERE c0 = %lld",
+                     (long long)(next_random() % rows));
+            start = now_ns();
+            Query *query = query_parse(lookupText, NULL, 0);
+            if (query && query_bind(query, table, NULL, 0))
+            {
+                query_cursor_init(&cursor);
+                query_next(query, table, &cursor);
+                query_cursor_free(&cursor);
+            }
+            query_free(query);
+            latencies[i] = now_ns() - start;
+        }
+        add_result("query_lookup", latencies, rows, 1);
+
+        for (int i = 0; i < rows; i++)
+        {
+            snprintf(key, sizeof(key), "%lld", (long long)(next_random() % rows));
+            start = now_ns();
+            query_set_param(prepared, 1, key);
+            query_plan(prepared, table);
+            query_cursor_init(&cursor);
+            query_next(prepared, table, &cursor);
+            query_cursor_free(&cursor);
+            latencies[i] = now_ns() - start;
+        }
+        add_result("prepared_lookup", latencies, rows, 1);
+    }
+    query_free(prepared);
+
+    // Half of the checked keys exist
+    for (int i = 0; i < rows; i++)
+    {
+        snprintf(key, sizeof(key), "%lld", (long long)(next_random() % (2 * (uint64_t)rows)));
+        start = now_ns();
+        is_value_unique(table, 0, key);
+        latencies[i] = now_ns() - start;
+    }
+    add_result("unique_check", latencies, rows, 1);
+
+    // Rewrite the last column, or move the key above the used range if it is the only one
+    int updateColumn = table->numColumns - 1;
+    for (int i = 0; i < rows; i++)
+    {
+        int slot = (int)(next_random() % rows);
+        random_value(&table->columns[updateColumn], updateColumn, (long long)rows + i, key, sizeof(key));
+        start = now_ns();
+        replace_row_value(table, slot, updateColumn, key);
+        latencies[i] = now_ns() - start;
+    }
+    add_result("update", latencies, rows, 1);
+
+    for (int i = 0; i < config->repeat; i++)
+    {
+        start = now_ns();
+        for (int slot = 0; slot < table->numRows; slot++)
+        {
+            if (!is_row_live(table, slot))
+            {
+                continue;
+            }
+            for (int j = 0; j < table->numColumns; j++)
+            {
+                format_cell(table, slot, j, cell, sizeof(cell));
+            }
+        }
+        latencies[i] = now_ns() - start;
+    }
+    add_result("full_scan", latencies, config->repeat, rows);
+
+    // Half of the keys match, NOT keeps the filter off the ordered index so it runs on whole column blocks
+    char queryText[64 + 2 * MAX_INPUT];
+    snprintf(queryText, sizeof(queryText), "SELECT * FROM data WHERE NOT c0 < %d", rows / 2);
+    int queryOk = 1;
+    for (int i = 0; queryOk && i < config->repeat; i++)
+    {
+        latencies[i] = time_query(table, queryText);
+        queryOk = latencies[i] > 0;
+    }
+    if (queryOk)
+    {
+        add_result("filtered_scan", latencies, config->repeat, rows);
+    }
+
+    // Equality on the first STRING column, which compares codes if it is dictionary encoded
+    int stringColumn = 0;
+    while (stringColumn < table->numColumns && table->columns[stringColumn].type != STRING)
+    {
+        stringColumn++;
+    }
+    if (stringColumn < table->numColumns)
+    {
+        format_cell(table, 0, stringColumn, cell, sizeof(cell));
+        snprintf(queryText, sizeof(queryText), "SELECT * FROM data WHERE %s = %s", table->columns[stringColumn].name,
+                 cell);
+        queryOk = 1;
+        for (int i = 0; queryOk && i < config->repeat; i++)
+        {
+            latencies[i] = time_query(table, queryText);
+            queryOk = latencies[i] > 0;
+        }
+        if (queryOk)
+        {
+            add_result("string_filter", latencies, config->repeat, rows);
+        }
+    }
+
+    // 100 consecutive keys through the ordered index, the first run builds it
+    for (int i = 0; queryOk && i < config->repeat; i++)
+    {
+        int low = (int)(next_random() % rows);
+        snprintf(queryText, sizeof(queryText), "SELECT * FROM data WHERE c0 >= %d AND c0 < %d", low, low + 100);
+        latencies[i] = time_query(table, queryText);
+        queryOk = latencies[i] > 0;
+    }
+    if (queryOk)
+    {
+        add_result("range_scan", latencies, config->repeat, 100);
+    }
+
+    // The top 100 rows, read in index order or sorted after a full scan
+    for (int i = 0; queryOk && i < config->repeat; i++)
+    {
+        latencies[i] = time_query(table, "SELECT * FROM data ORDER BY c0 DESC LIMIT 100");
+        queryOk = latencies[i] > 0;
+    }
+    if (queryOk)
+    {
+        add_result("ordered_limit", latencies, config->repeat, 100);
+    }
+    for (int i = 0; queryOk && table->numColumns > 1 && i < config->repeat; i++)
+    {
+        latencies[i] = time_query(table, "SELECT * FROM data ORDER BY c1 DESC LIMIT 100");
+        queryOk = latencies[i] > 0;
+    }
+    if (queryOk && table->numColumns > 1)
+    {
+        add_result("sorted_limit", latencies, config->repeat, rows);
+    }
+
+    // The same aggregates on one thread and split across config->threads
+    static const char *const aggregateNames[] = {"aggregate", "aggregate_par", "group_by", "group_by_par"};
+    for (int a = 0; queryOk && a < 4; a++)
+    {
+        if (a >= 2 && table->numColumns < 2)
+        {
+            break;
+        }
+        if (a < 2)
+        {
+            snprintf(queryText, sizeof(queryText), "SELECT COUNT(*), SUM(c0), MIN(c0), MAX(c0) FROM data");
+        }
+        else
+        {
+            snprintf(queryText, sizeof(queryText), "SELECT c1, COUNT(*), SUM(c0) FROM data GROUP BY c1");
+        }
+        for (int i = 0; queryOk && i < config->repeat; i++)
+        {
+            latencies[i] = time_aggregate(table, queryText, a % 2 ? config->threads : 1);
+            queryOk = latencies[i] > 0;
+        }
+        if (queryOk)
+        {
+            add_result(aggregateNames[a], latencies, config->repeat, rows);
+        }
+    }
+
+    // A quarter of the keys against a table a quarter the size, which is
+    // hashed, in memory and spilled to temporary files
+    TableNode *dimNode = insert_table(catalog.databases, "dim");
+    Column dimColumns[2] = {{"k", INTEGER, 0, 0, 0}, {"v", STRING, 0, 0, 0}};
+    int joinOk = dimNode && set_table_columns(&dimNode->table, dimColumns, 2);
+    for (int i = 0; joinOk && i < rows / 4; i++)
+    {
+        char dimValue[MAX_INPUT];
+        snprintf(key, sizeof(key), "%d", i * 4);
+        snprintf(dimValue, sizeof(dimValue), "v%d", i % DICTIONARY_VALUES);
+        const char *dimRow[] = {key, dimValue};
+        joinOk = insert_rows(&dimNode->table, dimRow, 1) == 1;
+    }
+    static const char *const joinNames[] = {"hash_join", "hash_join_spill"};
+    for (int j = 0; joinOk && j < 2; j++)
+    {
+        for (int i = 0; joinOk && i < config->repeat; i++)
+        {
+            latencies[i] = time_join(table, &dimNode->table, "SELECT * FROM data JOIN dim ON c0 = k",
+                                     j ? JOIN_SPILL_MEMORY : 0);
+            joinOk = latencies[i] > 0;
+        }
+        if (joinOk)
+        {
+            add_result(joinNames[j], latencies, config->repeat, rows);
+        }
+    }
+    if (dimNode)
+    {
+        remove_table(catalog.databases, "dim");
+    }
+
+    // A changed table is written to a new file, an unchanged one keeps its file
+    int filesOk = 1;
+    for (int i = 0; filesOk && i < config->repeat; i++)
+    {
+        table->dirty = 1;
+        start = now_ns();
+        filesOk = write_all_databases_to_file(&catalog, config->snapshot);
+        latencies[i] = now_ns() - start;
+    }
+    if (filesOk)
+    {
+        add_result("write_snapshot", latencies, config->repeat, rows);
+    }
+    for (int i = 0; filesOk && i < config->repeat; i++)
+    {
+        start = now_ns();
+        filesOk = write_all_databases_to_file(&catalog, config->snapshot);
+        latencies[i] = now_ns() - start;
+    }
+    if (filesOk)
+    {
+        add_result("clean_snapshot", latencies, config->repeat, rows);
+    }
+
+    // Opening reads the list of tables, a table is read on first use
+    for (int i = 0; filesOk && i < config->repeat; i++)
+    {
+        Catalog loaded;
+        catalog_init(&loaded);
+        start = now_ns();
+        filesOk = read_database_from_file(config->snapshot, &loaded, NULL);
+        latencies[i] = now_ns() - start;
+        free_databases(&loaded);
+    }
+    if (filesOk)
+    {
+        add_result("read_snapshot", latencies, config->repeat, rows);
+    }
+    for (int i = 0; filesOk && i < config->repeat; i++)
+    {
+        Catalog loaded;
+        catalog_init(&loaded);
+        filesOk = read_database_from_file(config->snapshot, &loaded, NULL);
+        start = now_ns();
+        filesOk = filesOk && find_table(loaded.databases, "data") != NULL;
+        latencies[i] = now_ns() - start;
+        free_databases(&loaded);
+    }
+    if (filesOk)
+    {
+        add_result("load_table", latencies, config->repeat, rows);
+    }
+    else
+    {
+        fprintf(stderr, "Snapshot file '%s' could not be written or read.\n", config->snapshot);
+    }
+    segment_remove(config->snapshot);
+
+    // Delete every row in random order, the id map is built before timing starts
+    int64_t *ids = malloc((rows > 0 ? rows : 1) * sizeof(int64_t));
+    if (ids)
+    {
+        for (int i = 0; i < rows; i++)
+        {
+            ids[i] = i;
+        }
+        for (int i = rows - 1; i > 0; i--)
+        {
+            int j = (int)(next_random() % (i + 1));
+            int64_t swap = ids[i];
+            ids[i] = ids[j];
+            ids[j] = swap;
+        }
+        find_row_slot(table, 0);
+        for (int i = 0; i < rows; i++)
+        {
+            start = now_ns();
+            remove_row(table, find_row_slot(table, ids[i]));
+            latencies[i] = now_ns() - start;
+        }
+        add_result("delete", latencies, rows, 1);
+        free(ids);
+    }
+
+    free(latencies);
+    free(buffer);
+    free(values);
+    free_databases(&catalog);
+    return filesOk;
+}
+
+static void print_results(const BenchConfig *config)
+{
+    if (config->format == FORMAT_JSON)
+    {
+        printf("{\"rows\": %d, \"columns\": %d, \"mix\": \"%s\", \"repeat\": %d, \"seed\": %llu, \"threads\": %d, "
+               "\"results\": [",
+               config->rows, config->columns, config->mix, config->repeat, (unsigned long long)config->seed,
+               config->threads);
+        for (int i = 0; i < numResults; i++)
+        {
+            BenchResult *r = &results[i];
+            double seconds = r->seconds > 0 ? r->seconds : 1e-9;
+            printf("%s\n  {\"op\": \"%s\", \"ops\": %d, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+                   "\"rows_per_sec\": %.1f, \"p50_us\": %.3f, \"p99_us\": %.3f}",
+                   i ? "," : "", r->name, r->ops, r->seconds, r->ops / seconds,
+                   r->ops * r->rowsPerOp / seconds, r->p50, r->p99);
+        }
+        printf("\n]}\n");
+        return;
+    }
+
+    if (config->format == FORMAT_CSV)
+    {
+        printf("op,rows,columns,mix,ops,seconds,ops_per_sec,rows_per_sec,p50_us,p99_us\n");
+    }
+    else
+    {
+        printf("%d rows, %d columns, mix '%s', seed %llu, %d threads\n", config->rows, config->columns, config->mix,
+               (unsigned long long)config->seed, config->threads);
+        printf("%-16s %10s %14s %14s %12s %12s\n", "op", "ops", "ops/s", "rows/s", "p50 us", "p99 us");
+    }
+    for (int i = 0; i < numResults; i++)
+    {
+        BenchResult *r = &results[i];
+        double seconds = r->seconds > 0 ? r->seconds : 1e-9;
+        if (config->format == FORMAT_CSV)
+        {
+            printf("%s,%d,%d,%s,%d,%.6f,%.1f,%.1f,%.3f,%.3f\n", r->name, config->rows, config->columns,
+                   config->mix, r->ops, r->seconds, r->ops / seconds, r->ops * r->rowsPerOp / seconds,
+                   r->p50, r->p99);
+        }
+        else
+        {
+            printf("%-16s %10d %14.1f %14.1f %12.3f %12.3f\n", r->name, r->ops, r->ops / seconds,
+                   r->ops * r->rowsPerOp / seconds, r->p50, r->p99);
+        }
+    }
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [--rows N] [--columns N] [--mix TYPES] [--repeat N] [--seed N]\n"
+            "          [--snapshot FILE] [--format text|json|csv] [--threads N]\n"
+            "TYPES cycles through the columns after the integer key: i=INTEGER s=STRING b=BOOLEAN f=FLOAT\n"
+            "d=dictionary encoded STRING with %d distinct values\n",
+            program, DICTIONARY_VALUES);
+}
+
+static int parse_args(int argc, char *argv[], BenchConfig *config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *option = argv[i];
+        const char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!arg)
+        {
+            return 0;
+        }
+        i++;
+
+        if (strcmp(option, "--rows") == 0)
+        {
+            config->rows = atoi(arg);
+        }
+        else if (strcmp(option, "--columns") == 0)
+        {
+            config->columns = atoi(arg);
+        }
+        else if (strcmp(option, "--mix") == 0)
+        {
+            config->mix = arg;
+        }
+        else if (strcmp(option, "--repeat") == 0)
+        {
+            config->repeat = atoi(arg);
+        }
+        else if (strcmp(option, "--seed") == 0)
+        {
+            config->seed = strtoull(arg, NULL, 10);
+        }
+        else if (strcmp(option, "--threads") == 0)
+        {
+            config->threads = atoi(arg);
+        }
+        else if (strcmp(option, "--snapshot") == 0)
+        {
+            config->snapshot = arg;
+        }
+        else if (strcmp(option, "--format") == 0)
+        {
+            if (strcmp(arg, "json") == 0)
+            {
+                config->format = FORMAT_JSON;
+            }
+            else if (strcmp(arg, "csv") == 0)
+            {
+                config->format = FORMAT_CSV;
+            }
+            else if (strcmp(arg, "text") == 0)
+            {
+                config->format = FORMAT_TEXT;
+            }
+            else
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    if (config->rows < 1 || config->columns < 1 || config->repeat < 1 || config->threads < 1 ||
+        config->threads > QUERY_MAX_THREADS || config->mix[0] == '\0' || config->seed == 0)
+    {
+        return 0;
+    }
+    for (const char *c = config->mix; *c; c++)
+    {
+        if (!strchr("isbfd", *c))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config = {100000, 4, "sif", 5, 42, "savvy_bench.svdb", FORMAT_TEXT, 0};
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    config.threads = processors < 1 ? 1 : processors < QUERY_MAX_THREADS ? (int)processors : QUERY_MAX_THREADS;
+    if (!parse_args(argc, argv, &config))
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    randomState = config.seed;
+    int ok = run_benchmarks(&config);
+    print_results(&config);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "query.h"
+
+// Aggregate SELECTs: COUNT, SUM, MIN, MAX and AVG, over the whole table or per
+// GROUP BY key. Each range of a parallel scan accumulates into a hash table of
+// its own, the tables are merged into the first once every range is done and
+// the groups are sorted by key. Groups and extremes are kept as the slot
+// holding their value, so results are read from the table, which must not
+// change until they are formatted.
+
+typedef struct
+{
+    int64_t count;   // Rows seen
+    int64_t intSum;  // SUM of INTEGER and rowid, until it overflows
+    double floatSum; // SUM of FLOAT, and of integers once intSum overflowed
+    int overflow;
+    int minSlot; // -1 while no row was seen
+    int maxSlot;
+} Accumulator;
+
+typedef struct
+{
+    int *buckets;        // Group index + 1, 0 when empty
+    int numBuckets;      // Always zero or a power of two
+    int *keySlots;       // A slot holding each group's key, -1 without GROUP BY
+    unsigned int *hashes;
+    Accumulator *accumulators; // numNames per group
+    int numGroups;
+    int capacity;
+    int failed; // Ran out of memory
+} GroupTable;
+
+typedef struct
+{
+    const Query *query;
+    const Table *table;
+    GroupTable groups;
+    int *order; // Groups in key order
+    int numRows;
+} AggregateResult;
+
+int aggregate_run(const Query *query, Table *table, AggregateResult *result);
+void aggregate_format(const AggregateResult *result, int row, int item, char *buffer, size_t size);
+void aggregate_free(AggregateResult *result);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "column_store.h"
+
+// Ordered index over one column of a table: a B+-tree with page-sized nodes
+// whose leaves hold (key, slot) entries in key order, chained both ways for
+// range scans. Integer, float and boolean keys are copied into the entries.
+// Leaf entries of strings are compared through the table's cells, while the
+// separators in inner nodes own a copy, since the slot they came from may be
+// updated or reused. Equal keys are ordered by slot, so every entry is distinct.
+//
+// Removing entries never merges nodes, leaves may run empty until the index
+// is rebuilt. Compaction drops the index, which rebuilds it.
+//
+// Nodes are carved from slabs owned by the tree, a build allocates all of
+// them at once, and freeing the tree releases the slabs without walking the
+// leaves.
+
+typedef struct BTreeNode BTreeNode;
+typedef struct BTreeSlab BTreeSlab;
+
+typedef struct
+{
+    union
+    {
+        int64_t i; // INTEGER and BOOLEAN
+        double f;
+        char *s; // STRING separators, NULL in leaf entries
+    } key;
+    int32_t slot;
+} BTreeEntry;
+
+typedef struct
+{
+    BTreeNode *root;  // NULL until built
+    BTreeSlab *slabs; // Memory of every node
+    BTreeNode *spare; // Slab nodes not in the tree, linked through next
+    int numNodes;     // Nodes in the slabs
+    int numSpare;
+    size_t bytes; // Size of the slabs
+    int count;
+    int height;     // Levels of inner nodes above the leaves
+    int stringKeys; // Separators own copies of their strings
+} BTree;
+
+// Position between two entries, moved with btree_next and btree_prev
+typedef struct
+{
+    const BTreeNode *leaf;
+    int index;
+} BTreeIterator;
+
+void btree_init(BTree *tree);
+void btree_free(BTree *tree);
+int btree_build(BTree *tree, const struct Table *table, int col, const uint32_t *slots, int count);
+int btree_insert(BTree *tree, const struct Table *table, int col, int slot);
+int btree_remove(BTree *tree, const struct Table *table, int col, int slot);
+
+void btree_first(const BTree *tree, BTreeIterator *it);
+void btree_last(const BTree *tree, BTreeIterator *it);
+void btree_seek(const BTree *tree, const struct Table *table, int col, const Value *key, int after,
+                BTreeIterator *it);
+int btree_next(BTreeIterator *it);
+int btree_prev(BTreeIterator *it);
+
+#endif
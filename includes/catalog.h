@@ -0,0 +1,21 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "dbms.h"
+
+// Databases and tables are kept in linked lists for ordered listing, with a
+// name map next to each list for lookups. Nodes never move once created, so
+// DatabaseNode and TableNode pointers stay valid as handles until removal.
+
+void catalog_init(Catalog *catalog);
+DatabaseNode *catalog_add_database(Catalog *catalog, const char *name, int atEnd);
+DatabaseNode *catalog_unlink_database(Catalog *catalog, const char *name, DatabaseNode **prev);
+int catalog_relink_database(Catalog *catalog, DatabaseNode *dbNode, DatabaseNode *prev);
+DatabaseNode *catalog_find_database(const Catalog *catalog, const char *name);
+
+TableNode *catalog_add_table(DatabaseNode *dbNode, const char *name, int atEnd);
+TableNode *catalog_unlink_table(DatabaseNode *dbNode, const char *name, TableNode **prev);
+int catalog_relink_table(DatabaseNode *dbNode, TableNode *tableNode, TableNode *prev);
+TableNode *catalog_find_table(const DatabaseNode *dbNode, const char *name);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Codecs for the value blocks of table files (see segment.h). A block is only
+// stored encoded when that takes at most three quarters of its bytes, since a
+// raw block is mapped and used in place while an encoded one is decoded into
+// memory when its table is read.
+
+typedef enum
+{
+    CODEC_RAW,   // The values as they are
+    CODEC_FRAME, // Frame of reference: offsets from the smallest value, bit-packed
+    CODEC_DELTA, // Differences between consecutive values, as a bit-packed frame
+    CODEC_RUNS,  // Run lengths, with each run's value as a difference from the last
+    CODEC_LZ     // Literal bytes and copies of earlier ones
+} Codec;
+
+// How a block's bytes are read as values
+typedef enum
+{
+    CODEC_INT64,  // int64_t values
+    CODEC_UINT32, // uint32_t values, string offsets
+    CODEC_BITS,   // One bit per value
+    CODEC_BYTES   // Anything else
+} CodecValues;
+
+size_t codec_encode(const void *values, size_t bytes, CodecValues kind, Codec *codec, uint8_t **encoded);
+int codec_decode(Codec codec, const uint8_t *encoded, size_t size, CodecValues kind, void *values, size_t bytes);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef COLUMN_STORE_H
+#define COLUMN_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    INTEGER,
+    STRING,
+    BOOLEAN,
+    FLOAT
+} ColumnType;
+
+typedef struct Dictionary Dictionary;
+
+// Values of one column, stored contiguously in the array matching its type.
+// Arrays only grow into new memory, the old arrays are retired (see mvcc.h),
+// so readers holding a copy of the pointers keep reading valid values.
+//
+// A dictionary encoded STRING column stores each distinct string once: its
+// heap offset is the value's code, shared by every cell holding it, so cells
+// compare equal exactly when their offsets do.
+typedef struct
+{
+    int64_t *ints;     // INTEGER
+    double *floats;    // FLOAT
+    uint8_t *bits;     // BOOLEAN, one bit per row
+    uint32_t *offsets; // STRING, start of each value in heap
+    char *heap;        // STRING, NUL-terminated values back to back
+    size_t heapSize;
+    size_t heapCapacity;
+    size_t heapGarbage;  // STRING, estimated bytes of strings no slot refers to anymore
+    Dictionary *dictionary; // STRING, set of the distinct strings if the column is dictionary encoded
+    size_t arrayBytes;   // Size of the owned value array
+    int64_t allocations; // Arrays allocated for the column, for monitoring
+    int mapped;     // Arrays point into a mapped snapshot file and are not owned
+    int mappedRows; // Values in the mapped arrays
+} ColumnData;
+
+// A parsed, typed value, used for lookups and comparisons against cells
+typedef struct
+{
+    ColumnType type;
+    union
+    {
+        int64_t i;
+        double f;
+        int b;
+        const char *s;
+    } as;
+} Value;
+
+struct Table;
+
+int parse_value(const char *text, ColumnType type, Value *out);
+
+void column_data_init(ColumnData *data);
+void column_data_free(ColumnData *data);
+int column_data_resize(ColumnData *data, ColumnType type, int numRows);
+int column_data_set(ColumnData *data, ColumnType type, int row, const Value *value);
+int column_data_fill_default(ColumnData *data, ColumnType type, int from, int to);
+int column_data_init_default(ColumnData *data, ColumnType type, int capacity, const Value *value);
+int column_data_compact(ColumnData *data, ColumnType type, const uint8_t *deleted, int numRows);
+int column_data_compact_heap(ColumnData *data, const uint8_t *keep, int numRows);
+size_t column_data_bytes(const ColumnData *data, ColumnType type);
+int column_data_encode(ColumnData *data, int numRows);
+void column_data_decode(ColumnData *data);
+int64_t column_data_find_code(const ColumnData *data, const char *value);
+void column_data_view(const ColumnData *data, ColumnData *view);
+
+int64_t cell_int(const struct Table *table, int row, int col);
+double cell_float(const struct Table *table, int row, int col);
+int cell_bool(const struct Table *table, int row, int col);
+const char *cell_string(const struct Table *table, int row, int col);
+void format_cell(const struct Table *table, int row, int col, char *buffer, size_t size);
+int cell_equals(const struct Table *table, int row, int col, const Value *value);
+int cell_compare(const struct Table *table, int row, int col, const Value *value);
+int cell_compare_rows(const struct Table *table, int col, int a, int b);
+int value_equals(const Value *a, const Value *b);
+
+#endif
@@ -4,38 +4,108 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "btree.h"
+#include "column_store.h"
+#include "hash_index.h"
+#include "mvcc.h"
+#include "name_map.h"
 
 #define MAX_INPUT 50
 
-typedef enum
-{
-    INTEGER,
-    STRING,
-    BOOLEAN,
-    FLOAT
-} ColumnType;
+#define SNAPSHOT_FILE "db.svdb"
+#define LEGACY_SNAPSHOT_FILE "db.txt"
+#define LOG_FILE "db.log"
+
+// Checkpoints compact tables once more than 1/COMPACT_RATIO of their slots are
+// deleted, or of a string heap is garbage
+#define COMPACT_RATIO 4
+
+// Snapshot of the latest state, including changes not committed yet
+#define TXN_LATEST UINT64_MAX
+
+// Column flags as stored in snapshots and logs
+#define COLUMN_UNIQUE 1
+#define COLUMN_ORDERED 2
+#define COLUMN_DICTIONARY 4
+#define COLUMN_DEFAULT 8 // Logs only: a new column's default value follows its source
 
 typedef struct
 {
     char name[MAX_INPUT];
     ColumnType type;
     int isUnique;
+    int isOrdered;    // Kept in key order by a B+-tree index
+    int isDictionary; // STRING values are dictionary encoded, see column_store.h
 } Column;
 
+// Slots of an ordered column in key order, as saved in the snapshot a table was loaded from
 typedef struct
 {
-    char **values;
-} Row;
+    const uint32_t *slots;
+    int count;
+} SavedOrder;
 
-typedef struct
+typedef struct Table
 {
     char name[MAX_INPUT];
     Column *columns;
-    Row *rows;
+    ColumnData *data;   // One per column, numRows values each
+    HashIndex *indexes; // One per column, only populated for unique columns
+    BTree *orderedIndexes;   // One per column, only built for ordered columns
+    SavedOrder *savedOrders; // One per column, lets ordered indexes skip sorting after a load
     int numColumns;
-    int numRows;
+    int numRows;        // Row slots, including deleted ones
+    int capacity;       // Row slots allocated in every per-slot array
+    ColumnData rowIds;  // INTEGER, stable id of the row in each slot
+    ColumnData deleted; // BOOLEAN, set for slots whose row was deleted
+    int numDeleted;     // Deleted slots free for reuse
+    int64_t nextRowId;
+    int *freeSlots;     // Stack of the deleted slots, built on the first insert after loading
+    int freeCapacity;
+    RowIdMap rowIdMap; // Row id to slot, built on first lookup
+
+    // Row versions, see mvcc.h. A slot's row is visible to the snapshots from
+    // created on, and if it was deleted, to those before expired. Both arrays
+    // are NULL until the first versioned change, every slot then has neither.
+    ColumnData created; // INTEGER, transaction that stored the row
+    ColumnData expired; // INTEGER, transaction that deleted or replaced the row, TXN_NONE if it is current
+    int *pending;       // Deleted slots snapshots may still read, in the order they expired
+    int pendingStart;   // Next slot in pending to reclaim
+    int pendingEnd;
+    int pendingCapacity;
+    int numPending;       // Deleted slots not yet free for reuse
+    unsigned resizes;     // Odd while the per-slot arrays are being replaced, see table_view
+    int64_t compactions;  // Slot or string heap compactions, for monitoring
+    uint64_t writeTxn;    // Stamped on changes made now, TXN_NONE changes rows in place without versions
+    uint64_t changedTxn;  // Last transaction that changed the table
+    Mutex latch;          // Held while the table or its indexes change, and to read through the indexes
+
+    // Where the table is stored in a snapshot, see segment.h. A stored table is
+    // read on first use through find_table, and while it is clean it can be
+    // evicted and read again later.
+    struct SegmentMapping *stored; // NULL until the table is first written to a snapshot
+    uint64_t storedOffset;
+    uint64_t storedBytes;
+    uint64_t storedFile;           // Number of the table's own file, 0 while it has none
+    struct SegmentMapping *source; // Snapshot the table's arrays were read from
+    int unloaded;      // Stored but not read yet, or evicted
+    int dirty;         // Changed since it was stored
+    uint64_t lastUsed; // Clock of the last find_table, the least recent is evicted first
+    int64_t loads;     // Times the table was read from a snapshot, for monitoring
 } Table;
 
+// Memory held by a table, see table_memory
+typedef struct
+{
+    size_t storageBytes; // Owned per-slot arrays, string heaps and slot lists, with unused capacity
+    size_t mappedBytes;  // Arrays still read from a mapped snapshot file
+    size_t garbageBytes; // Estimated heap bytes no row refers to anymore
+    size_t indexBytes;   // Hash indexes, ordered indexes and the row id map
+    int64_t allocations; // Per-slot arrays and heaps allocated since the table was loaded
+    int64_t compactions;
+    int64_t loads;
+} TableMemory;
+
 typedef struct TableNode
 {
     Table table;
@@ -45,7 +115,9 @@ typedef struct TableNode
 typedef struct
 {
     char name[MAX_INPUT];
-    TableNode *tables;
+    TableNode *tables; // In listing order
+    TableNode *lastTable;
+    NameMap tableNames; // Table name to TableNode
 } Database;
 
 typedef struct DatabaseNode
@@ -54,25 +126,76 @@ typedef struct DatabaseNode
     struct DatabaseNode *next;
 } DatabaseNode;
 
-extern DatabaseNode *dbList;
-extern DatabaseNode *dbNode;
+struct SegmentMapping;
+struct SegmentFiles;
+
+typedef struct
+{
+    DatabaseNode *databases; // In listing order
+    DatabaseNode *lastDatabase;
+    NameMap databaseNames;           // Database name to DatabaseNode
+    struct SegmentMapping *mappings; // Snapshot files the tables are stored in or point into
+    struct SegmentFiles *files;      // Table files of the snapshot, see segment.h
+} Catalog;
+
+// In-memory engine. These functions never log or print to the terminal, the
+// savvydb API (savvydb.h) adds logging and persistence on top of them.
+
+DatabaseNode *insert_database(Catalog *catalog, const char *db_name);
+int remove_database(Catalog *catalog, const char *db_name);
+void free_database(DatabaseNode *dbNode);
+void free_databases(Catalog *catalog);
+int list_databases(Catalog *catalog, const char *names[], int max_names);
+DatabaseNode *find_database(Catalog *catalog, const char *db_name);
 
-void create_database(DatabaseNode **head, const char *db_name);
-void delete_database(DatabaseNode **head, const char *db_name);
-int list_databases(DatabaseNode *head, const char *choices[], int max_choices);
-DatabaseNode *find_database(DatabaseNode *head, const char *db_name);
+TableNode *insert_table(DatabaseNode *dbNode, const char *tableName);
+int remove_table(DatabaseNode *dbNode, const char *table_name);
+void free_table(Table *table);
+void unload_table(Table *table);
+Table *find_table(DatabaseNode *dbNode, const char *tableName);
+Table *use_table(TableNode *tableNode);
+size_t table_resident_bytes(const Table *table);
+int evict_cold_tables(Catalog *catalog, size_t budget);
+int list_tables(DatabaseNode *dbNode, const char *names[], int max_names);
 
-void create_table(DatabaseNode *dbNode, const char *tableName);
-void list_rows_in_table(DatabaseNode *dbNode, const char *table_name);
-void delete_table(DatabaseNode *dbNode, const char *table_name);
-int list_tables(DatabaseNode *dbNode, const char **choices);
+int validate_value(const char *value, ColumnType type);
+int is_value_unique(Table *table, int colIndex, const char *value);
+int parse_column_type(const char *typeStr);
+int parse_table_schema(const char *schemaInput, Column **columns);
+int column_flags(const Column *column);
+void set_column_flags(Column *column, int flags);
 
-void add_row_to_table(DatabaseNode *dbNode, const char *table_name);
-void delete_row_from_table(DatabaseNode *dbNode, const char *table_name, int rowIndex);
-void update_row(DatabaseNode *dbNode, const char *table_name, int rowIndex);
+int append_row(Table *table, const char *const *values);
+int append_row_with_id(Table *table, const char *const *values, int64_t rowId);
+int insert_rows(Table *table, const char *const *values, size_t nrows);
+int remove_row(Table *table, int slot);
+int replace_row_value(Table *table, int slot, int colIndex, const char *value);
+int update_row(Table *table, int slot, const char *const *values);
+int is_row_live(const Table *table, int slot);
+int is_row_visible(const Table *table, int slot, uint64_t snapshot);
+int reserve_row_versions(Table *table);
+void reclaim_row_versions(Table *table, uint64_t horizon);
+void rollback_row_versions(Table *table, uint64_t txn);
+void table_view(const Table *table, Table *view, ColumnData *data);
+int64_t row_id(const Table *table, int slot);
+int find_row_slot(Table *table, int64_t rowId);
+int reset_row_ids(Table *table);
+int compact_table(Table *table);
+void compact_sparse_tables(Catalog *catalog);
+void table_memory(const Table *table, TableMemory *memory);
+int set_table_columns(Table *table, const Column *columns, int numColumns);
+int remap_table_columns(Table *table, const Column *columns, const int *sources, const char *const *defaults,
+                        int numColumns);
+void rebuild_indexes(Table *table);
+int find_row_by_value(Table *table, int colIndex, const char *value);
+BTree *find_ordered_index(Table *table, int colIndex);
 
-void write_all_databases_to_file(DatabaseNode *dbList, const char *filename);
-void read_database_from_file(const char *filename, DatabaseNode **dbList);
-void update_table_schema(DatabaseNode *dbNode, const char *tableName, const char *schemaInput);
+int sync_file(FILE *file);
+int sync_directory(const char *filename);
+int write_all_databases_to_file(Catalog *catalog, const char *filename);
+int read_database_from_file(const char *filename, Catalog *catalog, int *defaulted);
+int read_text_database(const char *filename, Catalog *catalog, int *defaulted);
+int export_databases_to_text(Catalog *catalog, const char *filename);
+int convert_text_database(const char *textFilename, const char *binaryFilename);
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+// Comparison kernels for filtered scans. Each one compares up to
+// FILTER_BLOCK_ROWS consecutive values of a column with a constant and writes a
+// selection mask with bit i set when value i matches. Masks hold 64 values per
+// word, bits past count are cleared.
+
+#define FILTER_BLOCK_ROWS 1024
+#define FILTER_BLOCK_WORDS (FILTER_BLOCK_ROWS / 64)
+
+typedef enum
+{
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE
+} CompareOp;
+
+void filter_compare_ints(const int64_t *values, int count, CompareOp op, int64_t key, uint64_t *mask);
+void filter_compare_floats(const double *values, int count, CompareOp op, double key, uint64_t *mask);
+void filter_compare_codes(const uint32_t *values, int count, CompareOp op, uint32_t key, uint64_t *mask);
+void filter_compare_bits(const uint8_t *bits, int start, int count, CompareOp op, int key, uint64_t *mask);
+void filter_load_bits(const uint8_t *bits, int start, int count, uint64_t *mask);
+void filter_fill(uint64_t *mask, int count, int value);
+int filter_next(const uint64_t *mask, int count, int from);
+const char *filter_kernel_name(void);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include "column_store.h"
+
+// Open-addressing hash index mapping a column's values to row indexes.
+// Entries only store the value's hash and its row, keys are compared against
+// the table itself, so the index never duplicates cell data.
+
+#define HASH_INDEX_EMPTY -1
+#define HASH_INDEX_DELETED -2
+
+typedef struct
+{
+    unsigned int hash;
+    int row;
+} HashEntry;
+
+typedef struct HashIndex
+{
+    HashEntry *entries;
+    int capacity; // Always zero or a power of two
+    int count;    // Live entries
+    int used;     // Live plus deleted entries
+} HashIndex;
+
+// Open-addressing map from stable row ids to the slots currently holding them
+typedef struct
+{
+    int64_t id;
+    int slot;
+} RowIdEntry;
+
+typedef struct
+{
+    RowIdEntry *entries;
+    int capacity; // Always zero or a power of two
+    int count;
+    int used;
+} RowIdMap;
+
+struct Table;
+
+unsigned int hash_value(const char *value);
+unsigned int hash_key(const Value *key);
+unsigned int hash_cell(const struct Table *table, int row, int col);
+
+void hash_index_init(HashIndex *index);
+void hash_index_free(HashIndex *index);
+int hash_index_build(HashIndex *index, const struct Table *table, int colIndex);
+int hash_index_insert(HashIndex *index, const struct Table *table, int colIndex, int row);
+void hash_index_remove(HashIndex *index, const struct Table *table, int colIndex, int row);
+int hash_index_find(const HashIndex *index, const struct Table *table, int colIndex, const Value *key);
+
+void row_id_map_init(RowIdMap *map);
+void row_id_map_free(RowIdMap *map);
+int row_id_map_put(RowIdMap *map, int64_t id, int slot);
+int row_id_map_get(const RowIdMap *map, int64_t id);
+void row_id_map_remove(RowIdMap *map, int64_t id);
+
+#endif
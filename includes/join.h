@@ -0,0 +1,69 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include "query.h"
+
+// Equi-joins of the two sides of a bound JOIN, see query_bind_join. The build
+// side's rows go into a hash table keyed by their ON value, and each row of
+// the other side probes it. Entries keep only a slot and its hash, so values
+// are compared where they are stored and never copied. Once the build side
+// would take more than query->joinMemory, the rows of both sides are split by
+// hash into JOIN_PARTITIONS temporary files of slots instead, and joined a
+// partition at a time, in several passes over its probe rows when its build
+// rows do not fit either. The tables must not change until the join is done.
+
+#define JOIN_PARTITION_BITS 4
+#define JOIN_PARTITIONS (1 << JOIN_PARTITION_BITS)
+
+typedef enum
+{
+    JOIN_OK,
+    JOIN_ERR_MEMORY,
+    JOIN_ERR_IO // A temporary file could not be created, written or read
+} JoinError;
+
+// Rows of one side, found by its query or collected beforehand through an index
+typedef struct
+{
+    const Query *query;
+    Table *table;
+    int column;   // ON column, QUERY_ROW_ID for the row id
+    int *slots;   // Collected rows, freed with the join, NULL to run the query
+    int numSlots;
+    int next;     // Next of slots
+    QueryCursor cursor;
+} JoinInput;
+
+typedef struct
+{
+    unsigned int hash;
+    int slot;
+    int next; // Next entry of the same bucket, -1 at its end
+} JoinEntry;
+
+typedef struct
+{
+    JoinInput inputs[2];
+    int build; // Side held in the hash table, the other probes it
+    size_t memoryLimit;
+    JoinEntry *entries;
+    int numEntries;
+    int capacity;
+    int *buckets; // First entry of each bucket, -1 when empty
+    int numBuckets;
+    int probeSlot; // Row looking for matches
+    unsigned int probeHash;
+    Value probeKey;
+    int chain; // Next entry to compare with it, -1 when done
+    int spilled;
+    FILE *partitions[2][JOIN_PARTITIONS]; // Hashes and slots of each side once spilled
+    int partition;                        // Partition being joined
+    JoinError error;
+} JoinRun;
+
+void join_init(JoinRun *run, const Query *query, Table *left, Table *right);
+int join_start(JoinRun *run);
+int join_next(JoinRun *run, int slots[2]);
+void join_free(JoinRun *run);
+
+#endif
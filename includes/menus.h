@@ -2,9 +2,10 @@
 #define MENUS_H
 
 #include <ncurses.h>
+#include "savvydb.h"
 
 void display_menu(const char *title, const char *choices[], int num_choices, int *highlight);
-void handle_main_menu();
+void handle_main_menu(SavvyDB *db);
 void handle_database_menu();
 void handle_table_menu();
 void view_tables();
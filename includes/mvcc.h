@@ -0,0 +1,60 @@
+#ifndef MVCC_H
+#define MVCC_H
+
+#include <stdint.h>
+#include "sync.h"
+
+// Multi-version concurrency control. One writer at a time numbers its
+// changes with a transaction id and stamps the row versions it stores and
+// expires with it (see Table in dbms.h). Readers take a snapshot, the newest
+// committed transaction, and only see row versions stamped at or before it,
+// without locking the tables. A version expired before every snapshot still
+// registered is garbage, and its slot can be reused.
+//
+// Arrays a reader may still hold a pointer to are retired instead of freed,
+// and freed once every reader registered at the time has left (epoch based
+// reclamation).
+//
+// Changes that move rows or replace a schema lock the readers out: they wait
+// until no reader is registered, and new readers wait for them to finish.
+
+// Transaction of rows loaded from files, visible to every snapshot
+#define TXN_NONE 0
+// Expiry of a version a rollback kept, later than every snapshot
+#define TXN_NEVER INT64_MAX
+
+typedef struct Mvcc
+{
+    Mutex writeLock;    // Held by the one writer
+    uint64_t nextTxn;   // Id of the next writer's transaction
+    uint64_t committed; // Newest committed transaction, read without a lock
+    int numReaders;
+    int exclusive; // New readers wait while nonzero, counts nested locks
+} Mvcc;
+
+typedef struct MvccReader
+{
+    Mvcc *owner;
+    uint64_t snapshot; // Newest transaction the reader sees
+    uint64_t epoch;    // Retired memory from this epoch on may still be read
+    struct MvccReader *next;
+} MvccReader;
+
+void mvcc_init(Mvcc *mvcc);
+void mvcc_destroy(Mvcc *mvcc);
+
+uint64_t mvcc_begin_read(Mvcc *mvcc, MvccReader *reader);
+void mvcc_end_read(MvccReader *reader);
+
+uint64_t mvcc_begin_write(Mvcc *mvcc);
+int mvcc_try_begin_write(Mvcc *mvcc);
+void mvcc_end_write(Mvcc *mvcc);
+void mvcc_publish(Mvcc *mvcc, uint64_t txn);
+void mvcc_lock_readers(Mvcc *mvcc);
+int mvcc_try_lock_readers(Mvcc *mvcc);
+void mvcc_unlock_readers(Mvcc *mvcc);
+uint64_t mvcc_horizon(Mvcc *mvcc);
+
+void mvcc_retire(void *memory);
+
+#endif
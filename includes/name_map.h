@@ -0,0 +1,28 @@
+#ifndef NAME_MAP_H
+#define NAME_MAP_H
+
+// Open-addressing map from a name to the node that owns it. Keys are not
+// copied, each entry points at the name stored inside its node.
+
+typedef struct
+{
+    const char *name;
+    void *node;
+    unsigned int hash;
+} NameEntry;
+
+typedef struct
+{
+    NameEntry *entries;
+    int capacity; // Always zero or a power of two
+    int count;    // Live entries
+    int used;     // Live plus deleted entries
+} NameMap;
+
+void name_map_init(NameMap *map);
+void name_map_free(NameMap *map);
+int name_map_put(NameMap *map, const char *name, void *node);
+void *name_map_get(const NameMap *map, const char *name);
+void name_map_remove(NameMap *map, const char *name);
+
+#endif
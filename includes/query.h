@@ -0,0 +1,205 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include "dbms.h"
+#include "filter.h"
+
+// A small SQL subset, compiled once into a plan that runs directly on a Table:
+//
+//   SELECT * | item, ... FROM table [WHERE cond] [GROUP BY col] [ORDER BY col [ASC | DESC]] [LIMIT n]
+//   SELECT * | col, ... FROM table [INNER] JOIN table ON col = col [WHERE cond] [LIMIT n]
+//   INSERT INTO table VALUES (v, ...) [, (v, ...)]
+//   UPDATE table SET col = v, ... [WHERE cond]
+//   DELETE FROM table [WHERE cond]
+//   ALTER TABLE table ADD [COLUMN] name TYPE [UNIQUE] [ORDERED] [DICTIONARY]
+//                   | DROP [COLUMN] name | RENAME [COLUMN] name TO name
+//   BEGIN [TRANSACTION] | COMMIT | ROLLBACK
+//
+// Conditions compare a column with a literal (= != <> < <= > >=) and combine
+// with AND, OR, NOT and parentheses. Keywords are case-insensitive, strings
+// may be quoted with '...' and the pseudo-column rowid is the stable row id.
+// Comparisons on ordered columns and ORDER BY an ordered column walk its
+// B+-tree, other orders are sorted after filtering.
+//
+// A ? may stand for any value of a WHERE comparison, INSERT VALUES or UPDATE
+// SET. Parameters are numbered from 1 in the order they are written and set
+// with query_set_param, which keeps the statement bound, so a prepared
+// statement runs again with new values without being parsed or bound again.
+//
+// SELECT items are columns or the aggregates COUNT(*), COUNT(col), SUM(col),
+// MIN(col), MAX(col) and AVG(col). With GROUP BY, plain items must name the
+// group column and rows come out one per group, ordered by its key. Full
+// scans of large tables are split across threads (see query_parallel_scan).
+//
+// A JOIN pairs the rows of two tables of a database whose ON columns are
+// equal, see join.h. Columns may be qualified as table.column and must be
+// when both tables have one of that name. Each condition of the WHERE that
+// all rows must meet is taken to the table it names, so either side can be
+// read through its indexes; conditions naming both tables are refused, as are
+// aggregates and ORDER BY.
+
+// In the order of SavvyStatementKind, which savvydb.h shows callers
+typedef enum
+{
+    QUERY_SELECT,
+    QUERY_INSERT,
+    QUERY_UPDATE,
+    QUERY_DELETE,
+    QUERY_ALTER, // Column change of a table, run as a schema change and never bound
+    QUERY_BEGIN, // Transaction control, bound to no table
+    QUERY_COMMIT,
+    QUERY_ROLLBACK
+} QueryKind;
+
+typedef enum
+{
+    EXPR_COMPARE,
+    EXPR_AND,
+    EXPR_OR,
+    EXPR_NOT
+} ExprKind;
+
+// Column index bound to the rowid pseudo-column
+#define QUERY_ROW_ID -1
+
+// Scans only go parallel with at least this many blocks per thread
+#define QUERY_MAX_THREADS 64
+#define PARALLEL_MIN_BLOCKS 16
+
+// Memory the build side of a join may take before it spills to temporary files
+#define JOIN_MEMORY_LIMIT ((size_t)64 << 20)
+
+typedef enum
+{
+    AGG_NONE, // Plain column
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_AVG
+} AggregateKind;
+
+typedef struct Expr
+{
+    ExprKind kind;
+    struct Expr *left; // AND, OR and NOT operand
+    struct Expr *right;
+    char column[MAX_INPUT]; // COMPARE only
+    CompareOp op;
+    char literal[MAX_INPUT];
+    int param;    // Number of the ? standing for literal, 0 if it was written out
+    int colIndex; // Set by query_bind
+    Value value;  // Literal parsed for the column's type
+} Expr;
+
+// Where the value of a ? goes
+typedef struct
+{
+    Expr *expr; // WHERE comparison, NULL for a value of INSERT or UPDATE
+    int value;  // Index in the query's values otherwise
+    int isSet;
+} QueryParam;
+
+typedef enum
+{
+    ALTER_ADD,
+    ALTER_DROP,
+    ALTER_RENAME
+} AlterAction;
+
+typedef enum
+{
+    ACCESS_SCAN,   // Every live slot in order
+    ACCESS_ROW_ID, // One row found through the row id map
+    ACCESS_INDEX,  // One row found through a unique column's hash index
+    ACCESS_RANGE   // Slots in key order from an ordered column's B+-tree, between optional bounds
+} AccessPath;
+
+typedef struct Query
+{
+    QueryKind kind;
+    char table[MAX_INPUT];
+    char (*names)[MAX_INPUT]; // SELECT columns, none for *, or UPDATE SET columns
+    int *columns;             // Column indexes of names, set by query_bind
+    int numNames;
+    AggregateKind *functions; // Aggregate of each SELECT item, "*" is named for COUNT(*)
+    int numAggregates;
+    char groupBy[MAX_INPUT]; // GROUP BY column, empty without
+    int groupColumn;         // Column index of groupBy, set by query_bind
+    char (*values)[MAX_INPUT]; // UPDATE SET values, or INSERT rows in row order
+    int numValues;
+    int numRows; // INSERT rows
+    Expr *where;
+    char orderBy[MAX_INPUT]; // SELECT ORDER BY column, empty without
+    int orderColumn;         // Column index of orderBy, set by query_bind
+    int descending;
+    long long limit; // -1 without LIMIT
+    QueryParam *params; // Each ? in order
+    int numParams;
+    AlterAction alter;             // ALTER TABLE change
+    Column column;                 // ALTER TABLE column added, or the one dropped or renamed by name
+    char columnDefault[MAX_INPUT]; // ADD COLUMN DEFAULT value, empty without
+    char newName[MAX_INPUT];       // RENAME COLUMN target
+
+    // Plan chosen by query_bind
+    AccessPath access;
+    const Expr *accessExpr; // Condition answered by the access path
+    int rangeColumn;        // ACCESS_RANGE column and its bounds, either may be NULL
+    const Expr *lowerBound;
+    const Expr *upperBound;
+    int needsSort; // ORDER BY is not answered by the access path
+    int threads;   // Workers a full scan may use, 1 unless the caller sets it
+    uint64_t snapshot; // Rows visible to this transaction, TXN_LATEST unless the caller sets it.
+                       // Only full scans can read a snapshot, see query_use_scan.
+
+    // JOIN, bound by query_bind_join. Side 0 is the FROM table, side 1 the joined one.
+    char joinTable[MAX_INPUT];   // Empty without JOIN
+    char joinKeys[2][MAX_INPUT]; // ON columns as written
+    struct Query *sides[2];      // SELECT * of each table with the conditions on it alone
+    int joinColumns[2];          // ON column of each side
+    int *itemSides;              // Side of each SELECT item
+    int buildSide;               // Side expected to have fewer rows, the hash table is built on it
+    size_t joinMemory;           // Build side bytes before spilling, JOIN_MEMORY_LIMIT unless the caller sets it
+} Query;
+
+// Position of a running query. Scans evaluate the condition for a block of
+// FILTER_BLOCK_ROWS slots at a time into a selection mask, range scans walk
+// the leaves of a B+-tree, and sorted queries collect all their slots first.
+typedef struct
+{
+    int next;       // Next slot to consider
+    int end;        // Scans stop before this slot, -1 for the end of the table
+    int blockStart; // First slot of the block in mask
+    int blockEnd;
+    uint64_t mask[FILTER_BLOCK_WORDS];
+    BTreeIterator position;
+    int scanning; // Range scan fell back to a full scan
+    int *sorted;  // Matching slots in ORDER BY order, next indexes them
+    int numSorted;
+} QueryCursor;
+
+Query *query_parse(const char *text, char *error, size_t errorSize);
+int query_bind(Query *query, const Table *table, char *error, size_t errorSize);
+void query_plan(Query *query, const Table *table);
+int query_set_param(Query *query, int param, const char *value);
+void query_clear_params(Query *query);
+int query_bind_join(Query *query, const Table *left, const Table *right, char *error, size_t errorSize);
+void query_cursor_init(QueryCursor *cursor);
+int query_next(const Query *query, Table *table, QueryCursor *cursor);
+void query_cursor_free(QueryCursor *cursor);
+int query_compare_slots(const Table *table, int col, int a, int b);
+int query_is_aggregate(const Query *query);
+void query_use_scan(Query *query);
+void query_item_label(const Query *query, int item, char *buffer, size_t size);
+
+// Runs on one range of a parallel scan, reading its slots with query_next
+typedef void (*QueryWorker)(const Query *query, Table *table, QueryCursor *cursor, void *state);
+
+int query_scan_ranges(const Query *query, const Table *table);
+void query_parallel_scan(const Query *query, Table *table, QueryWorker worker, void *states, size_t stateSize,
+                         int numRanges);
+void query_explain(const Query *query, const Table *table, char *buffer, size_t size);
+void query_explain_join(const Query *query, const Table *left, const Table *right, char *buffer, size_t size);
+void query_free(Query *query);
+
+#endif
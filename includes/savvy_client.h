@@ -0,0 +1,51 @@
+#ifndef SAVVY_CLIENT_H
+#define SAVVY_CLIENT_H
+
+#include <stdint.h>
+#include "savvydb.h"
+#include "wire.h"
+
+// Client of a savvyd server, see wire.h for the protocol. Requests may be
+// pipelined: send several, then receive their replies in the same order.
+// Sending only queues a request, it goes out with the next flush or receive.
+// The server stops reading a client whose replies pile up unread, so a
+// client sending without receiving should flush and receive every few
+// hundred requests. A client is used by one thread at a time.
+
+typedef struct SavvyClient SavvyClient;
+
+typedef struct
+{
+    WireOp op;
+    const char *database;
+    const char *table;
+    const char *text;          // Schema of SET_SCHEMA, statement of QUERY and PREPARE
+    int64_t rowId;             // Row of GET, UPDATE and DELETE
+    uint32_t statement;        // Id of EXECUTE and FINALIZE, the row id of PREPARE's reply
+    const char *const *values; // INSERT rows, the UPDATE row or EXECUTE's parameters, numColumns values each
+    int numRows;
+    int numColumns;
+} SavvyRequest;
+
+// Reply to a request, valid until the next savvy_client_receive
+typedef struct
+{
+    SavvyStatus status;
+    const char *error; // Message for any status but SAVVY_OK
+    int64_t rowId;     // First row id of an INSERT, -1 otherwise
+    int affected;
+    int width;
+    const char *const *names;
+    int numRows;
+    const int64_t *rowIds;
+    const char *const *values; // width per row
+} SavvyReply;
+
+SavvyStatus savvy_client_connect(const char *address, SavvyClient **out);
+SavvyStatus savvy_client_send(SavvyClient *client, const SavvyRequest *request);
+SavvyStatus savvy_client_flush(SavvyClient *client);
+SavvyStatus savvy_client_receive(SavvyClient *client, SavvyReply *reply);
+SavvyStatus savvy_client_call(SavvyClient *client, const SavvyRequest *request, SavvyReply *reply);
+void savvy_client_close(SavvyClient *client);
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef SAVVYDB_H
+#define SAVVYDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Programmatic interface to a SavvyDB data directory, without any terminal I/O.
+//
+// A directory holds a binary snapshot (db.svdb) listing the tables, a directory
+// per database with a file per table, and an append-only log (db.log).
+// Every successful change is logged and on disk before the call returns, and
+// the log is folded into the snapshot periodically and on savvy_close, which
+// writes only the files of the tables that changed. Opening
+// reads only the list of tables, each table is read on first use and may be
+// evicted again when memory runs past savvy_set_memory_budget. Calls
+// that change rows are transactions of their own, unless the calling thread
+// opened one with savvy_begin: its changes are then logged together on
+// savvy_commit, or undone by savvy_rollback. If syncing the log fails, the
+// change is never made visible and the handle refuses every later change,
+// checkpoint and savvy_close with SAVVY_ERR_IO: the files are left as they
+// are, and opening the directory again recovers what was synced.
+//
+// Values are passed in text form, one per column in schema order: integers
+// ("42"), floats ("1.5"), booleans ("true"/"false") and strings. Names and
+// values must be non-empty, shorter than SAVVY_MAX_VALUE and free of whitespace.
+// Rows are addressed by stable ids that never change while the row exists.
+
+#define SAVVY_MAX_VALUE 50
+
+typedef enum
+{
+    SAVVY_OK = 0,
+    SAVVY_ERR_NOT_FOUND,  // No such database, table or row
+    SAVVY_ERR_EXISTS,     // Database or table name already taken
+    SAVVY_ERR_INVALID,    // Malformed name, schema or value
+    SAVVY_ERR_NOT_UNIQUE, // Value already present in a unique column
+    SAVVY_ERR_NO_SCHEMA,  // Table has no columns yet
+    SAVVY_ERR_NO_MEMORY,
+    SAVVY_ERR_IO,
+    SAVVY_ERR_SYNTAX,     // Query could not be parsed
+    SAVVY_ERR_TRANSACTION // No transaction to end, one already open, or not allowed inside one
+} SavvyStatus;
+
+// Same order as the column types stored in snapshots and logs
+typedef enum
+{
+    SAVVY_INTEGER,
+    SAVVY_STRING,
+    SAVVY_BOOLEAN,
+    SAVVY_FLOAT // Finite doubles, NaN and infinities are refused as invalid
+} SavvyType;
+
+typedef struct
+{
+    char name[SAVVY_MAX_VALUE];
+    SavvyType type;
+    int isUnique;
+    int isOrdered;    // Has an ordered index for range queries and ORDER BY
+    int isDictionary; // STRING values are stored once each and compared by code
+} SavvyColumn;
+
+// Memory a table holds, for monitoring. Deleted rows and replaced strings
+// stay allocated until compaction reclaims them.
+typedef struct
+{
+    int64_t rows;         // Rows in the latest version
+    int64_t slots;        // Row slots, including deleted rows and old versions
+    int64_t storageBytes; // Values, string heaps and slot lists, with unused capacity
+    int64_t mappedBytes;  // Values still read in place from the snapshot file
+    int64_t garbageBytes; // Estimated string bytes no row refers to anymore
+    int64_t indexBytes;
+    int64_t allocations; // Value arrays and heaps allocated since the table was loaded
+    int64_t compactions;
+    int64_t loads; // Times the table was read from the snapshot, once more after each eviction
+} SavvyTableStats;
+
+// What savvy_open recovered from the data files, see savvy_recovery_stats
+typedef struct
+{
+    int replayedRecords; // Log records applied on top of the snapshot
+    int damagedRecord;   // Log record replay stopped at, counted from 1, or 0 if the log was read to its end
+    int defaultedValues; // Values of a text snapshot that did not parse, loaded as their type's default
+} SavvyRecoveryStats;
+
+typedef struct SavvyDB SavvyDB;
+
+// Rows of a SELECT read a batch at a time, see savvy_cursor_open
+typedef struct SavvyCursor SavvyCursor;
+
+// Statement parsed once and run many times, see savvy_prepare
+typedef struct SavvyStatement SavvyStatement;
+
+// What a statement does, see savvy_statement_kind
+typedef enum
+{
+    SAVVY_STATEMENT_SELECT,
+    SAVVY_STATEMENT_INSERT,
+    SAVVY_STATEMENT_UPDATE,
+    SAVVY_STATEMENT_DELETE,
+    SAVVY_STATEMENT_ALTER,
+    SAVVY_STATEMENT_BEGIN,
+    SAVVY_STATEMENT_COMMIT,
+    SAVVY_STATEMENT_ROLLBACK
+} SavvyStatementKind;
+
+// Called for each live row of a scan with its values in text form.
+// Returning nonzero stops the scan. The scan sees the snapshot taken when it
+// starts, so rows the callback changes are not revisited. Callbacks must not
+// create or drop databases or tables, change a schema or compact: those wait
+// for every reader to finish.
+typedef int (*SavvyRowCallback)(void *context, int64_t rowId, const char *const *values, int numValues);
+
+// Called for each result row of a query with the names of the result columns
+typedef int (*SavvyQueryCallback)(void *context, int64_t rowId, const char *const *values,
+                                  const char *const *names, int numValues);
+
+const char *savvy_status_message(SavvyStatus status);
+
+SavvyStatus savvy_open(const char *directory, SavvyDB **out);
+void savvy_recovery_stats(SavvyDB *db, SavvyRecoveryStats *stats);
+SavvyStatus savvy_checkpoint(SavvyDB *db);
+SavvyStatus savvy_close(SavvyDB *db);
+SavvyStatus savvy_convert_text(const char *textFilename, const char *snapshotFilename);
+
+// Transactions of the calling thread. Other threads' writes wait until it
+// ends, their reads do not see it until it commits. Schema changes,
+// compaction and checkpoints are refused inside one.
+SavvyStatus savvy_begin(SavvyDB *db);
+SavvyStatus savvy_commit(SavvyDB *db);
+SavvyStatus savvy_rollback(SavvyDB *db);
+
+SavvyStatus savvy_create_database(SavvyDB *db, const char *dbName);
+SavvyStatus savvy_drop_database(SavvyDB *db, const char *dbName);
+int savvy_list_databases(SavvyDB *db, const char **names, int maxNames);
+
+SavvyStatus savvy_create_table(SavvyDB *db, const char *dbName, const char *tableName);
+SavvyStatus savvy_drop_table(SavvyDB *db, const char *dbName, const char *tableName);
+SavvyStatus savvy_list_tables(SavvyDB *db, const char *dbName, const char **names, int maxNames, int *count);
+SavvyStatus savvy_set_schema(SavvyDB *db, const char *dbName, const char *tableName, const char *schema);
+SavvyStatus savvy_describe(SavvyDB *db, const char *dbName, const char *tableName,
+                           SavvyColumn *columns, int maxColumns, int *count);
+
+// Change one column without rewriting the table. ADD appends a column from a
+// "name TYPE [unique] [ordered] [dictionary]" definition whose cells hold
+// defaultValue until set, or the type's default (0, 0.0 or false) if it is
+// NULL; a STRING column added to a table with rows needs a defaultValue, and
+// a unique one needs at most one row. DROP frees the column's values and
+// RENAME only changes its name. The other columns keep their values and
+// indexes.
+SavvyStatus savvy_add_column(SavvyDB *db, const char *dbName, const char *tableName, const char *definition,
+                             const char *defaultValue);
+SavvyStatus savvy_drop_column(SavvyDB *db, const char *dbName, const char *tableName, const char *column);
+SavvyStatus savvy_rename_column(SavvyDB *db, const char *dbName, const char *tableName, const char *column,
+                                const char *newName);
+
+SavvyStatus savvy_check_value(SavvyDB *db, const char *dbName, const char *tableName,
+                              int column, const char *value, int64_t rowId);
+SavvyStatus savvy_insert(SavvyDB *db, const char *dbName, const char *tableName,
+                         const char *const *values, size_t numRows, int64_t *firstRowId);
+SavvyStatus savvy_get(SavvyDB *db, const char *dbName, const char *tableName, int64_t rowId,
+                      char **values, size_t valueSize);
+SavvyStatus savvy_update(SavvyDB *db, const char *dbName, const char *tableName, int64_t rowId,
+                         const char *const *values);
+SavvyStatus savvy_delete(SavvyDB *db, const char *dbName, const char *tableName, int64_t rowId);
+SavvyStatus savvy_scan(SavvyDB *db, const char *dbName, const char *tableName,
+                       SavvyRowCallback callback, void *context);
+SavvyStatus savvy_compact(SavvyDB *db, const char *dbName, const char *tableName, int *reclaimed);
+SavvyStatus savvy_table_stats(SavvyDB *db, const char *dbName, const char *tableName, SavvyTableStats *stats);
+SavvyStatus savvy_set_threads(SavvyDB *db, int threads);
+SavvyStatus savvy_set_memory_budget(SavvyDB *db, size_t bytes);
+// Bytes a join's hash table may take, 0 for no limit. Past them the join
+// spills to temporary files and reads back at most this much at a time.
+SavvyStatus savvy_set_join_memory(SavvyDB *db, size_t bytes);
+
+// Run one statement of the query language described in query.h against a
+// database. SELECT rows go to the callback, which may be NULL, with row id -1
+// for the rows of aggregates and joins. affected
+// receives the number of rows returned, inserted, updated or deleted, and
+// error a description of anything other than SAVVY_OK. Both may be NULL.
+SavvyStatus savvy_query(SavvyDB *db, const char *dbName, const char *query, SavvyQueryCallback callback,
+                        void *context, int *affected, char *error, size_t errorSize);
+// Write the plan of a statement without running it, or the reason it has none
+SavvyStatus savvy_explain(SavvyDB *db, const char *dbName, const char *query, char *plan, size_t planSize);
+
+// Prepare a statement to run many times. Its text may hold ? for any value of
+// a WHERE comparison, INSERT VALUES or UPDATE SET, bound by number from 1 and
+// kept across runs; a comparison's value is checked against its column when
+// bound. Running it again parses and resolves nothing unless a schema changed
+// meanwhile. savvy_finalize hands it back to a cache of the most recently used
+// statements, keyed by text, which savvy_query and savvy_cursor_open use too.
+// A statement is run by one thread at a time and finalized before
+// savvy_close; a cursor opened on it must be closed before it runs again.
+SavvyStatus savvy_prepare(SavvyDB *db, const char *dbName, const char *query, SavvyStatement **out, char *error,
+                          size_t errorSize);
+int savvy_statement_params(const SavvyStatement *statement);
+SavvyStatementKind savvy_statement_kind(const SavvyStatement *statement);
+SavvyStatus savvy_bind(SavvyStatement *statement, int param, const char *value);
+SavvyStatus savvy_execute(SavvyStatement *statement, SavvyQueryCallback callback, void *context, int *affected,
+                          char *error, size_t errorSize);
+SavvyStatus savvy_cursor_open_statement(SavvyStatement *statement, SavvyCursor **out, char *error,
+                                        size_t errorSize);
+void savvy_finalize(SavvyStatement *statement);
+SavvyStatus savvy_set_plan_cache(SavvyDB *db, int statements);
+
+// Read the rows of a SELECT, or every row of a table, in batches instead of
+// through a callback. A cursor reads the snapshot taken when it opens and
+// formats only the rows of the batch asked for, so memory stays flat however
+// many rows there are; sorted and index results keep one slot number per row.
+// An open cursor is a registered reader: the same restrictions as for
+// callbacks apply until it is closed, and every cursor must be closed before
+// savvy_close. Returns SAVVY_ERR_INVALID for statements other than SELECT.
+SavvyStatus savvy_cursor_open(SavvyDB *db, const char *dbName, const char *query, SavvyCursor **out, char *error,
+                              size_t errorSize);
+SavvyStatus savvy_cursor_open_table(SavvyDB *db, const char *dbName, const char *tableName, SavvyCursor **out);
+int savvy_cursor_width(const SavvyCursor *cursor);
+const char *savvy_cursor_name(const SavvyCursor *cursor, int column);
+SavvyStatus savvy_cursor_next(SavvyCursor *cursor, int maxRows, int *numRows);
+const char *savvy_cursor_value(const SavvyCursor *cursor, int row, int column);
+int64_t savvy_cursor_row_id(const SavvyCursor *cursor, int row);
+void savvy_cursor_close(SavvyCursor *cursor);
+
+#endif
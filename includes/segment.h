@@ -0,0 +1,124 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdint.h>
+#include "dbms.h"
+
+// Binary snapshot format. Every record and value block starts on an 8 byte
+// boundary, so a file mapped into memory can back a table's column arrays
+// directly, without parsing or copying. Values are stored in host byte order.
+//
+//   snapshot file: SegmentHeader
+//     per database: DatabaseHeader, TableFile * numTables
+//   table file <database>/<table>.<file>.svt next to it: SegmentHeader with no
+//   databases, then TableHeader, ColumnHeader * numColumns
+//     RowHeader, BlockHeader + row ids, BlockHeader + deleted slot bits
+//     per column: BlockHeader, values (dataBytes), string heap (heapBytes)
+//     per ordered column: BlockHeader, live slots in key order (uint32_t)
+//
+// From version 6 the row ids, deleted bits, values and heaps are each stored
+// as a BlockEncoding and its bytes, raw or in one of the codecs of codec.h;
+// BlockHeader still gives their decoded sizes. Raw blocks are mapped as
+// before, encoded ones are decoded into memory when their table is read. A
+// table file holds a table of the version in its header: one that did not
+// change is copied to its new file as it is and keeps its version.
+//
+// Names in file names keep letters, digits, '_' and '-', other bytes are
+// written as %XX. Loading only reads the snapshot file and maps the table
+// files, each table is read on first use and can be evicted and read again
+// while it is unchanged (see find_table). A snapshot writes only the tables
+// that changed, each to a new file, and the old files are deleted once the
+// new snapshot file is in place.
+//
+// numRows counts row slots, including deleted ones. In version 4 files the
+// tables follow the directory in the same file, at the offsets of TableEntry
+// records in place of TableFile ones. Versions before 4 have no directory,
+// each database's tables follow its header and are all read when the file is
+// loaded. Version 1 files have no row section; their rows are numbered in
+// order when loaded. Versions before 3 have no key orders, their ordered
+// indexes are sorted on first use.
+//
+// The string heap of a dictionary encoded column holds each distinct string
+// once, shared by the offsets of every cell holding it.
+
+#define SEGMENT_MAGIC "SAVVYDB"
+#define SEGMENT_VERSION 6
+#define SEGMENT_BYTE_ORDER 0x01020304u
+#define SEGMENT_NAME_SIZE 56 // MAX_INPUT rounded up to a multiple of 8
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t numDatabases;
+    uint32_t reserved;
+} SegmentHeader;
+
+typedef struct
+{
+    char name[SEGMENT_NAME_SIZE];
+    uint32_t numTables;
+    uint32_t reserved;
+} DatabaseHeader;
+
+typedef struct
+{
+    char name[SEGMENT_NAME_SIZE];
+    uint64_t offset; // Of the table's TableHeader from the start of the file
+    uint64_t bytes;
+} TableEntry;
+
+typedef struct
+{
+    char name[SEGMENT_NAME_SIZE];
+    uint64_t file;  // Number in the table file's name, unique in the data directory
+    uint64_t bytes; // Of the table after the file's SegmentHeader
+} TableFile;
+
+typedef struct
+{
+    char name[SEGMENT_NAME_SIZE];
+    uint32_t numColumns;
+    uint32_t numRows;
+} TableHeader;
+
+typedef struct
+{
+    char name[SEGMENT_NAME_SIZE];
+    uint32_t type;
+    uint32_t flags; // COLUMN_UNIQUE, COLUMN_ORDERED and COLUMN_DICTIONARY, only ever 0 or 1 before version 3
+} ColumnHeader;
+
+typedef struct
+{
+    int64_t nextRowId;
+    uint32_t numDeleted;
+    uint32_t reserved;
+} RowHeader;
+
+typedef struct
+{
+    uint64_t dataBytes;
+    uint64_t heapBytes;
+} BlockHeader;
+
+typedef struct
+{
+    uint32_t codec; // A Codec, CODEC_RAW for the bytes as they are used
+    uint32_t reserved;
+    uint64_t bytes; // Stored after the header, padded to 8 bytes
+} BlockEncoding;
+
+int segment_is_binary(const char *filename);
+int segment_write(Catalog *catalog, const char *filename);
+int segment_load(const char *filename, Catalog *catalog);
+int segment_read_table(Table *table);
+int segment_rebind(Catalog *catalog, const char *filename);
+void segment_unuse(struct SegmentMapping *mapping);
+void segment_release_unused(Catalog *catalog);
+int64_t segment_loads(void);
+void segment_release(Catalog *catalog);
+int segment_remove(const char *filename);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <signal.h>
+#include "savvydb.h"
+
+// Serves a handle to clients of the wire protocol (wire.h). One thread
+// multiplexes every connection with epoll: it reads whatever requests have
+// arrived, runs each complete one in order and queues its response, so a
+// client may pipeline requests and still get the responses in order.
+//
+// Transactions belong to the thread that opens them, here the server's, so
+// while a connection has one open the requests of the others wait in their
+// buffers until it commits, rolls back or disconnects, which rolls it back.
+// A connection whose responses are not read stops being read from until
+// they are, so one slow client does not grow the server's memory.
+
+// Unanswered responses or unprocessed requests a connection may buffer before it is no longer read
+#define SERVER_BUFFER_BYTES ((size_t)1 << 20)
+
+// Prepared statements a connection may keep at once
+#define SERVER_MAX_STATEMENTS 1024
+
+// Rows read from a cursor at a time while encoding a SELECT
+#define SERVER_BATCH_ROWS 256
+
+int server_run(SavvyDB *db, int listenFd, volatile sig_atomic_t *stop);
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+// Mutexes and condition variables over pthreads, or slim reader/writer locks
+// on Windows, thread ids, plus the atomic loads and stores shared data is
+// published with. Every primitive can be initialized statically.
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE Cond;
+typedef DWORD ThreadId;
+
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#define COND_INITIALIZER CONDITION_VARIABLE_INIT
+
+static inline void mutex_init(Mutex *mutex)
+{
+    InitializeSRWLock(mutex);
+}
+
+static inline void mutex_destroy(Mutex *mutex)
+{
+    (void)mutex;
+}
+
+static inline void mutex_lock(Mutex *mutex)
+{
+    AcquireSRWLockExclusive(mutex);
+}
+
+static inline int mutex_trylock(Mutex *mutex)
+{
+    return TryAcquireSRWLockExclusive(mutex) != 0;
+}
+
+static inline void mutex_unlock(Mutex *mutex)
+{
+    ReleaseSRWLockExclusive(mutex);
+}
+
+static inline void cond_init(Cond *cond)
+{
+    InitializeConditionVariable(cond);
+}
+
+static inline void cond_destroy(Cond *cond)
+{
+    (void)cond;
+}
+
+static inline void cond_wait(Cond *cond, Mutex *mutex)
+{
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static inline void cond_broadcast(Cond *cond)
+{
+    WakeAllConditionVariable(cond);
+}
+
+static inline ThreadId thread_self(void)
+{
+    return GetCurrentThreadId();
+}
+
+static inline int thread_equal(ThreadId a, ThreadId b)
+{
+    return a == b;
+}
+
+#else
+#include <pthread.h>
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+typedef pthread_t ThreadId;
+
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define COND_INITIALIZER PTHREAD_COND_INITIALIZER
+
+static inline void mutex_init(Mutex *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+static inline void mutex_destroy(Mutex *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void mutex_lock(Mutex *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline int mutex_trylock(Mutex *mutex)
+{
+    return pthread_mutex_trylock(mutex) == 0;
+}
+
+static inline void mutex_unlock(Mutex *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+static inline void cond_init(Cond *cond)
+{
+    pthread_cond_init(cond, NULL);
+}
+
+static inline void cond_destroy(Cond *cond)
+{
+    pthread_cond_destroy(cond);
+}
+
+static inline void cond_wait(Cond *cond, Mutex *mutex)
+{
+    pthread_cond_wait(cond, mutex);
+}
+
+static inline void cond_broadcast(Cond *cond)
+{
+    pthread_cond_broadcast(cond);
+}
+
+static inline ThreadId thread_self(void)
+{
+    return pthread_self();
+}
+
+static inline int thread_equal(ThreadId a, ThreadId b)
+{
+    return pthread_equal(a, b) != 0;
+}
+
+#endif
+
+// A store with RELEASE makes every earlier write visible to the thread that
+// reads the stored value with ACQUIRE
+#define atomic_load_acquire(pointer) __atomic_load_n(pointer, __ATOMIC_ACQUIRE)
+#define atomic_store_release(pointer, value) __atomic_store_n(pointer, value, __ATOMIC_RELEASE)
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "dbms.h"
+
+// Number of logged operations after which the log is folded into the snapshot file
+#define WAL_CHECKPOINT_THRESHOLD 1000
+
+// wal_replay applied part of a group only, the catalog must be loaded again
+#define WAL_REPLAY_PARTIAL (-2)
+
+typedef struct Wal
+{
+    FILE *file; // NULL while closed, commits then rewrite the snapshot instead
+    char path[FILENAME_MAX];
+    char snapshotPath[FILENAME_MAX];
+    int pendingRecords; // Records logged since the last checkpoint
+    long replayEnd;     // Offset of a group replay could only partly apply, -1 if none
+
+    // Redo records of the running transaction, appended to the file on commit
+    char *records;
+    size_t recordsSize;
+    size_t recordsCapacity;
+    int numRecords;
+    int recordsLost; // A record did not fit in memory, the commit checkpoints instead
+
+    // Log sequence numbers count the bytes appended since the log was opened
+    Mutex lock;          // Guards the fields below
+    Cond synced;         // Broadcast when durableLsn moves or a sync fails
+    uint64_t writtenLsn; // End of the records appended to the file
+    uint64_t durableLsn; // End of the records known to be on disk
+    int syncing;         // A committer is syncing the file for all waiting ones
+    int failed;          // The file may hold a torn or unsynced group, commits checkpoint until one succeeds
+    int broken;          // A sync failed, so what is on disk is unknown: commits and checkpoints fail from then on
+} Wal;
+
+void wal_init(Wal *wal, const char *logFilename, const char *snapshotFilename);
+int wal_open(Wal *wal);
+void wal_close(Wal *wal);
+void wal_destroy(Wal *wal);
+int wal_replay(Wal *wal, Catalog *catalog, int *damagedRecord);
+
+void wal_log_create_database(Wal *wal, const char *dbName);
+void wal_log_delete_database(Wal *wal, const char *dbName);
+void wal_log_create_table(Wal *wal, const char *dbName, const char *tableName);
+void wal_log_delete_table(Wal *wal, const char *dbName, const char *tableName);
+void wal_log_columns(Wal *wal, const char *dbName, const Table *table, const int *sources,
+                     const char *const *defaults);
+void wal_log_insert(Wal *wal, const char *dbName, const char *tableName, int64_t rowId,
+                    const char *const *values, int numValues);
+void wal_log_update(Wal *wal, const char *dbName, const Table *table, int slot);
+void wal_log_delete_row(Wal *wal, const char *dbName, const char *tableName, int64_t rowId);
+
+int wal_pending(const Wal *wal);
+int wal_commit(Wal *wal, Catalog *catalog);
+void wal_discard(Wal *wal);
+uint64_t wal_written(Wal *wal);
+int wal_sync(Wal *wal, uint64_t lsn);
+int wal_checkpoint(Wal *wal, Catalog *catalog);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "savvydb.h"
+
+// Binary protocol between savvyd and its clients. Every message is a frame:
+// a 32-bit length, then that many bytes. A request starts with its operation
+// and a response with its SavvyStatus, one byte each, followed by the fields
+// below in order. Integers are little endian, strings are NUL-terminated.
+// A client may send any number of requests without waiting for responses,
+// which come back in the order of the requests.
+//
+//   Operation                           Fields after it
+//   PING, CHECKPOINT, LIST_DATABASES    -
+//   CREATE_DATABASE, DROP_DATABASE,     database
+//   LIST_TABLES
+//   CREATE_TABLE, DROP_TABLE, DESCRIBE  database, table
+//   SET_SCHEMA                          database, table, schema
+//   INSERT                              database, table, u32 rows, u16 columns, rows * columns values
+//   GET, DELETE                         database, table, i64 row id
+//   UPDATE                              database, table, i64 row id, u16 columns, columns values
+//   QUERY, PREPARE                      database, statement
+//   EXECUTE                             u32 statement id, u16 values, values
+//   FINALIZE                            u32 statement id
+//
+// A response with SAVVY_OK carries a result: i64 row id (the first one of an
+// INSERT, else -1), i32 affected rows, u16 width, width column names, u32
+// rows, then each row's i64 row id and width values. Listings, DESCRIBE and
+// GET return their rows that way. Any other status carries a message.
+//
+// PREPARE keeps a statement on the connection until FINALIZE or disconnect
+// and answers with its id as the row id and its number of ? as the affected
+// rows. EXECUTE binds its values to parameters 1 on, the others keep the
+// values of the last run, then answers like QUERY.
+
+#define WIRE_HEADER_BYTES 4
+#define WIRE_MAX_FRAME ((uint32_t)16 << 20)
+
+// Address savvyd listens on unless told otherwise
+#define WIRE_DEFAULT_ADDRESS "127.0.0.1:7431"
+
+typedef enum
+{
+    WIRE_PING,
+    WIRE_CHECKPOINT,
+    WIRE_CREATE_DATABASE,
+    WIRE_DROP_DATABASE,
+    WIRE_LIST_DATABASES,
+    WIRE_CREATE_TABLE,
+    WIRE_DROP_TABLE,
+    WIRE_LIST_TABLES,
+    WIRE_SET_SCHEMA,
+    WIRE_DESCRIBE,
+    WIRE_INSERT,
+    WIRE_GET,
+    WIRE_UPDATE,
+    WIRE_DELETE,
+    WIRE_QUERY,
+    WIRE_PREPARE,
+    WIRE_EXECUTE,
+    WIRE_FINALIZE
+} WireOp;
+
+// Bytes being encoded. Appending never fails on its own, running out of
+// memory sets failed and drops the rest.
+typedef struct
+{
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} WireBuffer;
+
+// Bytes being decoded. Reading past the end or a string without its NUL sets
+// failed and returns zeros or an empty string.
+typedef struct
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+    int failed;
+} WireReader;
+
+void wire_buffer_init(WireBuffer *buffer);
+void wire_buffer_free(WireBuffer *buffer);
+int wire_reserve(WireBuffer *buffer, size_t bytes);
+void wire_put_u8(WireBuffer *buffer, uint8_t value);
+void wire_put_u16(WireBuffer *buffer, uint16_t value);
+void wire_put_u32(WireBuffer *buffer, uint32_t value);
+void wire_put_i64(WireBuffer *buffer, int64_t value);
+void wire_put_string(WireBuffer *buffer, const char *value);
+void wire_patch_u32(WireBuffer *buffer, size_t at, uint32_t value);
+size_t wire_begin_frame(WireBuffer *buffer);
+void wire_end_frame(WireBuffer *buffer, size_t start);
+
+void wire_reader_init(WireReader *reader, const uint8_t *data, size_t length);
+uint8_t wire_get_u8(WireReader *reader);
+uint16_t wire_get_u16(WireReader *reader);
+uint32_t wire_get_u32(WireReader *reader);
+int64_t wire_get_i64(WireReader *reader);
+const char *wire_get_string(WireReader *reader);
+int64_t wire_frame_length(const uint8_t *data, size_t available);
+
+int wire_listen(const char *address);
+int wire_connect(const char *address);
+
+#endif
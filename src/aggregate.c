@@ -0,0 +1,412 @@
+#include "aggregate.h"
+#include "hash_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void group_table_init(GroupTable *groups)
+{
+    memset(groups, 0, sizeof(*groups));
+}
+
+static void group_table_free(GroupTable *groups)
+{
+    free(groups->buckets);
+    free(groups->keySlots);
+    free(groups->hashes);
+    free(groups->accumulators);
+    group_table_init(groups);
+}
+
+static unsigned int hash_group(const Query *query, const Table *table, int slot)
+{
+    if (!query->groupBy[0])
+    {
+        return 0;
+    }
+    if (query->groupColumn == QUERY_ROW_ID)
+    {
+        Value key;
+        key.type = INTEGER;
+        key.as.i = row_id(table, slot);
+        return hash_key(&key);
+    }
+    return hash_cell(table, slot, query->groupColumn);
+}
+
+static int same_group(const Query *query, const Table *table, int a, int b)
+{
+    return !query->groupBy[0] || query_compare_slots(table, query->groupColumn, a, b) == 0;
+}
+
+static int grow_groups(GroupTable *groups, int numItems)
+{
+    int capacity = groups->capacity ? groups->capacity * 2 : 16;
+    int *keySlots = realloc(groups->keySlots, capacity * sizeof(int));
+    if (keySlots)
+    {
+        groups->keySlots = keySlots;
+    }
+    unsigned int *hashes = realloc(groups->hashes, capacity * sizeof(unsigned int));
+    if (hashes)
+    {
+        groups->hashes = hashes;
+    }
+    Accumulator *accumulators = realloc(groups->accumulators, (size_t)capacity * numItems * sizeof(Accumulator));
+    if (accumulators)
+    {
+        groups->accumulators = accumulators;
+    }
+    int *buckets = calloc(capacity * 2, sizeof(int));
+    if (!keySlots || !hashes || !accumulators || !buckets)
+    {
+        free(buckets);
+        return 0;
+    }
+
+    // Keep the load at most one half
+    free(groups->buckets);
+    groups->buckets = buckets;
+    groups->numBuckets = capacity * 2;
+    groups->capacity = capacity;
+    for (int g = 0; g < groups->numGroups; g++)
+    {
+        size_t at = groups->hashes[g] & (groups->numBuckets - 1);
+        while (groups->buckets[at])
+        {
+            at = (at + 1) & (groups->numBuckets - 1);
+        }
+        groups->buckets[at] = g + 1;
+    }
+    return 1;
+}
+
+// Index of the group whose key is in slot, added if new. Returns -1 when out of memory.
+static int find_group(GroupTable *groups, const Query *query, const Table *table, int slot, unsigned int hash)
+{
+    if (groups->numBuckets > 0)
+    {
+        size_t at = hash & (groups->numBuckets - 1);
+        while (groups->buckets[at])
+        {
+            int g = groups->buckets[at] - 1;
+            if (groups->hashes[g] == hash && same_group(query, table, groups->keySlots[g], slot))
+            {
+                return g;
+            }
+            at = (at + 1) & (groups->numBuckets - 1);
+        }
+    }
+
+    if (groups->numGroups == groups->capacity && !grow_groups(groups, query->numNames))
+    {
+        groups->failed = 1;
+        return -1;
+    }
+    int g = groups->numGroups++;
+    groups->keySlots[g] = query->groupBy[0] ? slot : -1;
+    groups->hashes[g] = hash;
+    Accumulator *acc = &groups->accumulators[(size_t)g * query->numNames];
+    for (int i = 0; i < query->numNames; i++)
+    {
+        memset(&acc[i], 0, sizeof(acc[i]));
+        acc[i].minSlot = -1;
+        acc[i].maxSlot = -1;
+    }
+
+    size_t at = hash & (groups->numBuckets - 1);
+    while (groups->buckets[at])
+    {
+        at = (at + 1) & (groups->numBuckets - 1);
+    }
+    groups->buckets[at] = g + 1;
+    return g;
+}
+
+static int64_t add_checked(int64_t a, int64_t b, int *overflow)
+{
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+    {
+        *overflow = 1;
+        return a;
+    }
+    return a + b;
+}
+
+static void accumulate(Accumulator *acc, const Query *query, const Table *table, int slot)
+{
+    for (int i = 0; i < query->numNames; i++)
+    {
+        int col = query->columns[i];
+        switch (query->functions[i])
+        {
+        case AGG_COUNT:
+            acc[i].count++;
+            break;
+        case AGG_SUM:
+        case AGG_AVG:
+            acc[i].count++;
+            if (col != QUERY_ROW_ID && table->columns[col].type == FLOAT)
+            {
+                acc[i].floatSum += cell_float(table, slot, col);
+            }
+            else
+            {
+                int64_t value = col == QUERY_ROW_ID ? row_id(table, slot) : cell_int(table, slot, col);
+                acc[i].intSum = add_checked(acc[i].intSum, value, &acc[i].overflow);
+                acc[i].floatSum += (double)value;
+            }
+            break;
+        case AGG_MIN:
+            if (acc[i].minSlot < 0 || query_compare_slots(table, col, slot, acc[i].minSlot) < 0)
+            {
+                acc[i].minSlot = slot;
+            }
+            break;
+        case AGG_MAX:
+            if (acc[i].maxSlot < 0 || query_compare_slots(table, col, slot, acc[i].maxSlot) > 0)
+            {
+                acc[i].maxSlot = slot;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Fold b, from a later range, into a. On equal extremes the earlier slot is kept.
+static void merge_accumulators(Accumulator *a, const Accumulator *b, const Query *query, const Table *table)
+{
+    for (int i = 0; i < query->numNames; i++)
+    {
+        int col = query->columns[i];
+        a[i].count += b[i].count;
+        a[i].intSum = add_checked(a[i].intSum, b[i].intSum, &a[i].overflow);
+        a[i].overflow |= b[i].overflow;
+        a[i].floatSum += b[i].floatSum;
+        if (b[i].minSlot >= 0 && (a[i].minSlot < 0 || query_compare_slots(table, col, b[i].minSlot, a[i].minSlot) < 0))
+        {
+            a[i].minSlot = b[i].minSlot;
+        }
+        if (b[i].maxSlot >= 0 && (a[i].maxSlot < 0 || query_compare_slots(table, col, b[i].maxSlot, a[i].maxSlot) > 0))
+        {
+            a[i].maxSlot = b[i].maxSlot;
+        }
+    }
+}
+
+static void accumulate_range(const Query *query, Table *table, QueryCursor *cursor, void *state)
+{
+    GroupTable *groups = state;
+    int slot;
+    while ((slot = query_next(query, table, cursor)) >= 0)
+    {
+        int g = find_group(groups, query, table, slot, hash_group(query, table, slot));
+        if (g < 0)
+        {
+            return;
+        }
+        accumulate(&groups->accumulators[(size_t)g * query->numNames], query, table, slot);
+    }
+}
+
+static int compare_groups(const AggregateResult *result, int a, int b)
+{
+    const Query *query = result->query;
+    int order = query_compare_slots(result->table, query->groupColumn, result->groups.keySlots[a],
+                                     result->groups.keySlots[b]);
+    return query->descending ? -order : order;
+}
+
+// Stable merge sort of group indexes by key
+static void sort_groups(const AggregateResult *result, int *order, int *scratch, int count)
+{
+    if (count < 2)
+    {
+        return;
+    }
+    int half = count / 2;
+    sort_groups(result, order, scratch, half);
+    sort_groups(result, order + half, scratch, count - half);
+
+    int a = 0, b = half, out = 0;
+    while (a < half && b < count)
+    {
+        scratch[out++] = compare_groups(result, order[b], order[a]) < 0 ? order[b++] : order[a++];
+    }
+    while (a < half)
+    {
+        scratch[out++] = order[a++];
+    }
+    while (b < count)
+    {
+        scratch[out++] = order[b++];
+    }
+    memcpy(order, scratch, count * sizeof(int));
+}
+
+// Scan the query's rows and compute its groups, across as many threads as
+// query_scan_ranges allows. Returns 0 when out of memory.
+int aggregate_run(const Query *query, Table *table, AggregateResult *result)
+{
+    memset(result, 0, sizeof(*result));
+    result->query = query;
+    result->table = table;
+
+    int numRanges = query_scan_ranges(query, table);
+    GroupTable *partials = malloc(numRanges * sizeof(GroupTable));
+    if (!partials)
+    {
+        return 0;
+    }
+    for (int r = 0; r < numRanges; r++)
+    {
+        group_table_init(&partials[r]);
+    }
+    query_parallel_scan(query, table, accumulate_range, partials, sizeof(GroupTable), numRanges);
+
+    GroupTable *groups = &partials[0];
+    for (int r = 1; r < numRanges && !groups->failed; r++)
+    {
+        for (int g = 0; g < partials[r].numGroups && !partials[r].failed; g++)
+        {
+            int slot = partials[r].keySlots[g];
+            int into = find_group(groups, query, table, slot, partials[r].hashes[g]);
+            if (into < 0)
+            {
+                break;
+            }
+            merge_accumulators(&groups->accumulators[(size_t)into * query->numNames],
+                               &partials[r].accumulators[(size_t)g * query->numNames], query, table);
+        }
+        groups->failed |= partials[r].failed;
+    }
+    for (int r = 1; r < numRanges; r++)
+    {
+        group_table_free(&partials[r]);
+    }
+    result->groups = *groups;
+    free(partials);
+
+    // Without GROUP BY there is always exactly one row, even over no rows
+    if (!result->groups.failed && !query->groupBy[0] && result->groups.numGroups == 0)
+    {
+        find_group(&result->groups, query, table, -1, 0);
+    }
+    if (result->groups.failed)
+    {
+        aggregate_free(result);
+        return 0;
+    }
+
+    int count = result->groups.numGroups;
+    int *scratch = malloc((count + 1) * sizeof(int)); // Not empty, so NULL always means out of memory
+    result->order = malloc((count + 1) * sizeof(int));
+    if (!scratch || !result->order)
+    {
+        free(scratch);
+        aggregate_free(result);
+        return 0;
+    }
+    for (int g = 0; g < count; g++)
+    {
+        result->order[g] = g;
+    }
+    if (query->groupBy[0])
+    {
+        sort_groups(result, result->order, scratch, count);
+    }
+    free(scratch);
+    result->numRows = count;
+    return 1;
+}
+
+// Shortest of the two precisions that reads back as the same double, as format_cell does
+static void format_double(double value, char *buffer, size_t size)
+{
+    snprintf(buffer, size, "%.15g", value);
+    if (strtod(buffer, NULL) != value)
+    {
+        snprintf(buffer, size, "%.17g", value);
+    }
+}
+
+static void format_slot(const Table *table, int col, int slot, char *buffer, size_t size)
+{
+    if (col == QUERY_ROW_ID)
+    {
+        snprintf(buffer, size, "%lld", (long long)row_id(table, slot));
+    }
+    else
+    {
+        format_cell(table, slot, col, buffer, size);
+    }
+}
+
+// Write the text of one item of a result row, NULL for the SUM, AVG, MIN or MAX of no rows
+void aggregate_format(const AggregateResult *result, int row, int item, char *buffer, size_t size)
+{
+    const Query *query = result->query;
+    int g = result->order[row];
+    const Accumulator *acc = &result->groups.accumulators[(size_t)g * query->numNames + item];
+    int col = query->columns[item];
+    int isFloat = col != QUERY_ROW_ID && result->table->columns[col].type == FLOAT;
+
+    switch (query->functions[item])
+    {
+    case AGG_NONE:
+        format_slot(result->table, col, result->groups.keySlots[g], buffer, size);
+        break;
+    case AGG_COUNT:
+        snprintf(buffer, size, "%lld", (long long)acc->count);
+        break;
+    case AGG_SUM:
+        if (acc->count == 0)
+        {
+            snprintf(buffer, size, "NULL");
+        }
+        else if (isFloat || acc->overflow)
+        {
+            format_double(acc->floatSum, buffer, size);
+        }
+        else
+        {
+            snprintf(buffer, size, "%lld", (long long)acc->intSum);
+        }
+        break;
+    case AGG_AVG:
+        if (acc->count == 0)
+        {
+            snprintf(buffer, size, "NULL");
+        }
+        else
+        {
+            double sum = isFloat || acc->overflow ? acc->floatSum : (double)acc->intSum;
+            format_double(sum / (double)acc->count, buffer, size);
+        }
+        break;
+    case AGG_MIN:
+    case AGG_MAX:
+    {
+        int slot = query->functions[item] == AGG_MIN ? acc->minSlot : acc->maxSlot;
+        if (slot < 0)
+        {
+            snprintf(buffer, size, "NULL");
+        }
+        else
+        {
+            format_slot(result->table, col, slot, buffer, size);
+        }
+        break;
+    }
+    }
+}
+
+void aggregate_free(AggregateResult *result)
+{
+    group_table_free(&result->groups);
+    free(result->order);
+    result->order = NULL;
+    result->numRows = 0;
+}
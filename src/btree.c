@@ -0,0 +1,637 @@
+#include "btree.h"
+#include "dbms.h"
+#include <math.h>
+
+#define BTREE_NODE_BYTES 4096
+#define BTREE_HEADER_BYTES (2 * sizeof(int) + 2 * sizeof(void *))
+#define LEAF_ENTRIES ((BTREE_NODE_BYTES - BTREE_HEADER_BYTES) / sizeof(BTreeEntry))
+#define INNER_CHILDREN ((BTREE_NODE_BYTES - BTREE_HEADER_BYTES) / (sizeof(BTreeEntry) + sizeof(void *)))
+
+// Deep enough for any int-sized table, even with half-full nodes
+#define BTREE_MAX_HEIGHT 16
+// Largest slab of nodes allocated while the tree grows
+#define BTREE_SLAB_NODES 64
+
+struct BTreeNode
+{
+    int isLeaf;
+    int count;              // Entries of a leaf, children of an inner node
+    struct BTreeNode *prev; // Neighbouring leaves in key order
+    struct BTreeNode *next;
+    union
+    {
+        BTreeEntry entries[LEAF_ENTRIES];
+        struct
+        {
+            // For i >= 1, keys[i] is above every entry under children[i - 1]
+            // and not above any under children[i]. keys[0] is unused.
+            BTreeEntry keys[INNER_CHILDREN];
+            struct BTreeNode *children[INNER_CHILDREN];
+        } inner;
+    } as;
+};
+
+typedef struct
+{
+    const Table *table;
+    int col;
+    ColumnType type;
+} KeyContext;
+
+static BTreeEntry make_entry(const KeyContext *ctx, int slot)
+{
+    BTreeEntry entry;
+    entry.key.i = 0;
+    entry.slot = slot;
+    switch (ctx->type)
+    {
+    case INTEGER:
+        entry.key.i = cell_int(ctx->table, slot, ctx->col);
+        break;
+    case FLOAT:
+        entry.key.f = cell_float(ctx->table, slot, ctx->col);
+        break;
+    case BOOLEAN:
+        entry.key.i = cell_bool(ctx->table, slot, ctx->col);
+        break;
+    case STRING:
+        break;
+    }
+    return entry;
+}
+
+// Floats are ordered with NaN after every number, so the tree has a total order
+static int compare_floats(double a, double b)
+{
+    if (isnan(a) || isnan(b))
+    {
+        return isnan(a) - isnan(b);
+    }
+    return (a > b) - (a < b);
+}
+
+static const char *entry_string(const KeyContext *ctx, const BTreeEntry *entry)
+{
+    return entry->key.s ? entry->key.s : cell_string(ctx->table, entry->slot, ctx->col);
+}
+
+static int compare_key(const KeyContext *ctx, const BTreeEntry *entry, const Value *key)
+{
+    switch (ctx->type)
+    {
+    case FLOAT:
+        return compare_floats(entry->key.f, key->as.f);
+    case STRING:
+        return strcmp(entry_string(ctx, entry), key->as.s);
+    case BOOLEAN:
+        return (int)entry->key.i - key->as.b;
+    default:
+        return (entry->key.i > key->as.i) - (entry->key.i < key->as.i);
+    }
+}
+
+static int compare_entries(const KeyContext *ctx, const BTreeEntry *a, const BTreeEntry *b)
+{
+    int order;
+    switch (ctx->type)
+    {
+    case FLOAT:
+        order = compare_floats(a->key.f, b->key.f);
+        break;
+    case STRING:
+        order = strcmp(entry_string(ctx, a), entry_string(ctx, b));
+        break;
+    default:
+        order = (a->key.i > b->key.i) - (a->key.i < b->key.i);
+        break;
+    }
+    return order ? order : (a->slot > b->slot) - (a->slot < b->slot);
+}
+
+// Copy an entry into a separator, returns 0 if a string cannot be copied. The
+// separator then reads the cell like a leaf entry, and the tree must be dropped.
+static int make_separator(const KeyContext *ctx, const BTreeEntry *entry, BTreeEntry *separator)
+{
+    *separator = *entry;
+    if (ctx->type == STRING)
+    {
+        separator->key.s = strdup(entry_string(ctx, entry));
+        return separator->key.s != NULL;
+    }
+    return 1;
+}
+
+// Nodes allocated together, only freed with the whole tree
+struct BTreeSlab
+{
+    struct BTreeSlab *next;
+    BTreeNode nodes[];
+};
+
+// Make sure the tree has at least count spare nodes. Each new slab is as large
+// as the ones before it together, up to a limit, or as large as needed.
+static int reserve_nodes(BTree *tree, int count)
+{
+    if (tree->numSpare >= count)
+    {
+        return 1;
+    }
+    int size = tree->numNodes < BTREE_SLAB_NODES ? tree->numNodes : BTREE_SLAB_NODES;
+    if (size < count - tree->numSpare)
+    {
+        size = count - tree->numSpare;
+    }
+    BTreeSlab *slab = malloc(sizeof(BTreeSlab) + size * sizeof(BTreeNode));
+    if (!slab)
+    {
+        return 0;
+    }
+    slab->next = tree->slabs;
+    tree->slabs = slab;
+    for (int i = size - 1; i >= 0; i--)
+    {
+        slab->nodes[i].next = tree->spare;
+        tree->spare = &slab->nodes[i];
+    }
+    tree->numNodes += size;
+    tree->numSpare += size;
+    tree->bytes += sizeof(BTreeSlab) + size * sizeof(BTreeNode);
+    return 1;
+}
+
+// Take a reserved node
+static BTreeNode *new_node(BTree *tree, int isLeaf)
+{
+    BTreeNode *node = tree->spare;
+    tree->spare = node->next;
+    tree->numSpare--;
+    node->isLeaf = isLeaf;
+    node->count = 0;
+    node->prev = NULL;
+    node->next = NULL;
+    return node;
+}
+
+static void free_separators(BTreeNode *node, int stringKeys)
+{
+    for (int i = 1; stringKeys && i < node->count; i++)
+    {
+        free(node->as.inner.keys[i].key.s);
+    }
+}
+
+// Free the separators of an inner node and the inner nodes below it, the
+// nodes themselves are released with their slabs
+static void free_inner_separators(BTreeNode *node, int height)
+{
+    free_separators(node, 1);
+    for (int i = 0; height > 1 && i < node->count; i++)
+    {
+        free_inner_separators(node->as.inner.children[i], height - 1);
+    }
+}
+
+void btree_init(BTree *tree)
+{
+    tree->root = NULL;
+    tree->slabs = NULL;
+    tree->spare = NULL;
+    tree->numNodes = 0;
+    tree->numSpare = 0;
+    tree->bytes = 0;
+    tree->count = 0;
+    tree->height = 0;
+    tree->stringKeys = 0;
+}
+
+// Release the whole tree at once, leaves are never visited
+void btree_free(BTree *tree)
+{
+    if (tree->root && tree->stringKeys && tree->height > 0)
+    {
+        free_inner_separators(tree->root, tree->height);
+    }
+    while (tree->slabs)
+    {
+        BTreeSlab *slab = tree->slabs;
+        tree->slabs = slab->next;
+        free(slab);
+    }
+    btree_init(tree);
+}
+
+// Child of an inner node whose range holds the entry
+static int route_entry(const BTreeNode *node, const KeyContext *ctx, const BTreeEntry *entry)
+{
+    int low = 1;
+    int high = node->count;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (compare_entries(ctx, &node->as.inner.keys[mid], entry) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low - 1;
+}
+
+// First position in a leaf whose entry is not below the given one
+static int leaf_position(const BTreeNode *leaf, const KeyContext *ctx, const BTreeEntry *entry)
+{
+    int low = 0;
+    int high = leaf->count;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (compare_entries(ctx, &leaf->as.entries[mid], entry) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// Merge sort, stable and with a context, unlike qsort
+static void sort_entries(BTreeEntry *entries, BTreeEntry *scratch, int count, const KeyContext *ctx)
+{
+    if (count < 2)
+    {
+        return;
+    }
+    int half = count / 2;
+    sort_entries(entries, scratch, half, ctx);
+    sort_entries(entries + half, scratch, count - half, ctx);
+
+    int a = 0, b = half, out = 0;
+    while (a < half && b < count)
+    {
+        scratch[out++] = compare_entries(ctx, &entries[a], &entries[b]) <= 0 ? entries[a++] : entries[b++];
+    }
+    while (a < half)
+    {
+        scratch[out++] = entries[a++];
+    }
+    while (b < count)
+    {
+        scratch[out++] = entries[b++];
+    }
+    memcpy(entries, scratch, count * sizeof(BTreeEntry));
+}
+
+static const BTreeEntry *first_entry(const BTreeNode *node)
+{
+    while (!node->isLeaf)
+    {
+        node = node->as.inner.children[0];
+    }
+    return &node->as.entries[0];
+}
+
+// Build the index from the given live slots, bottom up with full nodes. Slots
+// already in key order, like a saved index, are used as they are, others are
+// sorted first. Returns 0 if memory runs out, leaving the tree empty.
+int btree_build(BTree *tree, const Table *table, int col, const uint32_t *slots, int count)
+{
+    KeyContext ctx = {table, col, table->columns[col].type};
+    btree_free(tree);
+
+    BTreeEntry *entries = malloc((count > 0 ? count : 1) * sizeof(BTreeEntry));
+    if (!entries)
+    {
+        return 0;
+    }
+    int sorted = 1;
+    for (int i = 0; i < count; i++)
+    {
+        entries[i] = make_entry(&ctx, (int)slots[i]);
+        if (i > 0 && sorted && compare_entries(&ctx, &entries[i - 1], &entries[i]) >= 0)
+        {
+            sorted = 0;
+        }
+    }
+    if (!sorted)
+    {
+        BTreeEntry *scratch = malloc(count * sizeof(BTreeEntry));
+        if (!scratch)
+        {
+            free(entries);
+            return 0;
+        }
+        sort_entries(entries, scratch, count, &ctx);
+        free(scratch);
+    }
+
+    // Every node comes from one slab, allocated before linking any
+    int numLeaves = count > 0 ? (count + (int)LEAF_ENTRIES - 1) / (int)LEAF_ENTRIES : 1;
+    int numNodes = numLeaves;
+    for (int width = numLeaves; width > 1;)
+    {
+        width = (width + (int)INNER_CHILDREN - 1) / (int)INNER_CHILDREN;
+        numNodes += width;
+    }
+    BTreeNode **nodes = malloc(numNodes * sizeof(BTreeNode *));
+    if (!nodes || !reserve_nodes(tree, numNodes))
+    {
+        free(nodes);
+        free(entries);
+        btree_free(tree);
+        return 0;
+    }
+    for (int i = 0; i < numNodes; i++)
+    {
+        nodes[i] = new_node(tree, i < numLeaves);
+    }
+
+    for (int i = 0; i < numLeaves; i++)
+    {
+        int from = i * (int)LEAF_ENTRIES;
+        nodes[i]->count = count - from < (int)LEAF_ENTRIES ? count - from : (int)LEAF_ENTRIES;
+        memcpy(nodes[i]->as.entries, entries + from, nodes[i]->count * sizeof(BTreeEntry));
+        if (i > 0)
+        {
+            nodes[i - 1]->next = nodes[i];
+            nodes[i]->prev = nodes[i - 1];
+        }
+    }
+    free(entries);
+
+    // Each level groups the one below it into full parents
+    int levelStart = 0;
+    int width = numLeaves;
+    int height = 0;
+    int ok = 1;
+    while (width > 1)
+    {
+        int parentStart = levelStart + width;
+        for (int c = 0; c < width; c++)
+        {
+            BTreeNode *parent = nodes[parentStart + c / (int)INNER_CHILDREN];
+            BTreeNode *child = nodes[levelStart + c];
+            if (parent->count == 0)
+            {
+                memset(&parent->as.inner.keys[0], 0, sizeof(BTreeEntry));
+            }
+            else if (!make_separator(&ctx, first_entry(child), &parent->as.inner.keys[parent->count]))
+            {
+                ok = 0;
+            }
+            parent->as.inner.children[parent->count++] = child;
+        }
+        levelStart = parentStart;
+        width = (width + (int)INNER_CHILDREN - 1) / (int)INNER_CHILDREN;
+        height++;
+    }
+
+    if (!ok)
+    {
+        for (int i = numLeaves; i < numNodes; i++)
+        {
+            free_separators(nodes[i], ctx.type == STRING);
+        }
+        free(nodes);
+        btree_free(tree);
+        return 0;
+    }
+
+    tree->root = nodes[levelStart];
+    tree->count = count;
+    tree->height = height;
+    tree->stringKeys = ctx.type == STRING;
+    free(nodes);
+    return 1;
+}
+
+typedef struct
+{
+    BTree *tree; // Holds a spare node for every split
+    int failed;  // A separator could not be copied
+} NodePool;
+
+static BTreeNode *take_node(NodePool *pool, int isLeaf)
+{
+    return new_node(pool->tree, isLeaf);
+}
+
+typedef struct
+{
+    BTreeNode *node; // New right sibling, NULL if the node did not split
+    BTreeEntry low;
+} Split;
+
+static void insert_into(BTreeNode *node, const KeyContext *ctx, const BTreeEntry *entry, NodePool *pool,
+                        Split *split)
+{
+    split->node = NULL;
+    if (node->isLeaf)
+    {
+        int at = leaf_position(node, ctx, entry);
+        if (node->count == (int)LEAF_ENTRIES)
+        {
+            BTreeNode *right = take_node(pool, 1);
+            int half = node->count / 2;
+            right->count = node->count - half;
+            memcpy(right->as.entries, node->as.entries + half, right->count * sizeof(BTreeEntry));
+            node->count = half;
+
+            right->prev = node;
+            right->next = node->next;
+            if (node->next)
+            {
+                node->next->prev = right;
+            }
+            node->next = right;
+            split->node = right;
+            if (!make_separator(ctx, &right->as.entries[0], &split->low))
+            {
+                pool->failed = 1;
+            }
+            if (at > half)
+            {
+                node = right;
+                at -= half;
+            }
+        }
+        memmove(&node->as.entries[at + 1], &node->as.entries[at], (node->count - at) * sizeof(BTreeEntry));
+        node->as.entries[at] = *entry;
+        node->count++;
+        return;
+    }
+
+    int child = route_entry(node, ctx, entry);
+    Split below;
+    insert_into(node->as.inner.children[child], ctx, entry, pool, &below);
+    if (!below.node)
+    {
+        return;
+    }
+
+    int at = child + 1;
+    if (node->count == (int)INNER_CHILDREN)
+    {
+        BTreeNode *right = take_node(pool, 0);
+        int half = node->count / 2;
+        right->count = node->count - half;
+        memcpy(right->as.inner.keys, node->as.inner.keys + half, right->count * sizeof(BTreeEntry));
+        memcpy(right->as.inner.children, node->as.inner.children + half, right->count * sizeof(BTreeNode *));
+        node->count = half;
+
+        // The separator of the moved children now routes to the new node
+        split->node = right;
+        split->low = right->as.inner.keys[0];
+        memset(&right->as.inner.keys[0], 0, sizeof(BTreeEntry));
+        if (at > half)
+        {
+            node = right;
+            at -= half;
+        }
+    }
+    memmove(&node->as.inner.keys[at + 1], &node->as.inner.keys[at], (node->count - at) * sizeof(BTreeEntry));
+    memmove(&node->as.inner.children[at + 1], &node->as.inner.children[at],
+            (node->count - at) * sizeof(BTreeNode *));
+    node->as.inner.keys[at] = below.low;
+    node->as.inner.children[at] = below.node;
+    node->count++;
+}
+
+// Add a live slot, whose cell already holds the value to index. Spare nodes
+// for every possible split are reserved first. Returns 0 if memory runs out,
+// the tree must then be freed.
+int btree_insert(BTree *tree, const Table *table, int col, int slot)
+{
+    KeyContext ctx = {table, col, table->columns[col].type};
+    BTreeEntry entry = make_entry(&ctx, slot);
+
+    int splits = tree->height + 2 <= BTREE_MAX_HEIGHT + 1 ? tree->height + 2 : BTREE_MAX_HEIGHT + 1;
+    if (!reserve_nodes(tree, splits))
+    {
+        return 0;
+    }
+    NodePool pool;
+    pool.tree = tree;
+    pool.failed = 0;
+
+    Split split;
+    insert_into(tree->root, &ctx, &entry, &pool, &split);
+    if (split.node)
+    {
+        BTreeNode *root = take_node(&pool, 0);
+        root->count = 2;
+        memset(&root->as.inner.keys[0], 0, sizeof(BTreeEntry));
+        root->as.inner.children[0] = tree->root;
+        root->as.inner.keys[1] = split.low;
+        root->as.inner.children[1] = split.node;
+        tree->root = root;
+        tree->height++;
+    }
+    tree->count++;
+    return !pool.failed;
+}
+
+// Remove a slot, whose cell must still hold the indexed value. Returns 0 if it is not indexed.
+int btree_remove(BTree *tree, const Table *table, int col, int slot)
+{
+    KeyContext ctx = {table, col, table->columns[col].type};
+    BTreeEntry entry = make_entry(&ctx, slot);
+
+    BTreeNode *node = tree->root;
+    while (!node->isLeaf)
+    {
+        node = node->as.inner.children[route_entry(node, &ctx, &entry)];
+    }
+
+    int at = leaf_position(node, &ctx, &entry);
+    if (at >= node->count || node->as.entries[at].slot != slot)
+    {
+        return 0;
+    }
+    memmove(&node->as.entries[at], &node->as.entries[at + 1], (node->count - at - 1) * sizeof(BTreeEntry));
+    node->count--;
+    tree->count--;
+    return 1;
+}
+
+void btree_first(const BTree *tree, BTreeIterator *it)
+{
+    const BTreeNode *node = tree->root;
+    while (!node->isLeaf)
+    {
+        node = node->as.inner.children[0];
+    }
+    it->leaf = node;
+    it->index = 0;
+}
+
+void btree_last(const BTree *tree, BTreeIterator *it)
+{
+    const BTreeNode *node = tree->root;
+    while (!node->isLeaf)
+    {
+        node = node->as.inner.children[node->count - 1];
+    }
+    it->leaf = node;
+    it->index = node->count;
+}
+
+// Position before the first entry above the key if after is set, or else not below it
+void btree_seek(const BTree *tree, const Table *table, int col, const Value *key, int after, BTreeIterator *it)
+{
+    KeyContext ctx = {table, col, table->columns[col].type};
+    const BTreeNode *node = tree->root;
+    while (!node->isLeaf)
+    {
+        // Equal keys may continue from the previous child, so route strictly below the key
+        int child = 0;
+        for (int low = 1, high = node->count; low < high;)
+        {
+            int mid = (low + high) / 2;
+            int order = compare_key(&ctx, &node->as.inner.keys[mid], key);
+            if (order < 0 || (after && order == 0))
+            {
+                child = mid;
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        node = node->as.inner.children[child];
+    }
+
+    int low = 0;
+    int high = node->count;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        int order = compare_key(&ctx, &node->as.entries[mid], key);
+        if (order < 0 || (after && order == 0))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    it->leaf = node;
+    it->index = low;
+}
+
+// Return the slot after the position and move past it, or -1 at the end
+int btree_next(BTreeIterator *it)
+{
+    while (it->leaf && it->index >= it->leaf->count)
+    {
+        it->leaf = it->leaf->next;
+        it->index = 0;
+    }
+    return it->leaf ? it->leaf->as.entries[it->index++].slot : -1;
+}
+
+// Return the slot before the position and move before it, or -1 at the start
+int btree_prev(BTreeIterator *it)
+{
+    while (it->leaf && it->index == 0)
+    {
+        it->leaf = it->leaf->prev;
+        it->index = it->leaf ? it->leaf->count : 0;
+    }
+    return it->leaf ? it->leaf->as.entries[--it->index].slot : -1;
+}
@@ -0,0 +1,200 @@
+#include "catalog.h"
+
+void catalog_init(Catalog *catalog)
+{
+    catalog->databases = NULL;
+    catalog->lastDatabase = NULL;
+    name_map_init(&catalog->databaseNames);
+    catalog->mappings = NULL;
+    catalog->files = NULL;
+}
+
+// Create an empty database, at the front of the list or, when loading, at its end.
+// Returns NULL if the name is taken.
+DatabaseNode *catalog_add_database(Catalog *catalog, const char *name, int atEnd)
+{
+    if (name_map_get(&catalog->databaseNames, name))
+    {
+        return NULL;
+    }
+
+    DatabaseNode *dbNode = malloc(sizeof(DatabaseNode));
+    if (!dbNode)
+    {
+        return NULL;
+    }
+    strncpy(dbNode->db.name, name, MAX_INPUT - 1);
+    dbNode->db.name[MAX_INPUT - 1] = '\0';
+    dbNode->db.tables = NULL;
+    dbNode->db.lastTable = NULL;
+    name_map_init(&dbNode->db.tableNames);
+
+    if (!name_map_put(&catalog->databaseNames, dbNode->db.name, dbNode))
+    {
+        free(dbNode);
+        return NULL;
+    }
+
+    if (atEnd && catalog->lastDatabase)
+    {
+        dbNode->next = NULL;
+        catalog->lastDatabase->next = dbNode;
+        catalog->lastDatabase = dbNode;
+    }
+    else
+    {
+        dbNode->next = catalog->databases;
+        catalog->databases = dbNode;
+        if (!catalog->lastDatabase)
+            catalog->lastDatabase = dbNode;
+    }
+    return dbNode;
+}
+
+// Remove a database from the catalog without freeing it. prev, unless NULL,
+// receives the database listed before it for catalog_relink_database.
+DatabaseNode *catalog_unlink_database(Catalog *catalog, const char *name, DatabaseNode **prev)
+{
+    DatabaseNode *dbNode = name_map_get(&catalog->databaseNames, name);
+    if (!dbNode)
+    {
+        return NULL;
+    }
+    name_map_remove(&catalog->databaseNames, name);
+
+    DatabaseNode **link = &catalog->databases;
+    DatabaseNode *before = NULL;
+    while (*link != dbNode)
+    {
+        before = *link;
+        link = &(*link)->next;
+    }
+    *link = dbNode->next;
+    if (catalog->lastDatabase == dbNode)
+    {
+        catalog->lastDatabase = before;
+    }
+    dbNode->next = NULL;
+    if (prev)
+    {
+        *prev = before;
+    }
+    return dbNode;
+}
+
+// Put an unlinked database back after prev, or first if prev is NULL. Returns
+// 0 if its name could not be mapped again.
+int catalog_relink_database(Catalog *catalog, DatabaseNode *dbNode, DatabaseNode *prev)
+{
+    if (!name_map_put(&catalog->databaseNames, dbNode->db.name, dbNode))
+    {
+        return 0;
+    }
+    DatabaseNode **link = prev ? &prev->next : &catalog->databases;
+    dbNode->next = *link;
+    *link = dbNode;
+    if (catalog->lastDatabase == prev)
+    {
+        catalog->lastDatabase = dbNode;
+    }
+    return 1;
+}
+
+DatabaseNode *catalog_find_database(const Catalog *catalog, const char *name)
+{
+    return name_map_get(&catalog->databaseNames, name);
+}
+
+// Create a table with a blank schema. Returns NULL if the name is taken.
+TableNode *catalog_add_table(DatabaseNode *dbNode, const char *name, int atEnd)
+{
+    Database *db = &dbNode->db;
+    if (name_map_get(&db->tableNames, name))
+    {
+        return NULL;
+    }
+
+    TableNode *tableNode = calloc(1, sizeof(TableNode));
+    if (!tableNode)
+    {
+        return NULL;
+    }
+    strncpy(tableNode->table.name, name, MAX_INPUT - 1);
+    mutex_init(&tableNode->table.latch);
+
+    if (!name_map_put(&db->tableNames, tableNode->table.name, tableNode))
+    {
+        free(tableNode);
+        return NULL;
+    }
+
+    if (atEnd && db->lastTable)
+    {
+        db->lastTable->next = tableNode;
+        db->lastTable = tableNode;
+    }
+    else
+    {
+        tableNode->next = db->tables;
+        db->tables = tableNode;
+        if (!db->lastTable)
+            db->lastTable = tableNode;
+    }
+    return tableNode;
+}
+
+// Remove a table from its database without freeing it. prev, unless NULL,
+// receives the table listed before it for catalog_relink_table.
+TableNode *catalog_unlink_table(DatabaseNode *dbNode, const char *name, TableNode **prev)
+{
+    Database *db = &dbNode->db;
+    TableNode *tableNode = name_map_get(&db->tableNames, name);
+    if (!tableNode)
+    {
+        return NULL;
+    }
+    name_map_remove(&db->tableNames, name);
+
+    TableNode **link = &db->tables;
+    TableNode *before = NULL;
+    while (*link != tableNode)
+    {
+        before = *link;
+        link = &(*link)->next;
+    }
+    *link = tableNode->next;
+    if (db->lastTable == tableNode)
+    {
+        db->lastTable = before;
+    }
+    tableNode->next = NULL;
+    if (prev)
+    {
+        *prev = before;
+    }
+    return tableNode;
+}
+
+// Put an unlinked table back after prev, or first if prev is NULL. Returns 0
+// if its name could not be mapped again.
+int catalog_relink_table(DatabaseNode *dbNode, TableNode *tableNode, TableNode *prev)
+{
+    Database *db = &dbNode->db;
+    if (!name_map_put(&db->tableNames, tableNode->table.name, tableNode))
+    {
+        return 0;
+    }
+    TableNode **link = prev ? &prev->next : &db->tables;
+    tableNode->next = *link;
+    *link = tableNode;
+    if (db->lastTable == prev)
+    {
+        db->lastTable = tableNode;
+    }
+    return 1;
+}
+
+TableNode *catalog_find_table(const DatabaseNode *dbNode, const char *name)
+{
+    return name_map_get(&dbNode->db.tableNames, name);
+}
@@ -0,0 +1,304 @@
+#define _POSIX_C_SOURCE 200809L
+#include "savvy_client.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+struct SavvyClient
+{
+    int fd;
+    WireBuffer output;    // Requests not yet sent
+    WireBuffer input;     // Frame of the latest reply
+    const char **strings; // Names then values of the latest reply
+    size_t stringCapacity;
+    int64_t *rowIds;
+    size_t rowCapacity;
+};
+
+// Connect to a server at HOST:PORT or unix:PATH
+SavvyStatus savvy_client_connect(const char *address, SavvyClient **out)
+{
+    SavvyClient *client = calloc(1, sizeof(SavvyClient));
+    if (!client)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    client->fd = wire_connect(address);
+    if (client->fd < 0)
+    {
+        free(client);
+        return SAVVY_ERR_IO;
+    }
+    wire_buffer_init(&client->output);
+    wire_buffer_init(&client->input);
+    *out = client;
+    return SAVVY_OK;
+}
+
+// Queue a request, its reply comes from a later savvy_client_receive
+SavvyStatus savvy_client_send(SavvyClient *client, const SavvyRequest *request)
+{
+    WireBuffer *out = &client->output;
+    size_t frame = wire_begin_frame(out);
+    wire_put_u8(out, (uint8_t)request->op);
+    switch (request->op)
+    {
+    case WIRE_PING:
+    case WIRE_CHECKPOINT:
+    case WIRE_LIST_DATABASES:
+        break;
+    case WIRE_CREATE_DATABASE:
+    case WIRE_DROP_DATABASE:
+    case WIRE_LIST_TABLES:
+        wire_put_string(out, request->database);
+        break;
+    case WIRE_QUERY:
+    case WIRE_PREPARE:
+        wire_put_string(out, request->database);
+        wire_put_string(out, request->text);
+        break;
+    case WIRE_EXECUTE:
+    case WIRE_FINALIZE:
+        wire_put_u32(out, request->statement);
+        if (request->op == WIRE_EXECUTE)
+        {
+            wire_put_u16(out, (uint16_t)request->numColumns);
+            for (int i = 0; i < request->numColumns; i++)
+            {
+                wire_put_string(out, request->values[i]);
+            }
+        }
+        break;
+    case WIRE_CREATE_TABLE:
+    case WIRE_DROP_TABLE:
+    case WIRE_DESCRIBE:
+    case WIRE_SET_SCHEMA:
+    case WIRE_INSERT:
+    case WIRE_GET:
+    case WIRE_UPDATE:
+    case WIRE_DELETE:
+        wire_put_string(out, request->database);
+        wire_put_string(out, request->table);
+        if (request->op == WIRE_SET_SCHEMA)
+        {
+            wire_put_string(out, request->text);
+        }
+        if (request->op == WIRE_GET || request->op == WIRE_UPDATE || request->op == WIRE_DELETE)
+        {
+            wire_put_i64(out, request->rowId);
+        }
+        if (request->op == WIRE_INSERT)
+        {
+            wire_put_u32(out, (uint32_t)request->numRows);
+        }
+        if (request->op == WIRE_INSERT || request->op == WIRE_UPDATE)
+        {
+            int numRows = request->op == WIRE_UPDATE ? 1 : request->numRows;
+            wire_put_u16(out, (uint16_t)request->numColumns);
+            for (int i = 0; i < numRows * request->numColumns; i++)
+            {
+                wire_put_string(out, request->values[i]);
+            }
+        }
+        break;
+    }
+    wire_end_frame(out, frame);
+
+    if (out->failed || out->length - frame - WIRE_HEADER_BYTES > WIRE_MAX_FRAME)
+    {
+        SavvyStatus status = out->failed ? SAVVY_ERR_NO_MEMORY : SAVVY_ERR_INVALID;
+        out->failed = 0;
+        out->length = frame;
+        return status;
+    }
+    return SAVVY_OK;
+}
+
+// Send the queued requests, waiting until the server has taken them all
+SavvyStatus savvy_client_flush(SavvyClient *client)
+{
+    size_t sent = 0;
+    while (sent < client->output.length)
+    {
+        ssize_t written = send(client->fd, client->output.data + sent, client->output.length - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return SAVVY_ERR_IO;
+        }
+        sent += (size_t)written;
+    }
+    client->output.length = 0;
+    return SAVVY_OK;
+}
+
+static int receive_all(int fd, uint8_t *data, size_t length)
+{
+    size_t received = 0;
+    while (received < length)
+    {
+        ssize_t count = recv(fd, data + received, length - received, 0);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return 0;
+        }
+        received += (size_t)count;
+    }
+    return 1;
+}
+
+// Make room for the names and values of a reply
+static int reserve_strings(SavvyClient *client, size_t count)
+{
+    if (count > client->stringCapacity)
+    {
+        const char **strings = realloc(client->strings, count * sizeof(char *));
+        if (!strings)
+        {
+            return 0;
+        }
+        client->strings = strings;
+        client->stringCapacity = count;
+    }
+    return 1;
+}
+
+// Decode a successful result into the reply. Every name and value takes at
+// least its NUL, so counts are checked against the frame before allocating.
+static SavvyStatus decode_result(SavvyClient *client, WireReader *in, SavvyReply *reply)
+{
+    reply->rowId = wire_get_i64(in);
+    reply->affected = (int32_t)wire_get_u32(in);
+    reply->width = wire_get_u16(in);
+    size_t width = (size_t)reply->width;
+    if (in->failed || width > (size_t)(in->end - in->pos))
+    {
+        return SAVVY_ERR_IO;
+    }
+    if (!reserve_strings(client, width))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    for (size_t i = 0; i < width; i++)
+    {
+        client->strings[i] = wire_get_string(in);
+    }
+
+    size_t numRows = wire_get_u32(in);
+    if (in->failed || numRows > (size_t)(in->end - in->pos) / (8 + width))
+    {
+        return SAVVY_ERR_IO;
+    }
+    if (!reserve_strings(client, width + numRows * width))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    if (numRows > client->rowCapacity)
+    {
+        int64_t *rowIds = realloc(client->rowIds, numRows * sizeof(int64_t));
+        if (!rowIds)
+        {
+            return SAVVY_ERR_NO_MEMORY;
+        }
+        client->rowIds = rowIds;
+        client->rowCapacity = numRows;
+    }
+    const char **values = client->strings + width;
+    for (size_t row = 0; row < numRows; row++)
+    {
+        client->rowIds[row] = wire_get_i64(in);
+        for (size_t i = 0; i < width; i++)
+        {
+            values[row * width + i] = wire_get_string(in);
+        }
+    }
+    if (in->failed || in->pos != in->end)
+    {
+        return SAVVY_ERR_IO;
+    }
+    reply->numRows = (int)numRows;
+    reply->names = client->strings;
+    reply->rowIds = client->rowIds;
+    reply->values = values;
+    return SAVVY_OK;
+}
+
+// Wait for the reply to the oldest request without one, flushing queued
+// requests first. Returns SAVVY_OK once a reply is read, whose own status is
+// in reply->status, or SAVVY_ERR_IO if the connection failed.
+SavvyStatus savvy_client_receive(SavvyClient *client, SavvyReply *reply)
+{
+    memset(reply, 0, sizeof(*reply));
+    reply->rowId = -1;
+    SavvyStatus status = savvy_client_flush(client);
+    if (status != SAVVY_OK)
+    {
+        return status;
+    }
+
+    uint8_t header[WIRE_HEADER_BYTES];
+    if (!receive_all(client->fd, header, sizeof(header)))
+    {
+        return SAVVY_ERR_IO;
+    }
+    int64_t length = wire_frame_length(header, sizeof(header));
+    if (length == 0 || length > WIRE_MAX_FRAME)
+    {
+        return SAVVY_ERR_IO;
+    }
+    client->input.length = 0;
+    if (!wire_reserve(&client->input, (size_t)length))
+    {
+        client->input.failed = 0;
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    if (!receive_all(client->fd, client->input.data, (size_t)length))
+    {
+        return SAVVY_ERR_IO;
+    }
+
+    WireReader in;
+    wire_reader_init(&in, client->input.data, (size_t)length);
+    reply->status = (SavvyStatus)wire_get_u8(&in);
+    if (reply->status != SAVVY_OK)
+    {
+        reply->error = wire_get_string(&in);
+        return in.failed ? SAVVY_ERR_IO : SAVVY_OK;
+    }
+    return decode_result(client, &in, reply);
+}
+
+// Send a request and wait for its reply, on a client with no other reply
+// outstanding. Returns the reply's status or the connection's failure.
+SavvyStatus savvy_client_call(SavvyClient *client, const SavvyRequest *request, SavvyReply *reply)
+{
+    SavvyStatus status = savvy_client_send(client, request);
+    if (status == SAVVY_OK)
+    {
+        status = savvy_client_receive(client, reply);
+    }
+    return status == SAVVY_OK ? reply->status : status;
+}
+
+void savvy_client_close(SavvyClient *client)
+{
+    if (!client)
+    {
+        return;
+    }
+    close(client->fd);
+    wire_buffer_free(&client->output);
+    wire_buffer_free(&client->input);
+    free(client->strings);
+    free(client->rowIds);
+    free(client);
+}
@@ -0,0 +1,572 @@
+#include "codec.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Shortest match worth a copy, and the size of the table of earlier positions
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_TOKEN_MAX 15
+
+// Start of a CODEC_FRAME or CODEC_DELTA block, followed by the packed offsets
+// in 64 bit words, value i in bits i * width up
+typedef struct
+{
+    int64_t first; // First value, deltas start from it
+    int64_t base;  // Added to every packed offset
+    uint32_t width;
+    uint32_t reserved;
+} PackedHeader;
+
+static size_t value_size(CodecValues kind)
+{
+    return kind == CODEC_INT64 ? sizeof(int64_t) : sizeof(uint32_t);
+}
+
+static int64_t value_at(const void *values, CodecValues kind, size_t i)
+{
+    return kind == CODEC_INT64 ? ((const int64_t *)values)[i] : (int64_t)((const uint32_t *)values)[i];
+}
+
+static void set_value(void *values, CodecValues kind, size_t i, int64_t value)
+{
+    if (kind == CODEC_INT64)
+        ((int64_t *)values)[i] = value;
+    else
+        ((uint32_t *)values)[i] = (uint32_t)value;
+}
+
+// Bits needed for offsets up to range
+static uint32_t bit_width(uint64_t range)
+{
+    uint32_t width = 0;
+    while (width < 64 && (range >> width) != 0)
+    {
+        width++;
+    }
+    return width;
+}
+
+static size_t packed_bytes(size_t count, uint32_t width)
+{
+    return ((uint64_t)count * width + 63) / 64 * sizeof(uint64_t);
+}
+
+static void pack(uint64_t *words, uint32_t width, size_t i, uint64_t value)
+{
+    uint64_t bit = (uint64_t)i * width;
+    size_t word = bit / 64;
+    unsigned shift = bit % 64;
+    words[word] |= value << shift;
+    if (shift + width > 64)
+    {
+        words[word + 1] |= value >> (64 - shift);
+    }
+}
+
+static uint64_t unpack(const uint64_t *words, uint32_t width, size_t i)
+{
+    uint64_t bit = (uint64_t)i * width;
+    size_t word = bit / 64;
+    unsigned shift = bit % 64;
+    uint64_t value = words[word] >> shift;
+    if (shift + width > 64)
+    {
+        value |= words[word + 1] << (64 - shift);
+    }
+    return width == 64 ? value : value & (((uint64_t)1 << width) - 1);
+}
+
+// Size of a frame of the values, or of their deltas, with its base and width
+static size_t frame_size(const void *values, CodecValues kind, size_t count, int deltas, PackedHeader *header)
+{
+    memset(header, 0, sizeof(PackedHeader));
+    size_t first = deltas ? 1 : 0;
+    if (count <= first)
+    {
+        header->first = count > 0 ? value_at(values, kind, 0) : 0;
+        return sizeof(PackedHeader);
+    }
+
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    for (size_t i = first; i < count; i++)
+    {
+        int64_t value = value_at(values, kind, i);
+        if (deltas)
+        {
+            value = (int64_t)((uint64_t)value - (uint64_t)value_at(values, kind, i - 1));
+        }
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+    header->first = value_at(values, kind, 0);
+    header->base = min;
+    header->width = bit_width((uint64_t)max - (uint64_t)min);
+    return sizeof(PackedHeader) + packed_bytes(count - first, header->width);
+}
+
+static void encode_frame(const void *values, CodecValues kind, size_t count, int deltas, const PackedHeader *header,
+                         uint8_t *encoded)
+{
+    memcpy(encoded, header, sizeof(PackedHeader));
+    uint64_t *words = (uint64_t *)(encoded + sizeof(PackedHeader));
+    size_t first = deltas ? 1 : 0;
+    for (size_t i = first; header->width > 0 && i < count; i++)
+    {
+        uint64_t value = (uint64_t)value_at(values, kind, i);
+        if (deltas)
+        {
+            value -= (uint64_t)value_at(values, kind, i - 1);
+        }
+        pack(words, header->width, i - first, value - (uint64_t)header->base);
+    }
+}
+
+static int decode_frame(const uint8_t *encoded, size_t size, CodecValues kind, size_t count, int deltas,
+                        void *values)
+{
+    PackedHeader header;
+    size_t first = deltas ? 1 : 0;
+    if (size < sizeof(header))
+    {
+        return 0;
+    }
+    memcpy(&header, encoded, sizeof(header));
+    if (header.width > 64 || size != sizeof(header) + (count > first ? packed_bytes(count - first, header.width) : 0))
+    {
+        return 0;
+    }
+
+    const uint64_t *words = (const uint64_t *)(encoded + sizeof(header));
+    uint64_t value = (uint64_t)header.first;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i >= first)
+        {
+            uint64_t offset = header.width > 0 ? unpack(words, header.width, i - first) : 0;
+            value = (deltas ? value : 0) + (uint64_t)header.base + offset;
+        }
+        set_value(values, kind, i, (int64_t)value);
+    }
+    return 1;
+}
+
+static size_t varint_size(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static uint8_t *put_varint(uint8_t *out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+// Read a varint below end, returns NULL if it runs past it
+static const uint8_t *get_varint(const uint8_t *in, const uint8_t *end, uint64_t *value)
+{
+    if (in < end && *in < 0x80)
+    {
+        *value = *in;
+        return in + 1;
+    }
+    *value = 0;
+    for (unsigned shift = 0; in < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *in++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+// Signed differences as small unsigned numbers: 0, -1, 1, -2, ...
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Runs of equal values: their length, then their value less the last run's.
+// With out NULL only the size is counted.
+static size_t encode_value_runs(const void *values, CodecValues kind, size_t count, uint8_t *out)
+{
+    size_t size = 0;
+    int64_t previous = 0;
+    for (size_t i = 0; i < count;)
+    {
+        int64_t value = value_at(values, kind, i);
+        size_t length = 1;
+        while (i + length < count && value_at(values, kind, i + length) == value)
+        {
+            length++;
+        }
+        uint64_t delta = zigzag((int64_t)((uint64_t)value - (uint64_t)previous));
+        size += varint_size(length) + varint_size(delta);
+        if (out)
+        {
+            out = put_varint(put_varint(out, length), delta);
+        }
+        previous = value;
+        i += length;
+    }
+    return size;
+}
+
+static int decode_value_runs(const uint8_t *in, size_t size, CodecValues kind, size_t count, void *values)
+{
+    const uint8_t *end = in + size;
+    int64_t value = 0;
+    for (size_t i = 0; i < count;)
+    {
+        uint64_t length, delta;
+        if (!(in = get_varint(in, end, &length)) || !(in = get_varint(in, end, &delta)) || length == 0 ||
+            length > count - i)
+        {
+            return 0;
+        }
+        value = (int64_t)((uint64_t)value + (uint64_t)unzigzag(delta));
+        for (uint64_t j = 0; j < length; j++)
+        {
+            set_value(values, kind, i++, value);
+        }
+    }
+    return in == end;
+}
+
+static int bit_at(const uint8_t *bits, size_t i)
+{
+    return (bits[i / 8] >> (i % 8)) & 1;
+}
+
+// Runs of equal bits, alternating from clear ones, as their lengths. Whole
+// bytes of the run's bit are skipped at once. With out NULL only the size is
+// counted.
+static size_t encode_bit_runs(const uint8_t *bits, size_t bytes, uint8_t *out)
+{
+    size_t size = 0;
+    size_t count = bytes * 8;
+    int bit = 0;
+    for (size_t i = 0; i < count; bit = !bit)
+    {
+        size_t start = i;
+        uint8_t same = bit ? 0xff : 0x00;
+        while (i < count)
+        {
+            if (i % 8 == 0 && bits[i / 8] == same)
+                i += 8;
+            else if (bit_at(bits, i) == bit)
+                i++;
+            else
+                break;
+        }
+        size += varint_size(i - start);
+        if (out)
+        {
+            out = put_varint(out, i - start);
+        }
+    }
+    return size;
+}
+
+static int decode_bit_runs(const uint8_t *in, size_t size, uint8_t *bits, size_t bytes)
+{
+    const uint8_t *end = in + size;
+    size_t count = bytes * 8;
+    memset(bits, 0, bytes);
+    int bit = 0;
+    for (size_t i = 0; i < count; bit = !bit)
+    {
+        uint64_t length;
+        if (!(in = get_varint(in, end, &length)) || length > count - i)
+        {
+            return 0;
+        }
+        if (!bit)
+        {
+            i += length;
+            continue;
+        }
+        for (size_t stop = i + length; i < stop;)
+        {
+            if (i % 8 == 0 && stop - i >= 8)
+            {
+                bits[i / 8] = 0xff;
+                i += 8;
+            }
+            else
+            {
+                bits[i / 8] |= (uint8_t)(1 << (i % 8));
+                i++;
+            }
+        }
+    }
+    return in == end;
+}
+
+static uint32_t lz_hash(const uint8_t *at)
+{
+    uint32_t word;
+    memcpy(&word, at, sizeof(word));
+    return (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// A count of literal bytes and a match length past LZ_MIN_MATCH share a token
+// byte, four bits each, with LZ_TOKEN_MAX meaning the rest follows as a varint
+static uint8_t *put_token(uint8_t *out, size_t literals, size_t length)
+{
+    *out++ = (uint8_t)((literals < LZ_TOKEN_MAX ? literals : LZ_TOKEN_MAX) << 4 |
+                       (length < LZ_TOKEN_MAX ? length : LZ_TOKEN_MAX));
+    return literals >= LZ_TOKEN_MAX ? put_varint(out, literals - LZ_TOKEN_MAX) : out;
+}
+
+// Tokens of literal bytes, then unless the input ends with them the distance
+// back to a match and the rest of its length. Returns 0 if the output would
+// not fit in limit bytes.
+static size_t encode_lz(const uint8_t *in, size_t size, uint8_t *out, size_t limit)
+{
+    uint32_t *positions = calloc((size_t)1 << LZ_HASH_BITS, sizeof(uint32_t)); // Position + 1 of each hash
+    if (!positions)
+    {
+        return 0;
+    }
+
+    uint8_t *at = out;
+    uint8_t *end = out + limit;
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + LZ_MIN_MATCH <= size)
+    {
+        uint32_t hash = lz_hash(in + i);
+        size_t candidate = positions[hash];
+        positions[hash] = (uint32_t)(i + 1);
+        if (candidate == 0 || memcmp(in + candidate - 1, in + i, LZ_MIN_MATCH) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        size_t from = candidate - 1;
+        size_t length = LZ_MIN_MATCH;
+        while (i + length < size && in[from + length] == in[i + length])
+        {
+            length++;
+        }
+        size_t literals = i - anchor;
+        if ((size_t)(end - at) < literals + 31)
+        {
+            free(positions);
+            return 0;
+        }
+        at = put_token(at, literals, length - LZ_MIN_MATCH);
+        memcpy(at, in + anchor, literals);
+        at = put_varint(at + literals, i - from);
+        if (length - LZ_MIN_MATCH >= LZ_TOKEN_MAX)
+        {
+            at = put_varint(at, length - LZ_MIN_MATCH - LZ_TOKEN_MAX);
+        }
+        i += length;
+        anchor = i;
+    }
+    free(positions);
+
+    size_t literals = size - anchor;
+    if ((size_t)(end - at) < literals + 11)
+    {
+        return 0;
+    }
+    at = put_token(at, literals, 0);
+    memcpy(at, in + anchor, literals);
+    return (size_t)(at + literals - out);
+}
+
+static int decode_lz(const uint8_t *in, size_t size, uint8_t *out, size_t bytes)
+{
+    const uint8_t *end = in + size;
+    size_t at = 0;
+    while (in < end)
+    {
+        uint8_t token = *in++;
+        uint64_t literals = token >> 4;
+        uint64_t length = token & LZ_TOKEN_MAX;
+        uint64_t distance;
+        if (literals == LZ_TOKEN_MAX && !(in = get_varint(in, end, &literals)))
+        {
+            return 0;
+        }
+        literals += token >> 4 == LZ_TOKEN_MAX ? LZ_TOKEN_MAX : 0;
+        if (literals > (size_t)(end - in) || literals > bytes - at)
+        {
+            return 0;
+        }
+        // Short runs are copied in one fixed size step when both sides have room
+        if (literals <= 16 && end - in >= 16 && bytes - at >= 16)
+            memcpy(out + at, in, 16);
+        else
+            memcpy(out + at, in, literals);
+        in += literals;
+        at += literals;
+        if (at == bytes)
+        {
+            return in == end;
+        }
+
+        if (!(in = get_varint(in, end, &distance)) || distance == 0 || distance > at)
+        {
+            return 0;
+        }
+        if (length == LZ_TOKEN_MAX)
+        {
+            uint64_t more;
+            if (!(in = get_varint(in, end, &more)) || more > bytes)
+            {
+                return 0;
+            }
+            length += more;
+        }
+        length += LZ_MIN_MATCH;
+        if (length > bytes - at)
+        {
+            return 0;
+        }
+
+        // Copies may overlap what they write, repeating the last distance bytes
+        // in steps that do not
+        if (distance >= 8 && bytes - at >= length + 8)
+        {
+            for (size_t copied = 0; copied < length; copied += 8)
+            {
+                memcpy(out + at + copied, out + at + copied - distance, 8);
+            }
+            at += length;
+            continue;
+        }
+        while (length > 0)
+        {
+            size_t step = length < distance ? length : distance;
+            memcpy(out + at, out + at - distance, step);
+            at += step;
+            length -= step;
+        }
+    }
+    return 0; // Cut short, the last token holds literals only
+}
+
+// Encode a block of values with the codec that stores it in the fewest bytes.
+// Returns the encoded size with *encoded allocated to hold it, or 0 if no
+// codec saves a quarter of the bytes and the block should be stored raw.
+size_t codec_encode(const void *values, size_t bytes, CodecValues kind, Codec *codec, uint8_t **encoded)
+{
+    size_t limit = bytes / 4 * 3;
+    *encoded = NULL;
+    if (bytes == 0 || ((kind == CODEC_INT64 || kind == CODEC_UINT32) && bytes % value_size(kind) != 0))
+    {
+        return 0;
+    }
+
+    if (kind == CODEC_BYTES)
+    {
+        *encoded = malloc(limit > 0 ? limit : 1);
+        size_t size = *encoded ? encode_lz(values, bytes, *encoded, limit) : 0;
+        if (size == 0)
+        {
+            free(*encoded);
+            *encoded = NULL;
+        }
+        *codec = CODEC_LZ;
+        return size;
+    }
+
+    if (kind == CODEC_BITS)
+    {
+        size_t size = encode_bit_runs(values, bytes, NULL);
+        if (size > limit || !(*encoded = malloc(size)))
+        {
+            return 0;
+        }
+        encode_bit_runs(values, bytes, *encoded);
+        *codec = CODEC_RUNS;
+        return size;
+    }
+
+    size_t count = bytes / value_size(kind);
+    PackedHeader frame, delta;
+    size_t frameSize = frame_size(values, kind, count, 0, &frame);
+    size_t deltaSize = frame_size(values, kind, count, 1, &delta);
+    size_t runsSize = encode_value_runs(values, kind, count, NULL);
+    size_t size = frameSize;
+    *codec = CODEC_FRAME;
+    if (deltaSize < size)
+    {
+        size = deltaSize;
+        *codec = CODEC_DELTA;
+    }
+    if (runsSize < size)
+    {
+        size = runsSize;
+        *codec = CODEC_RUNS;
+    }
+    if (size > limit || !(*encoded = calloc(1, size)))
+    {
+        return 0;
+    }
+
+    if (*codec == CODEC_RUNS)
+        encode_value_runs(values, kind, count, *encoded);
+    else if (*codec == CODEC_DELTA)
+        encode_frame(values, kind, count, 1, &delta, *encoded);
+    else
+        encode_frame(values, kind, count, 0, &frame, *encoded);
+    return size;
+}
+
+// Decode size bytes of a block into the bytes of values it holds, returns 0
+// if they are damaged, cut short or followed by more, or were not written by
+// codec_encode for this kind. Never writes past bytes.
+int codec_decode(Codec codec, const uint8_t *encoded, size_t size, CodecValues kind, void *values, size_t bytes)
+{
+    int isNumber = kind == CODEC_INT64 || kind == CODEC_UINT32;
+    size_t count = isNumber ? bytes / value_size(kind) : 0;
+    if (isNumber && bytes % value_size(kind) != 0)
+    {
+        return 0;
+    }
+
+    switch (codec)
+    {
+    case CODEC_RAW:
+        if (size != bytes)
+            return 0;
+        memcpy(values, encoded, bytes);
+        return 1;
+    case CODEC_FRAME:
+    case CODEC_DELTA:
+        return isNumber && decode_frame(encoded, size, kind, count, codec == CODEC_DELTA, values);
+    case CODEC_RUNS:
+        if (kind == CODEC_BITS)
+            return decode_bit_runs(encoded, size, values, bytes);
+        return isNumber && decode_value_runs(encoded, size, kind, count, values);
+    case CODEC_LZ:
+        return kind == CODEC_BYTES && decode_lz(encoded, size, values, bytes);
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,812 @@
+#include "dbms.h"
+#include <errno.h>
+#include <math.h>
+
+#define HEAP_MIN_CAPACITY 256
+#define DICTIONARY_MIN_CAPACITY 16
+#define DICTIONARY_EMPTY UINT32_MAX
+
+// Open-addressing set of the heap offsets of a column's distinct strings, at
+// most half full. Readers probe it without locking: entries are only added,
+// and a set that grows is replaced as a whole and retired.
+struct Dictionary
+{
+    int capacity; // Always a power of two
+    int count;
+    uint32_t codes[];
+};
+
+// Parse text into a typed value, returns 0 if it is not valid for the type.
+// FLOAT values must be finite: NaN equals nothing, not even itself, so it
+// would slip past unique columns and sort differently in indexes and scans.
+// STRING values point into the given text.
+int parse_value(const char *text, ColumnType type, Value *out)
+{
+    char *endptr;
+    out->type = type;
+    switch (type)
+    {
+    case INTEGER:
+        errno = 0;
+        out->as.i = strtoll(text, &endptr, 10);
+        return endptr != text && *endptr == '\0' && errno != ERANGE;
+    case FLOAT:
+        out->as.f = strtod(text, &endptr);
+        return endptr != text && *endptr == '\0' && isfinite(out->as.f);
+    case BOOLEAN:
+        if (strcmp(text, "true") == 0)
+        {
+            out->as.b = 1;
+            return 1;
+        }
+        if (strcmp(text, "false") == 0)
+        {
+            out->as.b = 0;
+            return 1;
+        }
+        return 0;
+    case STRING:
+        out->as.s = text;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void column_data_init(ColumnData *data)
+{
+    memset(data, 0, sizeof(ColumnData));
+}
+
+// Free the arrays, the allocation count is kept for monitoring
+void column_data_free(ColumnData *data)
+{
+    int64_t allocations = data->allocations;
+    if (!data->mapped)
+    {
+        free(data->ints);
+        free(data->floats);
+        free(data->bits);
+        free(data->offsets);
+        free(data->heap);
+    }
+    free(data->dictionary);
+    column_data_init(data);
+    data->allocations = allocations;
+}
+
+// Move an array to new memory of the given size, keeping the values that fit.
+// The new array is published before the old one is retired.
+static int resize_array(void **array, size_t *size, size_t bytes)
+{
+    void *resized = NULL;
+    if (bytes > 0)
+    {
+        resized = malloc(bytes);
+        if (!resized)
+        {
+            return 0;
+        }
+        if (*array)
+        {
+            memcpy(resized, *array, *size < bytes ? *size : bytes);
+        }
+    }
+
+    void *old = *array;
+    atomic_store_release(array, resized);
+    *size = bytes;
+    mvcc_retire(old);
+    return 1;
+}
+
+static void **value_array(ColumnData *data, ColumnType type)
+{
+    switch (type)
+    {
+    case INTEGER:
+        return (void **)&data->ints;
+    case FLOAT:
+        return (void **)&data->floats;
+    case BOOLEAN:
+        return (void **)&data->bits;
+    case STRING:
+        return (void **)&data->offsets;
+    default:
+        return NULL;
+    }
+}
+
+static size_t value_bytes(ColumnType type, int numRows)
+{
+    switch (type)
+    {
+    case INTEGER:
+        return numRows * sizeof(int64_t);
+    case FLOAT:
+        return numRows * sizeof(double);
+    case BOOLEAN:
+        return (numRows + 7) / 8;
+    case STRING:
+        return numRows * sizeof(uint32_t);
+    default:
+        return 0;
+    }
+}
+
+// Copy mapped arrays into owned memory before they are resized or freed.
+// In-place writes need no copy, mappings are private copy-on-write pages.
+static int own_arrays(ColumnData *data, ColumnType type)
+{
+    if (!data->mapped)
+    {
+        return 1;
+    }
+
+    void **values = value_array(data, type);
+    size_t bytes = value_bytes(type, data->mappedRows);
+    void *ownValues = bytes ? malloc(bytes) : NULL;
+    char *ownHeap = data->heapSize ? malloc(data->heapSize) : NULL;
+    if ((bytes && !ownValues) || (data->heapSize && !ownHeap))
+    {
+        free(ownValues);
+        free(ownHeap);
+        return 0;
+    }
+
+    if (bytes)
+        memcpy(ownValues, *values, bytes);
+    if (data->heapSize)
+        memcpy(ownHeap, data->heap, data->heapSize);
+    atomic_store_release(values, ownValues);
+    atomic_store_release(&data->heap, ownHeap);
+    data->arrayBytes = bytes;
+    data->heapCapacity = data->heapSize;
+    data->allocations += (ownValues != NULL) + (ownHeap != NULL);
+    data->mapped = 0;
+    data->mappedRows = 0;
+    return 1;
+}
+
+// Resize the column's value array to hold exactly numRows values
+int column_data_resize(ColumnData *data, ColumnType type, int numRows)
+{
+    if (!own_arrays(data, type))
+    {
+        return 0;
+    }
+
+    void **values = value_array(data, type);
+    if (!values || !resize_array(values, &data->arrayBytes, value_bytes(type, numRows)))
+    {
+        return 0;
+    }
+    data->allocations++;
+    return 1;
+}
+
+// Copy a string to the end of the heap, returns its offset or -1 on failure
+static int64_t heap_append(ColumnData *data, const char *value)
+{
+    size_t length = strlen(value) + 1;
+    if (data->heapSize + length > UINT32_MAX || !own_arrays(data, STRING))
+    {
+        return -1;
+    }
+
+    if (data->heapSize + length > data->heapCapacity)
+    {
+        size_t capacity = data->heapCapacity ? data->heapCapacity : HEAP_MIN_CAPACITY;
+        while (data->heapSize + length > capacity)
+        {
+            capacity *= 2;
+        }
+        if (!resize_array((void **)&data->heap, &data->heapCapacity, capacity))
+        {
+            return -1;
+        }
+        data->allocations++;
+    }
+
+    int64_t offset = (int64_t)data->heapSize;
+    memcpy(data->heap + data->heapSize, value, length);
+    atomic_store_release(&data->heapSize, data->heapSize + length);
+    return offset;
+}
+
+static Dictionary *new_dictionary(int capacity)
+{
+    Dictionary *dictionary = malloc(sizeof(Dictionary) + capacity * sizeof(uint32_t));
+    if (dictionary)
+    {
+        dictionary->capacity = capacity;
+        dictionary->count = 0;
+        memset(dictionary->codes, 0xFF, capacity * sizeof(uint32_t));
+    }
+    return dictionary;
+}
+
+// Entry holding a string, or the empty entry it would take. Offsets at or past
+// heapSize were added after the caller's view of the heap and are skipped.
+static int dictionary_find(const Dictionary *dictionary, const char *heap, size_t heapSize, const char *value)
+{
+    int mask = dictionary->capacity - 1;
+    for (int i = (int)(hash_value(value) & (unsigned)mask);; i = (i + 1) & mask)
+    {
+        uint32_t code = atomic_load_acquire(&dictionary->codes[i]);
+        if (code == DICTIONARY_EMPTY || (code < heapSize && strcmp(heap + code, value) == 0))
+        {
+            return i;
+        }
+    }
+}
+
+// Add the offset of a string the set does not hold yet, which must have room for it
+static void dictionary_put(Dictionary *dictionary, const char *heap, uint32_t code)
+{
+    int mask = dictionary->capacity - 1;
+    int i = (int)(hash_value(heap + code) & (unsigned)mask);
+    while (dictionary->codes[i] != DICTIONARY_EMPTY)
+    {
+        i = (i + 1) & mask;
+    }
+    atomic_store_release(&dictionary->codes[i], code);
+    dictionary->count++;
+}
+
+// Build the set of a heap's distinct strings, each at its first offset. The
+// bytes of repeated copies are added to duplicateBytes. Returns NULL if memory runs out.
+static Dictionary *build_dictionary(const char *heap, size_t heapSize, size_t *duplicateBytes)
+{
+    int numStrings = 0;
+    for (size_t offset = 0; offset < heapSize; offset += strlen(heap + offset) + 1)
+    {
+        numStrings++;
+    }
+    int capacity = DICTIONARY_MIN_CAPACITY;
+    while (capacity < (numStrings + 1) * 2)
+    {
+        capacity *= 2;
+    }
+    Dictionary *dictionary = new_dictionary(capacity);
+    if (!dictionary)
+    {
+        return NULL;
+    }
+
+    *duplicateBytes = 0;
+    for (size_t offset = 0; offset < heapSize; offset += strlen(heap + offset) + 1)
+    {
+        // The empty string only backs slots no row uses, see column_data_compact_heap
+        if (heap[offset] == '\0')
+        {
+            continue;
+        }
+        if (dictionary->codes[dictionary_find(dictionary, heap, heapSize, heap + offset)] == DICTIONARY_EMPTY)
+        {
+            dictionary_put(dictionary, heap, (uint32_t)offset);
+        }
+        else
+        {
+            *duplicateBytes += strlen(heap + offset) + 1;
+        }
+    }
+    return dictionary;
+}
+
+// Offset of a string in a dictionary encoded column, appending it first if it
+// is new. Returns -1 on failure.
+static int64_t heap_intern(ColumnData *data, const char *value)
+{
+    Dictionary *dictionary = data->dictionary;
+    uint32_t code = dictionary->codes[dictionary_find(dictionary, data->heap, data->heapSize, value)];
+    if (code != DICTIONARY_EMPTY)
+    {
+        return code;
+    }
+
+    if ((dictionary->count + 1) * 2 > dictionary->capacity)
+    {
+        Dictionary *grown = new_dictionary(dictionary->capacity * 2);
+        if (!grown)
+        {
+            return -1;
+        }
+        for (int i = 0; i < dictionary->capacity; i++)
+        {
+            if (dictionary->codes[i] != DICTIONARY_EMPTY)
+            {
+                dictionary_put(grown, data->heap, dictionary->codes[i]);
+            }
+        }
+        atomic_store_release(&data->dictionary, grown);
+        mvcc_retire(dictionary);
+        dictionary = grown;
+    }
+
+    int64_t offset = heap_append(data, value);
+    if (offset >= 0)
+    {
+        dictionary_put(dictionary, data->heap, (uint32_t)offset);
+    }
+    return offset;
+}
+
+// Append a string, or find its copy in a dictionary encoded column
+static int64_t heap_store(ColumnData *data, const char *value)
+{
+    return data->dictionary ? heap_intern(data, value) : heap_append(data, value);
+}
+
+// Store a value in an already allocated row slot. Replaced strings stay in the heap.
+int column_data_set(ColumnData *data, ColumnType type, int row, const Value *value)
+{
+    switch (type)
+    {
+    case INTEGER:
+        data->ints[row] = value->as.i;
+        return 1;
+    case FLOAT:
+        data->floats[row] = value->as.f;
+        return 1;
+    case BOOLEAN:
+        if (value->as.b)
+            data->bits[row / 8] |= (uint8_t)(1u << (row % 8));
+        else
+            data->bits[row / 8] &= (uint8_t)~(1u << (row % 8));
+        return 1;
+    case STRING:
+    {
+        int64_t offset = heap_store(data, value->as.s);
+        if (offset < 0)
+        {
+            return 0;
+        }
+        data->offsets[row] = (uint32_t)offset;
+        return 1;
+    }
+    default:
+        return 0;
+    }
+}
+
+// Set rows [from, to) to the type's default value, the empty string for STRING
+int column_data_fill_default(ColumnData *data, ColumnType type, int from, int to)
+{
+    Value value;
+    value.type = type;
+    switch (type)
+    {
+    case INTEGER:
+        value.as.i = 0;
+        break;
+    case FLOAT:
+        value.as.f = 0.0;
+        break;
+    case BOOLEAN:
+        value.as.b = 0;
+        break;
+    case STRING:
+        if (from >= to)
+            return 1;
+        // All default cells share one copy of the string
+        int64_t offset = heap_store(data, "");
+        if (offset < 0)
+            return 0;
+        for (int i = from; i < to; i++)
+        {
+            data->offsets[i] = (uint32_t)offset;
+        }
+        return 1;
+    }
+
+    for (int i = from; i < to; i++)
+    {
+        column_data_set(data, type, i, &value);
+    }
+    return 1;
+}
+
+// Start an empty column with room for capacity rows that all hold value, or
+// the type's default without one. Every default is stored as zero bytes, and
+// so is any STRING value, which is the first string of the heap: the array
+// then comes from calloc without being written, and large ones are fresh
+// pages the system only backs once rows are touched.
+int column_data_init_default(ColumnData *data, ColumnType type, int capacity, const Value *value)
+{
+    column_data_init(data);
+    size_t bytes = value_bytes(type, capacity);
+    void **values = value_array(data, type);
+    if (!values || (bytes > 0 && !(*values = calloc(1, bytes))))
+    {
+        return 0;
+    }
+    data->arrayBytes = bytes;
+    data->allocations = bytes > 0;
+    if (type == STRING && heap_append(data, value ? value->as.s : "") != 0)
+    {
+        column_data_free(data);
+        return 0;
+    }
+    for (int i = 0; value && type != STRING && i < capacity; i++)
+    {
+        column_data_set(data, type, i, value);
+    }
+    return 1;
+}
+
+// Move the values of rows not set in the deleted bitmap to the front, keeping
+// their order, and shrink the array to them. Returns the number of rows kept; a
+// failed shrink only leaves the array larger than needed.
+int column_data_compact(ColumnData *data, ColumnType type, const uint8_t *deleted, int numRows)
+{
+    int kept = 0;
+    for (int i = 0; i < numRows; i++)
+    {
+        if ((deleted[i / 8] >> (i % 8)) & 1)
+        {
+            continue;
+        }
+        if (kept != i)
+        {
+            switch (type)
+            {
+            case INTEGER:
+                data->ints[kept] = data->ints[i];
+                break;
+            case FLOAT:
+                data->floats[kept] = data->floats[i];
+                break;
+            case STRING:
+                data->offsets[kept] = data->offsets[i];
+                break;
+            case BOOLEAN:
+            {
+                Value value;
+                value.type = BOOLEAN;
+                value.as.b = (data->bits[i / 8] >> (i % 8)) & 1;
+                column_data_set(data, BOOLEAN, kept, &value);
+                break;
+            }
+            }
+        }
+        kept++;
+    }
+    column_data_resize(data, type, kept);
+    return kept;
+}
+
+typedef struct
+{
+    uint32_t offset;
+    int32_t row;
+} HeapString;
+
+static int compare_heap_strings(const void *a, const void *b)
+{
+    uint32_t x = ((const HeapString *)a)->offset;
+    uint32_t y = ((const HeapString *)b)->offset;
+    return (x > y) - (x < y);
+}
+
+// Rebuild a STRING column's heap from the values of the rows set in keep, or
+// of every row if keep is NULL, dropping the strings no kept row refers to.
+// Rows sharing a string keep sharing one copy, the others point at an empty
+// string. Offsets are rewritten in place, so readers must be locked out.
+// Returns 0 if memory runs out, leaving the heap as it was.
+int column_data_compact_heap(ColumnData *data, const uint8_t *keep, int numRows)
+{
+    if (!own_arrays(data, STRING))
+    {
+        return 0;
+    }
+
+    int numKept = 0;
+    for (int i = 0; i < numRows; i++)
+    {
+        numKept += !keep || ((keep[i / 8] >> (i % 8)) & 1);
+    }
+    HeapString *strings = malloc((numKept > 0 ? numKept : 1) * sizeof(HeapString));
+    if (!strings)
+    {
+        return 0;
+    }
+    int count = 0;
+    for (int i = 0; i < numRows; i++)
+    {
+        if (!keep || ((keep[i / 8] >> (i % 8)) & 1))
+        {
+            strings[count].offset = data->offsets[i];
+            strings[count].row = i;
+            count++;
+        }
+    }
+
+    // Copies in heap order keep rows that shared a string together
+    qsort(strings, count, sizeof(HeapString), compare_heap_strings);
+    size_t size = 1;
+    for (int i = 0; i < count; i++)
+    {
+        if (i == 0 || strings[i].offset != strings[i - 1].offset)
+        {
+            size += strlen(data->heap + strings[i].offset) + 1;
+        }
+    }
+    size_t capacity = size > HEAP_MIN_CAPACITY ? size : HEAP_MIN_CAPACITY;
+    char *heap = malloc(capacity);
+    if (!heap)
+    {
+        free(strings);
+        return 0;
+    }
+
+    // Each entry now takes the offset of its string in the new heap
+    heap[0] = '\0';
+    size_t end = 1;
+    uint32_t copied = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t offset = strings[i].offset;
+        if (i == 0 || offset != copied)
+        {
+            size_t length = strlen(data->heap + offset) + 1;
+            memcpy(heap + end, data->heap + offset, length);
+            copied = offset;
+            strings[i].offset = (uint32_t)end;
+            end += length;
+        }
+        else
+        {
+            strings[i].offset = strings[i - 1].offset;
+        }
+    }
+
+    Dictionary *dictionary = NULL;
+    size_t duplicateBytes;
+    if (data->dictionary && !(dictionary = build_dictionary(heap, size, &duplicateBytes)))
+    {
+        free(heap);
+        free(strings);
+        return 0;
+    }
+
+    for (int i = 0; i < numRows; i++)
+    {
+        data->offsets[i] = 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        data->offsets[strings[i].row] = strings[i].offset;
+    }
+    free(strings);
+
+    char *old = data->heap;
+    atomic_store_release(&data->heap, heap);
+    mvcc_retire(old);
+    data->heapSize = size;
+    data->heapCapacity = capacity;
+    data->heapGarbage = 0;
+    data->allocations++;
+    if (dictionary)
+    {
+        Dictionary *oldDictionary = data->dictionary;
+        atomic_store_release(&data->dictionary, dictionary);
+        mvcc_retire(oldDictionary);
+    }
+    return 1;
+}
+
+// Dictionary encode a STRING column: cells holding equal strings are pointed
+// at one copy, and the set of distinct strings is kept to intern new values.
+// Interned heaps, like those of saved encoded columns, only need the set
+// built. Readers must be locked out. Returns 0 if memory runs out.
+int column_data_encode(ColumnData *data, int numRows)
+{
+    if (data->dictionary)
+    {
+        return 1;
+    }
+    size_t duplicateBytes;
+    Dictionary *dictionary = build_dictionary(data->heap, data->heapSize, &duplicateBytes);
+    if (!dictionary)
+    {
+        return 0;
+    }
+
+    // Mapped offsets are private copy-on-write pages, they can be rewritten in place
+    for (int i = 0; duplicateBytes > 0 && i < numRows; i++)
+    {
+        uint32_t code = dictionary->codes[dictionary_find(dictionary, data->heap, data->heapSize,
+                                                          data->heap + data->offsets[i])];
+        if (code != DICTIONARY_EMPTY)
+        {
+            data->offsets[i] = code;
+        }
+    }
+    data->heapGarbage += duplicateBytes;
+    atomic_store_release(&data->dictionary, dictionary);
+    return 1;
+}
+
+// Stop interning new strings, the cells keep sharing their strings
+void column_data_decode(ColumnData *data)
+{
+    Dictionary *dictionary = data->dictionary;
+    atomic_store_release(&data->dictionary, NULL);
+    mvcc_retire(dictionary);
+}
+
+// Code of a value in a dictionary encoded column, the offset every cell
+// holding it points at, or -1 if no cell the caller can see holds it. Lock
+// free, strings added after the caller's view of the column are not found.
+int64_t column_data_find_code(const ColumnData *data, const char *value)
+{
+    const Dictionary *dictionary = atomic_load_acquire(&data->dictionary);
+    if (!dictionary)
+    {
+        return -1;
+    }
+    uint32_t code = atomic_load_acquire(&dictionary->codes[dictionary_find(dictionary, data->heap, data->heapSize,
+                                                                           value)]);
+    return code == DICTIONARY_EMPTY ? -1 : code;
+}
+
+// Memory of the column's arrays, including unused capacity
+size_t column_data_bytes(const ColumnData *data, ColumnType type)
+{
+    size_t dictionaryBytes = data->dictionary ? sizeof(Dictionary) + data->dictionary->capacity * sizeof(uint32_t) : 0;
+    if (data->mapped)
+    {
+        return value_bytes(type, data->mappedRows) + data->heapSize + dictionaryBytes;
+    }
+    return data->arrayBytes + data->heapCapacity + dictionaryBytes;
+}
+
+// Copy the array pointers of a column another thread may be growing
+void column_data_view(const ColumnData *data, ColumnData *view)
+{
+    *view = *data;
+    // The heap holds at least heapSize bytes, see heap_append
+    view->heapSize = atomic_load_acquire(&data->heapSize);
+    view->dictionary = atomic_load_acquire(&data->dictionary);
+    view->ints = atomic_load_acquire(&data->ints);
+    view->floats = atomic_load_acquire(&data->floats);
+    view->bits = atomic_load_acquire(&data->bits);
+    view->offsets = atomic_load_acquire(&data->offsets);
+    view->heap = atomic_load_acquire(&data->heap);
+}
+
+int64_t cell_int(const Table *table, int row, int col)
+{
+    return table->data[col].ints[row];
+}
+
+double cell_float(const Table *table, int row, int col)
+{
+    return table->data[col].floats[row];
+}
+
+int cell_bool(const Table *table, int row, int col)
+{
+    return (table->data[col].bits[row / 8] >> (row % 8)) & 1;
+}
+
+const char *cell_string(const Table *table, int row, int col)
+{
+    const ColumnData *data = &table->data[col];
+    return data->heap + data->offsets[row];
+}
+
+// Write the text form of a cell, as accepted by parse_value
+void format_cell(const Table *table, int row, int col, char *buffer, size_t size)
+{
+    switch (table->columns[col].type)
+    {
+    case INTEGER:
+        snprintf(buffer, size, "%lld", (long long)cell_int(table, row, col));
+        break;
+    case FLOAT:
+    {
+        // Shortest of the two precisions that reads back as the same double
+        double value = cell_float(table, row, col);
+        snprintf(buffer, size, "%.15g", value);
+        if (strtod(buffer, NULL) != value)
+        {
+            snprintf(buffer, size, "%.17g", value);
+        }
+        break;
+    }
+    case BOOLEAN:
+        snprintf(buffer, size, "%s", cell_bool(table, row, col) ? "true" : "false");
+        break;
+    case STRING:
+        snprintf(buffer, size, "%s", cell_string(table, row, col));
+        break;
+    }
+}
+
+int cell_equals(const Table *table, int row, int col, const Value *value)
+{
+    switch (table->columns[col].type)
+    {
+    case INTEGER:
+        return cell_int(table, row, col) == value->as.i;
+    case FLOAT:
+        return cell_float(table, row, col) == value->as.f;
+    case BOOLEAN:
+        return cell_bool(table, row, col) == value->as.b;
+    case STRING:
+        return strcmp(cell_string(table, row, col), value->as.s) == 0;
+    default:
+        return 0;
+    }
+}
+
+// Order a cell against a value of the column's type, negative if the cell sorts first
+int cell_compare(const Table *table, int row, int col, const Value *value)
+{
+    switch (table->columns[col].type)
+    {
+    case INTEGER:
+    {
+        int64_t cell = cell_int(table, row, col);
+        return (cell > value->as.i) - (cell < value->as.i);
+    }
+    case FLOAT:
+    {
+        double cell = cell_float(table, row, col);
+        return (cell > value->as.f) - (cell < value->as.f);
+    }
+    case BOOLEAN:
+        return cell_bool(table, row, col) - value->as.b;
+    case STRING:
+        return strcmp(cell_string(table, row, col), value->as.s);
+    default:
+        return 0;
+    }
+}
+
+// Order two rows by one column, negative if row a sorts first
+int cell_compare_rows(const Table *table, int col, int a, int b)
+{
+    switch (table->columns[col].type)
+    {
+    case INTEGER:
+    {
+        int64_t x = cell_int(table, a, col), y = cell_int(table, b, col);
+        return (x > y) - (x < y);
+    }
+    case FLOAT:
+    {
+        double x = cell_float(table, a, col), y = cell_float(table, b, col);
+        return (x > y) - (x < y);
+    }
+    case BOOLEAN:
+        return cell_bool(table, a, col) - cell_bool(table, b, col);
+    case STRING:
+        return strcmp(cell_string(table, a, col), cell_string(table, b, col));
+    default:
+        return 0;
+    }
+}
+
+int value_equals(const Value *a, const Value *b)
+{
+    if (a->type != b->type)
+    {
+        return 0;
+    }
+    switch (a->type)
+    {
+    case INTEGER:
+        return a->as.i == b->as.i;
+    case FLOAT:
+        return a->as.f == b->as.f;
+    case BOOLEAN:
+        return a->as.b == b->as.b;
+    case STRING:
+        return strcmp(a->as.s, b->as.s) == 0;
+    default:
+        return 0;
+    }
+}
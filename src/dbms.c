@@ -1,447 +1,1384 @@
 #include "dbms.h"
-#include <ncurses.h>
+#include "catalog.h"
+#include "segment.h"
+#include <limits.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define ROW_MIN_CAPACITY 16
+
+// Ticks on every use_table, ordering tables from least to most recently used
+static uint64_t useClock;
+
+// Add a new, empty database at the head of the list (no logging or output).
+// Returns NULL if the name is already taken.
+DatabaseNode *insert_database(Catalog *catalog, const char *db_name)
+{
+    return catalog_add_database(catalog, db_name, 0);
+}
 
-DatabaseNode *dbList = NULL;
-DatabaseNode *dbNode = NULL;
+// Remove and free a database by name, returns 0 if it does not exist
+int remove_database(Catalog *catalog, const char *db_name)
+{
+    DatabaseNode *current = catalog_unlink_database(catalog, db_name, NULL);
+    if (current == NULL)
+    {
+        return 0;
+    }
+    free_database(current);
+    return 1;
+}
 
-const char filename[] = "db.txt";
+// Free an unlinked database and its tables
+void free_database(DatabaseNode *dbNode)
+{
+    while (dbNode->db.tables)
+    {
+        TableNode *next = dbNode->db.tables->next;
+        free_table(&dbNode->db.tables->table);
+        free(dbNode->db.tables);
+        dbNode->db.tables = next;
+    }
+    name_map_free(&dbNode->db.tableNames);
+    free(dbNode);
+}
 
-// Create a new database
-void create_database(DatabaseNode **head, const char *db_name)
+// Free every database in the catalog
+void free_databases(Catalog *catalog)
 {
-    DatabaseNode *newDbNode = (DatabaseNode *)malloc(sizeof(DatabaseNode));
-    strcpy(newDbNode->db.name, db_name);
-    newDbNode->db.tables = NULL;
-    newDbNode->next = *head;
-    *head = newDbNode;
-    printw("Database '%s' created.\n", db_name);
+    while (catalog->databases)
+    {
+        remove_database(catalog, catalog->databases->db.name);
+    }
+    name_map_free(&catalog->databaseNames);
+    segment_release(catalog);
 }
 
-// Delete a database
-void delete_database(DatabaseNode **head, const char *db_name)
+// Fill names with up to max_names database names in listing order, returns how many
+int list_databases(Catalog *catalog, const char *names[], int max_names)
 {
-    DatabaseNode *current = *head;
-    DatabaseNode *prev = NULL;
+    int count = 0;
+    DatabaseNode *temp = catalog->databases;
 
-    while (current != NULL && strcmp(current->db.name, db_name) != 0)
+    while (temp != NULL && count < max_names)
     {
-        prev = current;
-        current = current->next;
+        names[count] = temp->db.name;
+        count++;
+        temp = temp->next;
     }
 
-    if (current == NULL)
+    return count;
+}
+
+// Find a database by name
+DatabaseNode *find_database(Catalog *catalog, const char *db_name)
+{
+    return catalog_find_database(catalog, db_name);
+}
+
+// Add a new table with a blank schema at the head of the database's table list.
+// Returns NULL if the name is already taken.
+TableNode *insert_table(DatabaseNode *dbNode, const char *tableName)
+{
+    return catalog_add_table(dbNode, tableName, 0);
+}
+
+// Validate input value by column type
+int validate_value(const char *value, ColumnType type)
+{
+    Value parsed;
+    return parse_value(value, type, &parsed);
+}
+
+// Check for unique values
+int is_value_unique(Table *table, int colIndex, const char *value)
+{
+    return find_row_by_value(table, colIndex, value) < 0;
+}
+
+// Find the first row holding a value, using the column's hash index when it has one
+int find_row_by_value(Table *table, int colIndex, const char *value)
+{
+    Value key;
+    if (!parse_value(value, table->columns[colIndex].type, &key))
+    {
+        return -1;
+    }
+
+    // Indexes of loaded tables are built on first use, keeping startup free of per-row work
+    if (!table->indexes && table->columns[colIndex].isUnique)
+    {
+        rebuild_indexes(table);
+    }
+
+    if (table->indexes && table->indexes[colIndex].capacity > 0)
+    {
+        return hash_index_find(&table->indexes[colIndex], table, colIndex, &key);
+    }
+
+    // Cells of a dictionary encoded column hold the value if they share its code
+    const ColumnData *data = &table->data[colIndex];
+    int64_t code = data->dictionary ? column_data_find_code(data, value) : -1;
+    if (data->dictionary && code < 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < table->numRows; i++)
+    {
+        if (!is_row_live(table, i))
+        {
+            continue;
+        }
+        if (code >= 0 ? data->offsets[i] == (uint32_t)code : cell_equals(table, i, colIndex, &key))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void drop_hash_indexes(Table *table)
+{
+    if (table->indexes)
+    {
+        for (int i = 0; i < table->numColumns; i++)
+        {
+            hash_index_free(&table->indexes[i]);
+        }
+        free(table->indexes);
+        table->indexes = NULL;
+    }
+}
+
+// Free all indexes of a table, must run before its column count changes or its slots move
+static void drop_indexes(Table *table)
+{
+    drop_hash_indexes(table);
+    if (table->orderedIndexes)
+    {
+        for (int i = 0; i < table->numColumns; i++)
+        {
+            btree_free(&table->orderedIndexes[i]);
+        }
+        free(table->orderedIndexes);
+        table->orderedIndexes = NULL;
+    }
+    free(table->savedOrders);
+    table->savedOrders = NULL;
+}
+
+// Drop and rebuild the hash indexes of all unique columns
+void rebuild_indexes(Table *table)
+{
+    drop_hash_indexes(table);
+
+    if (table->numColumns == 0)
     {
-        printf("Database '%s' not found.\n", db_name);
         return;
     }
 
-    if (prev == NULL)
+    table->indexes = malloc(table->numColumns * sizeof(HashIndex));
+    if (!table->indexes)
     {
-        *head = current->next;
+        return;
     }
-    else
+
+    for (int i = 0; i < table->numColumns; i++)
     {
-        prev->next = current->next;
+        hash_index_init(&table->indexes[i]);
+        if (table->columns[i].isUnique && !hash_index_build(&table->indexes[i], table, i))
+        {
+            // Lookups on this column fall back to a scan
+            hash_index_free(&table->indexes[i]);
+        }
     }
+}
 
-    free(current);
-    printf("Database '%s' deleted.\n", db_name);
+static int is_indexed(const Table *table, int colIndex)
+{
+    return table->indexes && table->columns[colIndex].isUnique;
 }
 
-int list_databases(DatabaseNode *head, const char *choices[], int max_choices)
+static int has_ordered_index(const Table *table, int colIndex)
 {
-    int count = 0;
-    DatabaseNode *temp = head;
+    return table->orderedIndexes && table->orderedIndexes[colIndex].root;
+}
 
-    while (temp != NULL && count < max_choices - 1)
+// Whether a saved key order lists every live slot exactly once
+static int is_saved_order_current(const Table *table, const SavedOrder *saved)
+{
+    if (!saved->slots || saved->count != table->numRows - table->numDeleted - table->numPending)
     {
-        choices[count] = temp->db.name;
-        count++;
-        temp = temp->next;
+        return 0;
     }
 
-    choices[count] = "Go Back";
-    count++;
+    uint8_t *seen = calloc((table->numRows + 7) / 8 + 1, 1);
+    int current = seen != NULL;
+    for (int i = 0; current && i < saved->count; i++)
+    {
+        uint32_t slot = saved->slots[i];
+        current = slot < (uint32_t)table->numRows && is_row_live(table, slot) && !((seen[slot / 8] >> (slot % 8)) & 1);
+        if (current)
+        {
+            seen[slot / 8] |= 1 << (slot % 8);
+        }
+    }
+    free(seen);
+    return current;
+}
 
-    return count;
+static int build_ordered_index(Table *table, int colIndex)
+{
+    const SavedOrder *saved = table->savedOrders ? &table->savedOrders[colIndex] : NULL;
+    if (saved && is_saved_order_current(table, saved))
+    {
+        return btree_build(&table->orderedIndexes[colIndex], table, colIndex, saved->slots, saved->count);
+    }
+
+    int live = table->numRows - table->numDeleted - table->numPending;
+    uint32_t *slots = malloc((live > 0 ? live : 1) * sizeof(uint32_t));
+    if (!slots)
+    {
+        return 0;
+    }
+    int count = 0;
+    for (int i = 0; i < table->numRows; i++)
+    {
+        if (is_row_live(table, i))
+        {
+            slots[count++] = i;
+        }
+    }
+    int built = btree_build(&table->orderedIndexes[colIndex], table, colIndex, slots, count);
+    free(slots);
+    return built;
 }
 
-// Find a database by name
-DatabaseNode *find_database(DatabaseNode *head, const char *db_name)
+// The B+-tree of an ordered column, built on first use. Returns NULL for
+// columns that are not ordered or if memory runs out.
+BTree *find_ordered_index(Table *table, int colIndex)
 {
-    while (head != NULL)
+    if (!table->columns[colIndex].isOrdered)
     {
-        if (strcmp(head->db.name, db_name) == 0)
+        return NULL;
+    }
+
+    if (!table->orderedIndexes)
+    {
+        table->orderedIndexes = malloc(table->numColumns * sizeof(BTree));
+        if (!table->orderedIndexes)
+        {
+            return NULL;
+        }
+        for (int i = 0; i < table->numColumns; i++)
         {
-            return head;
+            btree_init(&table->orderedIndexes[i]);
         }
-        head = head->next;
     }
-    printf("Database not found\n");
-    return NULL;
+
+    if (!has_ordered_index(table, colIndex) && !build_ordered_index(table, colIndex))
+    {
+        return NULL;
+    }
+    return &table->orderedIndexes[colIndex];
+}
+
+int is_row_live(const Table *table, int slot)
+{
+    return !((table->deleted.bits[slot / 8] >> (slot % 8)) & 1);
 }
 
-void create_table(DatabaseNode *dbNode, const char *tableName)
+// Whether a snapshot sees the row in a slot: stored by a transaction it sees and
+// not yet expired for it. The deleted bit is read first and the expiry before
+// the creation stamp, the reverse of the order writers store them in, so a slot
+// reused meanwhile never passes for a row of the snapshot.
+int is_row_visible(const Table *table, int slot, uint64_t snapshot)
 {
-    // Allocate memory for the new TableNode
-    TableNode *newTableNode = malloc(sizeof(TableNode));
-    if (!newTableNode)
+    int deleted = (atomic_load_acquire(&table->deleted.bits[slot / 8]) >> (slot % 8)) & 1;
+    if (snapshot == TXN_LATEST)
     {
-        perror("Failed to allocate memory for TableNode");
-        return;
+        return !deleted;
     }
+    if (!table->expired.ints)
+    {
+        return !deleted;
+    }
+    uint64_t expired = (uint64_t)atomic_load_acquire(&table->expired.ints[slot]);
+    uint64_t created = (uint64_t)atomic_load_acquire(&table->created.ints[slot]);
+    if (created > snapshot)
+    {
+        return 0;
+    }
+    return expired == TXN_NONE ? !deleted : expired > snapshot;
+}
 
-    // Set table name and initialize with blank schema
-    strcpy(newTableNode->table.name, tableName);
-    newTableNode->table.numColumns = 0; // No columns yet
-    newTableNode->table.columns = NULL; // No column definitions
-    newTableNode->table.numRows = 0;    // No rows initially
-    newTableNode->table.rows = NULL;    // No row data
+int64_t row_id(const Table *table, int slot)
+{
+    return table->rowIds.ints[slot];
+}
 
-    // Add the new table to the database's table list
-    newTableNode->next = dbNode->db.tables;
-    dbNode->db.tables = newTableNode;
+// Released after the slot's stamps and values, see is_row_visible
+static void set_deleted(Table *table, int slot, int deleted)
+{
+    uint8_t bit = (uint8_t)(1u << (slot % 8));
+    if (deleted)
+    {
+        __atomic_fetch_or(&table->deleted.bits[slot / 8], bit, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        __atomic_fetch_and(&table->deleted.bits[slot / 8], (uint8_t)~bit, __ATOMIC_RELEASE);
+    }
+}
 
-    printw("Table '%s' created with a blank schema.\n", newTableNode->table.name);
-    write_all_databases_to_file(dbList, filename);
+// Stamp a slot as stored by the current transaction, before it is marked live
+static void stamp_created(Table *table, int slot)
+{
+    if (!table->expired.ints)
+    {
+        return; // No stamps yet, every slot has neither
+    }
+    table->created.ints[slot] = (int64_t)table->writeTxn;
+    atomic_store_release(&table->expired.ints[slot], TXN_NONE);
 }
 
-// Validate input value by column type
-int validate_value(const char *value, ColumnType type)
+// A changed table is written out in full by the next checkpoint and cannot be
+// evicted until then
+static void mark_changed(Table *table)
+{
+    table->dirty = 1;
+    if (table->writeTxn != TXN_NONE)
+    {
+        table->changedTxn = table->writeTxn;
+    }
+}
+
+// Make room for at least numSlots row slots in every per-slot array. The capacity
+// grows geometrically, so appending copies each value a constant number of times.
+static int reserve_slots(Table *table, int numSlots)
 {
-    char *endptr;
-    switch (type)
-    {
-    case INTEGER:
-        strtol(value, &endptr, 10);
-        return (*endptr == '\0');
-    case FLOAT:
-        strtof(value, &endptr);
-        return (*endptr == '\0');
-    case BOOLEAN:
-        return (strcmp(value, "true") == 0 || strcmp(value, "false") == 0);
-    case STRING:
+    if (numSlots <= table->capacity)
+    {
         return 1;
-    default:
-        return 0;
     }
+
+    int capacity = table->capacity ? table->capacity : ROW_MIN_CAPACITY;
+    while (capacity < numSlots)
+    {
+        capacity = capacity > INT_MAX / 2 ? numSlots : capacity * 2;
+    }
+
+    // A failure leaves some arrays larger than the capacity, which is harmless.
+    // Views retry while the count is odd, so they never mix old and new arrays.
+    __atomic_store_n(&table->resizes, table->resizes + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    int ok = column_data_resize(&table->rowIds, INTEGER, capacity) &&
+             column_data_resize(&table->deleted, BOOLEAN, capacity) &&
+             (!table->expired.ints || (column_data_resize(&table->created, INTEGER, capacity) &&
+                                       column_data_resize(&table->expired, INTEGER, capacity)));
+    for (int i = 0; ok && i < table->numColumns; i++)
+    {
+        ok = column_data_resize(&table->data[i], table->columns[i].type, capacity);
+    }
+    atomic_store_release(&table->resizes, table->resizes + 1);
+    if (ok)
+    {
+        table->capacity = capacity;
+    }
+    return ok;
 }
 
-// Check for unique values
-int is_value_unique(Table *table, int colIndex, const char *value)
+// Collect the deleted slots of a loaded table into the free list, lowest slot on
+// top. Slots still pending, with an expiry, are left for reclaim_row_versions.
+static int build_free_slots(Table *table)
 {
-    for (int i = 0; i < table->numRows; i++)
+    if (table->freeSlots || table->numDeleted == 0)
     {
-        if (strcmp(table->rows[i].values[colIndex], value) == 0)
+        return 1;
+    }
+
+    table->freeSlots = malloc(table->numDeleted * sizeof(int));
+    if (!table->freeSlots)
+    {
+        return 0;
+    }
+    table->freeCapacity = table->numDeleted;
+
+    int count = 0;
+    for (int i = table->numRows - 1; i >= 0 && count < table->freeCapacity; i--)
+    {
+        if (!is_row_live(table, i) && (!table->expired.ints || table->expired.ints[i] == TXN_NONE))
         {
-            return 0;
+            table->freeSlots[count++] = i;
         }
     }
+    table->numDeleted = count;
     return 1;
 }
 
-// Add a row to the table
-void add_row_to_table(DatabaseNode *dbNode, const char *table_name)
+static void push_free_slot(Table *table, int slot)
 {
-    TableNode *tableNode = dbNode->db.tables;
+    // An unbuilt list picks the slot up from the bitmap once it is built
+    if (!table->freeSlots && table->numDeleted > 0)
+    {
+        table->numDeleted++;
+        return;
+    }
 
-    while (tableNode && strcmp(tableNode->table.name, table_name) != 0)
+    if (table->numDeleted == table->freeCapacity)
     {
-        tableNode = tableNode->next;
+        int capacity = table->freeCapacity ? table->freeCapacity * 2 : 16;
+        int *slots = realloc(table->freeSlots, capacity * sizeof(int));
+        if (!slots)
+        {
+            // Fall back to rebuilding the list from the bitmap when it is next needed
+            free(table->freeSlots);
+            table->freeSlots = NULL;
+            table->freeCapacity = 0;
+            table->numDeleted++;
+            return;
+        }
+        table->freeSlots = slots;
+        table->freeCapacity = capacity;
+    }
+    table->freeSlots[table->numDeleted++] = slot;
+}
+
+// Returns a deleted slot to reuse, or -1 if there is none
+static int pop_free_slot(Table *table)
+{
+    if (table->numDeleted == 0 || !build_free_slots(table))
+    {
+        return -1;
+    }
+    return table->freeSlots[--table->numDeleted];
+}
+
+// Append a row with the next unused row id, see append_row_with_id
+int append_row(Table *table, const char *const *values)
+{
+    return append_row_with_id(table, values, -1);
+}
+
+// Store a row's values, id and stamps in a free slot, without indexing it.
+// Returns the slot, or -1 on failure.
+static int store_row(Table *table, const char *const *values, int64_t rowId)
+{
+    int slot = pop_free_slot(table);
+    int grown = slot < 0;
+    if (grown)
+    {
+        slot = table->numRows;
+        if (!reserve_slots(table, slot + 1))
+        {
+            return -1;
+        }
     }
 
-    if (!tableNode)
+    for (int i = 0; i < table->numColumns; i++)
     {
-        printw("Table '%s' not found in database '%s'.\n", table_name, dbNode->db.name);
+        Value value;
+        ColumnType type = table->columns[i].type;
+        if (!parse_value(values[i], type, &value) ||
+            !column_data_set(&table->data[i], type, slot, &value))
+        {
+            // Give a reused slot back, its old values stay unreachable behind the tombstone
+            if (!grown)
+            {
+                push_free_slot(table, slot);
+            }
+            return -1;
+        }
+    }
+
+    Value id;
+    id.type = INTEGER;
+    id.as.i = rowId;
+    column_data_set(&table->rowIds, INTEGER, slot, &id);
+    stamp_created(table, slot);
+    set_deleted(table, slot, 0);
+    if (grown)
+    {
+        atomic_store_release(&table->numRows, table->numRows + 1);
+    }
+    if (rowId >= table->nextRowId)
+    {
+        table->nextRowId = rowId + 1;
+    }
+    mark_changed(table);
+    return slot;
+}
+
+static void index_row(Table *table, int slot)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (is_indexed(table, i))
+        {
+            hash_index_insert(&table->indexes[i], table, i, slot);
+        }
+        if (has_ordered_index(table, i) && !btree_insert(&table->orderedIndexes[i], table, i, slot))
+        {
+            btree_free(&table->orderedIndexes[i]); // Rebuilt on next use
+        }
+    }
+    if (table->rowIdMap.entries && !row_id_map_put(&table->rowIdMap, row_id(table, slot), slot))
+    {
+        row_id_map_free(&table->rowIdMap); // Rebuilt on the next lookup
+    }
+}
+
+static void unindex_row(Table *table, int slot)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (is_indexed(table, i))
+        {
+            hash_index_remove(&table->indexes[i], table, i, slot);
+        }
+        if (has_ordered_index(table, i))
+        {
+            btree_remove(&table->orderedIndexes[i], table, i, slot);
+        }
+    }
+    row_id_map_remove(&table->rowIdMap, row_id(table, slot));
+}
+
+// Queue a deleted slot until no snapshot can read it. Without the memory the
+// slot is only reclaimed by compaction.
+static void push_pending(Table *table, int slot)
+{
+    table->numPending++;
+    if (table->pendingEnd == table->pendingCapacity && table->pendingStart > 0)
+    {
+        // Drop the reclaimed slots at the front before growing
+        int count = table->pendingEnd - table->pendingStart;
+        memmove(table->pending, table->pending + table->pendingStart, count * sizeof(int));
+        table->pendingStart = 0;
+        table->pendingEnd = count;
+    }
+    if (table->pendingEnd == table->pendingCapacity)
+    {
+        int capacity = table->pendingCapacity ? table->pendingCapacity * 2 : 16;
+        int *pending = realloc(table->pending, capacity * sizeof(int));
+        if (!pending)
+        {
+            return;
+        }
+        table->pending = pending;
+        table->pendingCapacity = capacity;
+    }
+    table->pending[table->pendingEnd++] = slot;
+}
+
+// Count the strings of a slot no row refers to anymore as heap garbage. The
+// strings of dictionary encoded columns are shared and stay in use.
+static void discard_strings(Table *table, int slot)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (table->columns[i].type == STRING && !table->data[i].dictionary)
+        {
+            table->data[i].heapGarbage += strlen(cell_string(table, slot, i)) + 1;
+        }
+    }
+}
+
+// Mark a slot's row deleted. Inside a transaction its version expires, and the
+// slot is only reused once the snapshots that still see it are gone.
+static void release_slot(Table *table, int slot)
+{
+    if (table->writeTxn == TXN_NONE)
+    {
+        set_deleted(table, slot, 1);
+        discard_strings(table, slot);
+        push_free_slot(table, slot);
+        mark_changed(table);
         return;
     }
+    atomic_store_release(&table->expired.ints[slot], (int64_t)table->writeTxn);
+    set_deleted(table, slot, 1);
+    push_pending(table, slot);
+    mark_changed(table);
+}
 
-    Table *table = &tableNode->table;
-    Row newRow;
-    newRow.values = malloc(table->numColumns * sizeof(char *));
+// Move the slots of versions that expired at or before the horizon, the oldest
+// snapshot still registered, from the pending queue to the free list
+void reclaim_row_versions(Table *table, uint64_t horizon)
+{
+    while (table->pendingStart < table->pendingEnd)
+    {
+        int slot = table->pending[table->pendingStart];
+        if ((uint64_t)table->expired.ints[slot] > horizon)
+        {
+            break;
+        }
+        // The slot stays deleted, so clearing its expiry hides it from every snapshot
+        atomic_store_release(&table->expired.ints[slot], TXN_NONE);
+        table->pendingStart++;
+        table->numPending--;
+        discard_strings(table, slot);
+        push_free_slot(table, slot);
+    }
+}
+
+// Store a row from the text form of its values, which must already be validated.
+// Deleted slots are reused before the table grows. A negative rowId assigns the
+// next unused id. Returns the slot holding the row, or -1 on failure.
+int append_row_with_id(Table *table, const char *const *values, int64_t rowId)
+{
+    int slot = store_row(table, values, rowId < 0 ? table->nextRowId : rowId);
+    if (slot >= 0)
+    {
+        index_row(table, slot);
+    }
+    return slot;
+}
+
+// Check the values a batch holds for a unique column against the table and each other
+static int is_batch_unique(Table *table, int colIndex, const char *const *values, size_t nrows)
+{
+    size_t capacity = ROW_MIN_CAPACITY;
+    while (capacity < nrows * 2)
+    {
+        capacity *= 2;
+    }
+
+    // Open-addressing set of batch rows, keyed by their parsed values
+    Value *keys = malloc(nrows * sizeof(Value));
+    int *seen = malloc(capacity * sizeof(int));
+    if (!keys || !seen)
+    {
+        free(keys);
+        free(seen);
+        return 0;
+    }
+    for (size_t i = 0; i < capacity; i++)
+    {
+        seen[i] = -1;
+    }
+
+    int unique = 1;
+    for (size_t r = 0; r < nrows && unique; r++)
+    {
+        const char *value = values[r * table->numColumns + colIndex];
+        if (find_row_by_value(table, colIndex, value) >= 0)
+        {
+            unique = 0;
+            break;
+        }
+
+        parse_value(value, table->columns[colIndex].type, &keys[r]);
+        size_t at = hash_key(&keys[r]) & (capacity - 1);
+        while (seen[at] >= 0)
+        {
+            if (value_equals(&keys[seen[at]], &keys[r]))
+            {
+                unique = 0;
+                break;
+            }
+            at = (at + 1) & (capacity - 1);
+        }
+        seen[at] = (int)r;
+    }
+
+    free(keys);
+    free(seen);
+    return unique;
+}
+
+// Insert a batch of rows from the text form of their values, nrows * numColumns
+// values in row order. Every value is validated and unique columns are checked
+// against the table and the rest of the batch before anything is stored, so the
+// batch is inserted as a whole or not at all. The rows get consecutive ids,
+// starting at the table's nextRowId. Returns 1 on success, 0 if a value is invalid or not unique
+// and -1 if the table cannot grow.
+int insert_rows(Table *table, const char *const *values, size_t nrows)
+{
+    if (nrows == 0)
+    {
+        return 1;
+    }
     if (table->numColumns == 0)
     {
-        printw("Schema not defined\n");
-        return;
+        return 0;
+    }
+    if (nrows > (size_t)(INT_MAX - table->numRows))
+    {
+        return -1;
+    }
+
+    for (size_t r = 0; r < nrows; r++)
+    {
+        for (int i = 0; i < table->numColumns; i++)
+        {
+            if (!validate_value(values[r * table->numColumns + i], table->columns[i].type))
+            {
+                return 0;
+            }
+        }
     }
     for (int i = 0; i < table->numColumns; i++)
     {
-        char input[MAX_INPUT];
-        Column currentColumn = table->columns[i];
+        if (table->columns[i].isUnique && !is_batch_unique(table, i, values, nrows))
+        {
+            return 0;
+        }
+    }
 
-        while (1)
+    // Grow once for the rows that do not fit in deleted slots
+    size_t appended = nrows > (size_t)table->numDeleted ? nrows - table->numDeleted : 0;
+    int *slots = malloc(nrows * sizeof(int));
+    if (!slots || !reserve_slots(table, table->numRows + (int)appended))
+    {
+        free(slots);
+        return -1;
+    }
+
+    for (size_t r = 0; r < nrows; r++)
+    {
+        slots[r] = append_row(table, values + r * table->numColumns);
+        if (slots[r] < 0)
         {
-            printw("Enter value for %s: ", currentColumn.name);
-            getstr(input);
+            // Out of memory for a string, take back the rows already stored
+            while (r-- > 0)
+            {
+                remove_row(table, slots[r]);
+            }
+            free(slots);
+            return -1;
+        }
+    }
+
+    free(slots);
+    return 1;
+}
 
-            if (!validate_value(input, currentColumn.type))
+// Delete the row in a slot by marking it as a tombstone, returns 0 for a bad or deleted slot.
+// The slot's values stay in place until it is reused or the table is compacted.
+int remove_row(Table *table, int slot)
+{
+    if (slot < 0 || slot >= table->numRows || !is_row_live(table, slot))
+    {
+        return 0;
+    }
+
+    unindex_row(table, slot);
+    release_slot(table, slot);
+    return 1;
+}
+
+// Replace a live row's values, NULL entries keep the current value. Inside a
+// transaction the row gets a new version in another slot and the old one
+// expires, so snapshots keep reading the old values; otherwise the values are
+// replaced in place. Returns the slot now holding the row, or -1 if memory ran
+// out, in which case an update in place may have stored some of the values.
+int update_row(Table *table, int slot, const char *const *values)
+{
+    if (table->writeTxn == TXN_NONE)
+    {
+        int stored = 1;
+        for (int i = 0; i < table->numColumns; i++)
+        {
+            if (values[i] && !replace_row_value(table, slot, i, values[i]))
             {
-                printw("Invalid value for %s. Try again.\n", currentColumn.name);
-                continue;
+                stored = 0;
             }
-            if (currentColumn.isUnique && !is_value_unique(table, i, input))
+        }
+        return stored ? slot : -1;
+    }
+
+    // Values are tokens shorter than MAX_INPUT, so their text always fits
+    char(*kept)[MAX_INPUT] = malloc((table->numColumns > 0 ? table->numColumns : 1) * sizeof(*kept));
+    const char **row = malloc((table->numColumns > 0 ? table->numColumns : 1) * sizeof(char *));
+    if (!kept || !row)
+    {
+        free(kept);
+        free(row);
+        return -1;
+    }
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (!values[i])
+        {
+            format_cell(table, slot, i, kept[i], MAX_INPUT);
+        }
+        row[i] = values[i] ? values[i] : kept[i];
+    }
+
+    int version = store_row(table, row, row_id(table, slot));
+    free(kept);
+    free(row);
+    if (version < 0)
+    {
+        return -1;
+    }
+    unindex_row(table, slot);
+    release_slot(table, slot);
+    index_row(table, version);
+    return version;
+}
+
+// Find the slot holding a row id, returns -1 if no live row has it
+int find_row_slot(Table *table, int64_t rowId)
+{
+    // Built on first use, keeping startup free of per-row work
+    if (!table->rowIdMap.entries && table->numRows > 0)
+    {
+        for (int i = 0; i < table->numRows; i++)
+        {
+            if (is_row_live(table, i) && !row_id_map_put(&table->rowIdMap, row_id(table, i), i))
             {
-                printw("Value for %s must be unique. Try again.\n", currentColumn.name);
-                continue;
+                row_id_map_free(&table->rowIdMap);
+                break;
             }
+        }
+    }
 
-            break;
+    if (table->rowIdMap.entries)
+    {
+        return row_id_map_get(&table->rowIdMap, rowId);
+    }
+
+    for (int i = 0; i < table->numRows; i++)
+    {
+        if (is_row_live(table, i) && row_id(table, i) == rowId)
+        {
+            return i;
         }
+    }
+    return -1;
+}
 
-        newRow.values[i] = strdup(input);
+// Number the table's slots 0 to numRows - 1 as live rows, for data read without row ids
+int reset_row_ids(Table *table)
+{
+    if (!column_data_resize(&table->rowIds, INTEGER, table->capacity) ||
+        !column_data_resize(&table->deleted, BOOLEAN, table->capacity) ||
+        !column_data_fill_default(&table->deleted, BOOLEAN, 0, table->numRows))
+    {
+        return 0;
+    }
+    for (int i = 0; i < table->numRows; i++)
+    {
+        table->rowIds.ints[i] = i;
     }
 
-    table->rows = realloc(table->rows, (table->numRows + 1) * sizeof(Row));
-    table->rows[table->numRows] = newRow;
-    table->numRows++;
-    printw("Row added to table '%s'.\n", table_name);
+    table->nextRowId = table->numRows;
+    table->numDeleted = 0;
+    free(table->freeSlots);
+    table->freeSlots = NULL;
+    table->freeCapacity = 0;
+    row_id_map_free(&table->rowIdMap);
+    return 1;
 }
 
-// List all rows in a table
-void list_rows_in_table(DatabaseNode *dbNode, const char *table_name)
+// Give a table version stamps before its first versioned change. Rows stored
+// until then have neither stamp, and loading a table never allocates them.
+// Views taken before read a copy of the bitmap without the stamps, which the
+// writer no longer changes, so they keep seeing the rows as they were.
+int reserve_row_versions(Table *table)
 {
-    TableNode *tableNode = dbNode->db.tables;
+    if (table->expired.ints)
+    {
+        return 1;
+    }
 
-    while (tableNode && strcmp(tableNode->table.name, table_name) != 0)
+    size_t slots = table->capacity > 0 ? (size_t)table->capacity : 1;
+    int64_t *created = calloc(slots, sizeof(int64_t));
+    int64_t *expired = calloc(slots, sizeof(int64_t));
+    if (!created || !expired)
     {
-        tableNode = tableNode->next;
+        free(created);
+        free(expired);
+        return 0;
     }
 
-    if (!tableNode)
+    __atomic_store_n(&table->resizes, table->resizes + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    int copied = column_data_resize(&table->deleted, BOOLEAN, table->capacity);
+    if (copied)
     {
-        printw("Table '%s' not found in database '%s'.\n", table_name, dbNode->db.name);
-        return;
+        table->created.arrayBytes = table->expired.arrayBytes = slots * sizeof(int64_t);
+        atomic_store_release(&table->created.ints, created);
+        atomic_store_release(&table->expired.ints, expired);
+    }
+    atomic_store_release(&table->resizes, table->resizes + 1);
+    if (!copied)
+    {
+        free(created);
+        free(expired);
     }
+    return copied;
+}
 
-    Table *table = &tableNode->table;
-    if (table->numColumns == 0)
+// Drop the stamps and the pending queue once no snapshot can need them
+static void reset_row_versions(Table *table)
+{
+    column_data_free(&table->created);
+    column_data_free(&table->expired);
+    table->pendingStart = 0;
+    table->pendingEnd = 0;
+    table->numPending = 0;
+}
+
+// Take back the changes a rolled back transaction made to a table: versions it
+// stored expire, and versions it expired are current again. Both keep its
+// stamps, so snapshots before it still read the old versions and those after
+// it, once it is published, see neither change.
+void rollback_row_versions(Table *table, uint64_t txn)
+{
+    if (!table->expired.ints || table->changedTxn != txn)
     {
-        printw("Table empty\n");
         return;
     }
 
-    // Print index column header
-    printw("(index)\t");
+    // Stored versions leave the indexes first, so the restored ones never collide with them
+    for (int slot = 0; slot < table->numRows; slot++)
+    {
+        if ((uint64_t)table->created.ints[slot] == txn && is_row_live(table, slot))
+        {
+            unindex_row(table, slot);
+            release_slot(table, slot);
+        }
+    }
+
+    // A restored version never expires rather than expiring at TXN_NONE: that
+    // is stored before its deleted bit is cleared, and a snapshot reading
+    // between the two would see it as neither deleted nor expired later
+    for (int slot = 0; slot < table->numRows; slot++)
+    {
+        if ((uint64_t)table->expired.ints[slot] == txn && (uint64_t)table->created.ints[slot] != txn)
+        {
+            atomic_store_release(&table->expired.ints[slot], TXN_NEVER);
+            set_deleted(table, slot, 0);
+            table->numPending--;
+            index_row(table, slot);
+        }
+    }
+
+    int kept = table->pendingStart;
+    for (int i = table->pendingStart; i < table->pendingEnd; i++)
+    {
+        if (table->expired.ints[table->pending[i]] != TXN_NEVER)
+        {
+            table->pending[kept++] = table->pending[i];
+        }
+    }
+    table->pendingEnd = kept;
+}
+
+// Copy what a snapshot reader needs of a table: its schema, slot count and
+// array pointers. The view has no indexes, it can only be scanned.
+void table_view(const Table *table, Table *view, ColumnData *data)
+{
+    memset(view, 0, sizeof(*view));
+    memcpy(view->name, table->name, sizeof(view->name));
+    view->columns = table->columns;
+    view->numColumns = table->numColumns;
+    view->data = data;
+
+    // Slots stored after a resize only reach the new arrays, so a view whose
+    // bitmap is newer than its stamps could see them with stale stamps
+    unsigned resizes;
+    do
+    {
+        resizes = atomic_load_acquire(&table->resizes);
+        view->numRows = atomic_load_acquire(&table->numRows);
+        for (int i = 0; i < table->numColumns; i++)
+        {
+            column_data_view(&table->data[i], &data[i]);
+        }
+        column_data_view(&table->rowIds, &view->rowIds);
+        column_data_view(&table->deleted, &view->deleted);
+        column_data_view(&table->created, &view->created);
+        column_data_view(&table->expired, &view->expired);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((resizes & 1) || __atomic_load_n(&table->resizes, __ATOMIC_RELAXED) != resizes);
+    view->nextRowId = table->nextRowId;
+}
 
-    // Print table headers
+// Rebuild the string heaps holding garbage, keeping the strings of live rows and
+// of the old versions snapshots may still read. Readers must be locked out.
+static void compact_string_heaps(Table *table)
+{
+    uint8_t *keep = NULL;
     for (int i = 0; i < table->numColumns; i++)
     {
-        printw("%s\t", table->columns[i].name);
+        if (table->columns[i].type != STRING || table->data[i].heapGarbage == 0)
+        {
+            continue;
+        }
+        if (!keep)
+        {
+            keep = calloc((table->numRows + 8) / 8, 1);
+            if (!keep)
+            {
+                return;
+            }
+            for (int slot = 0; slot < table->numRows; slot++)
+            {
+                if (is_row_live(table, slot) || (table->expired.ints && table->expired.ints[slot] != TXN_NONE))
+                {
+                    keep[slot / 8] |= (uint8_t)(1u << (slot % 8));
+                }
+            }
+        }
+        column_data_compact_heap(&table->data[i], keep, table->numRows);
     }
-    printw("\n");
+    if (keep)
+    {
+        table->compactions++;
+        mark_changed(table);
+    }
+    free(keep);
+}
 
-    // Print table rows with index
-    for (int i = 0; i < table->numRows; i++)
+// Whether a checkpoint should rebuild the table's string heaps, once more
+// than 1/COMPACT_RATIO of one is garbage
+static int has_sparse_heap(const Table *table)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        const ColumnData *data = &table->data[i];
+        if (table->columns[i].type == STRING && data->heapGarbage * COMPACT_RATIO > data->heapSize)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Drop the deleted slots, moving the live rows down in their current order, and
+// release the unused capacity. The string heaps are rebuilt without the values
+// no row refers to anymore. Rows keep their ids, only their slots change.
+// Returns the number of slots reclaimed.
+int compact_table(Table *table)
+{
+    if (table->numDeleted + table->numPending == 0)
     {
-        printw("%d\t", i); // Add index (starting from 1)
+        compact_string_heaps(table);
+        return 0;
+    }
 
-        for (int j = 0; j < table->numColumns; j++)
+    const uint8_t *deleted = table->deleted.bits;
+    int kept = column_data_compact(&table->rowIds, INTEGER, deleted, table->numRows);
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        column_data_compact(&table->data[i], table->columns[i].type, deleted, table->numRows);
+        if (table->columns[i].type == STRING)
         {
-            printw("%s\t", table->rows[i].values[j]);
+            column_data_compact_heap(&table->data[i], NULL, kept);
         }
-        printw("\n");
     }
+    table->compactions++;
+    mark_changed(table);
+    column_data_resize(&table->deleted, BOOLEAN, kept);
+    column_data_fill_default(&table->deleted, BOOLEAN, 0, kept);
+
+    int reclaimed = table->numRows - kept;
+    table->numRows = kept;
+    table->capacity = kept;
+    table->numDeleted = 0;
+    free(table->freeSlots);
+    table->freeSlots = NULL;
+    table->freeCapacity = 0;
+
+    // No snapshot outlives a compaction, so every kept row becomes a loaded one
+    reset_row_versions(table);
+
+    // Slots moved, both are rebuilt on first use
+    drop_indexes(table);
+    row_id_map_free(&table->rowIdMap);
+    return reclaimed;
 }
 
-void delete_row_from_table(DatabaseNode *dbNode, const char *table_name, int rowIndex)
+// Compact every table whose deleted slots or heap garbage passed the COMPACT_RATIO share
+void compact_sparse_tables(Catalog *catalog)
 {
+    for (DatabaseNode *node = catalog->databases; node; node = node->next)
+    {
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
+        {
+            Table *table = &tableNode->table;
+            if (table->unloaded)
+            {
+                continue; // Stored as it was last compacted
+            }
+            if ((int64_t)(table->numDeleted + table->numPending) * COMPACT_RATIO > table->numRows)
+            {
+                compact_table(table);
+            }
+            else if (has_sparse_heap(table))
+            {
+                compact_string_heaps(table);
+            }
+        }
+    }
+}
 
-    TableNode *tableNode = dbNode->db.tables;
-    while (tableNode != NULL && strcmp(tableNode->table.name, table_name) != 0)
+static void add_column_memory(const ColumnData *data, ColumnType type, TableMemory *memory)
+{
+    size_t bytes = column_data_bytes(data, type);
+    if (data->mapped)
+    {
+        memory->mappedBytes += bytes;
+    }
+    else
+    {
+        memory->storageBytes += bytes;
+    }
+    memory->garbageBytes += data->heapGarbage;
+    memory->allocations += data->allocations;
+}
+
+// Measure the memory a table holds, called with the table latched
+void table_memory(const Table *table, TableMemory *memory)
+{
+    memset(memory, 0, sizeof(TableMemory));
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        add_column_memory(&table->data[i], table->columns[i].type, memory);
+        if (table->indexes)
+        {
+            memory->indexBytes += table->indexes[i].capacity * sizeof(HashEntry);
+        }
+        if (table->orderedIndexes)
+        {
+            memory->indexBytes += table->orderedIndexes[i].bytes;
+        }
+    }
+    add_column_memory(&table->rowIds, INTEGER, memory);
+    add_column_memory(&table->deleted, BOOLEAN, memory);
+    add_column_memory(&table->created, INTEGER, memory);
+    add_column_memory(&table->expired, INTEGER, memory);
+    memory->storageBytes += (table->freeCapacity + table->pendingCapacity) * sizeof(int);
+    memory->indexBytes += table->rowIdMap.capacity * sizeof(RowIdEntry);
+    memory->compactions = table->compactions;
+    memory->loads = table->loads;
+}
+
+// Memory evicting the table would give back, mapped pages included since they
+// stay resident once read
+size_t table_resident_bytes(const Table *table)
+{
+    TableMemory memory;
+    table_memory(table, &memory);
+    return memory.storageBytes + memory.mappedBytes + memory.indexBytes;
+}
+
+// Overwrite a single cell of an existing row from the text form of the value
+int replace_row_value(Table *table, int slot, int colIndex, const char *value)
+{
+    Value parsed;
+    ColumnType type = table->columns[colIndex].type;
+    if (!parse_value(value, type, &parsed))
     {
-        tableNode = tableNode->next;
+        return 0;
     }
 
-    if (tableNode == NULL)
+    int indexed = is_indexed(table, colIndex);
+    int ordered = is_row_live(table, slot) && has_ordered_index(table, colIndex);
+    if (indexed)
     {
-        printw("Table '%s' not found.\n", table_name);
-        return;
+        hash_index_remove(&table->indexes[colIndex], table, colIndex, slot);
     }
-
-    Table *table = &tableNode->table;
-
-    if (rowIndex < 0 || rowIndex >= table->numRows)
+    if (ordered)
     {
-        printw("Invalid row index: %d\n", rowIndex);
-        return;
+        btree_remove(&table->orderedIndexes[colIndex], table, colIndex, slot);
     }
 
-    for (int i = 0; i < table->numColumns; i++)
+    if (type == STRING && !table->data[colIndex].dictionary)
     {
-        free(table->rows[rowIndex].values[i]);
+        table->data[colIndex].heapGarbage += strlen(cell_string(table, slot, colIndex)) + 1;
     }
-    free(table->rows[rowIndex].values);
+    int stored = column_data_set(&table->data[colIndex], type, slot, &parsed);
+    mark_changed(table);
 
-    for (int i = rowIndex; i < table->numRows - 1; i++)
+    if (indexed)
     {
-        table->rows[i] = table->rows[i + 1];
+        hash_index_insert(&table->indexes[colIndex], table, colIndex, slot);
     }
-
-    table->numRows--;
-
-    table->rows = realloc(table->rows, table->numRows * sizeof(Row));
-
-    if (table->numRows > 0 && table->rows == NULL)
+    if (ordered && !btree_insert(&table->orderedIndexes[colIndex], table, colIndex, slot))
     {
-        printw("Memory reallocation failed.\n");
-        return;
+        btree_free(&table->orderedIndexes[colIndex]); // Rebuilt on next use
     }
-
-    printw("Row %d deleted successfully from table '%s'.\n", rowIndex, table_name);
-    write_all_databases_to_file(dbList, filename);
+    return stored;
 }
 
-void update_row(DatabaseNode *dbNode, const char *table_name, int rowIndex)
+// Free everything a table holds except its latch and where it is stored
+static void free_table_data(Table *table)
 {
-    TableNode *tableNode = dbNode->db.tables;
-
-    while (tableNode && strcmp(tableNode->table.name, table_name) != 0)
+    if (table->data)
     {
-        tableNode = tableNode->next;
+        for (int i = 0; i < table->numColumns; i++)
+        {
+            column_data_free(&table->data[i]);
+        }
+        free(table->data);
     }
 
-    if (!tableNode)
-    {
-        printw("Table '%s' not found in database '%s'.\n", table_name, dbNode->db.name);
-        return;
-    }
+    drop_indexes(table);
+    free(table->columns);
 
-    Table *table = &tableNode->table;
+    column_data_free(&table->rowIds);
+    column_data_free(&table->deleted);
+    column_data_free(&table->created);
+    column_data_free(&table->expired);
+    free(table->freeSlots);
+    free(table->pending);
+    row_id_map_free(&table->rowIdMap);
+    segment_unuse(table->source);
+}
 
-    if (rowIndex < 0 || rowIndex >= table->numRows)
+void free_table(Table *table)
+{
+    free_table_data(table);
+    segment_unuse(table->stored);
+    mutex_destroy(&table->latch);
+}
+
+// Free a table's columns and rows, leaving it to be read again from where it
+// is stored on next use. Nothing may use the table meanwhile.
+void unload_table(Table *table)
+{
+    char name[sizeof(table->name)];
+    memcpy(name, table->name, sizeof(name));
+    int64_t compactions = table->compactions;
+
+    free_table_data(table);
+    memset(table, 0, offsetof(Table, latch));
+    memcpy(table->name, name, sizeof(name));
+    table->compactions = compactions;
+    table->source = NULL;
+    table->dirty = 0;
+    atomic_store_release(&table->unloaded, 1);
+}
+
+// Read the table in if it is stored but not loaded and note the use, returns
+// NULL if it cannot be read
+Table *use_table(TableNode *tableNode)
+{
+    Table *table = &tableNode->table;
+    if (atomic_load_acquire(&table->unloaded) && !segment_read_table(table))
     {
-        printw("Row index %d is out of range for table '%s'.\n", rowIndex, table_name);
-        return;
+        return NULL;
     }
+    __atomic_store_n(&table->lastUsed, __atomic_add_fetch(&useClock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    return table;
+}
 
-    Row *row = &table->rows[rowIndex];
-    char input[MAX_INPUT];
-    for (int i = 0; i < table->numColumns; i++)
+// Unload the least recently used tables until the loaded ones fit in budget
+// bytes, or only changed ones are left. The caller holds the writer and has
+// readers locked out. Returns the number of tables evicted.
+int evict_cold_tables(Catalog *catalog, size_t budget)
+{
+    size_t resident = 0;
+    for (DatabaseNode *node = catalog->databases; node; node = node->next)
     {
-        Column column = table->columns[i];
-        printw("Current value for %s (index %d): %s\n", column.name, i, row->values[i]);
-        while (1)
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
         {
-            printw("Enter new value for %s: ", column.name);
-            getstr(input);
-
-            if (!validate_value(input, column.type))
+            if (!tableNode->table.unloaded)
             {
-                printw("Invalid value for %s. Try again.\n", column.name);
-                continue;
+                resident += table_resident_bytes(&tableNode->table);
             }
+        }
+    }
 
-            if (column.isUnique && !is_value_unique(table, i, input) && strcmp(input, row->values[i]))
+    int evicted = 0;
+    while (resident > budget)
+    {
+        Table *coldest = NULL;
+        for (DatabaseNode *node = catalog->databases; node; node = node->next)
+        {
+            for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
             {
-                printw("Value for %s must be unique. Try again.\n", column.name);
-                continue;
+                Table *table = &tableNode->table;
+                if (!table->unloaded && table->stored && !table->dirty &&
+                    (!coldest || table->lastUsed < coldest->lastUsed))
+                {
+                    coldest = table;
+                }
             }
-
-            free(row->values[i]);
-            row->values[i] = strdup(input);
+        }
+        if (!coldest)
+        {
             break;
         }
+        resident -= table_resident_bytes(coldest);
+        unload_table(coldest);
+        evicted++;
     }
 
-    printw("Row %d updated in table '%s'.\n", rowIndex, table_name);
-    write_all_databases_to_file(dbList, filename);
-}
-
-void free_table(Table *table)
-{
-    for (int i = 0; i < table->numRows; i++)
+    if (evicted > 0)
     {
-        for (int j = 0; j < table->numColumns; j++)
-        {
-            free(table->rows[i].values[j]);
-        }
-        free(table->rows[i].values);
+        segment_release_unused(catalog);
     }
-    free(table->rows);
-
-    free(table->columns);
+    return evicted;
 }
 
-int list_tables(DatabaseNode *dbNode, const char **choices)
+// Fill names with up to max_names table names in listing order, returns how many
+int list_tables(DatabaseNode *dbNode, const char *names[], int max_names)
 {
-    if (!dbNode)
-    {
-        printf("No database provided.\n");
-        return -1;
-    }
-
     TableNode *current = dbNode->db.tables;
     int count = 0;
 
-    while (current)
+    while (current && count < max_names)
     {
-        if (count < 50)
-        {
-            choices[count] = current->table.name;
-            count++;
-        }
+        names[count] = current->table.name;
+        count++;
         current = current->next;
     }
 
-    choices[count++] = "Go Back";
     return count;
 }
 
-// Function to delete a table from the database
-void delete_table(DatabaseNode *dbNode, const char *table_name)
+// Unlink and free a table, returns 0 if it does not exist
+int remove_table(DatabaseNode *dbNode, const char *table_name)
 {
-    TableNode *current = dbNode->db.tables;
-    TableNode *previous = NULL;
-
-    // Find the table to delete
-    while (current && strcmp(current->table.name, table_name) != 0)
-    {
-        previous = current;
-        current = current->next;
-    }
-
+    // Remove the table node from the catalog
+    TableNode *current = catalog_unlink_table(dbNode, table_name, NULL);
     if (!current)
     {
-        printf("Table '%s' not found in database '%s'.\n", table_name, dbNode->db.name);
-        return;
-    }
-
-    // Remove the table node from the linked list
-    if (previous)
-    {
-        previous->next = current->next;
-    }
-    else
-    {
-        dbNode->db.tables = current->next;
+        return 0;
     }
 
     // Free memory of the table
     free_table(&current->table);
     free(current);
-
-    printf("Table '%s' deleted from database '%s'.\n", table_name, dbNode->db.name);
-    write_all_databases_to_file(dbList, filename);
+    return 1;
 }
 
-// Function to write a table and its schema to a file
+// Function to write a table and its schema to a text file
 void write_table(FILE *file, Table *table)
 {
-    // Write table name, number of columns, and number of rows
-    fprintf(file, "%s %d %d\n", table->name, table->numColumns, table->numRows);
+    // Write table name, number of columns, and number of live rows
+    fprintf(file, "%s %d %d\n", table->name, table->numColumns, table->numRows - table->numDeleted - table->numPending);
 
     // Write column definitions (schema)
     for (int i = 0; i < table->numColumns; i++)
     {
-        fprintf(file, "%s %d %d\n", table->columns[i].name, table->columns[i].type, table->columns[i].isUnique);
+        fprintf(file, "%s %d %d\n", table->columns[i].name, table->columns[i].type, column_flags(&table->columns[i]));
     }
 
-    // Write rows of data
+    // Write rows of data, the text format has no row ids so deleted rows are left out
+    char value[MAX_INPUT];
     for (int i = 0; i < table->numRows; i++)
     {
+        if (!is_row_live(table, i))
+        {
+            continue;
+        }
         for (int j = 0; j < table->numColumns; j++)
         {
-            fprintf(file, "%s ", table->rows[i].values[j]);
+            format_cell(table, i, j, value, sizeof(value));
+            fprintf(file, "%s ", value);
         }
         fprintf(file, "\n"); // New line for each row
     }
@@ -456,7 +1393,11 @@ void write_database_to_file(DatabaseNode *dbNode, FILE *file)
     TableNode *tableNode = dbNode->db.tables;
     while (tableNode)
     {
-        write_table(file, &tableNode->table);
+        Table *table = use_table(tableNode);
+        if (table)
+        {
+            write_table(file, table);
+        }
         tableNode = tableNode->next;
     }
 
@@ -464,37 +1405,135 @@ void write_database_to_file(DatabaseNode *dbNode, FILE *file)
     fprintf(file, "END_DB\n");
 }
 
-void write_all_databases_to_file(DatabaseNode *dbList, const char *filename)
+// Write every database in the readable text format
+int export_databases_to_text(Catalog *catalog, const char *filename)
 {
     FILE *file = fopen(filename, "w");
     if (!file)
     {
-        perror("Failed to open file");
-        return;
+        return 0;
     }
 
-    DatabaseNode *currentNode = dbList;
+    DatabaseNode *currentNode = catalog->databases;
     while (currentNode)
     {
         write_database_to_file(currentNode, file);
         currentNode = currentNode->next;
     }
 
-    fclose(file);
-    printw("All databases written to file '%s'.\n", filename);
+    return fclose(file) == 0;
+}
+
+// Flush a file's buffer and wait until its contents are on disk
+int sync_file(FILE *file)
+{
+    if (fflush(file) != 0)
+    {
+        return 0;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Make a rename in a file's directory survive a crash. Windows has no
+// directory handles to sync, a replaced file is durable once written there.
+int sync_directory(const char *filename)
+{
+#ifdef _WIN32
+    (void)filename;
+    return 1;
+#else
+    char directory[FILENAME_MAX];
+    snprintf(directory, sizeof(directory), "%s", filename);
+    char *slash = strrchr(directory, '/');
+    if (slash)
+    {
+        slash[slash == directory] = '\0';
+    }
+    else
+    {
+        snprintf(directory, sizeof(directory), ".");
+    }
+
+    int fd = open(directory, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    int synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+#endif
+}
+
+// Write every database to the binary snapshot file and the changed tables to
+// their own files next to it, returns 0 on failure
+int write_all_databases_to_file(Catalog *catalog, const char *filename)
+{
+    // Write into a temporary file first so a failed write never leaves a truncated snapshot
+    char tmpFilename[FILENAME_MAX];
+    snprintf(tmpFilename, sizeof(tmpFilename), "%s.tmp", filename);
+
+    if (!segment_write(catalog, tmpFilename))
+    {
+        remove(tmpFilename);
+        return 0;
+    }
+
+#ifdef _WIN32
+    remove(filename);
+#endif
+    if (rename(tmpFilename, filename) != 0)
+    {
+        return 0;
+    }
+
+    // Old table files are only deleted once the new snapshot is sure to be found
+    if (!sync_directory(filename))
+    {
+        return 0;
+    }
+    segment_rebind(catalog, filename);
+    return 1;
+}
+
+// Load databases from a binary snapshot, or parse them from the legacy text format.
+// Returns 0 if the file could not be read completely.
+int read_database_from_file(const char *filename, Catalog *catalog, int *defaulted)
+{
+    if (segment_is_binary(filename))
+    {
+        return segment_load(filename, catalog);
+    }
+
+    return read_text_database(filename, catalog, defaulted);
+}
+
+// Convert a text database file into a binary snapshot
+int convert_text_database(const char *textFilename, const char *binaryFilename)
+{
+    Catalog databases;
+    catalog_init(&databases);
+
+    int converted = read_text_database(textFilename, &databases, NULL) &&
+                    segment_write(&databases, binaryFilename);
+    free_databases(&databases);
+    return converted;
 }
 
-void read_database_from_file(const char *filename, DatabaseNode **dbList)
+// Parse the text format written by write_table, returns 0 if the file is missing or damaged.
+// defaulted, unless NULL, counts the values that did not parse and were loaded as defaults.
+int read_text_database(const char *filename, Catalog *catalog, int *defaulted)
 {
     FILE *file = fopen(filename, "r");
     if (!file)
     {
-        perror("Failed to open file");
-        return;
+        return 0;
     }
 
-    DatabaseNode *lastDbNode = NULL;
-
     while (1)
     {
         // Read the database name
@@ -503,41 +1542,19 @@ void read_database_from_file(const char *filename, DatabaseNode **dbList)
         {
             if (feof(file))
                 break; // End of file
-            perror("Failed to read database name");
             fclose(file);
-            return;
+            return 0;
         }
 
-        // Create a new DatabaseNode
-        DatabaseNode *dbNode = malloc(sizeof(DatabaseNode));
+        // Create a new DatabaseNode at the end of the list
+        DatabaseNode *dbNode = catalog_add_database(catalog, dbName, 1);
         if (!dbNode)
         {
-            perror("Failed to allocate memory");
             fclose(file);
-            return;
-        }
-
-        // Initialize the new DatabaseNode
-        strcpy(dbNode->db.name, dbName);
-        dbNode->db.tables = NULL;
-        dbNode->next = NULL;
-
-        // Add the new DatabaseNode to the list
-        if (lastDbNode)
-        {
-            lastDbNode->next = dbNode;
-        }
-        else
-        {
-            *dbList = dbNode;
+            return 0;
         }
-        lastDbNode = dbNode;
-
-        // Log the identified database
-        printf("Database '%s' identified.\n", dbName);
 
         // Read tables for this database
-        TableNode **currentTableNode = &dbNode->db.tables;
 
         while (1)
         {
@@ -558,103 +1575,113 @@ void read_database_from_file(const char *filename, DatabaseNode **dbList)
 
             // Initialize the table
             Table table;
+            memset(&table, 0, sizeof(table));
             strcpy(table.name, tableName);
             table.numColumns = numColumns;
             table.numRows = numRows;
+            table.capacity = numRows;
 
             // Allocate memory for columns
             table.columns = malloc(numColumns * sizeof(Column));
             if (!table.columns)
             {
-                perror("Failed to allocate memory for columns");
                 fclose(file);
-                return;
+                return 0;
             }
 
             // Read each column's details
             for (int i = 0; i < numColumns; i++)
             {
-                int type, isUnique;
-                if (fscanf(file, "%s %d %d", table.columns[i].name, &type, &isUnique) != 3)
+                int type, flags;
+                if (fscanf(file, "%s %d %d", table.columns[i].name, &type, &flags) != 3)
                 {
-                    perror("Failed to read column details");
                     fclose(file);
-                    return;
+                    return 0;
                 }
                 table.columns[i].type = (ColumnType)type;
-                table.columns[i].isUnique = isUnique;
+                set_column_flags(&table.columns[i], flags);
             }
 
-            // Allocate memory for rows
-            table.rows = malloc(numRows * sizeof(Row));
-            if (!table.rows)
+            // Allocate one value array per column
+            table.data = malloc(numColumns * sizeof(ColumnData));
+            if (!table.data)
             {
-                perror("Failed to allocate memory for rows");
                 fclose(file);
-                return;
+                return 0;
             }
-
-            // Read row data
-            for (int i = 0; i < numRows; i++)
+            for (int j = 0; j < numColumns; j++)
             {
-                table.rows[i].values = malloc(numColumns * sizeof(char *));
-                if (!table.rows[i].values)
+                column_data_init(&table.data[j]);
+                if (!column_data_resize(&table.data[j], table.columns[j].type, numRows) ||
+                    (table.columns[j].isDictionary && !column_data_encode(&table.data[j], 0)))
                 {
-                    perror("Failed to allocate memory for row values");
                     fclose(file);
-                    return;
+                    return 0;
                 }
+            }
 
+            // Read row data, parsing each value into its column's type
+            for (int i = 0; i < numRows; i++)
+            {
                 for (int j = 0; j < numColumns; j++)
                 {
-                    table.rows[i].values[j] = malloc(MAX_INPUT * sizeof(char));
-                    if (!table.rows[i].values[j])
+                    char text[MAX_INPUT];
+                    Value value;
+                    if (fscanf(file, "%49s", text) != 1)
                     {
-                        perror("Failed to allocate memory for row value");
                         fclose(file);
-                        return;
+                        return 0;
+                    }
+                    if (!parse_value(text, table.columns[j].type, &value))
+                    {
+                        // Keep loading, the cell falls back to the type's default
+                        if (defaulted)
+                        {
+                            (*defaulted)++;
+                        }
+                        column_data_fill_default(&table.data[j], table.columns[j].type, i, i + 1);
+                        continue;
                     }
-                    if (fscanf(file, "%s", table.rows[i].values[j]) != 1)
+                    if (!column_data_set(&table.data[j], table.columns[j].type, i, &value))
                     {
-                        perror("Failed to read row value");
                         fclose(file);
-                        return;
+                        return 0;
                     }
                 }
             }
 
-            // Add the new TableNode to the DatabaseNode
-            TableNode *newTableNode = malloc(sizeof(TableNode));
-            if (!newTableNode)
+            // Hash indexes are built on first lookup
+            table.indexes = NULL;
+            if (!reset_row_ids(&table))
             {
-                perror("Failed to allocate memory for TableNode");
+                free_table(&table);
                 fclose(file);
-                return;
+                return 0;
             }
 
+            // Add the new TableNode to the end of the DatabaseNode's tables
+            TableNode *newTableNode = catalog_add_table(dbNode, table.name, 1);
+            if (!newTableNode)
+            {
+                free_table(&table);
+                fclose(file);
+                return 0;
+            }
             newTableNode->table = table;
-            newTableNode->next = NULL;
-            *currentTableNode = newTableNode;
-            currentTableNode = &newTableNode->next;
+            mutex_init(&newTableNode->table.latch);
         }
     }
 
     fclose(file);
-    printf("All databases read from file '%s'.\n", filename);
+    return 1;
 }
 
+// Find a table by name, reading it in if it was not yet. NULL if it is not
+// found or cannot be read.
 Table *find_table(DatabaseNode *dbNode, const char *tableName)
 {
-    TableNode *current = dbNode->db.tables;
-    while (current)
-    {
-        if (strcmp(current->table.name, tableName) == 0)
-        {
-            return &current->table;
-        }
-        current = current->next;
-    }
-    return NULL; // Table not found
+    TableNode *tableNode = catalog_find_table(dbNode, tableName);
+    return tableNode ? use_table(tableNode) : NULL;
 }
 
 int parse_column_type(const char *typeStr)
@@ -678,78 +1705,255 @@ int parse_column_type(const char *typeStr)
     return -1; // Invalid type
 }
 
-void update_table_schema(DatabaseNode *dbNode, const char *tableName, const char *schemaInput)
+// Flags of a column for the snapshot and log formats
+int column_flags(const Column *column)
+{
+    return (column->isUnique ? COLUMN_UNIQUE : 0) | (column->isOrdered ? COLUMN_ORDERED : 0) |
+           (column->isDictionary ? COLUMN_DICTIONARY : 0);
+}
+
+void set_column_flags(Column *column, int flags)
 {
-    // Find the table by name
-    Table *table = find_table(dbNode, tableName);
-    if (!table)
+    column->isUnique = (flags & COLUMN_UNIQUE) != 0;
+    column->isOrdered = (flags & COLUMN_ORDERED) != 0;
+    column->isDictionary = (flags & COLUMN_DICTIONARY) != 0 && column->type == STRING;
+}
+
+static int has_flag(char flags[][MAX_INPUT], int numFlags, const char *flag)
+{
+    for (int i = 0; i < numFlags; i++)
     {
-        fprintf(stderr, "Table '%s' not found.\n", tableName);
-        return;
+        if (strcmp(flags[i], flag) == 0)
+        {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    // Break the schemaInput into lines
-    char *inputCopy = strdup(schemaInput);
-    char *line = strtok(inputCopy, ":");
+// Whether every flag given is one a column may have
+static int known_flags(char flags[][MAX_INPUT], int numFlags)
+{
+    for (int i = 0; i < numFlags; i++)
+    {
+        if (flags[i][0] && strcmp(flags[i], "unique") != 0 && strcmp(flags[i], "ordered") != 0 &&
+            strcmp(flags[i], "dictionary") != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-    // Count lines to know how many columns we will need
-    int columnCount = 0;
-    while (line)
+static int has_column(const Column *columns, int numColumns, const char *name)
+{
+    for (int i = 0; i < numColumns; i++)
     {
-        columnCount++;
-        line = strtok(NULL, ":");
+        if (strcmp(columns[i].name, name) == 0)
+        {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    free(inputCopy);
-    inputCopy = strdup(schemaInput); // Reset input
+// Parse "name TYPE [unique] [ordered] [dictionary]" column definitions
+// separated by ':' into a new array (to be freed by the caller). Only STRING
+// columns can be dictionary encoded. Returns the number of columns, or -1 if a
+// definition is invalid, has an unknown flag or repeats a name, or memory
+// runs out.
+int parse_table_schema(const char *schemaInput, Column **columns)
+{
+    // Count definitions to know how many columns we will need
+    int columnCount = 1;
+    for (const char *c = schemaInput; *c; c++)
+    {
+        if (*c == ':')
+            columnCount++;
+    }
 
-    // Allocate space for the columns
-    table->columns = realloc(table->columns, columnCount * sizeof(Column));
-    if (!table->columns)
+    char *inputCopy = strdup(schemaInput);
+    *columns = malloc(columnCount * sizeof(Column));
+    if (!inputCopy || !*columns)
     {
-        perror("Failed to allocate memory for columns");
         free(inputCopy);
-        return;
+        free(*columns);
+        return -1;
     }
 
-    // Parse each line
+    // Parse each definition, empty ones between separators are skipped
     int index = 0;
-    line = strtok(inputCopy, ":");
+    char *line = strtok(inputCopy, ":");
     while (line)
     {
-        char columnName[MAX_INPUT];
         char columnTypeStr[MAX_INPUT];
-        char uniqueFlag[MAX_INPUT] = "";
-
-        // Extract column name, type, and optional unique flag
-        int parts = sscanf(line, "%s %s %s", columnName, columnTypeStr, uniqueFlag);
-        if (parts < 2)
+        char flags[4][MAX_INPUT] = {"", "", "", ""};
+
+        // Extract column name, type, and the optional flags in any order. A
+        // fourth flag is read only to tell that there are too many.
+        int parts = sscanf(line, "%49s %49s %49s %49s %49s %49s", (*columns)[index].name, columnTypeStr, flags[0],
+                           flags[1], flags[2], flags[3]);
+        int columnType = parts >= 2 && parts <= 5 ? parse_column_type(columnTypeStr) : -1;
+        int isDictionary = has_flag(flags, 3, "dictionary");
+        if (columnType == -1 || (isDictionary && columnType != STRING) || !known_flags(flags, 3) ||
+            has_column(*columns, index, (*columns)[index].name))
         {
-            printw("Invalid column definition: %s\n", line);
+            free(*columns);
+            *columns = NULL;
             free(inputCopy);
-            return;
+            return -1;
         }
+        (*columns)[index].type = columnType;
+        (*columns)[index].isUnique = has_flag(flags, 3, "unique");
+        (*columns)[index].isOrdered = has_flag(flags, 3, "ordered");
+        (*columns)[index].isDictionary = isDictionary;
+
+        index++;
+        line = strtok(NULL, ":");
+    }
+
+    free(inputCopy);
+    return index;
+}
 
-        // Set column name and type
-        strcpy(table->columns[index].name, columnName);
-        int columnType = parse_column_type(columnTypeStr);
-        if (columnType == -1)
+// Replace a table's column definitions with a copy of the given ones. Column
+// i takes the values and indexes of the current column sources[i], which must
+// have its type, or starts as a new column if sources[i] is -1, every cell
+// holding defaults[i] or the type's default when there is none (defaults may
+// be NULL); columns no source names are dropped. Only per-column arrays move,
+// so adding, dropping or renaming a column copies no values of the others.
+int remap_table_columns(Table *table, const Column *columns, const int *sources, const char *const *defaults,
+                        int numColumns)
+{
+    int count = numColumns > 0 ? numColumns : 1;
+    Column *newColumns = malloc(count * sizeof(Column));
+    ColumnData *newData = malloc(count * sizeof(ColumnData));
+    HashIndex *newIndexes = table->indexes ? malloc(count * sizeof(HashIndex)) : NULL;
+    BTree *newOrdered = table->orderedIndexes ? malloc(count * sizeof(BTree)) : NULL;
+    SavedOrder *newSaved = table->savedOrders ? calloc(count, sizeof(SavedOrder)) : NULL;
+    int ok = newColumns && newData && (!table->indexes || newIndexes) && (!table->orderedIndexes || newOrdered) &&
+             (!table->savedOrders || newSaved);
+
+    // New columns first, a failure then leaves the table as it was
+    int added = 0;
+    for (; ok && added < numColumns; added++)
+    {
+        ColumnData *data = &newData[added];
+        if (sources[added] >= 0)
         {
-            printw("Invalid column type: %s\n", columnTypeStr);
-            free(inputCopy);
-            return;
+            continue;
+        }
+        Value value;
+        const char *text = defaults ? defaults[added] : NULL;
+        column_data_init(data);
+        if ((text && !parse_value(text, columns[added].type, &value)) ||
+            !column_data_init_default(data, columns[added].type, table->capacity, text ? &value : NULL) ||
+            (columns[added].isDictionary && !column_data_encode(data, table->numRows)))
+        {
+            column_data_free(data);
+            ok = 0;
+            break;
+        }
+    }
+    for (int i = 0; ok && i < numColumns; i++)
+    {
+        ok = sources[i] < 0 || !columns[i].isDictionary || column_data_encode(&table->data[sources[i]], table->numRows);
+    }
+    if (!ok)
+    {
+        for (int i = 0; i < added; i++)
+        {
+            if (sources[i] < 0)
+                column_data_free(&newData[i]);
         }
-        table->columns[index].type = columnType;
+        free(newColumns);
+        free(newData);
+        free(newIndexes);
+        free(newOrdered);
+        free(newSaved);
+        return 0;
+    }
+    memcpy(newColumns, columns, numColumns * sizeof(Column));
 
-        // Check if the column is unique
-        table->columns[index].isUnique = (parts == 3 && strcmp(uniqueFlag, "unique") == 0) ? 1 : 0;
+    for (int i = 0; i < numColumns; i++)
+    {
+        int source = sources[i];
+        if (newIndexes)
+            hash_index_init(&newIndexes[i]);
+        if (newOrdered)
+            btree_init(&newOrdered[i]);
+        if (source < 0)
+            continue;
+
+        const Column *old = &table->columns[source];
+        newData[i] = table->data[source];
+        column_data_init(&table->data[source]); // Moved, not freed below
+        if (!columns[i].isDictionary && newData[i].dictionary)
+        {
+            // Cells of columns no longer encoded keep sharing their strings
+            column_data_decode(&newData[i]);
+        }
+        if (columns[i].isUnique && old->isUnique && newIndexes)
+        {
+            newIndexes[i] = table->indexes[source];
+            hash_index_init(&table->indexes[source]);
+        }
+        if (columns[i].isOrdered && old->isOrdered && newOrdered)
+        {
+            newOrdered[i] = table->orderedIndexes[source];
+            btree_init(&table->orderedIndexes[source]);
+        }
+        if (newSaved)
+        {
+            newSaved[i] = table->savedOrders[source];
+        }
+    }
 
-        index++;
-        line = strtok(NULL, ":");
+    drop_indexes(table);
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        column_data_free(&table->data[i]);
     }
+    free(table->data);
+    free(table->columns);
 
-    table->numColumns = columnCount;
-    free(inputCopy);
-    printw("Table '%s' schema updated with %d columns.\n", table->name, columnCount);
-    write_all_databases_to_file(dbList, filename);
+    table->columns = newColumns;
+    table->data = newData;
+    table->indexes = newIndexes;
+    table->orderedIndexes = newOrdered;
+    table->savedOrders = newSaved;
+    table->numColumns = numColumns;
+    mark_changed(table);
+
+    // Columns that just became unique get an index, moved ones are current.
+    // Without indexes, they are all built on first use.
+    for (int i = 0; newIndexes && i < numColumns; i++)
+    {
+        int moved = sources[i] >= 0 && newIndexes[i].entries;
+        if (columns[i].isUnique && !moved && !hash_index_build(&newIndexes[i], table, i))
+        {
+            // Lookups on this column fall back to a scan
+            hash_index_free(&newIndexes[i]);
+        }
+    }
+    return 1;
+}
+
+// Replace a table's column definitions with a copy of the given ones.
+// Existing values are kept for columns whose position and type are unchanged,
+// every other column is filled with its type's default value.
+int set_table_columns(Table *table, const Column *columns, int numColumns)
+{
+    int *sources = malloc((numColumns > 0 ? numColumns : 1) * sizeof(int));
+    if (!sources)
+    {
+        return 0;
+    }
+    for (int i = 0; i < numColumns; i++)
+    {
+        sources[i] = i < table->numColumns && table->columns[i].type == columns[i].type ? i : -1;
+    }
+    int applied = remap_table_columns(table, columns, sources, NULL, numColumns);
+    free(sources);
+    return applied;
 }
\ No newline at end of file
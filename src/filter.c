@@ -0,0 +1,339 @@
+#include "filter.h"
+#include <string.h>
+
+// x86 builds carry AVX2 kernels next to the portable ones and pick them at
+// runtime, so one binary runs everywhere without -mavx2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FILTER_HAVE_AVX2 1
+#endif
+
+static void clear_tail(uint64_t *mask, int count)
+{
+    int words = (count + 63) / 64;
+    if (count % 64)
+    {
+        mask[words - 1] &= ((uint64_t)1 << (count % 64)) - 1;
+    }
+    memset(mask + words, 0, (FILTER_BLOCK_WORDS - words) * sizeof(uint64_t));
+}
+
+// Whether an operator accepts a value that orders against the key as given, negative meaning less
+static int order_matches(CompareOp op, int order)
+{
+    switch (op)
+    {
+    case CMP_EQ:
+        return order == 0;
+    case CMP_NE:
+        return order != 0;
+    case CMP_LT:
+        return order < 0;
+    case CMP_LE:
+        return order <= 0;
+    case CMP_GT:
+        return order > 0;
+    default:
+        return order >= 0;
+    }
+}
+
+// Scalar kernels, one mask word per 64 values with a branch-free inner loop
+
+#define SCALAR_KERNEL(type, values, count, mask, test)                   \
+    for (int word = 0; word * 64 < count; word++)                        \
+    {                                                                    \
+        int end = count - word * 64 < 64 ? count - word * 64 : 64;       \
+        const type *v = values + word * 64;                              \
+        uint64_t bits = 0;                                               \
+        for (int j = 0; j < end; j++)                                    \
+        {                                                                \
+            bits |= (uint64_t)(test) << j;                               \
+        }                                                                \
+        mask[word] = bits;                                               \
+    }
+
+static void compare_ints_scalar(const int64_t *values, int count, CompareOp op, int64_t key, uint64_t *mask)
+{
+    switch (op)
+    {
+    case CMP_EQ:
+        SCALAR_KERNEL(int64_t, values, count, mask, v[j] == key);
+        break;
+    case CMP_NE:
+        SCALAR_KERNEL(int64_t, values, count, mask, v[j] != key);
+        break;
+    case CMP_LT:
+        SCALAR_KERNEL(int64_t, values, count, mask, v[j] < key);
+        break;
+    case CMP_LE:
+        SCALAR_KERNEL(int64_t, values, count, mask, v[j] <= key);
+        break;
+    case CMP_GT:
+        SCALAR_KERNEL(int64_t, values, count, mask, v[j] > key);
+        break;
+    case CMP_GE:
+        SCALAR_KERNEL(int64_t, values, count, mask, v[j] >= key);
+        break;
+    }
+}
+
+static void compare_floats_scalar(const double *values, int count, CompareOp op, double key, uint64_t *mask)
+{
+    switch (op)
+    {
+    case CMP_EQ:
+        SCALAR_KERNEL(double, values, count, mask, v[j] == key);
+        break;
+    case CMP_NE:
+        SCALAR_KERNEL(double, values, count, mask, v[j] != key);
+        break;
+    case CMP_LT:
+        SCALAR_KERNEL(double, values, count, mask, v[j] < key);
+        break;
+    case CMP_LE:
+        SCALAR_KERNEL(double, values, count, mask, v[j] <= key);
+        break;
+    case CMP_GT:
+        SCALAR_KERNEL(double, values, count, mask, v[j] > key);
+        break;
+    case CMP_GE:
+        SCALAR_KERNEL(double, values, count, mask, v[j] >= key);
+        break;
+    }
+}
+
+// Dictionary codes only compare for equality, other operators match nothing
+static void compare_codes_scalar(const uint32_t *values, int count, CompareOp op, uint32_t key, uint64_t *mask)
+{
+    switch (op)
+    {
+    case CMP_EQ:
+        SCALAR_KERNEL(uint32_t, values, count, mask, v[j] == key);
+        break;
+    case CMP_NE:
+        SCALAR_KERNEL(uint32_t, values, count, mask, v[j] != key);
+        break;
+    default:
+        memset(mask, 0, FILTER_BLOCK_WORDS * sizeof(uint64_t));
+        break;
+    }
+}
+
+#ifdef FILTER_HAVE_AVX2
+
+// Four 64-bit comparisons per instruction. Integers only have == and >, the
+// other operators swap the operands or invert the result.
+__attribute__((target("avx2"))) static void compare_ints_avx2(const int64_t *values, int count, CompareOp op,
+                                                              int64_t key, uint64_t *mask)
+{
+    int swap = op == CMP_LT || op == CMP_GE;
+    int equal = op == CMP_EQ || op == CMP_NE;
+    unsigned invert = op == CMP_NE || op == CMP_LE || op == CMP_GE ? 0xF : 0;
+    __m256i k = _mm256_set1_epi64x(key);
+
+    memset(mask, 0, FILTER_BLOCK_WORDS * sizeof(uint64_t));
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(values + i));
+        __m256i r = equal ? _mm256_cmpeq_epi64(v, k) : swap ? _mm256_cmpgt_epi64(k, v) : _mm256_cmpgt_epi64(v, k);
+        unsigned bits = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(r)) ^ invert;
+        mask[i / 64] |= (uint64_t)bits << (i % 64);
+    }
+    for (; i < count; i++)
+    {
+        int match = order_matches(op, (values[i] > key) - (values[i] < key));
+        mask[i / 64] |= (uint64_t)match << (i % 64);
+    }
+}
+
+#define AVX2_FLOAT_LOOP(predicate)                                                   \
+    for (; i + 4 <= count; i += 4)                                                   \
+    {                                                                                \
+        __m256d r = _mm256_cmp_pd(_mm256_loadu_pd(values + i), k, predicate);        \
+        mask[i / 64] |= (uint64_t)(unsigned)_mm256_movemask_pd(r) << (i % 64);       \
+    }
+
+// Ordered predicates except !=, so NaN compares like it does in C
+__attribute__((target("avx2"))) static void compare_floats_avx2(const double *values, int count, CompareOp op,
+                                                                double key, uint64_t *mask)
+{
+    __m256d k = _mm256_set1_pd(key);
+    memset(mask, 0, FILTER_BLOCK_WORDS * sizeof(uint64_t));
+    int i = 0;
+    switch (op)
+    {
+    case CMP_EQ:
+        AVX2_FLOAT_LOOP(_CMP_EQ_OQ);
+        break;
+    case CMP_NE:
+        AVX2_FLOAT_LOOP(_CMP_NEQ_UQ);
+        break;
+    case CMP_LT:
+        AVX2_FLOAT_LOOP(_CMP_LT_OQ);
+        break;
+    case CMP_LE:
+        AVX2_FLOAT_LOOP(_CMP_LE_OQ);
+        break;
+    case CMP_GT:
+        AVX2_FLOAT_LOOP(_CMP_GT_OQ);
+        break;
+    case CMP_GE:
+        AVX2_FLOAT_LOOP(_CMP_GE_OQ);
+        break;
+    }
+
+    // The tail is shorter than a vector and never crosses a mask word
+    if (i < count)
+    {
+        uint64_t tail[FILTER_BLOCK_WORDS];
+        compare_floats_scalar(values + i, count - i, op, key, tail);
+        mask[i / 64] |= tail[0] << (i % 64);
+    }
+}
+
+// Eight 32-bit codes per comparison
+__attribute__((target("avx2"))) static void compare_codes_avx2(const uint32_t *values, int count, CompareOp op,
+                                                               uint32_t key, uint64_t *mask)
+{
+    unsigned invert = op == CMP_NE ? 0xFF : 0;
+    __m256i k = _mm256_set1_epi32((int)key);
+    memset(mask, 0, FILTER_BLOCK_WORDS * sizeof(uint64_t));
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i r = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(values + i)), k);
+        unsigned bits = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(r)) ^ invert;
+        mask[i / 64] |= (uint64_t)bits << (i % 64);
+    }
+    for (; i < count; i++)
+    {
+        mask[i / 64] |= (uint64_t)((values[i] == key) != (op == CMP_NE)) << (i % 64);
+    }
+}
+
+static int use_avx2(void)
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return supported;
+}
+
+#else
+
+static int use_avx2(void)
+{
+    return 0;
+}
+
+#endif
+
+void filter_compare_ints(const int64_t *values, int count, CompareOp op, int64_t key, uint64_t *mask)
+{
+#ifdef FILTER_HAVE_AVX2
+    if (use_avx2())
+    {
+        compare_ints_avx2(values, count, op, key, mask);
+        return;
+    }
+#endif
+    compare_ints_scalar(values, count, op, key, mask);
+    clear_tail(mask, count);
+}
+
+void filter_compare_floats(const double *values, int count, CompareOp op, double key, uint64_t *mask)
+{
+#ifdef FILTER_HAVE_AVX2
+    if (use_avx2())
+    {
+        compare_floats_avx2(values, count, op, key, mask);
+        return;
+    }
+#endif
+    compare_floats_scalar(values, count, op, key, mask);
+    clear_tail(mask, count);
+}
+
+// Compare the codes of a dictionary encoded STRING column for equality
+void filter_compare_codes(const uint32_t *values, int count, CompareOp op, uint32_t key, uint64_t *mask)
+{
+#ifdef FILTER_HAVE_AVX2
+    if (use_avx2() && (op == CMP_EQ || op == CMP_NE))
+    {
+        compare_codes_avx2(values, count, op, key, mask);
+        return;
+    }
+#endif
+    compare_codes_scalar(values, count, op, key, mask);
+    clear_tail(mask, count);
+}
+
+// Copy count bits of a packed BOOLEAN column, starting at a multiple of 8
+void filter_load_bits(const uint8_t *bits, int start, int count, uint64_t *mask)
+{
+    memset(mask, 0, FILTER_BLOCK_WORDS * sizeof(uint64_t));
+    const uint8_t *from = bits + start / 8;
+    for (int i = 0; i < (count + 7) / 8; i++)
+    {
+        mask[i / 8] |= (uint64_t)from[i] << (i % 8 * 8);
+    }
+    clear_tail(mask, count);
+}
+
+// Booleans compare as 0 and 1, so each operator maps true and false cells to a constant result
+void filter_compare_bits(const uint8_t *bits, int start, int count, CompareOp op, int key, uint64_t *mask)
+{
+    int whenTrue = order_matches(op, 1 - key);
+    int whenFalse = order_matches(op, 0 - key);
+
+    filter_load_bits(bits, start, count, mask);
+    for (int i = 0; i < FILTER_BLOCK_WORDS; i++)
+    {
+        mask[i] = (whenTrue ? mask[i] : 0) | (whenFalse ? ~mask[i] : 0);
+    }
+    clear_tail(mask, count);
+}
+
+void filter_fill(uint64_t *mask, int count, int value)
+{
+    memset(mask, value ? 0xFF : 0, FILTER_BLOCK_WORDS * sizeof(uint64_t));
+    clear_tail(mask, count);
+}
+
+// Index of the first set bit at or after from, or count if there is none
+int filter_next(const uint64_t *mask, int count, int from)
+{
+    for (int word = from / 64; word * 64 < count; word++)
+    {
+        uint64_t bits = mask[word];
+        if (word == from / 64)
+        {
+            bits &= ~(uint64_t)0 << (from % 64);
+        }
+        if (bits)
+        {
+#ifdef __GNUC__
+            int index = word * 64 + __builtin_ctzll(bits);
+#else
+            int index = word * 64;
+            while (!(bits & 1))
+            {
+                bits >>= 1;
+                index++;
+            }
+#endif
+            return index < count ? index : count;
+        }
+    }
+    return count;
+}
+
+const char *filter_kernel_name(void)
+{
+    return use_avx2() ? "avx2" : "scalar";
+}
@@ -0,0 +1,347 @@
+#include "dbms.h"
+
+#define HASH_INDEX_MIN_CAPACITY 16
+
+// FNV-1a
+unsigned int hash_value(const char *value)
+{
+    unsigned int hash = 2166136261u;
+    while (*value)
+    {
+        hash ^= (unsigned char)*value++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static unsigned int hash_bits(uint64_t bits)
+{
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    return (unsigned int)bits;
+}
+
+// Hash a typed value so that equal values hash alike, e.g. 1.0 and 1.00
+unsigned int hash_key(const Value *key)
+{
+    switch (key->type)
+    {
+    case INTEGER:
+        return hash_bits((uint64_t)key->as.i);
+    case FLOAT:
+    {
+        double value = key->as.f == 0.0 ? 0.0 : key->as.f; // -0.0 equals 0.0
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return hash_bits(bits);
+    }
+    case BOOLEAN:
+        return hash_bits((uint64_t)key->as.b);
+    case STRING:
+        return hash_value(key->as.s);
+    default:
+        return 0;
+    }
+}
+
+unsigned int hash_cell(const Table *table, int row, int col)
+{
+    Value key;
+    key.type = table->columns[col].type;
+    switch (key.type)
+    {
+    case INTEGER:
+        key.as.i = cell_int(table, row, col);
+        break;
+    case FLOAT:
+        key.as.f = cell_float(table, row, col);
+        break;
+    case BOOLEAN:
+        key.as.b = cell_bool(table, row, col);
+        break;
+    case STRING:
+        key.as.s = cell_string(table, row, col);
+        break;
+    }
+    return hash_key(&key);
+}
+
+void hash_index_init(HashIndex *index)
+{
+    index->entries = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->used = 0;
+}
+
+void hash_index_free(HashIndex *index)
+{
+    free(index->entries);
+    hash_index_init(index);
+}
+
+// Place an entry without checking for existing keys, the table must have room
+static void place_entry(HashEntry *entries, int capacity, unsigned int hash, int row)
+{
+    int mask = capacity - 1;
+    int slot = hash & mask;
+    while (entries[slot].row >= 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    entries[slot].hash = hash;
+    entries[slot].row = row;
+}
+
+// Rehash into a table of the given capacity, dropping deleted markers
+static int resize_index(HashIndex *index, int capacity)
+{
+    HashEntry *entries = malloc(capacity * sizeof(HashEntry));
+    if (!entries)
+    {
+        return 0;
+    }
+    for (int i = 0; i < capacity; i++)
+    {
+        entries[i].row = HASH_INDEX_EMPTY;
+    }
+
+    for (int i = 0; i < index->capacity; i++)
+    {
+        if (index->entries[i].row >= 0)
+        {
+            place_entry(entries, capacity, index->entries[i].hash, index->entries[i].row);
+        }
+    }
+
+    free(index->entries);
+    index->entries = entries;
+    index->capacity = capacity;
+    index->used = index->count;
+    return 1;
+}
+
+int hash_index_insert(HashIndex *index, const Table *table, int colIndex, int row)
+{
+    // Keep the load factor (including deleted markers) under 3/4
+    if ((index->used + 1) * 4 > index->capacity * 3)
+    {
+        int capacity = index->capacity ? index->capacity : HASH_INDEX_MIN_CAPACITY;
+        while ((index->count + 1) * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        if (!resize_index(index, capacity))
+        {
+            return 0;
+        }
+    }
+
+    unsigned int hash = hash_cell(table, row, colIndex);
+    int mask = index->capacity - 1;
+    int slot = hash & mask;
+    while (index->entries[slot].row >= 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    if (index->entries[slot].row == HASH_INDEX_EMPTY)
+    {
+        index->used++;
+    }
+    index->entries[slot].hash = hash;
+    index->entries[slot].row = row;
+    index->count++;
+    return 1;
+}
+
+// Remove the entry of a row, must be called while the row still holds the indexed value
+void hash_index_remove(HashIndex *index, const Table *table, int colIndex, int row)
+{
+    if (index->capacity == 0)
+    {
+        return;
+    }
+
+    unsigned int hash = hash_cell(table, row, colIndex);
+    int mask = index->capacity - 1;
+    int slot = hash & mask;
+    while (index->entries[slot].row != HASH_INDEX_EMPTY)
+    {
+        if (index->entries[slot].row == row)
+        {
+            index->entries[slot].row = HASH_INDEX_DELETED;
+            index->count--;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Returns the row holding the value, or -1 if no row does
+int hash_index_find(const HashIndex *index, const Table *table, int colIndex, const Value *key)
+{
+    if (index->capacity == 0)
+    {
+        return -1;
+    }
+
+    unsigned int hash = hash_key(key);
+    int mask = index->capacity - 1;
+    int slot = hash & mask;
+    while (index->entries[slot].row != HASH_INDEX_EMPTY)
+    {
+        const HashEntry *entry = &index->entries[slot];
+        if (entry->row >= 0 && entry->hash == hash && cell_equals(table, entry->row, colIndex, key))
+        {
+            return entry->row;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+int hash_index_build(HashIndex *index, const Table *table, int colIndex)
+{
+    hash_index_free(index);
+
+    int capacity = HASH_INDEX_MIN_CAPACITY;
+    while (table->numRows * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+    if (!resize_index(index, capacity))
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < table->numRows; i++)
+    {
+        if (is_row_live(table, i) && !hash_index_insert(index, table, colIndex, i))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void row_id_map_init(RowIdMap *map)
+{
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    map->used = 0;
+}
+
+void row_id_map_free(RowIdMap *map)
+{
+    free(map->entries);
+    row_id_map_init(map);
+}
+
+static int resize_row_id_map(RowIdMap *map, int capacity)
+{
+    RowIdEntry *entries = malloc(capacity * sizeof(RowIdEntry));
+    if (!entries)
+    {
+        return 0;
+    }
+    for (int i = 0; i < capacity; i++)
+    {
+        entries[i].slot = HASH_INDEX_EMPTY;
+    }
+
+    int mask = capacity - 1;
+    for (int i = 0; i < map->capacity; i++)
+    {
+        if (map->entries[i].slot >= 0)
+        {
+            int at = hash_bits((uint64_t)map->entries[i].id) & mask;
+            while (entries[at].slot >= 0)
+            {
+                at = (at + 1) & mask;
+            }
+            entries[at] = map->entries[i];
+        }
+    }
+
+    free(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+    map->used = map->count;
+    return 1;
+}
+
+// Add an id that is not in the map yet
+int row_id_map_put(RowIdMap *map, int64_t id, int slot)
+{
+    if ((map->used + 1) * 4 > map->capacity * 3)
+    {
+        int capacity = map->capacity ? map->capacity : HASH_INDEX_MIN_CAPACITY;
+        while ((map->count + 1) * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        if (!resize_row_id_map(map, capacity))
+        {
+            return 0;
+        }
+    }
+
+    int mask = map->capacity - 1;
+    int at = hash_bits((uint64_t)id) & mask;
+    while (map->entries[at].slot >= 0)
+    {
+        at = (at + 1) & mask;
+    }
+    if (map->entries[at].slot == HASH_INDEX_EMPTY)
+    {
+        map->used++;
+    }
+    map->entries[at].id = id;
+    map->entries[at].slot = slot;
+    map->count++;
+    return 1;
+}
+
+// Returns the slot holding the row id, or -1 if it is not in the map
+int row_id_map_get(const RowIdMap *map, int64_t id)
+{
+    if (map->capacity == 0)
+    {
+        return -1;
+    }
+
+    int mask = map->capacity - 1;
+    int at = hash_bits((uint64_t)id) & mask;
+    while (map->entries[at].slot != HASH_INDEX_EMPTY)
+    {
+        if (map->entries[at].slot >= 0 && map->entries[at].id == id)
+        {
+            return map->entries[at].slot;
+        }
+        at = (at + 1) & mask;
+    }
+    return -1;
+}
+
+void row_id_map_remove(RowIdMap *map, int64_t id)
+{
+    if (map->capacity == 0)
+    {
+        return;
+    }
+
+    int mask = map->capacity - 1;
+    int at = hash_bits((uint64_t)id) & mask;
+    while (map->entries[at].slot != HASH_INDEX_EMPTY)
+    {
+        if (map->entries[at].slot >= 0 && map->entries[at].id == id)
+        {
+            map->entries[at].slot = HASH_INDEX_DELETED;
+            map->count--;
+            return;
+        }
+        at = (at + 1) & mask;
+    }
+}
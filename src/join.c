@@ -0,0 +1,393 @@
+#include "join.h"
+#include "hash_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Memory the hash table takes per build row, counting up to two buckets
+#define ENTRY_BYTES (sizeof(JoinEntry) + 2 * sizeof(int))
+
+// A row written to a partition file
+typedef struct
+{
+    unsigned int hash;
+    int slot;
+} JoinRecord;
+
+// Point the inputs at the sides of a bound JOIN, read from the given tables.
+// Rows collected through an index may be set in inputs[side].slots before
+// join_start.
+void join_init(JoinRun *run, const Query *query, Table *left, Table *right)
+{
+    Table *tables[2] = {left, right};
+    memset(run, 0, sizeof(*run));
+    for (int s = 0; s < 2; s++)
+    {
+        JoinInput *input = &run->inputs[s];
+        input->query = query->sides[s];
+        input->table = tables[s];
+        input->column = query->joinColumns[s];
+        query_cursor_init(&input->cursor);
+    }
+    run->build = query->buildSide;
+    run->memoryLimit = query->joinMemory;
+    run->chain = -1;
+    run->partition = -1;
+}
+
+static int next_input(JoinInput *input)
+{
+    if (input->slots)
+    {
+        return input->next < input->numSlots ? input->slots[input->next++] : -1;
+    }
+    return query_next(input->query, input->table, &input->cursor);
+}
+
+// ON value of a row, strings are read in place
+static void key_value(const JoinInput *input, int slot, Value *key)
+{
+    if (input->column == QUERY_ROW_ID)
+    {
+        key->type = INTEGER;
+        key->as.i = row_id(input->table, slot);
+        return;
+    }
+    key->type = input->table->columns[input->column].type;
+    switch (key->type)
+    {
+    case INTEGER:
+        key->as.i = cell_int(input->table, slot, input->column);
+        break;
+    case FLOAT:
+        key->as.f = cell_float(input->table, slot, input->column);
+        break;
+    case BOOLEAN:
+        key->as.b = cell_bool(input->table, slot, input->column);
+        break;
+    case STRING:
+        key->as.s = cell_string(input->table, slot, input->column);
+        break;
+    }
+}
+
+static unsigned int key_hash(const JoinInput *input, int slot)
+{
+    Value key;
+    key_value(input, slot, &key);
+    return hash_key(&key);
+}
+
+static int add_entry(JoinRun *run, unsigned int hash, int slot)
+{
+    if (run->numEntries == run->capacity)
+    {
+        int capacity = run->capacity ? run->capacity * 2 : 64;
+        JoinEntry *entries = realloc(run->entries, capacity * sizeof(JoinEntry));
+        if (!entries)
+        {
+            run->error = JOIN_ERR_MEMORY;
+            return 0;
+        }
+        run->entries = entries;
+        run->capacity = capacity;
+    }
+    JoinEntry *entry = &run->entries[run->numEntries++];
+    entry->hash = hash;
+    entry->slot = slot;
+    return 1;
+}
+
+// Chain the entries into buckets, each chain in the order the rows were read
+static int link_buckets(JoinRun *run)
+{
+    int numBuckets = 16;
+    while (numBuckets < run->numEntries)
+    {
+        numBuckets *= 2;
+    }
+    if (numBuckets != run->numBuckets)
+    {
+        free(run->buckets);
+        run->buckets = malloc(numBuckets * sizeof(int));
+        run->numBuckets = run->buckets ? numBuckets : 0;
+        if (!run->buckets)
+        {
+            run->error = JOIN_ERR_MEMORY;
+            return 0;
+        }
+    }
+    for (int i = 0; i < numBuckets; i++)
+    {
+        run->buckets[i] = -1;
+    }
+    for (int e = run->numEntries - 1; e >= 0; e--)
+    {
+        int at = run->entries[e].hash & (numBuckets - 1);
+        run->entries[e].next = run->buckets[at];
+        run->buckets[at] = e;
+    }
+    return 1;
+}
+
+// Partitions take the top bits of the hash, buckets the bottom ones
+static int spill(JoinRun *run, int side, unsigned int hash, int slot)
+{
+    JoinRecord record = {hash, slot};
+    FILE *file = run->partitions[side][hash >> (sizeof(unsigned int) * 8 - JOIN_PARTITION_BITS)];
+    if (fwrite(&record, sizeof(record), 1, file) != 1)
+    {
+        run->error = JOIN_ERR_IO;
+        return 0;
+    }
+    return 1;
+}
+
+// Move the entries built so far to partition files, for both sides
+static int start_spill(JoinRun *run)
+{
+    for (int s = 0; s < 2; s++)
+    {
+        for (int p = 0; p < JOIN_PARTITIONS; p++)
+        {
+            run->partitions[s][p] = tmpfile();
+            if (!run->partitions[s][p])
+            {
+                run->error = JOIN_ERR_IO;
+                return 0;
+            }
+        }
+    }
+    run->spilled = 1;
+    for (int e = 0; e < run->numEntries; e++)
+    {
+        if (!spill(run, run->build, run->entries[e].hash, run->entries[e].slot))
+        {
+            return 0;
+        }
+    }
+    run->numEntries = 0;
+    return 1;
+}
+
+// Read the build side into the hash table, or into partitions once it would
+// take more than the memory limit, the probe side then follows it there.
+// Returns 0 on failure, see error.
+int join_start(JoinRun *run)
+{
+    JoinInput *build = &run->inputs[run->build];
+    JoinInput *probe = &run->inputs[!run->build];
+    int slot;
+    while ((slot = next_input(build)) >= 0)
+    {
+        unsigned int hash = key_hash(build, slot);
+        if (!run->spilled && run->memoryLimit > 0 && (run->numEntries + 1) * ENTRY_BYTES > run->memoryLimit &&
+            !start_spill(run))
+        {
+            return 0;
+        }
+        if (run->spilled ? !spill(run, run->build, hash, slot) : !add_entry(run, hash, slot))
+        {
+            return 0;
+        }
+    }
+    if (!run->spilled)
+    {
+        return link_buckets(run);
+    }
+
+    while ((slot = next_input(probe)) >= 0)
+    {
+        if (!spill(run, !run->build, key_hash(probe, slot), slot))
+        {
+            return 0;
+        }
+    }
+    for (int s = 0; s < 2; s++)
+    {
+        for (int p = 0; p < JOIN_PARTITIONS; p++)
+        {
+            if (fflush(run->partitions[s][p]) != 0)
+            {
+                run->error = JOIN_ERR_IO;
+                return 0;
+            }
+            rewind(run->partitions[s][p]);
+        }
+    }
+    return 1;
+}
+
+static void close_partition(JoinRun *run, int side, int partition)
+{
+    if (run->partitions[side][partition])
+    {
+        fclose(run->partitions[side][partition]);
+        run->partitions[side][partition] = NULL;
+    }
+}
+
+// Whether a partition file has records left to read
+static int has_more(FILE *file)
+{
+    int c = fgetc(file);
+    return c != EOF && ungetc(c, file) != EOF;
+}
+
+// Read the build rows of the current partition into the hash table, as many
+// as the memory limit allows. The file is closed once all were read, else the
+// rest waits for another pass. Returns 0 on failure, see error.
+static int load_entries(JoinRun *run)
+{
+    FILE *file = run->partitions[run->build][run->partition];
+    size_t maxEntries = run->memoryLimit > ENTRY_BYTES ? run->memoryLimit / ENTRY_BYTES : 1;
+    JoinRecord record;
+    run->numEntries = 0;
+    while ((size_t)run->numEntries < maxEntries && fread(&record, sizeof(record), 1, file) == 1)
+    {
+        if (!add_entry(run, record.hash, record.slot))
+        {
+            return 0;
+        }
+    }
+    if (ferror(file))
+    {
+        run->error = JOIN_ERR_IO;
+        return 0;
+    }
+    if (!has_more(file))
+    {
+        close_partition(run, run->build, run->partition);
+    }
+    return 1;
+}
+
+// Read the build rows of the next partition with any into the hash table.
+// Many rows with one hash can make a partition larger than the memory limit,
+// which hashing it again would not split: its build rows are then read a
+// limit's worth at a time, each time probed by all of its probe rows again.
+// Returns 0 after the last one or on failure.
+static int load_partition(JoinRun *run)
+{
+    if (run->partition >= JOIN_PARTITIONS)
+    {
+        return 0;
+    }
+    if (run->partition >= 0 && run->partitions[run->build][run->partition])
+    {
+        rewind(run->partitions[!run->build][run->partition]);
+        return load_entries(run) && link_buckets(run);
+    }
+    if (run->partition >= 0)
+    {
+        close_partition(run, !run->build, run->partition);
+    }
+    while (++run->partition < JOIN_PARTITIONS)
+    {
+        if (!load_entries(run))
+        {
+            return 0;
+        }
+        if (run->numEntries > 0)
+        {
+            return link_buckets(run);
+        }
+        // No probe row of the partition can match
+        close_partition(run, !run->build, run->partition);
+    }
+    return 0;
+}
+
+// Take the next probe row and find its bucket, returns 0 once there is none
+static int next_probe(JoinRun *run)
+{
+    JoinInput *probe = &run->inputs[!run->build];
+    while (1)
+    {
+        int slot;
+        if (!run->spilled)
+        {
+            slot = next_input(probe);
+            if (slot < 0)
+            {
+                return 0;
+            }
+            run->probeHash = key_hash(probe, slot);
+        }
+        else
+        {
+            FILE *file = run->partition >= 0 && run->partition < JOIN_PARTITIONS
+                             ? run->partitions[!run->build][run->partition]
+                             : NULL;
+            JoinRecord record;
+            if (!file || fread(&record, sizeof(record), 1, file) != 1)
+            {
+                if (file && ferror(file))
+                {
+                    run->error = JOIN_ERR_IO;
+                    return 0;
+                }
+                if (!load_partition(run))
+                {
+                    return 0;
+                }
+                continue;
+            }
+            slot = record.slot;
+            run->probeHash = record.hash;
+        }
+        run->probeSlot = slot;
+        key_value(probe, slot, &run->probeKey);
+        run->chain = run->buckets[run->probeHash & (run->numBuckets - 1)];
+        return 1;
+    }
+}
+
+// Find the next pair of rows with equal ON values and write their slots by
+// side. Returns 0 once there are no more, or on failure, see error.
+int join_next(JoinRun *run, int slots[2])
+{
+    const JoinInput *build = &run->inputs[run->build];
+    while (1)
+    {
+        while (run->chain >= 0)
+        {
+            const JoinEntry *entry = &run->entries[run->chain];
+            run->chain = entry->next;
+            if (entry->hash != run->probeHash)
+            {
+                continue;
+            }
+            Value key;
+            key_value(build, entry->slot, &key);
+            if (value_equals(&key, &run->probeKey))
+            {
+                slots[run->build] = entry->slot;
+                slots[!run->build] = run->probeSlot;
+                return 1;
+            }
+        }
+        if (run->error || (!run->spilled && run->numEntries == 0) || !next_probe(run))
+        {
+            return 0;
+        }
+    }
+}
+
+void join_free(JoinRun *run)
+{
+    for (int s = 0; s < 2; s++)
+    {
+        free(run->inputs[s].slots);
+        run->inputs[s].slots = NULL;
+        query_cursor_free(&run->inputs[s].cursor);
+        for (int p = 0; p < JOIN_PARTITIONS; p++)
+        {
+            close_partition(run, s, p);
+        }
+    }
+    free(run->entries);
+    free(run->buckets);
+    run->entries = NULL;
+    run->buckets = NULL;
+}
@@ -1,18 +1,43 @@
 #include <ncurses.h>
+#include <string.h>
 #include "menus.h"
-#include "dbms.h"
+#include "savvydb.h"
 
-int main()
+int main(int argc, char *argv[])
 {
-    read_database_from_file("db.txt", &dbList);
+    if (argc == 4 && strcmp(argv[1], "--convert") == 0)
+    {
+        if (savvy_convert_text(argv[2], argv[3]) != SAVVY_OK)
+        {
+            printf("Failed to convert '%s'.\n", argv[2]);
+            return 1;
+        }
+        printf("Converted '%s' to '%s'.\n", argv[2], argv[3]);
+        return 0;
+    }
+
+    SavvyDB *db;
+    SavvyStatus status = savvy_open(".", &db);
+    if (status != SAVVY_OK)
+    {
+        printf("Failed to open the database files: %s\n", savvy_status_message(status));
+        return 1;
+    }
+
     initscr();
     clear();
     noecho();
     cbreak();
     keypad(stdscr, TRUE);
 
-    handle_main_menu();
+    handle_main_menu(db);
 
     endwin();
+
+    if (savvy_close(db) != SAVVY_OK)
+    {
+        printf("Failed to save changes, they remain in the log.\n");
+        return 1;
+    }
     return 0;
 }
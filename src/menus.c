@@ -1,8 +1,352 @@
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include "menus.h"
-#include "dbms.h"
 
-#define MAX_INPUT 50
+#define MAX_INPUT SAVVY_MAX_VALUE
+#define MAX_LIST 50
+#define PAGE_MIN_ROWS 5
+
+static SavvyDB *savvy;
+static char currentDatabase[MAX_INPUT];
+
+static void create_database(const char *db_name)
+{
+    SavvyStatus status = savvy_create_database(savvy, db_name);
+    if (status == SAVVY_ERR_EXISTS)
+    {
+        printw("Database '%s' already exists.\n", db_name);
+    }
+    else if (status != SAVVY_OK)
+    {
+        printw("Failed to create database '%s': %s\n", db_name, savvy_status_message(status));
+    }
+    else
+    {
+        printw("Database '%s' created.\n", db_name);
+    }
+}
+
+static void create_table(const char *tableName)
+{
+    SavvyStatus status = savvy_create_table(savvy, currentDatabase, tableName);
+    if (status == SAVVY_ERR_EXISTS)
+    {
+        printw("Table '%s' already exists.\n", tableName);
+    }
+    else if (status != SAVVY_OK)
+    {
+        printw("Failed to create table '%s': %s\n", tableName, savvy_status_message(status));
+    }
+    else
+    {
+        printw("Table '%s' created with a blank schema.\n", tableName);
+    }
+}
+
+// Fetch a table's columns, returns the column count or -1 with columns left NULL
+static int describe_table(const char *table_name, SavvyColumn **columns)
+{
+    int count;
+    *columns = NULL;
+    if (savvy_describe(savvy, currentDatabase, table_name, NULL, 0, &count) != SAVVY_OK)
+    {
+        printw("Table '%s' not found in database '%s'.\n", table_name, currentDatabase);
+        return -1;
+    }
+
+    *columns = malloc((count > 0 ? count : 1) * sizeof(SavvyColumn));
+    if (!*columns)
+    {
+        printw("Failed to allocate memory for columns.\n");
+        return -1;
+    }
+    savvy_describe(savvy, currentDatabase, table_name, *columns, count, &count);
+    return count;
+}
+
+// Prompt until a column value is accepted, rowId is -1 for a new row
+static void read_value(const char *table_name, const SavvyColumn *column, int index, int64_t rowId,
+                       const char *prompt, char *input)
+{
+    while (1)
+    {
+        printw(prompt, column->name);
+        getstr(input);
+
+        SavvyStatus status = savvy_check_value(savvy, currentDatabase, table_name, index, input, rowId);
+        if (status == SAVVY_ERR_NOT_UNIQUE)
+        {
+            printw("Value for %s must be unique. Try again.\n", column->name);
+            continue;
+        }
+        if (status != SAVVY_OK)
+        {
+            printw("Invalid value for %s. Try again.\n", column->name);
+            continue;
+        }
+        break;
+    }
+}
+
+// Add a row to the table
+static void add_row_to_table(const char *table_name)
+{
+    SavvyColumn *columns;
+    int numColumns = describe_table(table_name, &columns);
+    if (numColumns < 0)
+    {
+        return;
+    }
+    if (numColumns == 0)
+    {
+        printw("Schema not defined\n");
+        free(columns);
+        return;
+    }
+
+    char *inputs = malloc(numColumns * MAX_INPUT);
+    const char **values = malloc(numColumns * sizeof(char *));
+    if (!inputs || !values)
+    {
+        printw("Failed to allocate memory for row.\n");
+        free(inputs);
+        free(values);
+        free(columns);
+        return;
+    }
+
+    for (int i = 0; i < numColumns; i++)
+    {
+        char *input = inputs + i * MAX_INPUT;
+        read_value(table_name, &columns[i], i, -1, "Enter value for %s: ", input);
+        values[i] = input;
+    }
+
+    int64_t rowId;
+    SavvyStatus status = savvy_insert(savvy, currentDatabase, table_name, values, 1, &rowId);
+    free(values);
+    free(inputs);
+    free(columns);
+    if (status != SAVVY_OK)
+    {
+        printw("Failed to add row to table '%s': %s\n", table_name, savvy_status_message(status));
+        return;
+    }
+
+    printw("Row %lld added to table '%s'.\n", (long long)rowId, table_name);
+}
+
+// Show a cursor's rows a screen at a time below the current line, under the
+// result headings and with row ids if showIds is set. Any key shows the next
+// page and q stops early. Returns the number of rows shown.
+static int page_cursor(SavvyCursor *cursor, int showIds)
+{
+    int width = savvy_cursor_width(cursor);
+    int shown = 0;
+    while (1)
+    {
+        // Keep a line for the headings and one for the prompt, on a new
+        // screen if too little of this one is left
+        int pageRows = LINES - getcury(stdscr) - 2;
+        if (pageRows < PAGE_MIN_ROWS)
+        {
+            clear();
+            pageRows = LINES - 2;
+        }
+        int numRows;
+        if (savvy_cursor_next(cursor, pageRows > 0 ? pageRows : 1, &numRows) != SAVVY_OK || numRows == 0)
+        {
+            break;
+        }
+
+        if (showIds)
+        {
+            printw("(id)\t");
+        }
+        for (int i = 0; i < width; i++)
+        {
+            printw("%s\t", savvy_cursor_name(cursor, i));
+        }
+        printw("\n");
+        for (int row = 0; row < numRows; row++)
+        {
+            if (showIds)
+            {
+                printw("%lld\t", (long long)savvy_cursor_row_id(cursor, row));
+            }
+            for (int i = 0; i < width; i++)
+            {
+                printw("%s\t", savvy_cursor_value(cursor, row, i));
+            }
+            printw("\n");
+        }
+        shown += numRows;
+        if (numRows < pageRows)
+        {
+            break;
+        }
+
+        printw("-- More: any key for the next page, q to stop --");
+        refresh();
+        int ch = getch();
+        clear();
+        if (ch == 'q' || ch == 'Q')
+        {
+            break;
+        }
+    }
+    return shown;
+}
+
+// List the rows of a table a page at a time, in the order of its first
+// ordered column if it has one
+static void list_rows_in_table(const char *table_name)
+{
+    SavvyColumn *columns;
+    int numColumns = describe_table(table_name, &columns);
+    if (numColumns < 0)
+    {
+        return;
+    }
+    if (numColumns == 0)
+    {
+        printw("Table empty\n");
+        free(columns);
+        return;
+    }
+
+    int sortColumn = 0;
+    while (sortColumn < numColumns && !columns[sortColumn].isOrdered)
+    {
+        sortColumn++;
+    }
+
+    // Live rows with their stable ids
+    SavvyCursor *cursor;
+    SavvyStatus status;
+    if (sortColumn < numColumns)
+    {
+        char query[3 * MAX_INPUT];
+        snprintf(query, sizeof(query), "SELECT * FROM %s ORDER BY %s", table_name, columns[sortColumn].name);
+        status = savvy_cursor_open(savvy, currentDatabase, query, &cursor, NULL, 0);
+    }
+    else
+    {
+        status = savvy_cursor_open_table(savvy, currentDatabase, table_name, &cursor);
+    }
+    free(columns);
+    if (status != SAVVY_OK)
+    {
+        printw("Failed to read table '%s': %s\n", table_name, savvy_status_message(status));
+        return;
+    }
+
+    int count = page_cursor(cursor, 1);
+    savvy_cursor_close(cursor);
+    printw("%d row(s)\n", count);
+}
+
+static void delete_row_from_table(const char *table_name, int64_t rowId)
+{
+    SavvyStatus status = savvy_delete(savvy, currentDatabase, table_name, rowId);
+    if (status == SAVVY_ERR_NOT_FOUND)
+    {
+        printw("Invalid row id: %lld\n", (long long)rowId);
+        return;
+    }
+    if (status != SAVVY_OK)
+    {
+        printw("Failed to delete row %lld: %s\n", (long long)rowId, savvy_status_message(status));
+        return;
+    }
+
+    printw("Row %lld deleted successfully from table '%s'.\n", (long long)rowId, table_name);
+}
+
+static void update_row(const char *table_name, int64_t rowId)
+{
+    SavvyColumn *columns;
+    int numColumns = describe_table(table_name, &columns);
+    if (numColumns < 0)
+    {
+        return;
+    }
+
+    char *current = malloc((numColumns > 0 ? numColumns : 1) * MAX_INPUT);
+    char **values = malloc((numColumns > 0 ? numColumns : 1) * sizeof(char *));
+    if (!current || !values)
+    {
+        printw("Failed to allocate memory for row.\n");
+        free(current);
+        free(values);
+        free(columns);
+        return;
+    }
+    for (int i = 0; i < numColumns; i++)
+    {
+        values[i] = current + i * MAX_INPUT;
+    }
+
+    SavvyStatus status = savvy_get(savvy, currentDatabase, table_name, rowId, values, MAX_INPUT);
+    if (status == SAVVY_OK)
+    {
+        for (int i = 0; i < numColumns; i++)
+        {
+            printw("Current value for %s (index %d): %s\n", columns[i].name, i, values[i]);
+            read_value(table_name, &columns[i], i, rowId, "Enter new value for %s: ", values[i]);
+        }
+        status = savvy_update(savvy, currentDatabase, table_name, rowId, (const char *const *)values);
+    }
+
+    if (status == SAVVY_ERR_NOT_FOUND)
+    {
+        printw("Row %lld does not exist in table '%s'.\n", (long long)rowId, table_name);
+    }
+    else if (status != SAVVY_OK)
+    {
+        printw("Failed to update row %lld: %s\n", (long long)rowId, savvy_status_message(status));
+    }
+    else
+    {
+        printw("Row %lld updated in table '%s'.\n", (long long)rowId, table_name);
+    }
+    free(current);
+    free(values);
+    free(columns);
+}
+
+// Reclaim the deleted slots of a table right away instead of at the next checkpoint
+static void compact_table_slots(const char *table_name)
+{
+    int reclaimed;
+    if (savvy_compact(savvy, currentDatabase, table_name, &reclaimed) != SAVVY_OK)
+    {
+        printw("Table '%s' not found in database '%s'.\n", table_name, currentDatabase);
+        return;
+    }
+    printw("Reclaimed %d deleted row slots in table '%s'.\n", reclaimed, table_name);
+}
+
+static void update_table_schema(const char *tableName, const char *schemaInput)
+{
+    SavvyStatus status = savvy_set_schema(savvy, currentDatabase, tableName, schemaInput);
+    if (status == SAVVY_ERR_INVALID)
+    {
+        printw("Invalid schema: %s\n", schemaInput);
+        printw("A table with rows only gains STRING columns through ALTER TABLE ... ADD ... DEFAULT.\n");
+        return;
+    }
+    if (status != SAVVY_OK)
+    {
+        printw("Failed to update schema of '%s': %s\n", tableName, savvy_status_message(status));
+        return;
+    }
+
+    int columnCount;
+    savvy_describe(savvy, currentDatabase, tableName, NULL, 0, &columnCount);
+    printw("Table '%s' schema updated with %d columns.\n", tableName, columnCount);
+}
 
 void display_menu(const char *title, const char *choices[], int num_choices, int *highlight)
 {
@@ -23,8 +367,35 @@ void display_menu(const char *title, const char *choices[], int num_choices, int
     refresh();
 }
 
-void handle_main_menu()
+// Tell what opening the data files could not recover, before the first menu
+static void report_recovery(void)
+{
+    SavvyRecoveryStats stats;
+    savvy_recovery_stats(savvy, &stats);
+    if (stats.damagedRecord == 0 && stats.defaultedValues == 0)
+    {
+        return;
+    }
+
+    clear();
+    if (stats.damagedRecord > 0)
+    {
+        printw("Stopped log replay at damaged record %d, the changes after it were dropped.\n",
+               stats.damagedRecord);
+    }
+    if (stats.defaultedValues > 0)
+    {
+        printw("%d invalid values of the old text database were loaded as defaults.\n", stats.defaultedValues);
+    }
+    printw("Press any key to continue...\n");
+    refresh();
+    getch();
+}
+
+void handle_main_menu(SavvyDB *db)
 {
+    savvy = db;
+    report_recovery();
     int highlight = 0;
     int choice = 0;
     const char *choices[] = {
@@ -73,7 +444,7 @@ void handle_main_menu()
                 noecho();
                 printf("\n");
 
-                create_database(&dbList, db_name);
+                create_database(db_name);
                 printw("Press any key to go back to the menu...\n");
                 refresh();
                 getch();
@@ -90,9 +461,10 @@ void handle_database_menu()
 {
     int highlight = 0;
     int choice = 0;
-    const char *choices[50 + 1];
+    const char *choices[MAX_LIST + 1];
 
-    int num_choices = list_databases(dbList, choices, sizeof(choices) / sizeof(choices[0]));
+    int num_choices = savvy_list_databases(savvy, choices, MAX_LIST);
+    choices[num_choices++] = "Go Back";
 
     while (1)
     {
@@ -118,7 +490,7 @@ void handle_database_menu()
                 return;
             else
             {
-                dbNode = find_database(dbList, choices[highlight]);
+                snprintf(currentDatabase, sizeof(currentDatabase), "%s", choices[highlight]);
                 handle_table_menu();
             }
             break;
@@ -138,7 +510,7 @@ void handle_table_menu()
 
     char dispText[100];
 
-    snprintf(dispText, sizeof(dispText), "Select Option in %s", dbNode->db.name);
+    snprintf(dispText, sizeof(dispText), "Select Option in %s", currentDatabase);
 
     while (1)
     {
@@ -178,7 +550,7 @@ void handle_table_menu()
                 noecho();
                 refresh();
                 clear();
-                create_table(dbNode, table_name);
+                create_table(table_name);
                 printw("Press any key to go back to the menu...\n");
                 refresh();
                 getch();
@@ -195,8 +567,10 @@ void handle_table_menu()
 void view_tables()
 {
     int highlight = 0;
-    const char *choices[50 + 1];
-    int num_choices = list_tables(dbNode, choices);
+    const char *choices[MAX_LIST + 1];
+    int num_choices;
+    savvy_list_tables(savvy, currentDatabase, choices, MAX_LIST, &num_choices);
+    choices[num_choices++] = "Go Back";
 
     while (1)
     {
@@ -231,36 +605,102 @@ void view_tables()
     }
 }
 
+// Whether a statement is a SELECT, whose rows are paged through a cursor
+static int is_select(const char *text)
+{
+    static const char keyword[] = "SELECT";
+    while (isspace((unsigned char)*text))
+    {
+        text++;
+    }
+    for (int i = 0; keyword[i]; i++)
+    {
+        if (toupper((unsigned char)text[i]) != keyword[i])
+        {
+            return 0;
+        }
+    }
+    return !isalnum((unsigned char)text[sizeof(keyword) - 1]);
+}
+
 void open_playground()
 {
-    clear();
-    mvprintw(0, 0, "Welcome to the Playground!");
-    char user_input[MAX_INPUT];
-    mvprintw(2, 0, "ID\tName\tAddress");
-    mvprintw(3, 0, "1\tTom\t123");
-    mvprintw(4, 0, "2\tBob\t456");
-    mvprintw(5, 0, "3\tRam\t789\n");
-    printw("Enter your queries below:\n");
-    echo();
-    getstr(user_input);
-    noecho();
-    printw("\nExplanation of query if valid\n");
-    printw("Press any key to go back to the menu...");
-    refresh();
-    getch();
+    char user_input[200];
+    char plan[1024];
+    char error[200];
+
+    scrollok(stdscr, TRUE);
+    while (1)
+    {
+        clear();
+        mvprintw(0, 0, "Welcome to the Playground!");
+        mvprintw(2, 0, "Run SELECT, INSERT, UPDATE or DELETE on the tables of %s, for example:\n", currentDatabase);
+        printw("  SELECT name FROM items WHERE price > 10 AND NOT sold = true LIMIT 5\n");
+        printw("BEGIN, COMMIT and ROLLBACK group changes, leaving rolls back an open transaction.\n");
+        printw("ALTER TABLE items ADD, DROP or RENAME COLUMN changes one column in place, ADD taking a DEFAULT.\n");
+        printw("Enter your queries below, or an empty line to go back:\n");
+        echo();
+        getstr(user_input);
+        noecho();
+        if (user_input[0] == '\0')
+        {
+            break;
+        }
+
+        // Show the plan before running it, the explanation must match what runs
+        SavvyStatus status = savvy_explain(savvy, currentDatabase, user_input, plan, sizeof(plan));
+        if (status != SAVVY_OK)
+        {
+            printw("\nError: %s\n", plan);
+        }
+        else
+        {
+            printw("\nPlan:\n%s\n", plan);
+            int affected;
+            if (is_select(user_input))
+            {
+                SavvyCursor *cursor;
+                status = savvy_cursor_open(savvy, currentDatabase, user_input, &cursor, error, sizeof(error));
+                if (status == SAVVY_OK)
+                {
+                    affected = page_cursor(cursor, 0);
+                    savvy_cursor_close(cursor);
+                }
+            }
+            else
+            {
+                status = savvy_query(savvy, currentDatabase, user_input, NULL, NULL, &affected, error,
+                                     sizeof(error));
+            }
+            if (status != SAVVY_OK)
+            {
+                printw("Error: %s\n", error);
+            }
+            else
+            {
+                printw("%d row(s)\n", affected);
+            }
+        }
+        printw("Press any key to continue...");
+        refresh();
+        getch();
+    }
+    savvy_rollback(savvy); // Fails harmlessly without an open transaction
+    scrollok(stdscr, FALSE);
 }
 
 void handle_record_menu(const char *table_name)
 {
     int highlight = 0;
     int choice = 0;
-    int num_choices = 6;
+    int num_choices = 7;
     const char *choices[] = {
         "Create Record",
         "Read Records",
         "Update Record",
         "Delete Record",
         "Edit Schema",
+        "Compact Table",
         "Go Back"};
 
     while (1)
@@ -283,8 +723,15 @@ void handle_record_menu(const char *table_name)
             }
             break;
         case 10:
-            if (highlight == 5)
+            if (highlight == 6)
                 return;
+            else if (highlight == 5)
+            {
+                clear();
+                compact_table_slots(table_name);
+                printw("Press any key to go back to the menu...");
+                getch();
+            }
             else if (highlight == 4)
             {
                 clear();
@@ -294,7 +741,7 @@ void handle_record_menu(const char *table_name)
                 getstr(schema);
                 noecho();
                 refresh();
-                update_table_schema(dbNode, table_name, schema);
+                update_table_schema(table_name, schema);
                 printw("Press any key to go back to the menu...");
                 getch();
             }
@@ -302,36 +749,34 @@ void handle_record_menu(const char *table_name)
             {
                 clear();
                 echo();
-                add_row_to_table(dbNode, table_name);
+                add_row_to_table(table_name);
                 noecho();
-                write_all_databases_to_file(dbList, "db.txt");
                 getch();
             }
             else if (highlight == 1)
             {
                 clear();
-                echo();
-                list_rows_in_table(dbNode, table_name);
-                noecho();
+                list_rows_in_table(table_name);
+                printw("Press any key to go back to the menu...");
                 getch();
             }
             else if (highlight == 2)
             {
                 char input[MAX_INPUT];
-                int rowIndex;
+                long long rowId;
                 clear();
                 echo();
-                printw("Enter index of value to UPDATE:\n");
+                printw("Enter id of row to UPDATE:\n");
                 getstr(input);
 
-                if (sscanf(input, "%d", &rowIndex) != 1)
+                if (sscanf(input, "%lld", &rowId) != 1)
                 {
                     printw("Invalid input. Please enter a valid number.\n");
                     getch();
                 }
                 else
                 {
-                    update_row(dbNode, table_name, rowIndex);
+                    update_row(table_name, rowId);
                     getch();
                 }
                 noecho();
@@ -339,20 +784,20 @@ void handle_record_menu(const char *table_name)
             else if (highlight == 3)
             {
                 char input[MAX_INPUT];
-                int rowIndex;
+                long long rowId;
                 clear();
                 echo();
-                printw("Enter index of value to DELETE:\n");
+                printw("Enter id of row to DELETE:\n");
                 getstr(input);
 
-                if (sscanf(input, "%d", &rowIndex) != 1)
+                if (sscanf(input, "%lld", &rowId) != 1)
                 {
                     printw("Invalid input. Please enter a valid number.\n");
                     getch();
                 }
                 else
                 {
-                    delete_row_from_table(dbNode, table_name, rowIndex);
+                    delete_row_from_table(table_name, rowId);
                     getch();
                 }
 
@@ -0,0 +1,210 @@
+#include "mvcc.h"
+#include <stdlib.h>
+
+// Memory retired while readers were registered, newest first
+typedef struct Retired
+{
+    void *memory;
+    uint64_t epoch;
+    struct Retired *next;
+} Retired;
+
+// Readers of every handle share one registry, so memory retired by any
+// writer waits for all of them
+static Mutex registryLock = MUTEX_INITIALIZER;
+static Cond readersLeft = COND_INITIALIZER;
+static MvccReader *readers;
+static Retired *retired;
+static uint64_t epoch;
+
+void mvcc_init(Mvcc *mvcc)
+{
+    mutex_init(&mvcc->writeLock);
+    mvcc->committed = TXN_NONE + 1;
+    mvcc->nextTxn = mvcc->committed + 1;
+    mvcc->numReaders = 0;
+    mvcc->exclusive = 0;
+}
+
+void mvcc_destroy(Mvcc *mvcc)
+{
+    mutex_destroy(&mvcc->writeLock);
+}
+
+// Free the retired memory no registered reader can still hold, called with the registry locked
+static void free_retired(void)
+{
+    uint64_t oldest = UINT64_MAX;
+    for (MvccReader *reader = readers; reader; reader = reader->next)
+    {
+        if (reader->epoch < oldest)
+        {
+            oldest = reader->epoch;
+        }
+    }
+
+    Retired **link = &retired;
+    while (*link)
+    {
+        Retired *item = *link;
+        if (item->epoch < oldest)
+        {
+            *link = item->next;
+            free(item->memory);
+            free(item);
+        }
+        else
+        {
+            link = &item->next;
+        }
+    }
+}
+
+// Register a reader and return its snapshot. Waits while readers are locked out.
+uint64_t mvcc_begin_read(Mvcc *mvcc, MvccReader *reader)
+{
+    mutex_lock(&registryLock);
+    while (mvcc->exclusive)
+    {
+        cond_wait(&readersLeft, &registryLock);
+    }
+    reader->owner = mvcc;
+    reader->snapshot = atomic_load_acquire(&mvcc->committed);
+    reader->epoch = epoch;
+    reader->next = readers;
+    readers = reader;
+    mvcc->numReaders++;
+    mutex_unlock(&registryLock);
+    return reader->snapshot;
+}
+
+void mvcc_end_read(MvccReader *reader)
+{
+    mutex_lock(&registryLock);
+    MvccReader **link = &readers;
+    while (*link != reader)
+    {
+        link = &(*link)->next;
+    }
+    *link = reader->next;
+    reader->owner->numReaders--;
+    free_retired();
+    cond_broadcast(&readersLeft);
+    mutex_unlock(&registryLock);
+}
+
+// Wait for the other writers and return the id of the new transaction
+uint64_t mvcc_begin_write(Mvcc *mvcc)
+{
+    mutex_lock(&mvcc->writeLock);
+    return mvcc->nextTxn++;
+}
+
+// Take the writer's place without a transaction if no writer is running, for
+// upkeep that changes no rows. Returns 0 if one is, end with mvcc_end_write.
+int mvcc_try_begin_write(Mvcc *mvcc)
+{
+    return mutex_trylock(&mvcc->writeLock);
+}
+
+// Let the next writer in. Its transaction may commit before this one is
+// published, the changes of both are then published together.
+void mvcc_end_write(Mvcc *mvcc)
+{
+    mutex_unlock(&mvcc->writeLock);
+}
+
+// Make a transaction's changes, and those of every transaction before it,
+// visible to new snapshots
+void mvcc_publish(Mvcc *mvcc, uint64_t txn)
+{
+    uint64_t committed = atomic_load_acquire(&mvcc->committed);
+    while (committed < txn)
+    {
+        // A failed exchange reloads committed
+        if (__atomic_compare_exchange_n(&mvcc->committed, &committed, txn, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+    }
+}
+
+// Wait until no reader is registered and keep new ones out, for the writer only.
+// Readers are not locked out while others wait, so a reader that writes or
+// reads again from a callback cannot deadlock against the writer.
+void mvcc_lock_readers(Mvcc *mvcc)
+{
+    mutex_lock(&registryLock);
+    while (mvcc->numReaders > 0)
+    {
+        cond_wait(&readersLeft, &registryLock);
+    }
+    mvcc->exclusive++;
+    mutex_unlock(&registryLock);
+}
+
+// Lock the readers out only if none is registered, returns 0 otherwise. Locks
+// nest, a writer that locked them out already can lock them again.
+int mvcc_try_lock_readers(Mvcc *mvcc)
+{
+    mutex_lock(&registryLock);
+    int locked = mvcc->numReaders == 0;
+    if (locked)
+    {
+        mvcc->exclusive++;
+    }
+    mutex_unlock(&registryLock);
+    return locked;
+}
+
+void mvcc_unlock_readers(Mvcc *mvcc)
+{
+    mutex_lock(&registryLock);
+    mvcc->exclusive--;
+    cond_broadcast(&readersLeft);
+    mutex_unlock(&registryLock);
+}
+
+// Oldest snapshot still registered, versions expired at or before it are garbage
+uint64_t mvcc_horizon(Mvcc *mvcc)
+{
+    mutex_lock(&registryLock);
+    uint64_t horizon = atomic_load_acquire(&mvcc->committed);
+    for (MvccReader *reader = readers; reader; reader = reader->next)
+    {
+        if (reader->owner == mvcc && reader->snapshot < horizon)
+        {
+            horizon = reader->snapshot;
+        }
+    }
+    mutex_unlock(&registryLock);
+    return horizon;
+}
+
+// Free memory readers may still be using once they have all left. Memory
+// replaced before retiring it is never seen by readers that register later.
+void mvcc_retire(void *memory)
+{
+    if (!memory)
+    {
+        return;
+    }
+
+    // Without the memory to queue it, it is never freed rather than freed too early
+    mutex_lock(&registryLock);
+    int inUse = readers != NULL;
+    Retired *item = inUse ? malloc(sizeof(Retired)) : NULL;
+    if (item)
+    {
+        item->memory = memory;
+        item->epoch = epoch++;
+        item->next = retired;
+        retired = item;
+    }
+    mutex_unlock(&registryLock);
+
+    if (!inUse)
+    {
+        free(memory);
+    }
+}
@@ -0,0 +1,134 @@
+#include "dbms.h"
+
+#define NAME_MAP_MIN_CAPACITY 16
+
+// Marks a slot whose entry was removed, probing continues past it
+static char deletedName;
+#define DELETED_NAME (&deletedName)
+
+void name_map_init(NameMap *map)
+{
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    map->used = 0;
+}
+
+void name_map_free(NameMap *map)
+{
+    free(map->entries);
+    name_map_init(map);
+}
+
+static int is_live(const NameEntry *entry)
+{
+    return entry->name && entry->name != DELETED_NAME;
+}
+
+static int resize_map(NameMap *map, int capacity)
+{
+    NameEntry *entries = calloc(capacity, sizeof(NameEntry));
+    if (!entries)
+    {
+        return 0;
+    }
+
+    int mask = capacity - 1;
+    for (int i = 0; i < map->capacity; i++)
+    {
+        if (is_live(&map->entries[i]))
+        {
+            int slot = map->entries[i].hash & mask;
+            while (entries[slot].name)
+            {
+                slot = (slot + 1) & mask;
+            }
+            entries[slot] = map->entries[i];
+        }
+    }
+
+    free(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+    map->used = map->count;
+    return 1;
+}
+
+// Slot holding the name, or -1 if it is not in the map
+static int find_slot(const NameMap *map, const char *name, unsigned int hash)
+{
+    if (map->capacity == 0)
+    {
+        return -1;
+    }
+
+    int mask = map->capacity - 1;
+    int slot = hash & mask;
+    while (map->entries[slot].name)
+    {
+        const NameEntry *entry = &map->entries[slot];
+        if (is_live(entry) && entry->hash == hash && strcmp(entry->name, name) == 0)
+        {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+// Add a name, returns 0 if it is already taken or memory runs out
+int name_map_put(NameMap *map, const char *name, void *node)
+{
+    unsigned int hash = hash_value(name);
+    if (find_slot(map, name, hash) >= 0)
+    {
+        return 0;
+    }
+
+    // Keep the load factor (including deleted markers) under 3/4
+    if ((map->used + 1) * 4 > map->capacity * 3)
+    {
+        int capacity = map->capacity ? map->capacity : NAME_MAP_MIN_CAPACITY;
+        while ((map->count + 1) * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        if (!resize_map(map, capacity))
+        {
+            return 0;
+        }
+    }
+
+    int mask = map->capacity - 1;
+    int slot = hash & mask;
+    while (is_live(&map->entries[slot]))
+    {
+        slot = (slot + 1) & mask;
+    }
+    if (!map->entries[slot].name)
+    {
+        map->used++;
+    }
+    map->entries[slot].name = name;
+    map->entries[slot].node = node;
+    map->entries[slot].hash = hash;
+    map->count++;
+    return 1;
+}
+
+void *name_map_get(const NameMap *map, const char *name)
+{
+    int slot = find_slot(map, name, hash_value(name));
+    return slot >= 0 ? map->entries[slot].node : NULL;
+}
+
+void name_map_remove(NameMap *map, const char *name)
+{
+    int slot = find_slot(map, name, hash_value(name));
+    if (slot >= 0)
+    {
+        map->entries[slot].name = DELETED_NAME;
+        map->entries[slot].node = NULL;
+        map->count--;
+    }
+}
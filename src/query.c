@@ -0,0 +1,2110 @@
+#include "query.h"
+#include <ctype.h>
+#include <stdarg.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+typedef enum
+{
+    TOKEN_END,
+    TOKEN_WORD,   // Keyword, name or unquoted literal
+    TOKEN_NUMBER, // Starts with a digit, sign or point
+    TOKEN_STRING, // Quoted literal, without the quotes
+    TOKEN_SYMBOL
+} TokenType;
+
+typedef struct
+{
+    TokenType type;
+    char text[MAX_INPUT];
+} Token;
+
+typedef struct
+{
+    const char *pos;
+    Token token;
+    char *error;
+    size_t errorSize;
+    int failed;
+    Query *query; // Statement being parsed, for its parameters
+} Parser;
+
+// Keep the first error, later ones are usually caused by it
+static void parse_error(Parser *parser, const char *format, ...)
+{
+    if (parser->failed)
+    {
+        return;
+    }
+    parser->failed = 1;
+    if (parser->error && parser->errorSize > 0)
+    {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(parser->error, parser->errorSize, format, args);
+        va_end(args);
+    }
+}
+
+static void next_token(Parser *parser)
+{
+    const char *p = parser->pos;
+    while (isspace((unsigned char)*p))
+    {
+        p++;
+    }
+
+    Token *token = &parser->token;
+    size_t length = 0;
+    token->text[0] = '\0';
+    if (*p == '\0')
+    {
+        token->type = TOKEN_END;
+        parser->pos = p;
+        return;
+    }
+
+    if (*p == '\'')
+    {
+        // Quoted literal, '' stands for a quote inside it
+        token->type = TOKEN_STRING;
+        p++;
+        while (*p && !(*p == '\'' && p[1] != '\''))
+        {
+            if (*p == '\'')
+            {
+                p++;
+            }
+            if (length + 1 >= sizeof(token->text))
+            {
+                parse_error(parser, "Value too long, at most %d characters", MAX_INPUT - 1);
+                break;
+            }
+            token->text[length++] = *p++;
+        }
+        if (*p != '\'')
+        {
+            parse_error(parser, "Unterminated string");
+        }
+        else
+        {
+            p++;
+        }
+    }
+    else if (isalnum((unsigned char)*p) || *p == '_' || *p == '-' || *p == '+' || *p == '.')
+    {
+        token->type = isalpha((unsigned char)*p) || *p == '_' ? TOKEN_WORD : TOKEN_NUMBER;
+        do
+        {
+            if (length + 1 >= sizeof(token->text))
+            {
+                parse_error(parser, "Word too long, at most %d characters", MAX_INPUT - 1);
+                break;
+            }
+            token->text[length++] = *p++;
+        } while (isalnum((unsigned char)*p) || *p == '_' || *p == '.' ||
+                 ((*p == '-' || *p == '+') && (p[-1] == 'e' || p[-1] == 'E') && token->type == TOKEN_NUMBER));
+    }
+    else
+    {
+        // Two character comparisons first
+        token->type = TOKEN_SYMBOL;
+        token->text[length++] = *p++;
+        if ((token->text[0] == '<' && (*p == '=' || *p == '>')) ||
+            ((token->text[0] == '>' || token->text[0] == '!' || token->text[0] == '=') && *p == '='))
+        {
+            token->text[length++] = *p++;
+        }
+    }
+
+    token->text[length] = '\0';
+    parser->pos = p;
+}
+
+static int is_keyword(const Token *token, const char *keyword)
+{
+    if (token->type != TOKEN_WORD)
+    {
+        return 0;
+    }
+    const char *a = token->text;
+    while (*a && *keyword && toupper((unsigned char)*a) == *keyword)
+    {
+        a++;
+        keyword++;
+    }
+    return *a == '\0' && *keyword == '\0';
+}
+
+static int is_symbol(const Token *token, const char *symbol)
+{
+    return token->type == TOKEN_SYMBOL && strcmp(token->text, symbol) == 0;
+}
+
+static const char *token_text(const Token *token)
+{
+    return token->type == TOKEN_END ? "end of query" : token->text;
+}
+
+static void expect_keyword(Parser *parser, const char *keyword)
+{
+    if (!is_keyword(&parser->token, keyword))
+    {
+        parse_error(parser, "Expected %s near '%s'", keyword, token_text(&parser->token));
+        return;
+    }
+    next_token(parser);
+}
+
+static void expect_symbol(Parser *parser, const char *symbol)
+{
+    if (!is_symbol(&parser->token, symbol))
+    {
+        parse_error(parser, "Expected '%s' near '%s'", symbol, token_text(&parser->token));
+        return;
+    }
+    next_token(parser);
+}
+
+static void expect_name(Parser *parser, char *name)
+{
+    if (parser->token.type != TOKEN_WORD)
+    {
+        parse_error(parser, "Expected a name near '%s'", token_text(&parser->token));
+        return;
+    }
+    strcpy(name, parser->token.text);
+    next_token(parser);
+}
+
+static void expect_literal(Parser *parser, char *literal)
+{
+    if (parser->token.type == TOKEN_END || parser->token.type == TOKEN_SYMBOL)
+    {
+        parse_error(parser, "Expected a value near '%s'", token_text(&parser->token));
+        return;
+    }
+    strcpy(literal, parser->token.text);
+    next_token(parser);
+}
+
+// Note a ? standing for a value and move past it. Returns its number, or 0
+// if the value is written out or memory runs out.
+static int accept_param(Parser *parser, Expr *expr, int value)
+{
+    if (!is_symbol(&parser->token, "?"))
+    {
+        return 0;
+    }
+    Query *query = parser->query;
+    QueryParam *params = realloc(query->params, (query->numParams + 1) * sizeof(QueryParam));
+    if (!params)
+    {
+        parse_error(parser, "Out of memory");
+        return 0;
+    }
+    query->params = params;
+    params[query->numParams].expr = expr;
+    params[query->numParams].value = value;
+    params[query->numParams].isSet = 0;
+    next_token(parser);
+    return ++query->numParams;
+}
+
+// Append a slot to an array of MAX_INPUT strings, returns NULL if memory runs out
+static char *push_text(Parser *parser, char (**array)[MAX_INPUT], int *count)
+{
+    char(*grown)[MAX_INPUT] = realloc(*array, (*count + 1) * sizeof(**array));
+    if (!grown)
+    {
+        parse_error(parser, "Out of memory");
+        return NULL;
+    }
+    *array = grown;
+    grown[*count][0] = '\0';
+    return grown[(*count)++];
+}
+
+static void free_expr(Expr *expr)
+{
+    if (expr)
+    {
+        free_expr(expr->left);
+        free_expr(expr->right);
+        free(expr);
+    }
+}
+
+static Expr *new_expr(Parser *parser, ExprKind kind, Expr *left, Expr *right)
+{
+    Expr *expr = calloc(1, sizeof(Expr));
+    if (!expr)
+    {
+        parse_error(parser, "Out of memory");
+        free_expr(left);
+        free_expr(right);
+        return NULL;
+    }
+    expr->kind = kind;
+    expr->left = left;
+    expr->right = right;
+    return expr;
+}
+
+static Expr *parse_or(Parser *parser);
+
+static Expr *parse_comparison(Parser *parser)
+{
+    if (is_symbol(&parser->token, "("))
+    {
+        next_token(parser);
+        Expr *inner = parse_or(parser);
+        expect_symbol(parser, ")");
+        return inner;
+    }
+
+    static const struct
+    {
+        const char *symbol;
+        CompareOp op;
+    } operators[] = {{"=", CMP_EQ}, {"==", CMP_EQ}, {"!=", CMP_NE}, {"<>", CMP_NE}, {"<", CMP_LT}, {"<=", CMP_LE}, {">", CMP_GT}, {">=", CMP_GE}};
+
+    Expr *expr = new_expr(parser, EXPR_COMPARE, NULL, NULL);
+    if (!expr)
+    {
+        return NULL;
+    }
+    expect_name(parser, expr->column);
+
+    int found = 0;
+    for (size_t i = 0; !parser->failed && i < sizeof(operators) / sizeof(operators[0]); i++)
+    {
+        if (is_symbol(&parser->token, operators[i].symbol))
+        {
+            expr->op = operators[i].op;
+            found = 1;
+            break;
+        }
+    }
+    if (!found)
+    {
+        parse_error(parser, "Expected a comparison near '%s'", token_text(&parser->token));
+    }
+    next_token(parser);
+    expr->param = accept_param(parser, expr, -1);
+    if (!expr->param)
+    {
+        expect_literal(parser, expr->literal);
+    }
+    return expr;
+}
+
+static Expr *parse_not(Parser *parser)
+{
+    if (is_keyword(&parser->token, "NOT"))
+    {
+        next_token(parser);
+        Expr *operand = parse_not(parser);
+        return operand ? new_expr(parser, EXPR_NOT, operand, NULL) : NULL;
+    }
+    return parse_comparison(parser);
+}
+
+static Expr *parse_and(Parser *parser)
+{
+    Expr *left = parse_not(parser);
+    while (left && !parser->failed && is_keyword(&parser->token, "AND"))
+    {
+        next_token(parser);
+        Expr *right = parse_not(parser);
+        left = right ? new_expr(parser, EXPR_AND, left, right) : (free_expr(left), NULL);
+    }
+    return left;
+}
+
+static Expr *parse_or(Parser *parser)
+{
+    Expr *left = parse_and(parser);
+    while (left && !parser->failed && is_keyword(&parser->token, "OR"))
+    {
+        next_token(parser);
+        Expr *right = parse_and(parser);
+        left = right ? new_expr(parser, EXPR_OR, left, right) : (free_expr(left), NULL);
+    }
+    return left;
+}
+
+static void parse_where(Parser *parser, Query *query)
+{
+    if (is_keyword(&parser->token, "WHERE"))
+    {
+        next_token(parser);
+        query->where = parse_or(parser);
+    }
+}
+
+static AggregateKind aggregate_kind(const Parser *parser)
+{
+    static const char *const names[] = {"COUNT", "SUM", "MIN", "MAX", "AVG"};
+    const char *p = parser->pos;
+    while (isspace((unsigned char)*p))
+    {
+        p++;
+    }
+
+    // A function name is only a keyword right before its parenthesis, so columns may still be called count
+    for (int i = 0; *p == '(' && i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (is_keyword(&parser->token, names[i]))
+        {
+            return (AggregateKind)(AGG_COUNT + i);
+        }
+    }
+    return AGG_NONE;
+}
+
+// One SELECT item, a column or an aggregate of one
+static void parse_item(Parser *parser, Query *query)
+{
+    char *name = push_text(parser, &query->names, &query->numNames);
+    if (!name)
+    {
+        return;
+    }
+    AggregateKind *functions = realloc(query->functions, query->numNames * sizeof(AggregateKind));
+    if (!functions)
+    {
+        parse_error(parser, "Out of memory");
+        return;
+    }
+    query->functions = functions;
+
+    AggregateKind kind = aggregate_kind(parser);
+    functions[query->numNames - 1] = kind;
+    if (kind == AGG_NONE)
+    {
+        expect_name(parser, name);
+        return;
+    }
+
+    query->numAggregates++;
+    next_token(parser);
+    expect_symbol(parser, "(");
+    if (kind == AGG_COUNT && is_symbol(&parser->token, "*"))
+    {
+        strcpy(name, "*");
+        next_token(parser);
+    }
+    else
+    {
+        expect_name(parser, name);
+    }
+    expect_symbol(parser, ")");
+}
+
+static void parse_select(Parser *parser, Query *query)
+{
+    if (is_symbol(&parser->token, "*"))
+    {
+        next_token(parser);
+    }
+    else
+    {
+        do
+        {
+            if (query->numNames > 0)
+            {
+                next_token(parser);
+            }
+            parse_item(parser, query);
+        } while (!parser->failed && is_symbol(&parser->token, ","));
+    }
+
+    expect_keyword(parser, "FROM");
+    expect_name(parser, query->table);
+
+    if (!parser->failed && (is_keyword(&parser->token, "JOIN") || is_keyword(&parser->token, "INNER")))
+    {
+        if (is_keyword(&parser->token, "INNER"))
+        {
+            next_token(parser);
+        }
+        expect_keyword(parser, "JOIN");
+        expect_name(parser, query->joinTable);
+        expect_keyword(parser, "ON");
+        expect_name(parser, query->joinKeys[0]);
+        if (is_symbol(&parser->token, "=="))
+        {
+            next_token(parser);
+        }
+        else
+        {
+            expect_symbol(parser, "=");
+        }
+        expect_name(parser, query->joinKeys[1]);
+    }
+    parse_where(parser, query);
+
+    if (!parser->failed && is_keyword(&parser->token, "GROUP"))
+    {
+        next_token(parser);
+        expect_keyword(parser, "BY");
+        expect_name(parser, query->groupBy);
+    }
+
+    if (!parser->failed && is_keyword(&parser->token, "ORDER"))
+    {
+        next_token(parser);
+        expect_keyword(parser, "BY");
+        expect_name(parser, query->orderBy);
+        if (is_keyword(&parser->token, "ASC") || is_keyword(&parser->token, "DESC"))
+        {
+            query->descending = is_keyword(&parser->token, "DESC");
+            next_token(parser);
+        }
+    }
+
+    if (!parser->failed && is_keyword(&parser->token, "LIMIT"))
+    {
+        next_token(parser);
+        char *end;
+        query->limit = strtoll(parser->token.text, &end, 10);
+        if (parser->token.type != TOKEN_NUMBER || *end != '\0' || query->limit < 0)
+        {
+            parse_error(parser, "Expected a row count near '%s'", token_text(&parser->token));
+        }
+        next_token(parser);
+    }
+}
+
+static void parse_insert(Parser *parser, Query *query)
+{
+    expect_keyword(parser, "INTO");
+    expect_name(parser, query->table);
+    expect_keyword(parser, "VALUES");
+
+    int width = -1;
+    do
+    {
+        if (query->numRows > 0)
+        {
+            next_token(parser);
+        }
+        expect_symbol(parser, "(");
+        int count = 0;
+        while (!parser->failed)
+        {
+            char *value = push_text(parser, &query->values, &query->numValues);
+            if (value && !accept_param(parser, NULL, query->numValues - 1))
+            {
+                expect_literal(parser, value);
+            }
+            count++;
+            if (!is_symbol(&parser->token, ","))
+            {
+                break;
+            }
+            next_token(parser);
+        }
+        expect_symbol(parser, ")");
+
+        if (width >= 0 && count != width && !parser->failed)
+        {
+            parse_error(parser, "Row %d has %d values instead of %d", query->numRows + 1, count, width);
+        }
+        width = count;
+        query->numRows++;
+    } while (!parser->failed && is_symbol(&parser->token, ","));
+}
+
+static void parse_update(Parser *parser, Query *query)
+{
+    expect_name(parser, query->table);
+    expect_keyword(parser, "SET");
+    do
+    {
+        if (query->numNames > 0)
+        {
+            next_token(parser);
+        }
+        char *name = push_text(parser, &query->names, &query->numNames);
+        char *value = name ? push_text(parser, &query->values, &query->numValues) : NULL;
+        if (value)
+        {
+            expect_name(parser, name);
+            expect_symbol(parser, "=");
+            if (!accept_param(parser, NULL, query->numValues - 1))
+            {
+                expect_literal(parser, value);
+            }
+        }
+    } while (!parser->failed && is_symbol(&parser->token, ","));
+    parse_where(parser, query);
+}
+
+// Column name after ADD, DROP or RENAME, which may be followed by COLUMN
+static void expect_column_name(Parser *parser, char *name)
+{
+    if (is_keyword(&parser->token, "COLUMN"))
+    {
+        next_token(parser);
+    }
+    expect_name(parser, name);
+}
+
+static void parse_alter(Parser *parser, Query *query)
+{
+    expect_keyword(parser, "TABLE");
+    expect_name(parser, query->table);
+    Column *column = &query->column;
+    if (!parser->failed && is_keyword(&parser->token, "ADD"))
+    {
+        query->alter = ALTER_ADD;
+        next_token(parser);
+        expect_column_name(parser, column->name);
+
+        char type[MAX_INPUT];
+        strcpy(type, parser->token.text);
+        for (char *c = type; *c; c++)
+        {
+            *c = (char)toupper((unsigned char)*c);
+        }
+        int parsed = parser->token.type == TOKEN_WORD ? parse_column_type(type) : -1;
+        if (parsed < 0 && !parser->failed)
+        {
+            parse_error(parser, "Expected INTEGER, STRING, BOOLEAN or FLOAT near '%s'", token_text(&parser->token));
+        }
+        column->type = parsed < 0 ? INTEGER : (ColumnType)parsed;
+        next_token(parser);
+        while (!parser->failed && parser->token.type == TOKEN_WORD)
+        {
+            int *flag = is_keyword(&parser->token, "UNIQUE")       ? &column->isUnique
+                        : is_keyword(&parser->token, "ORDERED")    ? &column->isOrdered
+                        : is_keyword(&parser->token, "DICTIONARY") ? &column->isDictionary
+                                                                   : NULL;
+            if (!flag)
+            {
+                break;
+            }
+            *flag = 1;
+            next_token(parser);
+        }
+        if (!parser->failed && is_keyword(&parser->token, "DEFAULT"))
+        {
+            next_token(parser);
+            expect_literal(parser, query->columnDefault);
+        }
+    }
+    else if (!parser->failed && is_keyword(&parser->token, "DROP"))
+    {
+        query->alter = ALTER_DROP;
+        next_token(parser);
+        expect_column_name(parser, column->name);
+    }
+    else if (!parser->failed && is_keyword(&parser->token, "RENAME"))
+    {
+        query->alter = ALTER_RENAME;
+        next_token(parser);
+        expect_column_name(parser, column->name);
+        expect_keyword(parser, "TO");
+        expect_name(parser, query->newName);
+    }
+    else
+    {
+        parse_error(parser, "Expected ADD, DROP or RENAME near '%s'", token_text(&parser->token));
+    }
+}
+
+// Parse a statement, returns NULL with a message in error if it is malformed
+Query *query_parse(const char *text, char *error, size_t errorSize)
+{
+    Query *query = calloc(1, sizeof(Query));
+    Parser parser = {text, {TOKEN_END, ""}, error, errorSize, 0, query};
+    if (!query)
+    {
+        parse_error(&parser, "Out of memory");
+        return NULL;
+    }
+    query->limit = -1;
+    query->threads = 1;
+    query->snapshot = TXN_LATEST;
+    query->joinMemory = JOIN_MEMORY_LIMIT;
+
+    next_token(&parser);
+    if (is_keyword(&parser.token, "SELECT"))
+    {
+        query->kind = QUERY_SELECT;
+        next_token(&parser);
+        parse_select(&parser, query);
+    }
+    else if (is_keyword(&parser.token, "INSERT"))
+    {
+        query->kind = QUERY_INSERT;
+        next_token(&parser);
+        parse_insert(&parser, query);
+    }
+    else if (is_keyword(&parser.token, "UPDATE"))
+    {
+        query->kind = QUERY_UPDATE;
+        next_token(&parser);
+        parse_update(&parser, query);
+    }
+    else if (is_keyword(&parser.token, "DELETE"))
+    {
+        query->kind = QUERY_DELETE;
+        next_token(&parser);
+        expect_keyword(&parser, "FROM");
+        expect_name(&parser, query->table);
+        parse_where(&parser, query);
+    }
+    else if (is_keyword(&parser.token, "ALTER"))
+    {
+        query->kind = QUERY_ALTER;
+        next_token(&parser);
+        parse_alter(&parser, query);
+    }
+    else if (is_keyword(&parser.token, "BEGIN"))
+    {
+        query->kind = QUERY_BEGIN;
+        next_token(&parser);
+        if (is_keyword(&parser.token, "TRANSACTION"))
+        {
+            next_token(&parser);
+        }
+    }
+    else if (is_keyword(&parser.token, "COMMIT"))
+    {
+        query->kind = QUERY_COMMIT;
+        next_token(&parser);
+    }
+    else if (is_keyword(&parser.token, "ROLLBACK"))
+    {
+        query->kind = QUERY_ROLLBACK;
+        next_token(&parser);
+    }
+    else
+    {
+        parse_error(&parser, "Expected SELECT, INSERT, UPDATE, DELETE, ALTER, BEGIN, COMMIT or ROLLBACK near '%s'",
+                    token_text(&parser.token));
+    }
+
+    if (is_symbol(&parser.token, ";"))
+    {
+        next_token(&parser);
+    }
+    if (parser.token.type != TOKEN_END)
+    {
+        parse_error(&parser, "Unexpected '%s'", parser.token.text);
+    }
+    if (parser.failed)
+    {
+        query_free(query);
+        return NULL;
+    }
+    return query;
+}
+
+static int find_column(const Table *table, const char *name)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (strcmp(table->columns[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    // A real column of that name takes precedence
+    return strcmp(name, "rowid") == 0 ? QUERY_ROW_ID : -2;
+}
+
+static int bind_expr(Parser *parser, Expr *expr, const Table *table)
+{
+    if (expr->kind != EXPR_COMPARE)
+    {
+        return bind_expr(parser, expr->left, table) && (!expr->right || bind_expr(parser, expr->right, table));
+    }
+
+    expr->colIndex = find_column(table, expr->column);
+    if (expr->colIndex == -2)
+    {
+        parse_error(parser, "No column '%s' in table '%s'", expr->column, table->name);
+        return 0;
+    }
+
+    ColumnType type = expr->colIndex == QUERY_ROW_ID ? INTEGER : table->columns[expr->colIndex].type;
+    if (expr->param && !expr->literal[0])
+    {
+        // Only typed until query_set_param gives it a value
+        expr->value.type = type;
+        return 1;
+    }
+    if (!parse_value(expr->literal, type, &expr->value))
+    {
+        parse_error(parser, "Invalid value '%s' for column '%s'", expr->literal, expr->column);
+        return 0;
+    }
+    return 1;
+}
+
+// Pick the access path from an equality on rowid or a unique column among the
+// conditions that all rows must meet, preferring the row id
+static void choose_access(Query *query, const Table *table, const Expr *expr)
+{
+    if (expr->kind == EXPR_AND)
+    {
+        choose_access(query, table, expr->left);
+        choose_access(query, table, expr->right);
+        return;
+    }
+    if (expr->kind != EXPR_COMPARE || expr->op != CMP_EQ || query->access == ACCESS_ROW_ID)
+    {
+        return;
+    }
+
+    if (expr->colIndex == QUERY_ROW_ID)
+    {
+        query->access = ACCESS_ROW_ID;
+        query->accessExpr = expr;
+    }
+    else if (table->columns[expr->colIndex].isUnique && query->access == ACCESS_SCAN)
+    {
+        query->access = ACCESS_INDEX;
+        query->accessExpr = expr;
+    }
+}
+
+static int compare_values(const Value *a, const Value *b)
+{
+    switch (a->type)
+    {
+    case FLOAT:
+        return (a->as.f > b->as.f) - (a->as.f < b->as.f);
+    case BOOLEAN:
+        return a->as.b - b->as.b;
+    case STRING:
+        return strcmp(a->as.s, b->as.s);
+    default:
+        return (a->as.i > b->as.i) - (a->as.i < b->as.i);
+    }
+}
+
+// The bound that excludes more, a lower bound keeps the larger value
+static const Expr *tighter_bound(const Expr *current, const Expr *candidate, int lower)
+{
+    if (!current)
+    {
+        return candidate;
+    }
+    int order = compare_values(&candidate->value, &current->value);
+    if (order == 0)
+    {
+        return candidate->op == CMP_LT || candidate->op == CMP_GT ? candidate : current;
+    }
+    return (lower ? order > 0 : order < 0) ? candidate : current;
+}
+
+// Gather the bounds on a column from the conditions that all rows must meet
+static void collect_bounds(Query *query, const Expr *expr, int col)
+{
+    if (expr->kind == EXPR_AND)
+    {
+        collect_bounds(query, expr->left, col);
+        collect_bounds(query, expr->right, col);
+        return;
+    }
+    if (expr->kind != EXPR_COMPARE || expr->colIndex != col || expr->op == CMP_NE ||
+        (expr->param && !expr->literal[0]))
+    {
+        return;
+    }
+    if (expr->op != CMP_LT && expr->op != CMP_LE)
+    {
+        query->lowerBound = tighter_bound(query->lowerBound, expr, 1);
+    }
+    if (expr->op != CMP_GT && expr->op != CMP_GE)
+    {
+        query->upperBound = tighter_bound(query->upperBound, expr, 0);
+    }
+}
+
+// Walk an ordered column's B+-tree when ORDER BY asks for its order or the
+// conditions bound it, preferring the ORDER BY column. Single row lookups
+// are kept and need no sort.
+static void choose_range(Query *query, const Table *table)
+{
+    // Aggregates order their groups themselves
+    query->needsSort = query->orderBy[0] != '\0' && query->access == ACCESS_SCAN && !query_is_aggregate(query);
+    if (query->access != ACCESS_SCAN)
+    {
+        return;
+    }
+
+    if (query->needsSort && query->orderColumn != QUERY_ROW_ID && table->columns[query->orderColumn].isOrdered)
+    {
+        if (query->where)
+        {
+            collect_bounds(query, query->where, query->orderColumn);
+        }
+        query->access = ACCESS_RANGE;
+        query->rangeColumn = query->orderColumn;
+        query->needsSort = 0;
+    }
+    for (int i = 0; query->access == ACCESS_SCAN && query->where && i < table->numColumns; i++)
+    {
+        if (table->columns[i].isOrdered)
+        {
+            collect_bounds(query, query->where, i);
+            if (query->lowerBound || query->upperBound)
+            {
+                query->access = ACCESS_RANGE;
+                query->rangeColumn = i;
+            }
+        }
+    }
+
+    // A lone comparison is answered by the range itself
+    if (query->access == ACCESS_RANGE && query->where &&
+        (query->where == query->lowerBound || query->where == query->upperBound))
+    {
+        query->accessExpr = query->where;
+    }
+}
+
+int query_is_aggregate(const Query *query)
+{
+    return query->numAggregates > 0 || query->groupBy[0] != '\0';
+}
+
+// Answer a bound query with a full scan instead of its index, for snapshots the
+// indexes no longer describe. ORDER BY is then sorted, so rows come out the same.
+void query_use_scan(Query *query)
+{
+    if (query->access == ACCESS_SCAN)
+    {
+        return;
+    }
+    query->access = ACCESS_SCAN;
+    query->accessExpr = NULL;
+    query->lowerBound = NULL;
+    query->upperBound = NULL;
+    query->needsSort = query->orderBy[0] != '\0' && !query_is_aggregate(query);
+}
+
+// Check that the SELECT items fit the grouping and that sums are taken over numbers
+static int bind_aggregates(Parser *parser, Query *query, const Table *table)
+{
+    if (!query_is_aggregate(query))
+    {
+        return 1;
+    }
+    if (query->numNames == 0)
+    {
+        parse_error(parser, "SELECT * cannot be combined with GROUP BY");
+        return 0;
+    }
+
+    int grouped = query->groupBy[0] != '\0';
+    if (grouped)
+    {
+        query->groupColumn = find_column(table, query->groupBy);
+        if (query->groupColumn == -2)
+        {
+            parse_error(parser, "No column '%s' in table '%s'", query->groupBy, table->name);
+            return 0;
+        }
+    }
+    if (query->orderBy[0] && (!grouped || query->orderColumn != query->groupColumn))
+    {
+        parse_error(parser, "Aggregates can only be ordered by the GROUP BY column");
+        return 0;
+    }
+
+    for (int i = 0; i < query->numNames; i++)
+    {
+        int col = query->columns[i];
+        AggregateKind kind = query->functions[i];
+        if (kind == AGG_NONE && (!grouped || col != query->groupColumn))
+        {
+            parse_error(parser, "Column '%s' must be in GROUP BY or inside an aggregate", query->names[i]);
+            return 0;
+        }
+        if ((kind == AGG_SUM || kind == AGG_AVG) && col != QUERY_ROW_ID && table->columns[col].type != INTEGER &&
+            table->columns[col].type != FLOAT)
+        {
+            parse_error(parser, "%s needs an INTEGER or FLOAT column, '%s' is not one",
+                        kind == AGG_SUM ? "SUM" : "AVG", query->names[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Resolve names against the table and choose the plan, returns 0 with a
+// message in error if the query does not fit the table
+int query_bind(Query *query, const Table *table, char *error, size_t errorSize)
+{
+    Parser parser = {"", {TOKEN_END, ""}, error, errorSize, 0, NULL};
+
+    if (query->joinTable[0])
+    {
+        parse_error(&parser, "A JOIN is bound to both its tables");
+        return 0;
+    }
+
+    if (query->numNames > 0)
+    {
+        int *columns = realloc(query->columns, query->numNames * sizeof(int));
+        if (!columns)
+        {
+            parse_error(&parser, "Out of memory");
+            return 0;
+        }
+        query->columns = columns;
+    }
+    for (int i = 0; i < query->numNames; i++)
+    {
+        query->columns[i] = strcmp(query->names[i], "*") == 0 ? QUERY_ROW_ID : find_column(table, query->names[i]);
+        if (query->columns[i] == -2 || (query->kind == QUERY_UPDATE && query->columns[i] == QUERY_ROW_ID))
+        {
+            parse_error(&parser, "No column '%s' in table '%s'", query->names[i], table->name);
+            return 0;
+        }
+    }
+
+    if (query->kind == QUERY_INSERT && query->numValues != query->numRows * table->numColumns)
+    {
+        parse_error(&parser, "Table '%s' has %d columns, rows have %d values", table->name, table->numColumns,
+                    query->numValues / query->numRows);
+        return 0;
+    }
+
+    query->orderColumn = QUERY_ROW_ID;
+    if (query->orderBy[0])
+    {
+        query->orderColumn = find_column(table, query->orderBy);
+        if (query->orderColumn == -2)
+        {
+            parse_error(&parser, "No column '%s' in table '%s'", query->orderBy, table->name);
+            return 0;
+        }
+    }
+    if (!bind_aggregates(&parser, query, table))
+    {
+        return 0;
+    }
+    if (query->where && !bind_expr(&parser, query->where, table))
+    {
+        return 0;
+    }
+    query_plan(query, table);
+    return 1;
+}
+
+// Choose the access path of a bound query again, from the values its
+// parameters have now. Running it may have switched it to a scan.
+void query_plan(Query *query, const Table *table)
+{
+    query->access = ACCESS_SCAN;
+    query->accessExpr = NULL;
+    query->lowerBound = NULL;
+    query->upperBound = NULL;
+    if (query->where)
+    {
+        choose_access(query, table, query->where);
+    }
+    choose_range(query, table);
+}
+
+// Give the ? numbered param from 1 a value. A comparison of a bound query
+// parses it for its column at once, returns 0 if it does not fit the column
+// or the query has no such parameter.
+int query_set_param(Query *query, int param, const char *value)
+{
+    if (param < 1 || param > query->numParams || strlen(value) >= MAX_INPUT)
+    {
+        return 0;
+    }
+    QueryParam *slot = &query->params[param - 1];
+    Expr *expr = slot->expr;
+    char *literal = expr ? expr->literal : query->values[slot->value];
+    strcpy(literal, value);
+
+    // The conditions of a JOIN are bound through copies on each side
+    if (expr && !query->joinTable[0] && !parse_value(literal, expr->value.type, &expr->value))
+    {
+        literal[0] = '\0';
+        slot->isSet = 0;
+        return 0;
+    }
+    slot->isSet = 1;
+    return 1;
+}
+
+// Forget the values of every parameter
+void query_clear_params(Query *query)
+{
+    for (int i = 0; i < query->numParams; i++)
+    {
+        QueryParam *slot = &query->params[i];
+        char *literal = slot->expr ? slot->expr->literal : query->values[slot->value];
+        literal[0] = '\0';
+        slot->isSet = 0;
+    }
+}
+
+// Resolve a column of a join to its side. A name qualified with either
+// table's name is tried as such first, columns may contain points. Returns -2
+// with a message in error if neither table or both have it.
+static int find_join_column(Parser *parser, const char *name, const Table *const tables[2], int *side)
+{
+    for (int s = 0; s < 2; s++)
+    {
+        size_t length = strlen(tables[s]->name);
+        if (strncmp(name, tables[s]->name, length) == 0 && name[length] == '.')
+        {
+            int col = find_column(tables[s], name + length + 1);
+            if (col != -2)
+            {
+                *side = s;
+                return col;
+            }
+        }
+    }
+
+    int found = -2;
+    for (int s = 0; s < 2; s++)
+    {
+        int col = find_column(tables[s], name);
+        if (col == -2)
+        {
+            continue;
+        }
+        if (found != -2)
+        {
+            parse_error(parser, "Column '%s' is in both tables, qualify it as table.%s", name, name);
+            return -2;
+        }
+        found = col;
+        *side = s;
+    }
+    if (found == -2)
+    {
+        parse_error(parser, "No column '%s' in table '%s' or '%s'", name, tables[0]->name, tables[1]->name);
+    }
+    return found;
+}
+
+// Sides a condition reads, one bit each, 0 if it names an unknown column
+static int expr_sides(Parser *parser, const Expr *expr, const Table *const tables[2])
+{
+    if (expr->kind != EXPR_COMPARE)
+    {
+        int left = expr_sides(parser, expr->left, tables);
+        int right = expr->right ? expr_sides(parser, expr->right, tables) : left;
+        return left && right ? left | right : 0;
+    }
+    int side;
+    return find_join_column(parser, expr->column, tables, &side) == -2 ? 0 : 1 << side;
+}
+
+// Copy a condition on one side of a join, naming its columns as that table does
+static Expr *copy_side_expr(Parser *parser, const Expr *expr, const Table *const tables[2])
+{
+    Expr *copy = new_expr(parser, expr->kind, NULL, NULL);
+    if (!copy)
+    {
+        return NULL;
+    }
+    if (expr->kind != EXPR_COMPARE)
+    {
+        copy->left = copy_side_expr(parser, expr->left, tables);
+        copy->right = expr->right ? copy_side_expr(parser, expr->right, tables) : NULL;
+        if (!copy->left || (expr->right && !copy->right))
+        {
+            free_expr(copy);
+            return NULL;
+        }
+        return copy;
+    }
+
+    int side;
+    int col = find_join_column(parser, expr->column, tables, &side);
+    snprintf(copy->column, sizeof(copy->column), "%s", col == QUERY_ROW_ID ? "rowid" : tables[side]->columns[col].name);
+    copy->op = expr->op;
+    copy->param = expr->param;
+    strcpy(copy->literal, expr->literal);
+    return copy;
+}
+
+// Add each condition that all rows must meet to the side it reads. Returns 0
+// for a condition reading both sides, which no single table can answer.
+static int split_conditions(Parser *parser, const Expr *expr, const Table *const tables[2], Query *sides[2])
+{
+    if (expr->kind == EXPR_AND)
+    {
+        return split_conditions(parser, expr->left, tables, sides) &&
+               split_conditions(parser, expr->right, tables, sides);
+    }
+
+    int mask = expr_sides(parser, expr, tables);
+    if (mask == 3)
+    {
+        parse_error(parser, "Each condition may only read one of '%s' and '%s', ON compares them", tables[0]->name,
+                    tables[1]->name);
+    }
+    Expr *copy = mask == 1 || mask == 2 ? copy_side_expr(parser, expr, tables) : NULL;
+    if (!copy)
+    {
+        return 0;
+    }
+    Query *side = sides[mask >> 1];
+    side->where = side->where ? new_expr(parser, EXPR_AND, side->where, copy) : copy;
+    return side->where != NULL;
+}
+
+static Query *new_side(Parser *parser, const Query *query, const Table *table)
+{
+    Query *side = calloc(1, sizeof(Query));
+    if (!side)
+    {
+        parse_error(parser, "Out of memory");
+        return NULL;
+    }
+    side->kind = QUERY_SELECT;
+    snprintf(side->table, sizeof(side->table), "%s", table->name);
+    side->limit = -1;
+    side->threads = query->threads;
+    side->snapshot = TXN_LATEST;
+    side->joinMemory = query->joinMemory;
+    return side;
+}
+
+// Rows a side of a join is expected to yield from its access path
+static int64_t estimate_rows(const Query *side, const Table *table)
+{
+    if (side->access == ACCESS_ROW_ID || side->access == ACCESS_INDEX)
+    {
+        return 1;
+    }
+    return table->numRows - table->numDeleted - table->numPending;
+}
+
+// Resolve the names of a JOIN against its FROM and joined tables and plan
+// each side as a query of its own, returns 0 with a message in error if the
+// query does not fit them
+int query_bind_join(Query *query, const Table *left, const Table *right, char *error, size_t errorSize)
+{
+    Parser parser = {"", {TOKEN_END, ""}, error, errorSize, 0, NULL};
+    const Table *const tables[2] = {left, right};
+    for (int s = 0; s < 2; s++)
+    {
+        query_free(query->sides[s]);
+        query->sides[s] = NULL;
+    }
+
+    if (left == right)
+    {
+        parse_error(&parser, "Table '%s' cannot be joined with itself", left->name);
+        return 0;
+    }
+    if (query_is_aggregate(query) || query->orderBy[0])
+    {
+        parse_error(&parser, "JOIN cannot be combined with aggregates, GROUP BY or ORDER BY");
+        return 0;
+    }
+
+    if (query->numNames > 0)
+    {
+        int *columns = realloc(query->columns, query->numNames * sizeof(int));
+        if (columns)
+        {
+            query->columns = columns;
+        }
+        int *itemSides = realloc(query->itemSides, query->numNames * sizeof(int));
+        if (itemSides)
+        {
+            query->itemSides = itemSides;
+        }
+        if (!columns || !itemSides)
+        {
+            parse_error(&parser, "Out of memory");
+            return 0;
+        }
+    }
+    for (int i = 0; i < query->numNames; i++)
+    {
+        query->columns[i] = find_join_column(&parser, query->names[i], tables, &query->itemSides[i]);
+        if (query->columns[i] == -2)
+        {
+            return 0;
+        }
+    }
+
+    int keys[2], keySides[2];
+    for (int k = 0; k < 2; k++)
+    {
+        keys[k] = find_join_column(&parser, query->joinKeys[k], tables, &keySides[k]);
+        if (keys[k] == -2)
+        {
+            return 0;
+        }
+    }
+    if (keySides[0] == keySides[1])
+    {
+        parse_error(&parser, "ON must compare a column of '%s' with one of '%s'", left->name, right->name);
+        return 0;
+    }
+    ColumnType types[2];
+    for (int k = 0; k < 2; k++)
+    {
+        int s = keySides[k];
+        query->joinColumns[s] = keys[k];
+        types[s] = keys[k] == QUERY_ROW_ID ? INTEGER : tables[s]->columns[keys[k]].type;
+    }
+    if (types[0] != types[1])
+    {
+        parse_error(&parser, "Cannot join '%s' with '%s', their types differ", query->joinKeys[0], query->joinKeys[1]);
+        return 0;
+    }
+
+    for (int s = 0; s < 2; s++)
+    {
+        query->sides[s] = new_side(&parser, query, tables[s]);
+        if (!query->sides[s])
+        {
+            return 0;
+        }
+    }
+    if (query->where && !split_conditions(&parser, query->where, tables, query->sides))
+    {
+        return 0;
+    }
+    for (int s = 0; s < 2; s++)
+    {
+        if (!query_bind(query->sides[s], tables[s], error, errorSize))
+        {
+            return 0;
+        }
+    }
+
+    // Ties build on the joined table, usually the smaller lookup table
+    query->buildSide = estimate_rows(query->sides[1], right) <= estimate_rows(query->sides[0], left);
+    query->access = ACCESS_SCAN;
+    query->accessExpr = NULL;
+    query->lowerBound = NULL;
+    query->upperBound = NULL;
+    query->needsSort = 0;
+    return 1;
+}
+
+static int compare_matches(const Expr *expr, const Table *table, int slot)
+{
+    int order;
+    if (expr->colIndex == QUERY_ROW_ID)
+    {
+        int64_t id = row_id(table, slot);
+        order = (id > expr->value.as.i) - (id < expr->value.as.i);
+    }
+    else
+    {
+        order = cell_compare(table, slot, expr->colIndex, &expr->value);
+    }
+
+    switch (expr->op)
+    {
+    case CMP_EQ:
+        return order == 0;
+    case CMP_NE:
+        return order != 0;
+    case CMP_LT:
+        return order < 0;
+    case CMP_LE:
+        return order <= 0;
+    case CMP_GT:
+        return order > 0;
+    case CMP_GE:
+        return order >= 0;
+    default:
+        return 0;
+    }
+}
+
+static int expr_matches(const Expr *expr, const Table *table, int slot)
+{
+    switch (expr->kind)
+    {
+    case EXPR_AND:
+        return expr_matches(expr->left, table, slot) && expr_matches(expr->right, table, slot);
+    case EXPR_OR:
+        return expr_matches(expr->left, table, slot) || expr_matches(expr->right, table, slot);
+    case EXPR_NOT:
+        return !expr_matches(expr->left, table, slot);
+    default:
+        return compare_matches(expr, table, slot);
+    }
+}
+
+static void compare_block(const Expr *expr, const Table *table, int start, int count, const uint64_t *live,
+                          uint64_t *mask)
+{
+    if (expr->colIndex == QUERY_ROW_ID)
+    {
+        filter_compare_ints(table->rowIds.ints + start, count, expr->op, expr->value.as.i, mask);
+        return;
+    }
+
+    const ColumnData *data = &table->data[expr->colIndex];
+    switch (table->columns[expr->colIndex].type)
+    {
+    case INTEGER:
+        filter_compare_ints(data->ints + start, count, expr->op, expr->value.as.i, mask);
+        break;
+    case FLOAT:
+        filter_compare_floats(data->floats + start, count, expr->op, expr->value.as.f, mask);
+        break;
+    case BOOLEAN:
+        filter_compare_bits(data->bits, start, count, expr->op, expr->value.as.b, mask);
+        break;
+    case STRING:
+        // Equality on a dictionary encoded column compares the codes. Slots the
+        // query cannot see may match, their offsets are only compared.
+        if (data->dictionary && (expr->op == CMP_EQ || expr->op == CMP_NE))
+        {
+            int64_t code = column_data_find_code(data, expr->value.as.s);
+            if (code < 0)
+            {
+                filter_fill(mask, count, expr->op == CMP_NE);
+            }
+            else
+            {
+                filter_compare_codes(data->offsets + start, count, expr->op, (uint32_t)code, mask);
+            }
+            break;
+        }
+        // Strings have no fixed width to compare side by side. Only live slots
+        // are compared, a reused slot may point past the heap a snapshot reads.
+        filter_fill(mask, count, 0);
+        for (int i = filter_next(live, count, 0); i < count; i = filter_next(live, count, i + 1))
+        {
+            mask[i / 64] |= (uint64_t)compare_matches(expr, table, start + i) << (i % 64);
+        }
+        break;
+    }
+}
+
+// Evaluate a condition for count slots from start into a selection mask. Bits
+// outside live, the slots the query can see, may be set or not.
+static void eval_block(const Expr *expr, const Table *table, int start, int count, const uint64_t *live,
+                       uint64_t *mask)
+{
+    uint64_t other[FILTER_BLOCK_WORDS];
+    switch (expr->kind)
+    {
+    case EXPR_AND:
+    case EXPR_OR:
+        eval_block(expr->left, table, start, count, live, mask);
+        eval_block(expr->right, table, start, count, live, other);
+        for (int i = 0; i < FILTER_BLOCK_WORDS; i++)
+        {
+            mask[i] = expr->kind == EXPR_AND ? mask[i] & other[i] : mask[i] | other[i];
+        }
+        break;
+    case EXPR_NOT:
+        eval_block(expr->left, table, start, count, live, mask);
+        filter_fill(other, count, 1);
+        for (int i = 0; i < FILTER_BLOCK_WORDS; i++)
+        {
+            mask[i] = ~mask[i] & other[i];
+        }
+        break;
+    default:
+        compare_block(expr, table, start, count, live, mask);
+        break;
+    }
+}
+
+static int scan_end(const Table *table, const QueryCursor *cursor)
+{
+    return cursor->end >= 0 && cursor->end < table->numRows ? cursor->end : table->numRows;
+}
+
+// Slots of a block the query can see, the same test as is_row_visible for a
+// whole block. The deleted bits are read before the stamps.
+static void load_live(const Query *query, const Table *table, int start, int count, uint64_t *live)
+{
+    uint64_t deleted[FILTER_BLOCK_WORDS];
+    if (table->numDeleted + table->numPending > 0 || query->snapshot != TXN_LATEST)
+    {
+        filter_load_bits(table->deleted.bits, start, count, deleted);
+    }
+    else
+    {
+        filter_fill(deleted, count, 0);
+    }
+
+    filter_fill(live, count, 1);
+    // Without stamps every snapshot sees the rows that are not deleted
+    if (query->snapshot == TXN_LATEST || !table->expired.ints)
+    {
+        for (int i = 0; i < FILTER_BLOCK_WORDS; i++)
+        {
+            live[i] &= ~deleted[i];
+        }
+        return;
+    }
+
+    // Expiries before stamps: a slot reused meanwhile then shows its new stamp
+    uint64_t created[FILTER_BLOCK_WORDS], current[FILTER_BLOCK_WORDS], expiredLater[FILTER_BLOCK_WORDS];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    filter_compare_ints(table->expired.ints + start, count, CMP_EQ, TXN_NONE, current);
+    filter_compare_ints(table->expired.ints + start, count, CMP_GT, (int64_t)query->snapshot, expiredLater);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    filter_compare_ints(table->created.ints + start, count, CMP_LE, (int64_t)query->snapshot, created);
+    for (int i = 0; i < FILTER_BLOCK_WORDS; i++)
+    {
+        live[i] &= created[i] & ((current[i] & ~deleted[i]) | expiredLater[i]);
+    }
+}
+
+static void load_block(const Query *query, const Table *table, QueryCursor *cursor)
+{
+    int start = cursor->next;
+    int end = scan_end(table, cursor);
+    int count = end - start < FILTER_BLOCK_ROWS ? end - start : FILTER_BLOCK_ROWS;
+    cursor->blockStart = start;
+    cursor->blockEnd = start + count;
+
+    uint64_t live[FILTER_BLOCK_WORDS];
+    load_live(query, table, start, count, live);
+    if (query->where)
+    {
+        eval_block(query->where, table, start, count, live, cursor->mask);
+        for (int i = 0; i < FILTER_BLOCK_WORDS; i++)
+        {
+            cursor->mask[i] &= live[i];
+        }
+    }
+    else
+    {
+        memcpy(cursor->mask, live, sizeof(live));
+    }
+}
+
+void query_cursor_init(QueryCursor *cursor)
+{
+    cursor->next = 0;
+    cursor->end = -1;
+    cursor->blockStart = 0;
+    cursor->blockEnd = 0;
+    cursor->scanning = 0;
+    cursor->sorted = NULL;
+    cursor->numSorted = 0;
+}
+
+void query_cursor_free(QueryCursor *cursor)
+{
+    free(cursor->sorted);
+    cursor->sorted = NULL;
+}
+
+static int next_lookup(const Query *query, Table *table, QueryCursor *cursor)
+{
+    if (cursor->next > 0)
+    {
+        return -1;
+    }
+    cursor->next = 1;
+
+    const Expr *key = query->accessExpr;
+    int slot = query->access == ACCESS_ROW_ID ? find_row_slot(table, key->value.as.i)
+                                              : find_row_by_value(table, key->colIndex, key->literal);
+    return slot >= 0 && expr_matches(query->where, table, slot) ? slot : -1;
+}
+
+static int next_in_scan(const Query *query, Table *table, QueryCursor *cursor)
+{
+    while (1)
+    {
+        if (cursor->next >= cursor->blockEnd)
+        {
+            if (cursor->next >= scan_end(table, cursor))
+            {
+                return -1;
+            }
+            load_block(query, table, cursor);
+        }
+
+        int count = cursor->blockEnd - cursor->blockStart;
+        int index = filter_next(cursor->mask, count, cursor->next - cursor->blockStart);
+        if (index < count)
+        {
+            cursor->next = cursor->blockStart + index + 1;
+            return cursor->blockStart + index;
+        }
+        cursor->next = cursor->blockEnd;
+    }
+}
+
+// Position the cursor at the near bound of the range, returns 0 if the index cannot be built
+static int start_range(const Query *query, Table *table, QueryCursor *cursor)
+{
+    int col = query->rangeColumn;
+    const BTree *index = find_ordered_index(table, col);
+    if (!index)
+    {
+        return 0;
+    }
+
+    const Expr *near = query->descending ? query->upperBound : query->lowerBound;
+    if (near)
+    {
+        int after = query->descending ? near->op != CMP_LT : near->op == CMP_GT;
+        btree_seek(index, table, col, &near->value, after, &cursor->position);
+    }
+    else if (query->descending)
+    {
+        btree_last(index, &cursor->position);
+    }
+    else
+    {
+        btree_first(index, &cursor->position);
+    }
+    return 1;
+}
+
+static int next_in_range(const Query *query, Table *table, QueryCursor *cursor)
+{
+    const Expr *far = query->descending ? query->lowerBound : query->upperBound;
+    while (1)
+    {
+        int slot = query->descending ? btree_prev(&cursor->position) : btree_next(&cursor->position);
+        if (slot < 0)
+        {
+            return -1;
+        }
+
+        // Past the far bound every later slot is too
+        if (far)
+        {
+            int order = cell_compare(table, slot, far->colIndex, &far->value);
+            int strict = far->op == CMP_LT || far->op == CMP_GT;
+            if ((query->descending ? order < 0 : order > 0) || (strict && order == 0))
+            {
+                return -1;
+            }
+        }
+        if (!query->where || expr_matches(query->where, table, slot))
+        {
+            return slot;
+        }
+    }
+}
+
+static int next_match(const Query *query, Table *table, QueryCursor *cursor)
+{
+    switch (query->access)
+    {
+    case ACCESS_ROW_ID:
+    case ACCESS_INDEX:
+        return next_lookup(query, table, cursor);
+    case ACCESS_RANGE:
+        if (!cursor->scanning)
+        {
+            if (cursor->next == 0 && !start_range(query, table, cursor))
+            {
+                // Without memory for the index, scan in slot order instead
+                cursor->scanning = 1;
+                return next_in_scan(query, table, cursor);
+            }
+            cursor->next = 1;
+            return next_in_range(query, table, cursor);
+        }
+        return next_in_scan(query, table, cursor);
+    default:
+        return next_in_scan(query, table, cursor);
+    }
+}
+
+// Order two slots by a column or the row id, negative if a sorts first
+int query_compare_slots(const Table *table, int col, int a, int b)
+{
+    if (col == QUERY_ROW_ID)
+    {
+        return (row_id(table, a) > row_id(table, b)) - (row_id(table, a) < row_id(table, b));
+    }
+    return cell_compare_rows(table, col, a, b);
+}
+
+// Stable merge sort, so equal keys keep their slot order
+static void sort_slots(const Query *query, const Table *table, int *slots, int *scratch, int count)
+{
+    if (count < 2)
+    {
+        return;
+    }
+    int half = count / 2;
+    sort_slots(query, table, slots, scratch, half);
+    sort_slots(query, table, slots + half, scratch, count - half);
+
+    int a = 0, b = half, out = 0;
+    while (a < half && b < count)
+    {
+        int order = query_compare_slots(table, query->orderColumn, slots[a], slots[b]);
+        scratch[out++] = (query->descending ? order >= 0 : order <= 0) ? slots[a++] : slots[b++];
+    }
+    while (a < half)
+    {
+        scratch[out++] = slots[a++];
+    }
+    while (b < count)
+    {
+        scratch[out++] = slots[b++];
+    }
+    memcpy(slots, scratch, count * sizeof(int));
+}
+
+// Collect and sort every match on the first call. Returns 0 if memory runs
+// out, the query then runs unsorted.
+static int sort_matches(const Query *query, Table *table, QueryCursor *cursor)
+{
+    QueryCursor matches;
+    query_cursor_init(&matches);
+    int capacity = 64;
+    int *slots = malloc(capacity * sizeof(int));
+    int count = 0;
+    int slot;
+    while (slots && (slot = next_match(query, table, &matches)) >= 0)
+    {
+        if (count == capacity)
+        {
+            int *grown = realloc(slots, 2 * capacity * sizeof(int));
+            if (!grown)
+            {
+                free(slots);
+                slots = NULL;
+                break;
+            }
+            slots = grown;
+            capacity *= 2;
+        }
+        slots[count++] = slot;
+    }
+
+    int *scratch = slots ? malloc((count > 0 ? count : 1) * sizeof(int)) : NULL;
+    if (!scratch)
+    {
+        free(slots);
+        return 0;
+    }
+    sort_slots(query, table, slots, scratch, count);
+    free(scratch);
+
+    cursor->sorted = slots;
+    cursor->numSorted = count;
+    return 1;
+}
+
+// Return the next slot matching a bound query and advance the cursor, or -1
+// once there are no more. The table must not change until the query is done,
+// collect the slots first to change their rows.
+int query_next(const Query *query, Table *table, QueryCursor *cursor)
+{
+    if (!query->needsSort || cursor->numSorted < 0)
+    {
+        return next_match(query, table, cursor);
+    }
+
+    if (!cursor->sorted && !sort_matches(query, table, cursor))
+    {
+        cursor->numSorted = -1;
+        return next_match(query, table, cursor);
+    }
+    return cursor->next < cursor->numSorted ? cursor->sorted[cursor->next++] : -1;
+}
+
+// Number of ranges to split a query's full scan into: one per thread, with at
+// least PARALLEL_MIN_BLOCKS blocks each. Other access paths and sorted
+// queries run as a single range.
+int query_scan_ranges(const Query *query, const Table *table)
+{
+    if (query->access != ACCESS_SCAN || query->needsSort)
+    {
+        return 1;
+    }
+    int blocks = (table->numRows + FILTER_BLOCK_ROWS - 1) / FILTER_BLOCK_ROWS;
+    int ranges = blocks / PARALLEL_MIN_BLOCKS;
+    int threads = query->threads < QUERY_MAX_THREADS ? query->threads : QUERY_MAX_THREADS;
+    if (ranges > threads)
+    {
+        ranges = threads;
+    }
+    return ranges > 1 ? ranges : 1;
+}
+
+typedef struct
+{
+    const Query *query;
+    Table *table;
+    QueryWorker worker;
+    void *state;
+    int start;
+    int end;
+} ScanRange;
+
+static void *run_range(void *arg)
+{
+    ScanRange *range = arg;
+    QueryCursor cursor;
+    query_cursor_init(&cursor);
+    cursor.next = range->start;
+    cursor.end = range->end;
+    range->worker(range->query, range->table, &cursor, range->state);
+    query_cursor_free(&cursor);
+    return NULL;
+}
+
+// Split the slots into numRanges runs of whole blocks, from query_scan_ranges,
+// and call the worker on each with its own state, one thread per range. The
+// table is only read, so a worker must not change it.
+void query_parallel_scan(const Query *query, Table *table, QueryWorker worker, void *states, size_t stateSize,
+                         int numRanges)
+{
+    ScanRange ranges[QUERY_MAX_THREADS];
+    int blocks = (table->numRows + FILTER_BLOCK_ROWS - 1) / FILTER_BLOCK_ROWS;
+    for (int i = 0; i < numRanges; i++)
+    {
+        ranges[i].query = query;
+        ranges[i].table = table;
+        ranges[i].worker = worker;
+        ranges[i].state = (char *)states + i * stateSize;
+        ranges[i].start = (int)((int64_t)blocks * i / numRanges) * FILTER_BLOCK_ROWS;
+        ranges[i].end = i == numRanges - 1 ? -1 : (int)((int64_t)blocks * (i + 1) / numRanges) * FILTER_BLOCK_ROWS;
+    }
+
+#ifdef _WIN32
+    for (int i = 0; i < numRanges; i++)
+    {
+        run_range(&ranges[i]);
+    }
+#else
+    // The calling thread takes the first range, and any whose thread could not start
+    pthread_t threads[QUERY_MAX_THREADS];
+    int started[QUERY_MAX_THREADS];
+    for (int i = 1; i < numRanges; i++)
+    {
+        started[i] = pthread_create(&threads[i], NULL, run_range, &ranges[i]) == 0;
+    }
+    run_range(&ranges[0]);
+    for (int i = 1; i < numRanges; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            run_range(&ranges[i]);
+        }
+    }
+#endif
+}
+
+typedef struct
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+} Output;
+
+static void append(Output *out, const char *format, ...)
+{
+    if (out->length >= out->size)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out->buffer + out->length, out->size - out->length, format, args);
+    va_end(args);
+    if (written > 0)
+    {
+        out->length += (size_t)written;
+    }
+}
+
+static void append_expr(Output *out, const Expr *expr, const Table *table)
+{
+    static const char *const operators[] = {"=", "!=", "<", "<=", ">", ">="};
+    switch (expr->kind)
+    {
+    case EXPR_AND:
+    case EXPR_OR:
+        append(out, "(");
+        append_expr(out, expr->left, table);
+        append(out, expr->kind == EXPR_AND ? " AND " : " OR ");
+        append_expr(out, expr->right, table);
+        append(out, ")");
+        break;
+    case EXPR_NOT:
+        append(out, "NOT ");
+        append_expr(out, expr->left, table);
+        break;
+    default:
+    {
+        int quoted = expr->colIndex != QUERY_ROW_ID && table->columns[expr->colIndex].type == STRING;
+        if (expr->param && !expr->literal[0])
+        {
+            append(out, "%s %s ?", expr->column, operators[expr->op]);
+            break;
+        }
+        append(out, quoted ? "%s %s '%s'" : "%s %s %s", expr->column, operators[expr->op], expr->literal);
+        break;
+    }
+    }
+}
+
+// Operators that find the rows of a query, from depth down
+static void explain_access(Output *out, const Query *query, const Table *table, int depth)
+{
+    if (query->needsSort)
+    {
+        append(out, "%*s-> Sort: by %s %s\n", depth * 2, "", query->orderBy, query->descending ? "DESC" : "ASC");
+        depth++;
+    }
+
+    if (query->where && query->where != query->accessExpr)
+    {
+        append(out, "%*s-> Filter: ", depth * 2, "");
+        append_expr(out, query->where, table);
+        append(out, "\n");
+        depth++;
+    }
+
+    switch (query->access)
+    {
+    case ACCESS_ROW_ID:
+        append(out, "%*s-> Row id lookup: rowid = %s\n", depth * 2, "", query->accessExpr->literal);
+        break;
+    case ACCESS_INDEX:
+        append(out, "%*s-> Hash index lookup: ", depth * 2, "");
+        append_expr(out, query->accessExpr, table);
+        append(out, " (unique column)\n");
+        break;
+    case ACCESS_RANGE:
+    {
+        const char *direction = query->descending ? "descending" : "ascending";
+        if (!query->lowerBound && !query->upperBound)
+        {
+            append(out, "%*s-> Ordered index scan: %s (%s)\n", depth * 2, "",
+                   table->columns[query->rangeColumn].name, direction);
+            break;
+        }
+        append(out, "%*s-> Ordered index range scan: ", depth * 2, "");
+        if (query->lowerBound)
+        {
+            append_expr(out, query->lowerBound, table);
+        }
+        if (query->upperBound && query->upperBound != query->lowerBound)
+        {
+            append(out, query->lowerBound ? " AND " : "");
+            append_expr(out, query->upperBound, table);
+        }
+        append(out, " (%s)\n", direction);
+        break;
+    }
+    default:
+        append(out, "%*s-> Full scan: %d row slots, %d deleted, in blocks of %d (%s kernels)", depth * 2, "",
+               table->numRows, table->numDeleted + table->numPending, FILTER_BLOCK_ROWS, filter_kernel_name());
+        if (query->kind == QUERY_SELECT && query_is_aggregate(query) && query_scan_ranges(query, table) > 1)
+        {
+            append(out, " across %d threads", query_scan_ranges(query, table));
+        }
+        append(out, "\n");
+        break;
+    }
+}
+
+// Heading of a SELECT item, such as price or SUM(price)
+void query_item_label(const Query *query, int item, char *buffer, size_t size)
+{
+    static const char *const names[] = {"", "COUNT", "SUM", "MIN", "MAX", "AVG"};
+    AggregateKind kind = query->functions ? query->functions[item] : AGG_NONE;
+    if (kind == AGG_NONE)
+    {
+        snprintf(buffer, size, "%s", query->names[item]);
+    }
+    else
+    {
+        snprintf(buffer, size, "%s(%s)", names[kind], query->names[item]);
+    }
+}
+
+// Describe the plan of a bound query, one operator per line from the top.
+// Transaction control is never bound, table may be NULL for it.
+void query_explain(const Query *query, const Table *table, char *buffer, size_t size)
+{
+    static const char *const kinds[] = {"Select", "Insert", "Update", "Delete"};
+    static const char *const controls[] = {"Begin a transaction", "Commit the transaction",
+                                           "Roll back the transaction"};
+    Output out = {buffer, size, 0};
+    if (size > 0)
+    {
+        buffer[0] = '\0';
+    }
+
+    if (query->kind >= QUERY_BEGIN)
+    {
+        append(&out, "%s\n", controls[query->kind - QUERY_BEGIN]);
+        return;
+    }
+    if (query->kind == QUERY_ALTER)
+    {
+        static const char *const types[] = {"INTEGER", "STRING", "BOOLEAN", "FLOAT"};
+        const Column *column = &query->column;
+        if (query->alter == ALTER_ADD)
+        {
+            append(&out, "Add column '%s' %s to table '%s'\n", column->name, types[column->type], query->table);
+            if (query->columnDefault[0])
+            {
+                append(&out, "-> Cells hold %s until set\n", query->columnDefault);
+            }
+            else
+            {
+                append(&out, "-> Cells hold the default until set, no row is rewritten\n");
+            }
+        }
+        else if (query->alter == ALTER_DROP)
+        {
+            append(&out, "Drop column '%s' of table '%s'\n", column->name, query->table);
+            append(&out, "-> Its values are freed, no row is rewritten\n");
+        }
+        else
+        {
+            append(&out, "Rename column '%s' of table '%s' to '%s'\n", column->name, query->table, query->newName);
+        }
+        return;
+    }
+    append(&out, "%s on table '%s'\n", kinds[query->kind], table->name);
+    if (query->kind == QUERY_INSERT)
+    {
+        append(&out, "-> Values: %d row(s) of %d columns, checked for type and uniqueness first\n", query->numRows,
+               table->numColumns);
+        return;
+    }
+
+    // Each operator reads from the one below it
+    int depth = 0;
+    if (query->kind == QUERY_SELECT)
+    {
+        if (query->limit >= 0)
+        {
+            append(&out, "-> Limit: %lld row(s)\n", query->limit);
+            depth++;
+        }
+        if (query_is_aggregate(query))
+        {
+            append(&out, "%*s-> Aggregate: ", depth * 2, "");
+            for (int i = 0; i < query->numNames; i++)
+            {
+                char label[MAX_INPUT + 8];
+                query_item_label(query, i, label, sizeof(label));
+                append(&out, i ? ", %s" : "%s", label);
+            }
+            if (query->groupBy[0])
+            {
+                append(&out, " by %s (hash groups, sorted %s)", query->groupBy, query->descending ? "DESC" : "ASC");
+            }
+        }
+        else
+        {
+            append(&out, "%*s-> Project: ", depth * 2, "");
+            if (query->numNames == 0)
+            {
+                append(&out, "all %d columns", table->numColumns);
+            }
+            for (int i = 0; i < query->numNames; i++)
+            {
+                append(&out, i ? ", %s" : "%s", query->names[i]);
+            }
+        }
+        append(&out, "\n");
+    }
+    else if (query->kind == QUERY_UPDATE)
+    {
+        append(&out, "-> Set: ");
+        for (int i = 0; i < query->numNames; i++)
+        {
+            append(&out, i ? ", %s = %s" : "%s = %s", query->names[i], query->values[i]);
+        }
+        append(&out, "\n");
+    }
+    else
+    {
+        append(&out, "-> Mark deleted\n");
+    }
+    explain_access(&out, query, table, depth + 1);
+}
+
+// Describe the plan of a bound JOIN. The build side is read into a hash table
+// first, then each row of the other side probes it.
+void query_explain_join(const Query *query, const Table *left, const Table *right, char *buffer, size_t size)
+{
+    const Table *const tables[2] = {left, right};
+    Output out = {buffer, size, 0};
+    if (size > 0)
+    {
+        buffer[0] = '\0';
+    }
+
+    append(&out, "Select joining table '%s' with '%s'\n", left->name, right->name);
+    int depth = 0;
+    if (query->limit >= 0)
+    {
+        append(&out, "-> Limit: %lld row(s)\n", query->limit);
+        depth++;
+    }
+    append(&out, "%*s-> Project: ", depth * 2, "");
+    if (query->numNames == 0)
+    {
+        append(&out, "all %d columns of both tables", left->numColumns + right->numColumns);
+    }
+    for (int i = 0; i < query->numNames; i++)
+    {
+        append(&out, i ? ", %s" : "%s", query->names[i]);
+    }
+    append(&out, "\n");
+    depth++;
+
+    append(&out, "%*s-> Hash join: %s = %s", depth * 2, "", query->joinKeys[0], query->joinKeys[1]);
+    if (query->joinMemory > 0)
+    {
+        append(&out, " (spills to temporary files past %llu KiB)", (unsigned long long)(query->joinMemory >> 10));
+    }
+    append(&out, "\n");
+    depth++;
+    for (int i = 0; i < 2; i++)
+    {
+        int side = i == 0 ? query->buildSide : !query->buildSide;
+        append(&out, "%*s-> %s table '%s'\n", depth * 2, "", i == 0 ? "Build from" : "Probe with", tables[side]->name);
+        explain_access(&out, query->sides[side], tables[side], depth + 1);
+    }
+}
+
+void query_free(Query *query)
+{
+    if (query)
+    {
+        free(query->names);
+        free(query->functions);
+        free(query->columns);
+        free(query->values);
+        free(query->itemSides);
+        free(query->params);
+        free_expr(query->where);
+        query_free(query->sides[0]);
+        query_free(query->sides[1]);
+        free(query);
+    }
+}
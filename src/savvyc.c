@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "savvy_client.h"
+
+// Statements sent ahead of their replies
+#define WINDOW 64
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [--connect ADDRESS] [--database NAME] [STATEMENT ...]\n"
+            "Runs each STATEMENT on a savvyd server, or each line of standard input without any\n"
+            "ADDRESS is HOST:PORT or unix:PATH, %s by default\n",
+            program, WIRE_DEFAULT_ADDRESS);
+}
+
+// Print a reply as tab-separated rows under a heading, returns 0 for an error
+static int print_reply(const SavvyReply *reply)
+{
+    if (reply->status != SAVVY_OK)
+    {
+        printf("Error: %s\n", reply->error);
+        return 0;
+    }
+    if (reply->width == 0)
+    {
+        printf("OK, %d row(s) affected\n", reply->affected);
+        return 1;
+    }
+    for (int i = 0; i < reply->width; i++)
+    {
+        printf("%s%s", i > 0 ? "\t" : "", reply->names[i]);
+    }
+    printf("\n");
+    for (int row = 0; row < reply->numRows; row++)
+    {
+        for (int i = 0; i < reply->width; i++)
+        {
+            printf("%s%s", i > 0 ? "\t" : "", reply->values[row * reply->width + i]);
+        }
+        printf("\n");
+    }
+    return 1;
+}
+
+// Print the replies to the statements sent so far, returns 0 if the connection failed
+static int drain(SavvyClient *client, int *pending, int *failures)
+{
+    for (; *pending > 0; (*pending)--)
+    {
+        SavvyReply reply;
+        SavvyStatus status = savvy_client_receive(client, &reply);
+        if (status != SAVVY_OK)
+        {
+            fprintf(stderr, "Connection to the server failed\n");
+            return 0;
+        }
+        *failures += !print_reply(&reply);
+    }
+    return 1;
+}
+
+static int send_statement(SavvyClient *client, const char *database, const char *statement, int *pending,
+                          int *failures)
+{
+    SavvyRequest request;
+    memset(&request, 0, sizeof(request));
+    request.op = WIRE_QUERY;
+    request.database = database;
+    request.text = statement;
+    SavvyStatus status = savvy_client_send(client, &request);
+    if (status != SAVVY_OK)
+    {
+        fprintf(stderr, "Cannot send '%s': %s\n", statement,
+                status == SAVVY_ERR_NO_MEMORY ? "out of memory" : "larger than a frame");
+        return 0;
+    }
+    return ++*pending < WINDOW || drain(client, pending, failures);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *address = WIRE_DEFAULT_ADDRESS;
+    const char *database = "";
+    int first = 1;
+    while (first + 1 < argc && strncmp(argv[first], "--", 2) == 0)
+    {
+        if (strcmp(argv[first], "--connect") == 0)
+        {
+            address = argv[first + 1];
+        }
+        else if (strcmp(argv[first], "--database") == 0)
+        {
+            database = argv[first + 1];
+        }
+        else
+        {
+            break;
+        }
+        first += 2;
+    }
+    if (first < argc && strncmp(argv[first], "--", 2) == 0)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    SavvyClient *client;
+    SavvyStatus status = savvy_client_connect(address, &client);
+    if (status != SAVVY_OK)
+    {
+        fprintf(stderr, "Cannot connect to %s\n", address);
+        return 1;
+    }
+
+    int pending = 0;
+    int failures = 0;
+    int ok = 1;
+    if (first < argc)
+    {
+        for (int i = first; ok && i < argc; i++)
+        {
+            ok = send_statement(client, database, argv[i], &pending, &failures);
+        }
+    }
+    else
+    {
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length;
+        while (ok && (length = getline(&line, &capacity, stdin)) >= 0)
+        {
+            while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            {
+                line[--length] = '\0';
+            }
+            if (length > 0)
+            {
+                ok = send_statement(client, database, line, &pending, &failures);
+            }
+        }
+        free(line);
+    }
+    ok = ok && drain(client, &pending, &failures);
+    savvy_client_close(client);
+    return ok && failures == 0 ? 0 : 1;
+}
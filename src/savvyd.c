@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "savvydb.h"
+#include "server.h"
+#include "wire.h"
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void request_stop(int signalNumber)
+{
+    (void)signalNumber;
+    stopRequested = 1;
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [--data DIR] [--listen ADDRESS]\n"
+            "Serves the databases in DIR, the current directory by default, until interrupted\n"
+            "ADDRESS is HOST:PORT or unix:PATH, %s by default\n",
+            program, WIRE_DEFAULT_ADDRESS);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *directory = ".";
+    const char *address = WIRE_DEFAULT_ADDRESS;
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            print_usage(argv[0]);
+            return 2;
+        }
+        if (strcmp(argv[i], "--data") == 0)
+        {
+            directory = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--listen") == 0)
+        {
+            address = argv[i + 1];
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    SavvyDB *db;
+    SavvyStatus status = savvy_open(directory, &db);
+    if (status != SAVVY_OK)
+    {
+        fprintf(stderr, "Cannot open '%s': %s\n", directory, savvy_status_message(status));
+        return 1;
+    }
+    SavvyRecoveryStats recovery;
+    savvy_recovery_stats(db, &recovery);
+    if (recovery.damagedRecord > 0)
+    {
+        fprintf(stderr, "Stopped log replay at damaged record %d, the changes after it were dropped\n",
+                recovery.damagedRecord);
+    }
+    if (recovery.defaultedValues > 0)
+    {
+        fprintf(stderr, "Loaded %d invalid values of the old text database as defaults\n", recovery.defaultedValues);
+    }
+    int listenFd = wire_listen(address);
+    if (listenFd < 0)
+    {
+        fprintf(stderr, "Cannot listen on %s: %s\n", address, strerror(errno));
+        savvy_close(db);
+        return 1;
+    }
+
+    // Without SA_RESTART the signal interrupts the wait for events
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+
+    fprintf(stderr, "Serving '%s' on %s\n", directory, address);
+    int ok = server_run(db, listenFd, &stopRequested);
+    close(listenFd);
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        unlink(address + 5);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Event loop failed: %s\n", strerror(errno));
+    }
+    if (savvy_close(db) != SAVVY_OK)
+    {
+        fprintf(stderr, "Failed to save the databases, changes remain in the log\n");
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,2569 @@
+#include "savvydb.h"
+#include "dbms.h"
+#include "catalog.h"
+#include "wal.h"
+#include "query.h"
+#include "aggregate.h"
+#include "join.h"
+#include "segment.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdarg.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Memory the loaded tables may take before the least recently used are evicted
+#define DEFAULT_MEMORY_BUDGET ((size_t)256 << 20)
+
+// Statements the plan cache keeps parsed and bound between runs
+#define DEFAULT_PLAN_CACHE 64
+
+// First capacity of the slot lists of cursors and join inputs, doubled as they fill
+#define SLOTS_MIN_CAPACITY 64
+
+// Calls that only read register as MVCC readers and see the snapshot taken
+// when they start. Calls that change rows run as the one write transaction,
+// or join the one their thread opened with savvy_begin, and schema changes,
+// compaction and closing also lock the readers out.
+struct SavvyDB
+{
+    Catalog catalog;
+    Wal wal;
+    int threads; // Upper bound for the threads of one query
+    Mvcc mvcc;
+    uint64_t txn;      // Transaction of the running writer
+    int inTransaction; // Set while a thread has a transaction open with savvy_begin
+    ThreadId owner;    // That thread
+    size_t memoryBudget;  // Bytes of loaded tables before cold ones are evicted, 0 for no limit
+    int64_t checkedLoads; // segment_loads at the last eviction, -1 after a checkpoint
+    size_t joinMemory;    // Bytes the build side of a join may take before it spills, 0 for no limit
+    uint64_t schemaVersion; // Counts schema changes, statements bound before the latest bind again
+    Mutex planLock;
+    SavvyStatement *plans; // Plan cache, most recently used first
+    SavvyStatement *lastPlan;
+    int numPlans;
+    int planCacheSize; // Statements the plan cache keeps, 0 for none
+    SavvyRecoveryStats recovery;
+};
+
+// A parsed statement. It is bound to its table when it first runs and again
+// only after a schema change, so running it again with new parameters parses
+// and resolves nothing. Between runs statements wait in the plan cache, keyed
+// by database and text, and the most recently used are kept; several of the
+// same text are kept when threads ran it at once.
+struct SavvyStatement
+{
+    SavvyDB *db;
+    char *dbName;
+    char *text; // NULL for statements the cache does not keep
+    unsigned int hash;
+    Query *query;
+    uint64_t boundVersion; // schemaVersion when the query was bound, 0 while it is not
+    struct SavvyStatement *prev;
+    struct SavvyStatement *next;
+};
+
+// A SELECT being read. Its reader stays registered and the view taken when it
+// starts is read until it is done, so every row comes from one snapshot
+// however slowly the rows are fetched.
+struct SavvyCursor
+{
+    SavvyDB *db;
+    MvccReader reader;
+    SavvyStatement *statement; // Released on close, NULL if the caller keeps it
+    Query *query;
+    int width; // Values per result row
+    char *labels;
+    const char **names;
+    Table view;
+    ColumnData *data;
+    QueryCursor position; // Scans of the view
+    int *slots;           // Rows found through an index
+    int numSlots;
+    int indexed;
+    AggregateResult result;
+    int aggregated;
+    Table joinView; // Joined table of a JOIN, read like view
+    ColumnData *joinData;
+    JoinRun join;
+    int joined;
+    int pair[2]; // Slots of the latest JOIN result by side
+    int count;   // Result rows read so far
+
+    // Values of the latest batch, width per row of MAX_INPUT bytes each
+    char *values;
+    int64_t *rowIds;
+    int numRows;
+    int capacity;
+};
+
+static const char *const statusMessages[] = {
+    "OK",
+    "Not found",
+    "Already exists",
+    "Invalid name, schema or value",
+    "Value must be unique",
+    "Schema not defined",
+    "Out of memory",
+    "File error",
+    "Syntax error",
+    "Not allowed in the current transaction state"};
+
+const char *savvy_status_message(SavvyStatus status)
+{
+    if ((unsigned)status >= sizeof(statusMessages) / sizeof(statusMessages[0]))
+    {
+        return "Unknown status";
+    }
+    return statusMessages[status];
+}
+
+static int file_exists(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file)
+    {
+        fclose(file);
+        return 1;
+    }
+    return 0;
+}
+
+// Names and values are stored as whitespace separated tokens in the text formats
+static int is_valid_token(const char *text)
+{
+    if (!text || text[0] == '\0' || strlen(text) >= MAX_INPUT)
+    {
+        return 0;
+    }
+    for (const char *c = text; *c; c++)
+    {
+        if (isspace((unsigned char)*c))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// One thread per online processor, up to QUERY_MAX_THREADS
+static int default_threads(void)
+{
+#ifdef _WIN32
+    return 1;
+#else
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if (processors < 1)
+    {
+        return 1;
+    }
+    return processors < QUERY_MAX_THREADS ? (int)processors : QUERY_MAX_THREADS;
+#endif
+}
+
+// Free a handle whose open failed
+static void discard_handle(SavvyDB *db)
+{
+    free_databases(&db->catalog);
+    wal_destroy(&db->wal);
+    mvcc_destroy(&db->mvcc);
+    mutex_destroy(&db->planLock);
+    free(db);
+}
+
+// Read the snapshot into the empty catalog, if there is one
+static int load_snapshot(SavvyDB *db, const char *source)
+{
+    db->recovery.defaultedValues = 0;
+    return !file_exists(source) || read_database_from_file(source, &db->catalog, &db->recovery.defaultedValues);
+}
+
+// Open the data files in an existing directory. Fails with SAVVY_ERR_IO if the
+// log cannot be opened there, as no change could be kept.
+SavvyStatus savvy_open(const char *directory, SavvyDB **out)
+{
+    *out = NULL;
+    SavvyDB *db = malloc(sizeof(SavvyDB));
+    if (!db)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    catalog_init(&db->catalog);
+    db->threads = default_threads();
+    mvcc_init(&db->mvcc);
+    db->inTransaction = 0;
+    db->memoryBudget = DEFAULT_MEMORY_BUDGET;
+    db->checkedLoads = 0;
+    db->joinMemory = JOIN_MEMORY_LIMIT;
+    db->schemaVersion = 1;
+    mutex_init(&db->planLock);
+    db->plans = NULL;
+    db->lastPlan = NULL;
+    db->numPlans = 0;
+    db->planCacheSize = DEFAULT_PLAN_CACHE;
+    memset(&db->recovery, 0, sizeof(db->recovery));
+
+    if (!directory)
+    {
+        directory = ".";
+    }
+    char snapshot[FILENAME_MAX];
+    char legacySnapshot[FILENAME_MAX];
+    char log[FILENAME_MAX];
+    snprintf(snapshot, sizeof(snapshot), "%s/%s", directory, SNAPSHOT_FILE);
+    snprintf(legacySnapshot, sizeof(legacySnapshot), "%s/%s", directory, LEGACY_SNAPSHOT_FILE);
+    snprintf(log, sizeof(log), "%s/%s", directory, LOG_FILE);
+    wal_init(&db->wal, log, snapshot);
+
+    // Data from older versions is still in the text format, the first checkpoint converts it
+    int legacy = !file_exists(snapshot) && file_exists(legacySnapshot);
+    const char *source = legacy ? legacySnapshot : snapshot;
+    if (!load_snapshot(db, source))
+    {
+        // Never checkpoint a partly loaded snapshot over the original
+        discard_handle(db);
+        return SAVVY_ERR_IO;
+    }
+
+    int replayed = wal_replay(&db->wal, &db->catalog, &db->recovery.damagedRecord);
+    if (replayed == WAL_REPLAY_PARTIAL)
+    {
+        // Drop the whole group a record failed in: load again and replay up to it
+        free_databases(&db->catalog);
+        catalog_init(&db->catalog);
+        if (!load_snapshot(db, source))
+        {
+            discard_handle(db);
+            return SAVVY_ERR_IO;
+        }
+        replayed = wal_replay(&db->wal, &db->catalog, &db->recovery.damagedRecord);
+    }
+    db->recovery.replayedRecords = wal_pending(&db->wal);
+    if (!wal_open(&db->wal))
+    {
+        discard_handle(db);
+        return SAVVY_ERR_IO;
+    }
+    if (replayed < 0 || legacy)
+    {
+        // Drop a damaged log tail so new records are not appended after it
+        compact_sparse_tables(&db->catalog);
+        wal_checkpoint(&db->wal, &db->catalog);
+    }
+
+    *out = db;
+    return SAVVY_OK;
+}
+
+// What opening the handle recovered. A damaged log record, the rest of its
+// transaction and everything after it were dropped, as were the rows of a
+// crashed commit.
+void savvy_recovery_stats(SavvyDB *db, SavvyRecoveryStats *stats)
+{
+    *stats = db->recovery;
+}
+
+// Whether the calling thread has a transaction open. Only that thread sets
+// the owner, so no other one can mistake itself for it.
+static int in_transaction(SavvyDB *db)
+{
+    return atomic_load_acquire(&db->inTransaction) && thread_equal(atomic_load_acquire(&db->owner), thread_self());
+}
+
+// Start the transaction of a call that changes rows, unless the calling thread
+// has one open, which the call's changes then join
+static void begin_write(SavvyDB *db)
+{
+    if (!in_transaction(db))
+    {
+        db->txn = mvcc_begin_write(&db->mvcc);
+    }
+}
+
+// Evict the least recently used tables once the loaded ones outgrow the
+// memory budget. Only tables unchanged since the last checkpoint can go, and
+// only while no reader or writer is running, so this is tried after the calls
+// that read tables in and after checkpoints, and skipped if anything runs.
+static void evict_idle_tables(SavvyDB *db)
+{
+    int64_t loads = segment_loads();
+    if (db->memoryBudget == 0 || in_transaction(db) ||
+        __atomic_load_n(&db->checkedLoads, __ATOMIC_RELAXED) == loads || !mvcc_try_begin_write(&db->mvcc))
+    {
+        return;
+    }
+    if (mvcc_try_lock_readers(&db->mvcc))
+    {
+        evict_cold_tables(&db->catalog, db->memoryBudget);
+        __atomic_store_n(&db->checkedLoads, loads, __ATOMIC_RELAXED);
+        mvcc_unlock_readers(&db->mvcc);
+    }
+    mvcc_end_write(&db->mvcc);
+}
+
+// Commit the writer's transaction: let the next writer in, wait until its log
+// records are on disk, synced together with those of the writers committing
+// meanwhile, and make its changes visible. Returns status, or SAVVY_ERR_IO if
+// the records could not be synced. Its changes are never published then: the
+// log refuses every later commit, so no later transaction publishes them
+// either and readers keep seeing what was synced last.
+static SavvyStatus finish_write(SavvyDB *db, SavvyStatus status)
+{
+    uint64_t txn = db->txn;
+    uint64_t lsn = wal_written(&db->wal);
+    mvcc_end_write(&db->mvcc);
+    int durable = wal_sync(&db->wal, lsn);
+    if (durable)
+    {
+        mvcc_publish(&db->mvcc, txn);
+    }
+    evict_idle_tables(db);
+    return status == SAVVY_OK && !durable ? SAVVY_ERR_IO : status;
+}
+
+// Commit the transaction of a call, unless it joined an open one
+static SavvyStatus end_write(SavvyDB *db, SavvyStatus status)
+{
+    return in_transaction(db) ? status : finish_write(db, status);
+}
+
+// Schema changes free memory readers may be using, so they wait until none is
+// registered. They are never part of a transaction, returns 0 inside one.
+static int begin_schema_change(SavvyDB *db)
+{
+    if (in_transaction(db))
+    {
+        return 0;
+    }
+    begin_write(db);
+    mvcc_lock_readers(&db->mvcc);
+    db->schemaVersion++;
+    return 1;
+}
+
+static SavvyStatus end_schema_change(SavvyDB *db, SavvyStatus status)
+{
+    mvcc_unlock_readers(&db->mvcc);
+    return end_write(db, status);
+}
+
+// Register a reader and return its snapshot. Inside its own transaction a
+// thread also reads the changes it made.
+static uint64_t begin_read(SavvyDB *db, MvccReader *reader)
+{
+    uint64_t snapshot = mvcc_begin_read(&db->mvcc, reader);
+    return in_transaction(db) ? db->txn : snapshot;
+}
+
+// Unregister a reader, evicting tables if its read paged some in
+static void end_read(SavvyDB *db, MvccReader *reader)
+{
+    mvcc_end_read(reader);
+    evict_idle_tables(db);
+}
+
+// Let the writer change a table. Readers stop using its indexes meanwhile, and
+// slots of versions no snapshot can see anymore are reused. Returns 0 if the
+// table's version stamps cannot be allocated.
+static int begin_change(SavvyDB *db, Table *table)
+{
+    mutex_lock(&table->latch);
+    if (!reserve_row_versions(table))
+    {
+        mutex_unlock(&table->latch);
+        return 0;
+    }
+    table->writeTxn = db->txn;
+    reclaim_row_versions(table, mvcc_horizon(&db->mvcc));
+    return 1;
+}
+
+static void end_change(Table *table)
+{
+    table->writeTxn = TXN_NONE;
+    mutex_unlock(&table->latch);
+}
+
+// Compaction moves rows, so it is skipped while any reader is registered
+static void compact_unread_tables(SavvyDB *db)
+{
+    if (mvcc_try_lock_readers(&db->mvcc))
+    {
+        compact_sparse_tables(&db->catalog);
+        mvcc_unlock_readers(&db->mvcc);
+    }
+}
+
+// Tables are clean after a checkpoint, and can be evicted again
+static void note_checkpoint(SavvyDB *db)
+{
+    if (wal_pending(&db->wal) == 0)
+    {
+        __atomic_store_n(&db->checkedLoads, -1, __ATOMIC_RELAXED);
+    }
+}
+
+static int checkpoint(SavvyDB *db)
+{
+    compact_unread_tables(db);
+    int saved = wal_checkpoint(&db->wal, &db->catalog);
+    note_checkpoint(db);
+    return saved;
+}
+
+// Fold the log into the snapshot now instead of waiting for the threshold.
+// Not inside a transaction, the snapshot would hold its uncommitted changes.
+SavvyStatus savvy_checkpoint(SavvyDB *db)
+{
+    if (in_transaction(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    begin_write(db);
+    int saved = checkpoint(db);
+    return end_write(db, saved ? SAVVY_OK : SAVVY_ERR_IO);
+}
+
+// Checkpoint pending changes and free the handle, which is freed even on failure.
+// A transaction the calling thread left open is rolled back. No other call may
+// run on the handle meanwhile or after.
+SavvyStatus savvy_close(SavvyDB *db)
+{
+    if (!db)
+    {
+        return SAVVY_OK;
+    }
+
+    if (in_transaction(db))
+    {
+        savvy_rollback(db);
+    }
+    savvy_set_plan_cache(db, 0);
+    mutex_destroy(&db->planLock);
+    begin_schema_change(db);
+    int saved = wal_pending(&db->wal) == 0 || checkpoint(db);
+    wal_close(&db->wal);
+    free_databases(&db->catalog);
+    end_schema_change(db, SAVVY_OK);
+    wal_destroy(&db->wal);
+    mvcc_destroy(&db->mvcc);
+    free(db);
+    return saved ? SAVVY_OK : SAVVY_ERR_IO;
+}
+
+SavvyStatus savvy_convert_text(const char *textFilename, const char *snapshotFilename)
+{
+    return convert_text_database(textFilename, snapshotFilename) ? SAVVY_OK : SAVVY_ERR_IO;
+}
+
+// Append the writer's logged changes to the log, checkpointing once the log is
+// long. Inside a transaction they wait for savvy_commit.
+static SavvyStatus commit(SavvyDB *db)
+{
+    if (in_transaction(db))
+    {
+        return SAVVY_OK;
+    }
+    if (wal_pending(&db->wal) >= WAL_CHECKPOINT_THRESHOLD)
+    {
+        compact_unread_tables(db);
+    }
+    int written = wal_commit(&db->wal, &db->catalog);
+    note_checkpoint(db);
+    return written ? SAVVY_OK : SAVVY_ERR_IO;
+}
+
+// Undo the row versions the writer's transaction made in a table
+static void rollback_table(SavvyDB *db, Table *table)
+{
+    mutex_lock(&table->latch);
+    rollback_row_versions(table, db->txn);
+    mutex_unlock(&table->latch);
+}
+
+static void rollback_tables(SavvyDB *db)
+{
+    for (DatabaseNode *node = db->catalog.databases; node; node = node->next)
+    {
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
+        {
+            rollback_table(db, &tableNode->table);
+        }
+    }
+}
+
+// Commit a call's row changes to a table. If their log records could not be
+// written the changes are undone, so memory never holds rows the files lack.
+static SavvyStatus commit_rows(SavvyDB *db, Table *table)
+{
+    SavvyStatus status = commit(db);
+    if (status != SAVVY_OK)
+    {
+        rollback_table(db, table);
+    }
+    return status;
+}
+
+// Open a transaction on the calling thread. The rows it changes until
+// savvy_commit are logged together, so a crash keeps all of the changes or
+// none, and the thread's own reads see them meanwhile.
+SavvyStatus savvy_begin(SavvyDB *db)
+{
+    if (in_transaction(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    db->txn = mvcc_begin_write(&db->mvcc);
+    atomic_store_release(&db->owner, thread_self());
+    atomic_store_release(&db->inTransaction, 1);
+    return SAVVY_OK;
+}
+
+SavvyStatus savvy_commit(SavvyDB *db)
+{
+    if (!in_transaction(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    atomic_store_release(&db->inTransaction, 0);
+    SavvyStatus status = commit(db);
+    if (status != SAVVY_OK)
+    {
+        rollback_tables(db);
+    }
+    return finish_write(db, status);
+}
+
+// Undo the changes of the calling thread's transaction. Snapshots taken
+// meanwhile never saw them, so they keep reading the same rows.
+SavvyStatus savvy_rollback(SavvyDB *db)
+{
+    if (!in_transaction(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    rollback_tables(db);
+    wal_discard(&db->wal);
+    atomic_store_release(&db->inTransaction, 0);
+    return finish_write(db, SAVVY_OK);
+}
+
+static SavvyStatus lookup_database(SavvyDB *db, const char *dbName, DatabaseNode **dbNode)
+{
+    *dbNode = dbName ? find_database(&db->catalog, dbName) : NULL;
+    return *dbNode ? SAVVY_OK : SAVVY_ERR_NOT_FOUND;
+}
+
+static SavvyStatus lookup_table(SavvyDB *db, const char *dbName, const char *tableName, Table **table)
+{
+    DatabaseNode *dbNode;
+    *table = NULL;
+    if (lookup_database(db, dbName, &dbNode) == SAVVY_OK && tableName)
+    {
+        *table = find_table(dbNode, tableName);
+    }
+    return *table ? SAVVY_OK : SAVVY_ERR_NOT_FOUND;
+}
+
+static SavvyStatus create_database(SavvyDB *db, const char *dbName)
+{
+    if (!is_valid_token(dbName))
+    {
+        return SAVVY_ERR_INVALID;
+    }
+    if (find_database(&db->catalog, dbName))
+    {
+        return SAVVY_ERR_EXISTS;
+    }
+    if (!insert_database(&db->catalog, dbName))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+
+    wal_log_create_database(&db->wal, dbName);
+    SavvyStatus status = commit(db);
+    if (status != SAVVY_OK)
+    {
+        remove_database(&db->catalog, dbName);
+    }
+    return status;
+}
+
+SavvyStatus savvy_create_database(SavvyDB *db, const char *dbName)
+{
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    return end_schema_change(db, create_database(db, dbName));
+}
+
+// The database is freed only once the drop is logged, until then it can be put back
+static SavvyStatus drop_database(SavvyDB *db, const char *dbName)
+{
+    DatabaseNode *prev;
+    DatabaseNode *dbNode = dbName ? catalog_unlink_database(&db->catalog, dbName, &prev) : NULL;
+    if (!dbNode)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+
+    wal_log_delete_database(&db->wal, dbName);
+    SavvyStatus status = commit(db);
+    if (status != SAVVY_OK && catalog_relink_database(&db->catalog, dbNode, prev))
+    {
+        return status;
+    }
+    free_database(dbNode);
+    return status;
+}
+
+SavvyStatus savvy_drop_database(SavvyDB *db, const char *dbName)
+{
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    return end_schema_change(db, drop_database(db, dbName));
+}
+
+// Fill names with up to maxNames database names, valid until the next change
+int savvy_list_databases(SavvyDB *db, const char **names, int maxNames)
+{
+    MvccReader reader;
+    mvcc_begin_read(&db->mvcc, &reader);
+    int count = list_databases(&db->catalog, names, maxNames);
+    end_read(db, &reader);
+    return count;
+}
+
+static SavvyStatus create_table(SavvyDB *db, const char *dbName, const char *tableName)
+{
+    DatabaseNode *dbNode;
+    if (lookup_database(db, dbName, &dbNode) != SAVVY_OK)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    if (!is_valid_token(tableName))
+    {
+        return SAVVY_ERR_INVALID;
+    }
+    if (catalog_find_table(dbNode, tableName))
+    {
+        return SAVVY_ERR_EXISTS;
+    }
+    if (!insert_table(dbNode, tableName))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+
+    wal_log_create_table(&db->wal, dbName, tableName);
+    SavvyStatus status = commit(db);
+    if (status != SAVVY_OK)
+    {
+        remove_table(dbNode, tableName);
+    }
+    return status;
+}
+
+SavvyStatus savvy_create_table(SavvyDB *db, const char *dbName, const char *tableName)
+{
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    return end_schema_change(db, create_table(db, dbName, tableName));
+}
+
+// Like a database, a table is freed only once its drop is logged
+static SavvyStatus drop_table(SavvyDB *db, const char *dbName, const char *tableName)
+{
+    DatabaseNode *dbNode;
+    TableNode *prev;
+    TableNode *tableNode = NULL;
+    if (lookup_database(db, dbName, &dbNode) == SAVVY_OK && tableName)
+    {
+        tableNode = catalog_unlink_table(dbNode, tableName, &prev);
+    }
+    if (!tableNode)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+
+    wal_log_delete_table(&db->wal, dbName, tableName);
+    SavvyStatus status = commit(db);
+    if (status != SAVVY_OK && catalog_relink_table(dbNode, tableNode, prev))
+    {
+        return status;
+    }
+    free_table(&tableNode->table);
+    free(tableNode);
+    return status;
+}
+
+SavvyStatus savvy_drop_table(SavvyDB *db, const char *dbName, const char *tableName)
+{
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    return end_schema_change(db, drop_table(db, dbName, tableName));
+}
+
+// Fill names with up to maxNames table names, valid until the next change
+SavvyStatus savvy_list_tables(SavvyDB *db, const char *dbName, const char **names, int maxNames, int *count)
+{
+    DatabaseNode *dbNode;
+    MvccReader reader;
+    *count = 0;
+    mvcc_begin_read(&db->mvcc, &reader);
+    SavvyStatus status = lookup_database(db, dbName, &dbNode);
+    if (status == SAVVY_OK)
+    {
+        *count = list_tables(dbNode, names, maxNames);
+    }
+    end_read(db, &reader);
+    return status;
+}
+
+// Give a table the columns sources[i] of its current ones, -1 for a new column
+// whose cells hold defaults[i] if given, see remap_table_columns. Runs as a
+// schema change. Rows can only gain a STRING cell with a default, the empty
+// string not being a value. If it cannot be logged, a change that kept the
+// values of every column is undone; those of dropped or retyped columns are
+// already freed by then.
+static SavvyStatus remap_columns(SavvyDB *db, const char *dbName, Table *table, const Column *columns,
+                                 const int *sources, const char *const *defaults, int numColumns)
+{
+    for (int i = 0; i < numColumns; i++)
+    {
+        if (sources[i] < 0 && columns[i].type == STRING && !(defaults && defaults[i]) &&
+            table->numRows - table->numDeleted - table->numPending > 0)
+        {
+            return SAVVY_ERR_INVALID;
+        }
+    }
+
+    int oldCount = table->numColumns;
+    Column *oldColumns = malloc((oldCount > 0 ? oldCount : 1) * sizeof(Column));
+    int *inverse = malloc((oldCount > 0 ? oldCount : 1) * sizeof(int));
+    if (!oldColumns || !inverse)
+    {
+        free(oldColumns);
+        free(inverse);
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    if (oldCount > 0)
+    {
+        memcpy(oldColumns, table->columns, oldCount * sizeof(Column));
+    }
+    int reversible = 1;
+    for (int j = 0; j < oldCount; j++)
+    {
+        inverse[j] = -1;
+        for (int i = 0; i < numColumns; i++)
+        {
+            inverse[j] = sources[i] == j ? i : inverse[j];
+        }
+        reversible = reversible && inverse[j] >= 0;
+    }
+
+    SavvyStatus status = SAVVY_ERR_NO_MEMORY;
+    if (remap_table_columns(table, columns, sources, defaults, numColumns))
+    {
+        wal_log_columns(&db->wal, dbName, table, sources, defaults);
+        status = commit(db);
+        if (status != SAVVY_OK && reversible)
+        {
+            remap_table_columns(table, oldColumns, inverse, NULL, oldCount);
+        }
+    }
+    free(oldColumns);
+    free(inverse);
+    return status;
+}
+
+static SavvyStatus set_schema(SavvyDB *db, const char *dbName, const char *tableName, const char *schema)
+{
+    Table *table;
+    if (lookup_table(db, dbName, tableName, &table) != SAVVY_OK)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+
+    Column *columns;
+    int numColumns = schema ? parse_table_schema(schema, &columns) : -1;
+    if (numColumns < 0)
+    {
+        return SAVVY_ERR_INVALID;
+    }
+
+    // Like set_table_columns, logged as the column change it is
+    int *sources = malloc((numColumns > 0 ? numColumns : 1) * sizeof(int));
+    SavvyStatus status = SAVVY_ERR_NO_MEMORY;
+    for (int i = 0; sources && i < numColumns; i++)
+    {
+        sources[i] = i < table->numColumns && table->columns[i].type == columns[i].type ? i : -1;
+    }
+    if (sources)
+    {
+        status = remap_columns(db, dbName, table, columns, sources, NULL, numColumns);
+    }
+    free(columns);
+    free(sources);
+    return status;
+}
+
+// Replace a table's columns from "name TYPE [unique] [ordered] [dictionary]"
+// definitions separated by ':'. Values of columns keeping their position and
+// type are kept, others get their type's default, which STRING columns only
+// have in tables without rows.
+SavvyStatus savvy_set_schema(SavvyDB *db, const char *dbName, const char *tableName, const char *schema)
+{
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    return end_schema_change(db, set_schema(db, dbName, tableName, schema));
+}
+
+// Position of a column by name, -1 if the table has none
+static int column_index(const Table *table, const char *name)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (strcmp(table->columns[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Names must fit a schema definition, which separates columns with ':'
+static int is_valid_column_name(const char *name)
+{
+    return is_valid_token(name) && !strchr(name, ':');
+}
+
+// Copy a table's columns and their positions into new arrays with room for one more
+static int copy_columns(const Table *table, Column **columns, int **sources)
+{
+    *columns = malloc((table->numColumns + 1) * sizeof(Column));
+    *sources = malloc((table->numColumns + 1) * sizeof(int));
+    if (!*columns || !*sources)
+    {
+        free(*columns);
+        free(*sources);
+        return 0;
+    }
+    memcpy(*columns, table->columns, table->numColumns * sizeof(Column));
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        (*sources)[i] = i;
+    }
+    return 1;
+}
+
+static SavvyStatus add_column(SavvyDB *db, const char *dbName, const char *tableName, const Column *column,
+                              const char *defaultValue)
+{
+    Table *table;
+    if (lookup_table(db, dbName, tableName, &table) != SAVVY_OK)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    if (!is_valid_column_name(column->name) || (column->isDictionary && column->type != STRING) ||
+        (defaultValue && (!is_valid_token(defaultValue) || !validate_value(defaultValue, column->type))))
+    {
+        return SAVVY_ERR_INVALID;
+    }
+    if (column_index(table, column->name) >= 0)
+    {
+        return SAVVY_ERR_EXISTS;
+    }
+    // Every row would hold the same default
+    if (column->isUnique && table->numRows - table->numDeleted - table->numPending > 1)
+    {
+        return SAVVY_ERR_NOT_UNIQUE;
+    }
+
+    Column *columns;
+    int *sources;
+    if (!copy_columns(table, &columns, &sources))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    columns[table->numColumns] = *column;
+    sources[table->numColumns] = -1;
+    const char **defaults = calloc(table->numColumns + 1, sizeof(char *));
+    if (!defaults)
+    {
+        free(columns);
+        free(sources);
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    defaults[table->numColumns] = defaultValue;
+    SavvyStatus status = remap_columns(db, dbName, table, columns, sources, defaults, table->numColumns + 1);
+    free(columns);
+    free(sources);
+    free(defaults);
+    return status;
+}
+
+static SavvyStatus drop_column(SavvyDB *db, const char *dbName, const char *tableName, const char *name)
+{
+    Table *table;
+    if (lookup_table(db, dbName, tableName, &table) != SAVVY_OK)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    int col = name ? column_index(table, name) : -1;
+    if (col < 0)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+
+    Column *columns;
+    int *sources;
+    if (!copy_columns(table, &columns, &sources))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    memmove(&columns[col], &columns[col + 1], (table->numColumns - col - 1) * sizeof(Column));
+    memmove(&sources[col], &sources[col + 1], (table->numColumns - col - 1) * sizeof(int));
+    SavvyStatus status = remap_columns(db, dbName, table, columns, sources, NULL, table->numColumns - 1);
+    free(columns);
+    free(sources);
+    return status;
+}
+
+static SavvyStatus rename_column(SavvyDB *db, const char *dbName, const char *tableName, const char *name,
+                                 const char *newName)
+{
+    Table *table;
+    if (lookup_table(db, dbName, tableName, &table) != SAVVY_OK)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    int col = name ? column_index(table, name) : -1;
+    if (col < 0)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    if (!is_valid_column_name(newName))
+    {
+        return SAVVY_ERR_INVALID;
+    }
+    int existing = column_index(table, newName);
+    if (existing >= 0)
+    {
+        return existing == col ? SAVVY_OK : SAVVY_ERR_EXISTS;
+    }
+
+    Column *columns;
+    int *sources;
+    if (!copy_columns(table, &columns, &sources))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    strcpy(columns[col].name, newName);
+    SavvyStatus status = remap_columns(db, dbName, table, columns, sources, NULL, table->numColumns);
+    free(columns);
+    free(sources);
+    return status;
+}
+
+// Add a column after the others, from a definition of savvy_set_schema's form.
+// Rows there already hold defaultValue in it, or its type's default if it is
+// NULL, which a STRING column added to rows must not be.
+SavvyStatus savvy_add_column(SavvyDB *db, const char *dbName, const char *tableName, const char *definition,
+                             const char *defaultValue)
+{
+    Column *columns;
+    int numColumns = definition && !strchr(definition, ':') ? parse_table_schema(definition, &columns) : -1;
+    if (numColumns != 1)
+    {
+        if (numColumns >= 0)
+        {
+            free(columns);
+        }
+        return SAVVY_ERR_INVALID;
+    }
+    if (!begin_schema_change(db))
+    {
+        free(columns);
+        return SAVVY_ERR_TRANSACTION;
+    }
+    SavvyStatus status = end_schema_change(db, add_column(db, dbName, tableName, &columns[0], defaultValue));
+    free(columns);
+    return status;
+}
+
+SavvyStatus savvy_drop_column(SavvyDB *db, const char *dbName, const char *tableName, const char *column)
+{
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    return end_schema_change(db, drop_column(db, dbName, tableName, column));
+}
+
+SavvyStatus savvy_rename_column(SavvyDB *db, const char *dbName, const char *tableName, const char *column,
+                                const char *newName)
+{
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    return end_schema_change(db, rename_column(db, dbName, tableName, column, newName));
+}
+
+// Copy up to maxColumns column definitions, count receives the table's column count
+SavvyStatus savvy_describe(SavvyDB *db, const char *dbName, const char *tableName,
+                           SavvyColumn *columns, int maxColumns, int *count)
+{
+    Table *table;
+    MvccReader reader;
+    *count = 0;
+    mvcc_begin_read(&db->mvcc, &reader);
+    if (lookup_table(db, dbName, tableName, &table) != SAVVY_OK)
+    {
+        end_read(db, &reader);
+        return SAVVY_ERR_NOT_FOUND;
+    }
+
+    for (int i = 0; i < table->numColumns && i < maxColumns; i++)
+    {
+        snprintf(columns[i].name, sizeof(columns[i].name), "%s", table->columns[i].name);
+        columns[i].type = (SavvyType)table->columns[i].type;
+        columns[i].isUnique = table->columns[i].isUnique;
+        columns[i].isOrdered = table->columns[i].isOrdered;
+        columns[i].isDictionary = table->columns[i].isDictionary;
+    }
+    *count = table->numColumns;
+    end_read(db, &reader);
+    return SAVVY_OK;
+}
+
+static SavvyStatus check_value(Table *table, int column, const char *value, int slot)
+{
+    if (!is_valid_token(value) || !validate_value(value, table->columns[column].type))
+    {
+        return SAVVY_ERR_INVALID;
+    }
+    if (table->columns[column].isUnique)
+    {
+        int existing = find_row_by_value(table, column, value);
+        if (existing >= 0 && existing != slot)
+        {
+            return SAVVY_ERR_NOT_UNIQUE;
+        }
+    }
+    return SAVVY_OK;
+}
+
+// Check whether a value could be stored in a column, for a new row if rowId is
+// negative or else for the given row, without changing anything
+SavvyStatus savvy_check_value(SavvyDB *db, const char *dbName, const char *tableName,
+                              int column, const char *value, int64_t rowId)
+{
+    Table *table;
+    MvccReader reader;
+    mvcc_begin_read(&db->mvcc, &reader);
+    SavvyStatus status = lookup_table(db, dbName, tableName, &table);
+    if (status == SAVVY_OK && (column < 0 || column >= table->numColumns))
+    {
+        status = SAVVY_ERR_INVALID;
+    }
+    else if (status == SAVVY_OK)
+    {
+        // Checked against the latest rows, the indexes it uses are built on demand
+        mutex_lock(&table->latch);
+        int slot = rowId >= 0 ? find_row_slot(table, rowId) : -1;
+        status = check_value(table, column, value, slot);
+        mutex_unlock(&table->latch);
+    }
+    end_read(db, &reader);
+    return status;
+}
+
+// Store and log a batch of rows, called by the writer
+static SavvyStatus insert_values(SavvyDB *db, const char *dbName, Table *table,
+                                 const char *const *values, size_t numRows, int64_t *firstRowId)
+{
+    if (table->numColumns == 0)
+    {
+        return SAVVY_ERR_NO_SCHEMA;
+    }
+
+    for (size_t i = 0; i < numRows * table->numColumns; i++)
+    {
+        if (!is_valid_token(values[i]) || !validate_value(values[i], table->columns[i % table->numColumns].type))
+        {
+            return SAVVY_ERR_INVALID;
+        }
+    }
+
+    // Values are valid, so a rejected batch broke a unique column
+    int64_t firstId = table->nextRowId;
+    if (!begin_change(db, table))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    int inserted = insert_rows(table, values, numRows);
+    end_change(table);
+    if (inserted <= 0)
+    {
+        return inserted == 0 ? SAVVY_ERR_NOT_UNIQUE : SAVVY_ERR_NO_MEMORY;
+    }
+    if (firstRowId)
+    {
+        *firstRowId = firstId;
+    }
+
+    for (size_t r = 0; r < numRows; r++)
+    {
+        wal_log_insert(&db->wal, dbName, table->name, firstId + (int64_t)r,
+                       values + r * table->numColumns, table->numColumns);
+    }
+    return numRows > 0 ? commit_rows(db, table) : SAVVY_OK;
+}
+
+// Insert numRows rows of numColumns values each, in row order. The batch is
+// stored as a whole or not at all, and logged with a single commit. The rows
+// get consecutive ids, the first of which is stored in firstRowId if not NULL.
+SavvyStatus savvy_insert(SavvyDB *db, const char *dbName, const char *tableName,
+                         const char *const *values, size_t numRows, int64_t *firstRowId)
+{
+    Table *table;
+    begin_write(db);
+    SavvyStatus status = lookup_table(db, dbName, tableName, &table);
+    if (status == SAVVY_OK)
+    {
+        status = insert_values(db, dbName, table, values, numRows, firstRowId);
+    }
+    return end_write(db, status);
+}
+
+// Take a view of a table and find the slot of a row's version in it that a
+// snapshot sees, returns -1 if the row did not exist then. The row id map
+// only holds the latest versions and is read with the writer kept out.
+static int find_version(Table *table, Table *view, ColumnData *data, int64_t rowId, uint64_t snapshot)
+{
+    if (mutex_trylock(&table->latch))
+    {
+        table_view(table, view, data);
+        int slot = find_row_slot(table, rowId);
+        int unchanged = table->changedTxn <= snapshot;
+        mutex_unlock(&table->latch);
+        if (slot >= 0 && (unchanged || is_row_visible(view, slot, snapshot)))
+        {
+            return slot;
+        }
+        if (unchanged)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        table_view(table, view, data);
+    }
+
+    for (int slot = 0; slot < view->numRows; slot++)
+    {
+        if (row_id(view, slot) == rowId && is_row_visible(view, slot, snapshot))
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Copy a row's values in text form into numColumns buffers of valueSize bytes
+SavvyStatus savvy_get(SavvyDB *db, const char *dbName, const char *tableName, int64_t rowId,
+                      char **values, size_t valueSize)
+{
+    Table *table;
+    MvccReader reader;
+    uint64_t snapshot = begin_read(db, &reader);
+    if (lookup_table(db, dbName, tableName, &table) != SAVVY_OK)
+    {
+        end_read(db, &reader);
+        return SAVVY_ERR_NOT_FOUND;
+    }
+
+    Table view;
+    ColumnData *data = malloc((table->numColumns > 0 ? table->numColumns : 1) * sizeof(ColumnData));
+    int slot = data ? find_version(table, &view, data, rowId, snapshot) : -1;
+    for (int i = 0; i < table->numColumns && slot >= 0; i++)
+    {
+        format_cell(&view, slot, i, values[i], valueSize);
+    }
+
+    free(data);
+    end_read(db, &reader);
+    if (!data)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    return slot >= 0 ? SAVVY_OK : SAVVY_ERR_NOT_FOUND;
+}
+
+// Check and store new values for a row, called by the writer
+static SavvyStatus update_values(SavvyDB *db, const char *dbName, Table *table, int64_t rowId,
+                                 const char *const *values)
+{
+    if (!begin_change(db, table))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    int slot = find_row_slot(table, rowId);
+    SavvyStatus status = slot >= 0 ? SAVVY_OK : SAVVY_ERR_NOT_FOUND;
+    for (int i = 0; i < table->numColumns && status == SAVVY_OK; i++)
+    {
+        status = values[i] ? check_value(table, i, values[i], slot) : SAVVY_OK;
+    }
+
+    // The new version is stored as a whole or not at all
+    int version = status == SAVVY_OK ? update_row(table, slot, values) : -1;
+    end_change(table);
+    if (status != SAVVY_OK)
+    {
+        return status;
+    }
+    if (version < 0)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+
+    wal_log_update(&db->wal, dbName, table, version);
+    return commit_rows(db, table);
+}
+
+// Replace a row's values, one per column. NULL entries keep the current value.
+// Nothing is changed unless every new value is valid.
+SavvyStatus savvy_update(SavvyDB *db, const char *dbName, const char *tableName, int64_t rowId,
+                         const char *const *values)
+{
+    Table *table;
+    begin_write(db);
+    SavvyStatus status = lookup_table(db, dbName, tableName, &table);
+    if (status == SAVVY_OK)
+    {
+        status = update_values(db, dbName, table, rowId, values);
+    }
+    return end_write(db, status);
+}
+
+SavvyStatus savvy_delete(SavvyDB *db, const char *dbName, const char *tableName, int64_t rowId)
+{
+    Table *table;
+    begin_write(db);
+    SavvyStatus status = lookup_table(db, dbName, tableName, &table);
+    if (status == SAVVY_OK && !begin_change(db, table))
+    {
+        status = SAVVY_ERR_NO_MEMORY;
+    }
+    else if (status == SAVVY_OK)
+    {
+        int removed = remove_row(table, find_row_slot(table, rowId));
+        end_change(table);
+        if (removed)
+        {
+            wal_log_delete_row(&db->wal, dbName, tableName, rowId);
+            status = commit_rows(db, table);
+        }
+        else
+        {
+            status = SAVVY_ERR_NOT_FOUND;
+        }
+    }
+    return end_write(db, status);
+}
+
+// Call back once per row of the snapshot taken when the scan starts, in slot order
+SavvyStatus savvy_scan(SavvyDB *db, const char *dbName, const char *tableName,
+                       SavvyRowCallback callback, void *context)
+{
+    Table *table;
+    MvccReader reader;
+    uint64_t snapshot = begin_read(db, &reader);
+    if (lookup_table(db, dbName, tableName, &table) != SAVVY_OK)
+    {
+        end_read(db, &reader);
+        return SAVVY_ERR_NOT_FOUND;
+    }
+
+    int numColumns = table->numColumns;
+    char *buffer = malloc((numColumns > 0 ? numColumns : 1) * MAX_INPUT);
+    const char **values = malloc((numColumns > 0 ? numColumns : 1) * sizeof(char *));
+    ColumnData *data = malloc((numColumns > 0 ? numColumns : 1) * sizeof(ColumnData));
+    if (!buffer || !values || !data)
+    {
+        free(buffer);
+        free(values);
+        free(data);
+        end_read(db, &reader);
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    for (int i = 0; i < numColumns; i++)
+    {
+        values[i] = buffer + i * MAX_INPUT;
+    }
+
+    Table view;
+    table_view(table, &view, data);
+    for (int slot = 0; slot < view.numRows; slot++)
+    {
+        if (!is_row_visible(&view, slot, snapshot))
+        {
+            continue;
+        }
+        for (int i = 0; i < numColumns; i++)
+        {
+            format_cell(&view, slot, i, buffer + i * MAX_INPUT, MAX_INPUT);
+        }
+        if (callback(context, row_id(&view, slot), values, numColumns))
+        {
+            break;
+        }
+    }
+
+    free(buffer);
+    free(values);
+    free(data);
+    end_read(db, &reader);
+    return SAVVY_OK;
+}
+
+// Limit the threads a query may scan with, 0 for one per processor
+SavvyStatus savvy_set_threads(SavvyDB *db, int threads)
+{
+    if (threads < 0)
+    {
+        return SAVVY_ERR_INVALID;
+    }
+    db->threads = threads == 0 ? default_threads() : threads;
+    return SAVVY_OK;
+}
+
+// Bound the memory of the loaded tables, 0 for no limit. Past it the least
+// recently used tables that did not change since the last checkpoint are
+// evicted, and read again from the snapshot on next use.
+SavvyStatus savvy_set_memory_budget(SavvyDB *db, size_t bytes)
+{
+    db->memoryBudget = bytes;
+    __atomic_store_n(&db->checkedLoads, -1, __ATOMIC_RELAXED);
+    return SAVVY_OK;
+}
+
+// Bound the memory the build side of a join may take, 0 for no limit. Past it
+// both sides are split into temporary files and joined a part at a time.
+SavvyStatus savvy_set_join_memory(SavvyDB *db, size_t bytes)
+{
+    db->joinMemory = bytes;
+    return SAVVY_OK;
+}
+
+// Reclaim a table's deleted row slots and unused strings now instead of at a
+// later checkpoint. Rows move, so this waits until no reader is registered.
+SavvyStatus savvy_compact(SavvyDB *db, const char *dbName, const char *tableName, int *reclaimed)
+{
+    Table *table;
+    if (!begin_schema_change(db))
+    {
+        return SAVVY_ERR_TRANSACTION;
+    }
+    SavvyStatus status = lookup_table(db, dbName, tableName, &table);
+    if (status == SAVVY_OK)
+    {
+        int count = compact_table(table);
+        if (reclaimed)
+        {
+            *reclaimed = count;
+        }
+    }
+    return end_schema_change(db, status);
+}
+
+// Measure the memory a table holds, including the latest uncommitted changes
+SavvyStatus savvy_table_stats(SavvyDB *db, const char *dbName, const char *tableName, SavvyTableStats *stats)
+{
+    Table *table;
+    MvccReader reader;
+    mvcc_begin_read(&db->mvcc, &reader);
+    SavvyStatus status = lookup_table(db, dbName, tableName, &table);
+    if (status == SAVVY_OK)
+    {
+        TableMemory memory;
+        mutex_lock(&table->latch);
+        table_memory(table, &memory);
+        stats->rows = table->numRows - table->numDeleted - table->numPending;
+        stats->slots = table->numRows;
+        mutex_unlock(&table->latch);
+
+        stats->storageBytes = (int64_t)memory.storageBytes;
+        stats->mappedBytes = (int64_t)memory.mappedBytes;
+        stats->garbageBytes = (int64_t)memory.garbageBytes;
+        stats->indexBytes = (int64_t)memory.indexBytes;
+        stats->allocations = memory.allocations;
+        stats->compactions = memory.compactions;
+        stats->loads = memory.loads;
+    }
+    end_read(db, &reader);
+    return status;
+}
+
+static void set_error(char *error, size_t errorSize, const char *format, ...)
+{
+    if (error && errorSize > 0)
+    {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(error, errorSize, format, args);
+        va_end(args);
+    }
+}
+
+// FNV-1a over the database name and the text, which cannot contain a NUL
+static unsigned int hash_statement(const char *dbName, const char *text)
+{
+    unsigned int hash = 2166136261u;
+    for (const char *p = dbName; *p; p++)
+    {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    hash = (hash ^ 0xff) * 16777619u;
+    for (const char *p = text; *p; p++)
+    {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
+
+static void free_statement(SavvyStatement *statement)
+{
+    if (statement)
+    {
+        query_free(statement->query);
+        free(statement->dbName);
+        free(statement->text);
+        free(statement);
+    }
+}
+
+// Parse a statement, kept by the plan cache if cached is set
+static SavvyStatus new_statement(SavvyDB *db, const char *dbName, const char *text, int cached,
+                                 SavvyStatement **out, char *error, size_t errorSize)
+{
+    *out = NULL;
+    Query *query = query_parse(text, error, errorSize);
+    if (!query)
+    {
+        return SAVVY_ERR_SYNTAX;
+    }
+    SavvyStatement *statement = calloc(1, sizeof(SavvyStatement));
+    if (statement)
+    {
+        statement->db = db;
+        statement->query = query;
+        statement->dbName = malloc(strlen(dbName) + 1);
+        statement->text = cached ? malloc(strlen(text) + 1) : NULL;
+    }
+    if (!statement || !statement->dbName || (cached && !statement->text))
+    {
+        if (statement)
+        {
+            free_statement(statement);
+        }
+        else
+        {
+            query_free(query);
+        }
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    strcpy(statement->dbName, dbName);
+    if (cached)
+    {
+        strcpy(statement->text, text);
+        statement->hash = hash_statement(dbName, text);
+    }
+    *out = statement;
+    return SAVVY_OK;
+}
+
+static void unlink_plan(SavvyDB *db, SavvyStatement *statement)
+{
+    *(statement->prev ? &statement->prev->next : &db->plans) = statement->next;
+    *(statement->next ? &statement->next->prev : &db->lastPlan) = statement->prev;
+    statement->prev = NULL;
+    statement->next = NULL;
+    db->numPlans--;
+}
+
+// Take the statement for a text out of the plan cache, or parse it. A cached
+// statement comes without the parameter values of its last run.
+static SavvyStatus checkout_statement(SavvyDB *db, const char *dbName, const char *text, SavvyStatement **out,
+                                      char *error, size_t errorSize)
+{
+    dbName = dbName ? dbName : "";
+    text = text ? text : "";
+    unsigned int hash = hash_statement(dbName, text);
+    mutex_lock(&db->planLock);
+    SavvyStatement *statement = db->plans;
+    while (statement && (statement->hash != hash || strcmp(statement->text, text) != 0 ||
+                         strcmp(statement->dbName, dbName) != 0))
+    {
+        statement = statement->next;
+    }
+    if (statement)
+    {
+        unlink_plan(db, statement);
+    }
+    mutex_unlock(&db->planLock);
+
+    if (statement)
+    {
+        query_clear_params(statement->query);
+        *out = statement;
+        return SAVVY_OK;
+    }
+    return new_statement(db, dbName, text, 1, out, error, errorSize);
+}
+
+// Hand a statement back to the plan cache, which frees the least recently
+// used ones beyond its size. Threads running the same text at once each parse
+// their own copy, only one of which is kept.
+static void release_statement(SavvyStatement *statement)
+{
+    SavvyDB *db = statement->db;
+    SavvyStatement *evicted = NULL;
+    mutex_lock(&db->planLock);
+    SavvyStatement *same = statement->text ? db->plans : NULL;
+    while (same && (same->hash != statement->hash || strcmp(same->text, statement->text) != 0 ||
+                    strcmp(same->dbName, statement->dbName) != 0))
+    {
+        same = same->next;
+    }
+    if (statement->text && !same && db->planCacheSize > 0)
+    {
+        statement->next = db->plans;
+        *(db->plans ? &db->plans->prev : &db->lastPlan) = statement;
+        db->plans = statement;
+        db->numPlans++;
+        statement = NULL;
+    }
+    while (db->numPlans > db->planCacheSize)
+    {
+        SavvyStatement *last = db->lastPlan;
+        unlink_plan(db, last);
+        last->next = evicted;
+        evicted = last;
+    }
+    mutex_unlock(&db->planLock);
+
+    free_statement(statement);
+    while (evicted)
+    {
+        SavvyStatement *next = evicted->next;
+        free_statement(evicted);
+        evicted = next;
+    }
+}
+
+// Bind a statement to its table, and a JOIN to the joined one in tables[1].
+// Names are resolved again only after a schema change, otherwise the access
+// path is chosen again for the parameters' values. A JOIN binds again on
+// every run, as its build side follows the sizes of the tables.
+static SavvyStatus bind_statement(SavvyStatement *statement, Table *tables[2], char *error, size_t errorSize)
+{
+    SavvyDB *db = statement->db;
+    Query *query = statement->query;
+    tables[1] = NULL;
+    for (int s = 0; s < (query->joinTable[0] ? 2 : 1); s++)
+    {
+        const char *name = s == 0 ? query->table : query->joinTable;
+        if (lookup_table(db, statement->dbName, name, &tables[s]) != SAVVY_OK)
+        {
+            set_error(error, errorSize, "Table '%s' not found in database '%s'", name, statement->dbName);
+            return SAVVY_ERR_NOT_FOUND;
+        }
+    }
+
+    query->joinMemory = db->joinMemory;
+    if (tables[1] || statement->boundVersion != db->schemaVersion)
+    {
+        statement->boundVersion = 0;
+        if (tables[1] ? !query_bind_join(query, tables[0], tables[1], error, errorSize)
+                      : !query_bind(query, tables[0], error, errorSize))
+        {
+            return SAVVY_ERR_INVALID;
+        }
+        statement->boundVersion = db->schemaVersion;
+    }
+    else
+    {
+        query_plan(query, tables[0]);
+    }
+    query->threads = db->threads;
+    return SAVVY_OK;
+}
+
+// Find the rows a query matches, at most limit of them if not negative.
+// Returns 0 if memory runs out.
+static int collect_slots(const Query *query, Table *table, int limit, int **slots, int *numSlots)
+{
+    QueryCursor cursor;
+    query_cursor_init(&cursor);
+    *slots = NULL;
+    *numSlots = 0;
+    int capacity = 0;
+    int slot;
+    while ((limit < 0 || *numSlots < limit) && (slot = query_next(query, table, &cursor)) >= 0)
+    {
+        if (*numSlots == capacity)
+        {
+            capacity = capacity ? (capacity > INT_MAX / 2 ? INT_MAX : capacity * 2) : SLOTS_MIN_CAPACITY;
+            int *grown = *numSlots < capacity ? realloc(*slots, (size_t)capacity * sizeof(int)) : NULL;
+            if (!grown)
+            {
+                free(*slots);
+                *slots = NULL;
+                query_cursor_free(&cursor);
+                return 0;
+            }
+            *slots = grown;
+        }
+        (*slots)[(*numSlots)++] = slot;
+    }
+    query_cursor_free(&cursor);
+    return 1;
+}
+
+// Indexes only describe the latest version of each row, so a snapshot uses
+// them while the writer is kept out and has not changed the table since the
+// snapshot was taken. Returns 1 with the table latched, or else switches the
+// query to a scan of the snapshot.
+static int latch_for_index(Query *query, Table *table, uint64_t snapshot)
+{
+    query->snapshot = snapshot;
+    if (query->access == ACCESS_SCAN)
+    {
+        return 0;
+    }
+    if (mutex_trylock(&table->latch))
+    {
+        if (table->changedTxn <= snapshot)
+        {
+            query->snapshot = TXN_LATEST;
+            return 1;
+        }
+        mutex_unlock(&table->latch);
+    }
+    query_use_scan(query);
+    return 0;
+}
+
+// Side and column of a result column, side 0 unless the query joins. SELECT *
+// of a join has the FROM table's columns first.
+static int result_column(const Query *query, int leftColumns, int item, int *side)
+{
+    *side = 0;
+    if (query->numNames > 0)
+    {
+        *side = query->joinTable[0] ? query->itemSides[item] : 0;
+        return query->columns[item];
+    }
+    if (query->joinTable[0] && item >= leftColumns)
+    {
+        *side = 1;
+        return item - leftColumns;
+    }
+    return item;
+}
+
+// Room for a result heading, which can be a table and a column name
+#define LABEL_SIZE (2 * MAX_INPUT)
+
+// Allocate the result headings of a SELECT. Aggregate items are labeled like
+// SUM(price), plain ones with their column's name, qualified by its table's
+// name in a join.
+static int label_results(SavvyCursor *cursor, Table *const tables[2])
+{
+    const Query *query = cursor->query;
+    int width = cursor->width > 0 ? cursor->width : 1;
+    cursor->labels = malloc(width * LABEL_SIZE);
+    cursor->names = malloc(width * sizeof(char *));
+    if (!cursor->labels || !cursor->names)
+    {
+        return 0;
+    }
+    for (int i = 0; i < cursor->width; i++)
+    {
+        int side;
+        int col = result_column(query, tables[0]->numColumns, i, &side);
+        const char *name = col == QUERY_ROW_ID ? "rowid" : tables[side]->columns[col].name;
+        char *label = cursor->labels + i * LABEL_SIZE;
+        if (query_is_aggregate(query))
+        {
+            query_item_label(query, i, label, LABEL_SIZE);
+        }
+        else if (query->joinTable[0])
+        {
+            snprintf(label, LABEL_SIZE, "%s.%s", tables[side]->name, name);
+        }
+        else
+        {
+            snprintf(label, LABEL_SIZE, "%s", name);
+        }
+        cursor->names[i] = label;
+    }
+    return 1;
+}
+
+// Start a bound JOIN on a view of each table. A side found through an index
+// collects its rows now, and the build side is read into the hash table.
+static SavvyStatus start_join(SavvyCursor *cursor, Query *query, Table *const tables[2], uint64_t snapshot)
+{
+    cursor->joinData = malloc((tables[1]->numColumns > 0 ? tables[1]->numColumns : 1) * sizeof(ColumnData));
+    if (!cursor->joinData)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    Table *views[2] = {&cursor->view, &cursor->joinView};
+    ColumnData *data[2] = {cursor->data, cursor->joinData};
+    int latched[2];
+    for (int s = 0; s < 2; s++)
+    {
+        latched[s] = latch_for_index(query->sides[s], tables[s], snapshot);
+        table_view(tables[s], views[s], data[s]);
+    }
+    join_init(&cursor->join, query, views[0], views[1]);
+    cursor->joined = 1;
+
+    int collected = 1;
+    for (int s = 0; s < 2; s++)
+    {
+        if (latched[s])
+        {
+            JoinInput *input = &cursor->join.inputs[s];
+            collected = collected && collect_slots(query->sides[s], tables[s], -1, &input->slots, &input->numSlots);
+            mutex_unlock(&tables[s]->latch);
+        }
+    }
+    if (!collected)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    if (!join_start(&cursor->join))
+    {
+        return cursor->join.error == JOIN_ERR_IO ? SAVVY_ERR_IO : SAVVY_ERR_NO_MEMORY;
+    }
+    return SAVVY_OK;
+}
+
+// Start reading the rows of a bound SELECT from a snapshot. Rows found through
+// an index and aggregate results are collected now with the writer kept out,
+// scans read the view a block at a time as rows are asked for, so callbacks
+// and cursors run without the latch.
+static SavvyStatus start_select(SavvyCursor *cursor, Query *query, Table *const tables[2], uint64_t snapshot)
+{
+    Table *table = tables[0];
+    cursor->query = query;
+    cursor->width = query->numNames > 0 ? query->numNames : table->numColumns + (tables[1] ? tables[1]->numColumns : 0);
+    cursor->labels = NULL;
+    cursor->names = NULL;
+    cursor->slots = NULL;
+    cursor->numSlots = 0;
+    cursor->indexed = 0;
+    cursor->aggregated = 0;
+    cursor->joinData = NULL;
+    cursor->joined = 0;
+    cursor->count = 0;
+    cursor->values = NULL;
+    cursor->rowIds = NULL;
+    cursor->numRows = 0;
+    cursor->capacity = 0;
+    query_cursor_init(&cursor->position);
+    cursor->data = malloc((table->numColumns > 0 ? table->numColumns : 1) * sizeof(ColumnData));
+    if (!cursor->data || !label_results(cursor, tables))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    if (tables[1])
+    {
+        return start_join(cursor, query, tables, snapshot);
+    }
+
+    int latched = latch_for_index(query, table, snapshot);
+    table_view(table, &cursor->view, cursor->data);
+    int collected = 1;
+    if (query_is_aggregate(query))
+    {
+        // Results refer to the slots they were taken from, which are read from the view
+        collected = cursor->aggregated = aggregate_run(query, latched ? table : &cursor->view, &cursor->result);
+        cursor->result.table = &cursor->view;
+    }
+    else if (latched)
+    {
+        collected = cursor->indexed = collect_slots(query, table, query->limit, &cursor->slots, &cursor->numSlots);
+    }
+    if (latched)
+    {
+        mutex_unlock(&table->latch);
+    }
+    return collected ? SAVVY_OK : SAVVY_ERR_NO_MEMORY;
+}
+
+// Advance to the next result row, returns its slot, its group for an
+// aggregate or its number for a join, whose slots are in pair, or -1 past the
+// last one
+static int next_result(SavvyCursor *cursor)
+{
+    const Query *query = cursor->query;
+    if (query->limit >= 0 && cursor->count >= query->limit)
+    {
+        return -1;
+    }
+
+    int row;
+    if (cursor->aggregated)
+    {
+        row = cursor->count < cursor->result.numRows ? cursor->count : -1;
+    }
+    else if (cursor->joined)
+    {
+        row = join_next(&cursor->join, cursor->pair) ? cursor->count : -1;
+    }
+    else if (cursor->indexed)
+    {
+        row = cursor->count < cursor->numSlots ? cursor->slots[cursor->count] : -1;
+    }
+    else
+    {
+        row = query_next(query, &cursor->view, &cursor->position);
+    }
+    if (row >= 0)
+    {
+        cursor->count++;
+    }
+    return row;
+}
+
+// Row id of a result row, -1 for the rows of an aggregate or a join
+static int64_t result_row_id(const SavvyCursor *cursor, int row)
+{
+    return cursor->aggregated || cursor->joined ? -1 : row_id(&cursor->view, row);
+}
+
+// Status of a join that stopped early, SAVVY_OK for every other query
+static SavvyStatus result_status(const SavvyCursor *cursor)
+{
+    if (!cursor->joined || cursor->join.error == JOIN_OK)
+    {
+        return SAVVY_OK;
+    }
+    return cursor->join.error == JOIN_ERR_IO ? SAVVY_ERR_IO : SAVVY_ERR_NO_MEMORY;
+}
+
+// Write the values of a result row into width buffers of MAX_INPUT bytes
+static void format_result(const SavvyCursor *cursor, int row, char *buffer)
+{
+    for (int i = 0; i < cursor->width; i++)
+    {
+        int side;
+        int col = result_column(cursor->query, cursor->view.numColumns, i, &side);
+        const Table *view = side ? &cursor->joinView : &cursor->view;
+        int slot = cursor->joined ? cursor->pair[side] : row;
+        if (cursor->aggregated)
+        {
+            aggregate_format(&cursor->result, row, i, buffer + i * MAX_INPUT, MAX_INPUT);
+        }
+        else if (col == QUERY_ROW_ID)
+        {
+            snprintf(buffer + i * MAX_INPUT, MAX_INPUT, "%lld", (long long)row_id(view, slot));
+        }
+        else
+        {
+            format_cell(view, slot, col, buffer + i * MAX_INPUT, MAX_INPUT);
+        }
+    }
+}
+
+// Free what start_select allocated, the query stays with the caller
+static void finish_select(SavvyCursor *cursor)
+{
+    if (cursor->aggregated)
+    {
+        aggregate_free(&cursor->result);
+    }
+    if (cursor->joined)
+    {
+        join_free(&cursor->join);
+    }
+    free(cursor->joinData);
+    query_cursor_free(&cursor->position);
+    free(cursor->slots);
+    free(cursor->data);
+    free(cursor->labels);
+    free(cursor->names);
+    free(cursor->values);
+    free(cursor->rowIds);
+}
+
+// Call back once per result row, formatting values only when there is a callback
+static SavvyStatus run_select(SavvyCursor *cursor, SavvyQueryCallback callback, void *context)
+{
+    char *buffer = malloc((cursor->width > 0 ? cursor->width : 1) * MAX_INPUT);
+    const char **values = malloc((cursor->width > 0 ? cursor->width : 1) * sizeof(char *));
+    if (!buffer || !values)
+    {
+        free(buffer);
+        free(values);
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    for (int i = 0; i < cursor->width; i++)
+    {
+        values[i] = buffer + i * MAX_INPUT;
+    }
+
+    int row;
+    while ((row = next_result(cursor)) >= 0)
+    {
+        if (!callback)
+        {
+            continue;
+        }
+        format_result(cursor, row, buffer);
+        if (callback(context, result_row_id(cursor, row), values, cursor->names, cursor->width))
+        {
+            break;
+        }
+    }
+    free(buffer);
+    free(values);
+    return result_status(cursor);
+}
+
+static SavvyStatus select_rows(SavvyStatement *statement, SavvyQueryCallback callback, void *context,
+                               int *affected, char *error, size_t errorSize)
+{
+    SavvyDB *db = statement->db;
+    Table *tables[2];
+    MvccReader reader;
+    uint64_t snapshot = begin_read(db, &reader);
+    SavvyStatus status = bind_statement(statement, tables, error, errorSize);
+    if (status == SAVVY_OK)
+    {
+        SavvyCursor cursor;
+        status = start_select(&cursor, statement->query, tables, snapshot);
+        if (status == SAVVY_OK)
+        {
+            status = run_select(&cursor, callback, context);
+        }
+        *affected = cursor.count;
+        finish_select(&cursor);
+    }
+    end_read(db, &reader);
+    return status;
+}
+
+static SavvyStatus run_insert(SavvyDB *db, const char *dbName, const Query *query, Table *table, int *affected,
+                              char *error, size_t errorSize)
+{
+    const char **values = malloc((query->numValues > 0 ? query->numValues : 1) * sizeof(char *));
+    if (!values)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    for (int i = 0; i < query->numValues; i++)
+    {
+        values[i] = query->values[i];
+    }
+
+    SavvyStatus status = insert_values(db, dbName, table, values, query->numRows, NULL);
+    free(values);
+    if (status == SAVVY_OK)
+    {
+        *affected = query->numRows;
+    }
+    else if (status == SAVVY_ERR_INVALID || status == SAVVY_ERR_NOT_UNIQUE)
+    {
+        set_error(error, errorSize, "%s for a column of table '%s'", savvy_status_message(status), table->name);
+    }
+    return status;
+}
+
+// Store the new versions of the rows in slots, returns how many were stored
+static int update_slots(SavvyDB *db, const char *dbName, const Query *query, Table *table, const int *slots,
+                        int numSlots)
+{
+    const char **row = calloc(table->numColumns > 0 ? table->numColumns : 1, sizeof(char *));
+    if (!row)
+    {
+        return 0;
+    }
+    for (int i = 0; i < query->numNames; i++)
+    {
+        row[query->columns[i]] = query->values[i];
+    }
+
+    int updated = 0;
+    for (; updated < numSlots; updated++)
+    {
+        int version = update_row(table, slots[updated], row);
+        if (version < 0)
+        {
+            break;
+        }
+        wal_log_update(&db->wal, dbName, table, version);
+    }
+    free(row);
+    return updated;
+}
+
+static SavvyStatus run_update(SavvyDB *db, const char *dbName, const Query *query, Table *table, int *affected,
+                              char *error, size_t errorSize)
+{
+    for (int i = 0; i < query->numNames; i++)
+    {
+        const Column *column = &table->columns[query->columns[i]];
+        if (!is_valid_token(query->values[i]) || !validate_value(query->values[i], column->type))
+        {
+            set_error(error, errorSize, "Invalid value '%s' for column '%s'", query->values[i], column->name);
+            return SAVVY_ERR_INVALID;
+        }
+    }
+
+    // Find every target before changing any, so the uniqueness check sees all of them
+    int *slots;
+    int numSlots;
+    if (!begin_change(db, table))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    if (!collect_slots(query, table, -1, &slots, &numSlots))
+    {
+        end_change(table);
+        return SAVVY_ERR_NO_MEMORY;
+    }
+
+    // A unique column can take a value for one row, and only if no other row holds it
+    for (int i = 0; i < query->numNames && numSlots > 0; i++)
+    {
+        int col = query->columns[i];
+        int existing = table->columns[col].isUnique ? find_row_by_value(table, col, query->values[i]) : -1;
+        if (table->columns[col].isUnique && (numSlots > 1 || (existing >= 0 && existing != slots[0])))
+        {
+            end_change(table);
+            set_error(error, errorSize, "Value for %s must be unique", table->columns[col].name);
+            free(slots);
+            return SAVVY_ERR_NOT_UNIQUE;
+        }
+    }
+
+    // Only running out of memory stops the update, the log then records the rows changed so far
+    int updated = update_slots(db, dbName, query, table, slots, numSlots);
+    end_change(table);
+    free(slots);
+
+    *affected = updated;
+    SavvyStatus committed = updated > 0 ? commit_rows(db, table) : SAVVY_OK;
+    return updated < numSlots ? SAVVY_ERR_NO_MEMORY : committed;
+}
+
+static SavvyStatus run_delete(SavvyDB *db, const char *dbName, const Query *query, Table *table, int *affected)
+{
+    int *slots;
+    int deleted;
+    if (!begin_change(db, table))
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    if (!collect_slots(query, table, -1, &slots, &deleted))
+    {
+        end_change(table);
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    for (int i = 0; i < deleted; i++)
+    {
+        int64_t rowId = row_id(table, slots[i]);
+        remove_row(table, slots[i]);
+        wal_log_delete_row(&db->wal, dbName, table->name, rowId);
+    }
+    end_change(table);
+    free(slots);
+
+    *affected = deleted;
+    return deleted > 0 ? commit_rows(db, table) : SAVVY_OK;
+}
+
+// Run a statement that changes rows as the writer
+static SavvyStatus change_rows(SavvyStatement *statement, int *affected, char *error, size_t errorSize)
+{
+    SavvyDB *db = statement->db;
+    const char *dbName = statement->dbName;
+    Query *query = statement->query;
+    Table *tables[2];
+    begin_write(db);
+    SavvyStatus status = bind_statement(statement, tables, error, errorSize);
+    Table *table = tables[0];
+    if (status == SAVVY_OK)
+    {
+        switch (query->kind)
+        {
+        case QUERY_INSERT:
+            status = run_insert(db, dbName, query, table, affected, error, errorSize);
+            break;
+        case QUERY_UPDATE:
+            status = run_update(db, dbName, query, table, affected, error, errorSize);
+            break;
+        case QUERY_DELETE:
+            status = run_delete(db, dbName, query, table, affected);
+            break;
+        default:
+            break;
+        }
+    }
+    return end_write(db, status);
+}
+
+// Run BEGIN, COMMIT or ROLLBACK for the calling thread
+static SavvyStatus control_transaction(SavvyDB *db, QueryKind kind, char *error, size_t errorSize)
+{
+    SavvyStatus status;
+    switch (kind)
+    {
+    case QUERY_BEGIN:
+        status = savvy_begin(db);
+        break;
+    case QUERY_COMMIT:
+        status = savvy_commit(db);
+        break;
+    default:
+        status = savvy_rollback(db);
+        break;
+    }
+    if (status == SAVVY_ERR_TRANSACTION)
+    {
+        set_error(error, errorSize, "%s", kind == QUERY_BEGIN ? "A transaction is already open" : "No transaction is open");
+    }
+    return status;
+}
+
+// Run ALTER TABLE as a schema change
+static SavvyStatus alter_table(SavvyDB *db, const char *dbName, const Query *query, char *error, size_t errorSize)
+{
+    static const char *const verbs[] = {"add", "drop", "rename"};
+    if (!begin_schema_change(db))
+    {
+        set_error(error, errorSize, "%s", "Columns cannot change inside a transaction");
+        return SAVVY_ERR_TRANSACTION;
+    }
+    SavvyStatus status;
+    switch (query->alter)
+    {
+    case ALTER_ADD:
+        status = add_column(db, dbName, query->table, &query->column,
+                            query->columnDefault[0] ? query->columnDefault : NULL);
+        break;
+    case ALTER_DROP:
+        status = drop_column(db, dbName, query->table, query->column.name);
+        break;
+    default:
+        status = rename_column(db, dbName, query->table, query->column.name, query->newName);
+        break;
+    }
+    status = end_schema_change(db, status);
+    if (status != SAVVY_OK)
+    {
+        set_error(error, errorSize, "Cannot %s column '%s' of table '%s': %s", verbs[query->alter],
+                  query->column.name, query->table, savvy_status_message(status));
+    }
+    return status;
+}
+
+// Run a statement once every parameter has a value. SELECT reads the snapshot
+// taken when it starts, other statements wait for the writer before them.
+static SavvyStatus run_statement(SavvyStatement *statement, SavvyQueryCallback callback, void *context,
+                                 int *affected, char *error, size_t errorSize)
+{
+    Query *query = statement->query;
+    for (int i = 0; i < query->numParams; i++)
+    {
+        if (!query->params[i].isSet)
+        {
+            set_error(error, errorSize, "Parameter %d has no value", i + 1);
+            return SAVVY_ERR_INVALID;
+        }
+    }
+    if (query->kind == QUERY_SELECT)
+    {
+        return select_rows(statement, callback, context, affected, error, errorSize);
+    }
+    if (query->kind == QUERY_ALTER)
+    {
+        return alter_table(statement->db, statement->dbName, query, error, errorSize);
+    }
+    if (query->kind >= QUERY_BEGIN)
+    {
+        return control_transaction(statement->db, query->kind, error, errorSize);
+    }
+    return change_rows(statement, affected, error, errorSize);
+}
+
+SavvyStatus savvy_query(SavvyDB *db, const char *dbName, const char *text, SavvyQueryCallback callback,
+                        void *context, int *affected, char *error, size_t errorSize)
+{
+    int count = 0;
+    set_error(error, errorSize, "%s", "");
+    SavvyStatement *statement;
+    SavvyStatus status = checkout_statement(db, dbName, text, &statement, error, errorSize);
+    if (status == SAVVY_OK)
+    {
+        status = run_statement(statement, callback, context, &count, error, errorSize);
+        release_statement(statement);
+    }
+
+    if (status != SAVVY_OK && error && errorSize > 0 && error[0] == '\0')
+    {
+        set_error(error, errorSize, "%s", savvy_status_message(status));
+    }
+    if (affected)
+    {
+        *affected = count;
+    }
+    return status;
+}
+
+SavvyStatus savvy_explain(SavvyDB *db, const char *dbName, const char *text, char *plan, size_t planSize)
+{
+    Table *tables[2];
+    MvccReader reader;
+    SavvyStatement *statement;
+    SavvyStatus status = checkout_statement(db, dbName, text, &statement, plan, planSize);
+    if (status != SAVVY_OK)
+    {
+        return status;
+    }
+    Query *query = statement->query;
+    if (query->kind >= QUERY_ALTER)
+    {
+        query_explain(query, NULL, plan, planSize);
+        release_statement(statement);
+        return SAVVY_OK;
+    }
+
+    mvcc_begin_read(&db->mvcc, &reader);
+    status = bind_statement(statement, tables, plan, planSize);
+    if (status == SAVVY_OK && tables[1])
+    {
+        query_explain_join(query, tables[0], tables[1], plan, planSize);
+    }
+    else if (status == SAVVY_OK)
+    {
+        query_explain(query, tables[0], plan, planSize);
+    }
+    end_read(db, &reader);
+    release_statement(statement);
+    return status;
+}
+
+// Parse and bind a statement for savvy_execute. A statement the plan cache
+// holds is taken out of it until savvy_finalize.
+SavvyStatus savvy_prepare(SavvyDB *db, const char *dbName, const char *text, SavvyStatement **out, char *error,
+                          size_t errorSize)
+{
+    *out = NULL;
+    set_error(error, errorSize, "%s", "");
+    SavvyStatement *statement;
+    SavvyStatus status = checkout_statement(db, dbName, text, &statement, error, errorSize);
+    if (status == SAVVY_OK && statement->query->kind < QUERY_ALTER)
+    {
+        Table *tables[2];
+        MvccReader reader;
+        mvcc_begin_read(&db->mvcc, &reader);
+        status = bind_statement(statement, tables, error, errorSize);
+        end_read(db, &reader);
+        if (status != SAVVY_OK)
+        {
+            release_statement(statement);
+        }
+    }
+    if (status != SAVVY_OK && error && errorSize > 0 && error[0] == '\0')
+    {
+        set_error(error, errorSize, "%s", savvy_status_message(status));
+    }
+    *out = status == SAVVY_OK ? statement : NULL;
+    return status;
+}
+
+// Number of ? in a statement
+int savvy_statement_params(const SavvyStatement *statement)
+{
+    return statement->query->numParams;
+}
+
+// The statement's kind, which follows the order of QueryKind
+SavvyStatementKind savvy_statement_kind(const SavvyStatement *statement)
+{
+    return (SavvyStatementKind)statement->query->kind;
+}
+
+// Set parameter param, counted from 1, until it is set again
+SavvyStatus savvy_bind(SavvyStatement *statement, int param, const char *value)
+{
+    if (param < 1 || param > statement->query->numParams)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    return value && query_set_param(statement->query, param, value) ? SAVVY_OK : SAVVY_ERR_INVALID;
+}
+
+// Run a prepared statement with the values bound so far, like savvy_query
+SavvyStatus savvy_execute(SavvyStatement *statement, SavvyQueryCallback callback, void *context, int *affected,
+                          char *error, size_t errorSize)
+{
+    int count = 0;
+    set_error(error, errorSize, "%s", "");
+    SavvyStatus status = run_statement(statement, callback, context, &count, error, errorSize);
+    if (status != SAVVY_OK && error && errorSize > 0 && error[0] == '\0')
+    {
+        set_error(error, errorSize, "%s", savvy_status_message(status));
+    }
+    if (affected)
+    {
+        *affected = count;
+    }
+    return status;
+}
+
+// Hand a prepared statement back to the plan cache
+void savvy_finalize(SavvyStatement *statement)
+{
+    if (statement)
+    {
+        release_statement(statement);
+    }
+}
+
+// Keep at most this many statements in the plan cache, 0 turns it off
+SavvyStatus savvy_set_plan_cache(SavvyDB *db, int statements)
+{
+    if (statements < 0)
+    {
+        return SAVVY_ERR_INVALID;
+    }
+    SavvyStatement *evicted = NULL;
+    mutex_lock(&db->planLock);
+    db->planCacheSize = statements;
+    while (db->numPlans > statements)
+    {
+        SavvyStatement *last = db->lastPlan;
+        unlink_plan(db, last);
+        last->next = evicted;
+        evicted = last;
+    }
+    mutex_unlock(&db->planLock);
+
+    while (evicted)
+    {
+        SavvyStatement *next = evicted->next;
+        free_statement(evicted);
+        evicted = next;
+    }
+    return SAVVY_OK;
+}
+
+// Start reading a statement. The cursor releases it on close if owned is set.
+static SavvyStatus open_cursor(SavvyStatement *statement, int owned, SavvyCursor **out, char *error,
+                               size_t errorSize)
+{
+    Query *query = statement->query;
+    if (query->kind != QUERY_SELECT)
+    {
+        set_error(error, errorSize, "%s", "Only SELECT statements are read through a cursor");
+        return SAVVY_ERR_INVALID;
+    }
+    for (int i = 0; i < query->numParams; i++)
+    {
+        if (!query->params[i].isSet)
+        {
+            set_error(error, errorSize, "Parameter %d has no value", i + 1);
+            return SAVVY_ERR_INVALID;
+        }
+    }
+    SavvyCursor *cursor = malloc(sizeof(SavvyCursor));
+    if (!cursor)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+
+    Table *tables[2];
+    cursor->db = statement->db;
+    uint64_t snapshot = begin_read(cursor->db, &cursor->reader);
+    SavvyStatus status = bind_statement(statement, tables, error, errorSize);
+    if (status == SAVVY_OK)
+    {
+        status = start_select(cursor, query, tables, snapshot);
+        if (status != SAVVY_OK)
+        {
+            finish_select(cursor);
+        }
+    }
+    if (status != SAVVY_OK)
+    {
+        end_read(cursor->db, &cursor->reader);
+        free(cursor);
+        return status;
+    }
+    cursor->statement = owned ? statement : NULL;
+    *out = cursor;
+    return SAVVY_OK;
+}
+
+// Open a cursor over the rows of a SELECT, read from the snapshot taken now
+SavvyStatus savvy_cursor_open(SavvyDB *db, const char *dbName, const char *text, SavvyCursor **out, char *error,
+                              size_t errorSize)
+{
+    *out = NULL;
+    set_error(error, errorSize, "%s", "");
+    SavvyStatement *statement;
+    SavvyStatus status = checkout_statement(db, dbName, text, &statement, error, errorSize);
+    if (status == SAVVY_OK)
+    {
+        status = open_cursor(statement, 1, out, error, errorSize);
+        if (status != SAVVY_OK)
+        {
+            release_statement(statement);
+        }
+    }
+    if (status != SAVVY_OK && error && errorSize > 0 && error[0] == '\0')
+    {
+        set_error(error, errorSize, "%s", savvy_status_message(status));
+    }
+    return status;
+}
+
+// Open a cursor over the rows of a prepared SELECT with the values bound so
+// far. The statement stays the caller's.
+SavvyStatus savvy_cursor_open_statement(SavvyStatement *statement, SavvyCursor **out, char *error,
+                                        size_t errorSize)
+{
+    *out = NULL;
+    set_error(error, errorSize, "%s", "");
+    SavvyStatus status = open_cursor(statement, 0, out, error, errorSize);
+    if (status != SAVVY_OK && error && errorSize > 0 && error[0] == '\0')
+    {
+        set_error(error, errorSize, "%s", savvy_status_message(status));
+    }
+    return status;
+}
+
+// Open a cursor over every row of a table in slot order, like savvy_scan. Any
+// table name is accepted, not only those the query language can spell.
+SavvyStatus savvy_cursor_open_table(SavvyDB *db, const char *dbName, const char *tableName, SavvyCursor **out)
+{
+    *out = NULL;
+    if (!tableName || strlen(tableName) >= MAX_INPUT)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    SavvyStatement *statement;
+    SavvyStatus status = new_statement(db, dbName ? dbName : "", "SELECT * FROM rows", 0, &statement, NULL, 0);
+    if (status != SAVVY_OK)
+    {
+        return SAVVY_ERR_NO_MEMORY;
+    }
+    strcpy(statement->query->table, tableName);
+    status = open_cursor(statement, 1, out, NULL, 0);
+    if (status != SAVVY_OK)
+    {
+        free_statement(statement);
+    }
+    return status;
+}
+
+// Values per result row
+int savvy_cursor_width(const SavvyCursor *cursor)
+{
+    return cursor->width;
+}
+
+// Heading of a result column, such as price or SUM(price)
+const char *savvy_cursor_name(const SavvyCursor *cursor, int column)
+{
+    return cursor->names[column];
+}
+
+// Read the next batch of at most maxRows result rows. numRows is 0 once every
+// row was read, and the values of a batch stay valid until the next one.
+SavvyStatus savvy_cursor_next(SavvyCursor *cursor, int maxRows, int *numRows)
+{
+    *numRows = 0;
+    cursor->numRows = 0;
+    if (maxRows <= 0)
+    {
+        return SAVVY_ERR_INVALID;
+    }
+
+    size_t rowBytes = (size_t)(cursor->width > 0 ? cursor->width : 1) * MAX_INPUT;
+    if (maxRows > cursor->capacity)
+    {
+        char *values = realloc(cursor->values, maxRows * rowBytes);
+        if (values)
+        {
+            cursor->values = values;
+        }
+        int64_t *rowIds = realloc(cursor->rowIds, maxRows * sizeof(int64_t));
+        if (rowIds)
+        {
+            cursor->rowIds = rowIds;
+        }
+        if (!values || !rowIds)
+        {
+            return SAVVY_ERR_NO_MEMORY;
+        }
+        cursor->capacity = maxRows;
+    }
+
+    int row;
+    while (cursor->numRows < maxRows && (row = next_result(cursor)) >= 0)
+    {
+        format_result(cursor, row, cursor->values + cursor->numRows * rowBytes);
+        cursor->rowIds[cursor->numRows++] = result_row_id(cursor, row);
+    }
+    *numRows = cursor->numRows;
+    return result_status(cursor);
+}
+
+// Value of a row of the latest batch in text form
+const char *savvy_cursor_value(const SavvyCursor *cursor, int row, int column)
+{
+    return cursor->values + ((size_t)row * cursor->width + column) * MAX_INPUT;
+}
+
+// Stable id of a row of the latest batch, -1 for the rows of an aggregate or a join
+int64_t savvy_cursor_row_id(const SavvyCursor *cursor, int row)
+{
+    return cursor->rowIds[row];
+}
+
+void savvy_cursor_close(SavvyCursor *cursor)
+{
+    if (!cursor)
+    {
+        return;
+    }
+    finish_select(cursor);
+    end_read(cursor->db, &cursor->reader);
+    if (cursor->statement)
+    {
+        release_statement(cursor->statement);
+    }
+    free(cursor);
+}
@@ -0,0 +1,1554 @@
+#include "segment.h"
+#include "catalog.h"
+#include "codec.h"
+
+#include <ctype.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Table files written at once by a snapshot, each waits for its own sync
+#define SEGMENT_WRITE_THREADS 4
+// Threads decoding a table's encoded blocks when it is read, used from this
+// many decoded bytes on
+#define SEGMENT_DECODE_THREADS 4
+#define SEGMENT_PARALLEL_DECODE_BYTES (1 << 20)
+#define TABLE_FILE_SUFFIX ".svt"
+
+// Files stay mapped while a table is stored in them or its arrays point into
+// them, counted in users, and unused ones are unmapped by segment_release_unused
+typedef struct SegmentMapping
+{
+    void *base;
+    size_t size;
+    uint32_t version; // Of the tables stored in the file
+    int users;
+    struct SegmentMapping *next;
+} SegmentMapping;
+
+// A table's file, by the names of its database and table
+typedef struct
+{
+    char database[SEGMENT_NAME_SIZE];
+    TableFile table;
+} StoredFile;
+
+// Table files of the snapshot last loaded or put in place, in catalog order,
+// and of the one written since, until segment_rebind puts it in place
+typedef struct SegmentFiles
+{
+    StoredFile *committed;
+    size_t numCommitted;
+    StoredFile *written;
+    size_t numWritten;
+    uint64_t nextFile; // Number for the next table file written
+} SegmentFiles;
+
+// Tables are read in by whichever reader or writer uses them first
+static Mutex loadLock = MUTEX_INITIALIZER;
+static int64_t loads;
+
+static size_t padded(size_t bytes)
+{
+    return (bytes + 7) & ~(size_t)7;
+}
+
+static size_t value_bytes(ColumnType type, uint32_t numRows)
+{
+    switch (type)
+    {
+    case INTEGER:
+        return numRows * sizeof(int64_t);
+    case FLOAT:
+        return numRows * sizeof(double);
+    case BOOLEAN:
+        return (numRows + 7) / 8;
+    case STRING:
+        return numRows * sizeof(uint32_t);
+    default:
+        return 0;
+    }
+}
+
+static const void *column_values(const ColumnData *data, ColumnType type)
+{
+    switch (type)
+    {
+    case INTEGER:
+        return data->ints;
+    case FLOAT:
+        return data->floats;
+    case BOOLEAN:
+        return data->bits;
+    case STRING:
+        return data->offsets;
+    default:
+        return NULL;
+    }
+}
+
+// How a column's values are read by the codecs
+static CodecValues codec_values(ColumnType type)
+{
+    switch (type)
+    {
+    case INTEGER:
+        return CODEC_INT64;
+    case STRING:
+        return CODEC_UINT32;
+    case BOOLEAN:
+        return CODEC_BITS;
+    default:
+        return CODEC_BYTES;
+    }
+}
+
+int segment_is_binary(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    char magic[8];
+    int isBinary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                   memcmp(magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == 0;
+    fclose(file);
+    return isBinary;
+}
+
+// Pad a record of the given size up to the next 8 byte boundary
+static int write_padding(FILE *file, size_t size)
+{
+    static const char zeros[8] = {0};
+    size_t padding = padded(size) - size;
+    return padding == 0 || fwrite(zeros, 1, padding, file) == padding;
+}
+
+static int write_padded(FILE *file, const void *bytes, size_t size)
+{
+    if (size > 0 && fwrite(bytes, 1, size, file) != size)
+    {
+        return 0;
+    }
+    return write_padding(file, size);
+}
+
+// Write a block's values, encoded if a codec stores them in sufficiently
+// fewer bytes (see codec.h), raw to be mapped as they are otherwise
+static int write_encoded(FILE *file, const void *values, size_t bytes, CodecValues kind)
+{
+    BlockEncoding encoding = {CODEC_RAW, 0, bytes};
+    Codec codec;
+    uint8_t *encoded;
+    size_t size = codec_encode(values, bytes, kind, &codec, &encoded);
+    if (size > 0)
+    {
+        encoding.codec = codec;
+        encoding.bytes = size;
+        values = encoded;
+    }
+    int ok = fwrite(&encoding, sizeof(encoding), 1, file) == 1 && write_padded(file, values, encoding.bytes);
+    free(encoded);
+    return ok;
+}
+
+// Write a column's block: its header, values, then its heap if it has one
+static int write_block(FILE *file, const void *values, size_t bytes, ColumnType type, const char *heap,
+                       size_t heapBytes)
+{
+    BlockHeader block = {bytes, heapBytes};
+    return fwrite(&block, sizeof(block), 1, file) == 1 && write_encoded(file, values, bytes, codec_values(type)) &&
+           (heapBytes == 0 || write_encoded(file, heap, heapBytes, CODEC_BYTES));
+}
+
+// Strings are written without the garbage left in the heap by updates,
+// so the offsets are recomputed for the compacted heap. The heap of a
+// dictionary encoded column is its dictionary, written as it is.
+static int write_string_column(FILE *file, const Table *table, int col)
+{
+    const ColumnData *data = &table->data[col];
+    size_t bytes = table->numRows * sizeof(uint32_t);
+    if (table->columns[col].isDictionary)
+    {
+        return write_block(file, data->offsets, bytes, STRING, data->heap, data->heapSize);
+    }
+
+    size_t heapBytes = 0;
+    for (int i = 0; i < table->numRows; i++)
+    {
+        heapBytes += strlen(cell_string(table, i, col)) + 1;
+    }
+    uint32_t *offsets = malloc(bytes > 0 ? bytes : 1);
+    char *heap = malloc(heapBytes > 0 ? heapBytes : 1);
+    if (!offsets || !heap)
+    {
+        free(offsets);
+        free(heap);
+        return 0;
+    }
+
+    size_t offset = 0;
+    for (int i = 0; i < table->numRows; i++)
+    {
+        const char *value = cell_string(table, i, col);
+        size_t length = strlen(value) + 1;
+        offsets[i] = (uint32_t)offset;
+        memcpy(heap + offset, value, length);
+        offset += length;
+    }
+    int ok = write_block(file, offsets, bytes, STRING, heap, heapBytes);
+    free(offsets);
+    free(heap);
+    return ok;
+}
+
+// Write the live slots of an ordered column in key order, through its index.
+// An index that cannot be built leaves an empty order, which loading ignores.
+static int write_key_order(FILE *file, Table *table, int col)
+{
+    BTree *index = find_ordered_index(table, col);
+    int count = index ? index->count : 0;
+    uint32_t *slots = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+    if (!slots)
+    {
+        count = 0;
+    }
+
+    if (count > 0)
+    {
+        BTreeIterator it;
+        btree_first(index, &it);
+        for (int i = 0; i < count; i++)
+        {
+            slots[i] = (uint32_t)btree_next(&it);
+        }
+    }
+
+    BlockHeader block = {count * sizeof(uint32_t), 0};
+    int ok = fwrite(&block, sizeof(block), 1, file) == 1 && write_padded(file, slots, block.dataBytes);
+    free(slots);
+    return ok;
+}
+
+static int write_table_segment(FILE *file, Table *table)
+{
+    TableHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.name, table->name, SEGMENT_NAME_SIZE - 1);
+    header.numColumns = table->numColumns;
+    header.numRows = table->numRows;
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        ColumnHeader column;
+        memset(&column, 0, sizeof(column));
+        strncpy(column.name, table->columns[i].name, SEGMENT_NAME_SIZE - 1);
+        column.type = table->columns[i].type;
+        column.flags = column_flags(&table->columns[i]);
+        if (fwrite(&column, sizeof(column), 1, file) != 1)
+        {
+            return 0;
+        }
+    }
+
+    RowHeader rows;
+    memset(&rows, 0, sizeof(rows));
+    rows.nextRowId = table->nextRowId;
+    rows.numDeleted = table->numDeleted + table->numPending;
+    if (fwrite(&rows, sizeof(rows), 1, file) != 1 ||
+        !write_block(file, table->rowIds.ints, value_bytes(INTEGER, table->numRows), INTEGER, NULL, 0) ||
+        !write_block(file, table->deleted.bits, value_bytes(BOOLEAN, table->numRows), BOOLEAN, NULL, 0))
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        ColumnType type = table->columns[i].type;
+        if (type == STRING)
+        {
+            if (!write_string_column(file, table, i))
+                return 0;
+            continue;
+        }
+
+        if (!write_block(file, column_values(&table->data[i], type), value_bytes(type, table->numRows), type, NULL, 0))
+        {
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (table->columns[i].isOrdered && !write_key_order(file, table, i))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// File name form of a database or table name: letters, digits, '_' and '-'
+// are kept, every other byte is written as %XX
+static void escape_name(const char *name, char *escaped, size_t size)
+{
+    size_t length = 0;
+    for (const unsigned char *c = (const unsigned char *)name; *c && length + 4 < size; c++)
+    {
+        if (isalnum(*c) || *c == '_' || *c == '-')
+        {
+            escaped[length++] = (char)*c;
+        }
+        else
+        {
+            length += snprintf(escaped + length, size - length, "%%%02X", *c);
+        }
+    }
+    escaped[length] = '\0';
+}
+
+// Directory a snapshot file is in, where its databases' directories are
+static void snapshot_directory(const char *filename, char *directory, size_t size)
+{
+    snprintf(directory, size, "%s", filename);
+    char *slash = strrchr(directory, '/');
+    if (slash)
+    {
+        slash[slash == directory] = '\0';
+    }
+    else
+    {
+        snprintf(directory, size, ".");
+    }
+}
+
+// Paths of a database's directory and of a table's file. Both return 0 if
+// the path does not fit, which leaves it cut short.
+static int database_path(const char *directory, const char *database, char *path, size_t size)
+{
+    char escaped[SEGMENT_NAME_SIZE * 3];
+    escape_name(database, escaped, sizeof(escaped));
+    int length = snprintf(path, size, "%s/%s", directory, escaped);
+    return length >= 0 && (size_t)length < size;
+}
+
+static int table_file_path(const char *directory, const StoredFile *stored, char *path, size_t size)
+{
+    char databasePath[FILENAME_MAX];
+    char escaped[SEGMENT_NAME_SIZE * 3];
+    if (!database_path(directory, stored->database, databasePath, sizeof(databasePath)))
+    {
+        return 0;
+    }
+    escape_name(stored->table.name, escaped, sizeof(escaped));
+    int length = snprintf(path, size, "%s/%s.%llu%s", databasePath, escaped, (unsigned long long)stored->table.file,
+                          TABLE_FILE_SUFFIX);
+    return length >= 0 && (size_t)length < size;
+}
+
+// Create a directory, returns 1 if it exists afterwards
+static int make_directory(const char *path)
+{
+#ifdef _WIN32
+    return _mkdir(path) == 0 || errno == EEXIST;
+#else
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+// Remove a directory if it is empty
+static void remove_directory(const char *path)
+{
+#ifdef _WIN32
+    _rmdir(path);
+#else
+    rmdir(path);
+#endif
+}
+
+static SegmentFiles *catalog_files(Catalog *catalog)
+{
+    if (!catalog->files)
+    {
+        catalog->files = calloc(1, sizeof(SegmentFiles));
+        if (catalog->files)
+        {
+            catalog->files->nextFile = 1;
+        }
+    }
+    return catalog->files;
+}
+
+static void init_segment_header(SegmentHeader *header, uint32_t numDatabases)
+{
+    memset(header, 0, sizeof(SegmentHeader));
+    memcpy(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    header->version = SEGMENT_VERSION;
+    header->byteOrder = SEGMENT_BYTE_ORDER;
+    header->numDatabases = numDatabases;
+}
+
+// A table to write to its own file, and the directory entry to fill in
+typedef struct
+{
+    Table *table;
+    TableFile *entry;
+    char path[FILENAME_MAX];
+    int ok;
+} TableWrite;
+
+typedef struct
+{
+    TableWrite *writes;
+    int numWrites;
+    int next; // Next write a thread takes
+} WriteQueue;
+
+// Write a table to a new file and wait until it is on disk. A table that did
+// not change since it was stored, in a snapshot of an older version, is copied
+// from there as it is, without reading it in, and keeps that version.
+static int write_table_file(TableWrite *write)
+{
+    FILE *file = fopen(write->path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    Table *table = write->table;
+    SegmentHeader header;
+    init_segment_header(&header, 0);
+    if (table->stored && !table->dirty)
+    {
+        header.version = table->stored->version;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && table->stored && !table->dirty)
+    {
+        const char *bytes = (const char *)table->stored->base + table->storedOffset;
+        ok = fwrite(bytes, 1, table->storedBytes, file) == table->storedBytes;
+    }
+    else if (ok)
+    {
+        ok = write_table_segment(file, table);
+    }
+
+    long end = ok ? ftell(file) : -1;
+    write->entry->bytes = end > 0 ? (uint64_t)end - sizeof(header) : 0;
+    ok = end > 0 && sync_file(file);
+    if (fclose(file) != 0)
+    {
+        ok = 0;
+    }
+    if (!ok)
+    {
+        remove(write->path);
+    }
+    return ok;
+}
+
+static void *run_table_writes(void *argument)
+{
+    WriteQueue *queue = argument;
+    for (;;)
+    {
+        int i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= queue->numWrites)
+        {
+            return NULL;
+        }
+        queue->writes[i].ok = write_table_file(&queue->writes[i]) && sync_directory(queue->writes[i].path);
+    }
+}
+
+// Write the tables' files, on up to SEGMENT_WRITE_THREADS threads since each
+// waits for its own sync. Returns 0 if any could not be written.
+static int write_table_files(TableWrite *writes, int numWrites)
+{
+    WriteQueue queue = {writes, numWrites, 0};
+#ifdef _WIN32
+    run_table_writes(&queue);
+#else
+    pthread_t threads[SEGMENT_WRITE_THREADS];
+    int numThreads = 0;
+    while (numThreads < SEGMENT_WRITE_THREADS - 1 && numThreads < numWrites - 1 &&
+           pthread_create(&threads[numThreads], NULL, run_table_writes, &queue) == 0)
+    {
+        numThreads++;
+    }
+    run_table_writes(&queue);
+    for (int i = 0; i < numThreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+
+    for (int i = 0; i < numWrites; i++)
+    {
+        if (!writes[i].ok)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Write the snapshot file listing every database's tables and their files
+static int write_manifest(const Catalog *catalog, const StoredFile *files, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    uint32_t numDatabases = 0;
+    for (DatabaseNode *node = catalog->databases; node; node = node->next)
+    {
+        numDatabases++;
+    }
+    SegmentHeader header;
+    init_segment_header(&header, numDatabases);
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    size_t next = 0;
+    for (DatabaseNode *node = catalog->databases; ok && node; node = node->next)
+    {
+        DatabaseHeader dbHeader;
+        memset(&dbHeader, 0, sizeof(dbHeader));
+        strncpy(dbHeader.name, node->db.name, SEGMENT_NAME_SIZE - 1);
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
+        {
+            dbHeader.numTables++;
+        }
+        ok = fwrite(&dbHeader, sizeof(dbHeader), 1, file) == 1;
+        for (uint32_t i = 0; ok && i < dbHeader.numTables; i++)
+        {
+            ok = fwrite(&files[next++].table, sizeof(TableFile), 1, file) == 1;
+        }
+    }
+
+    // The snapshot replaces the old one only once it is on disk
+    if (ok && !sync_file(file))
+    {
+        ok = 0;
+    }
+    if (fclose(file) != 0)
+    {
+        ok = 0;
+    }
+    return ok;
+}
+
+// Write a snapshot of every database: the tables that changed since they were
+// stored, or were never stored in a file of their own, each to a new file in
+// their database's directory next to filename, then the list of all tables
+// and their files to filename. Returns 0 on failure. The new files are only
+// used once segment_rebind is called for the snapshot.
+int segment_write(Catalog *catalog, const char *filename)
+{
+    SegmentFiles *files = catalog_files(catalog);
+    if (!files)
+    {
+        return 0;
+    }
+
+    size_t numTables = 0;
+    for (DatabaseNode *node = catalog->databases; node; node = node->next)
+    {
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
+        {
+            numTables++;
+        }
+    }
+    StoredFile *written = calloc(numTables > 0 ? numTables : 1, sizeof(StoredFile));
+    TableWrite *writes = calloc(numTables > 0 ? numTables : 1, sizeof(TableWrite));
+    int ok = written && writes;
+
+    char directory[FILENAME_MAX];
+    snapshot_directory(filename, directory, sizeof(directory));
+    size_t next = 0;
+    int numWrites = 0;
+    for (DatabaseNode *node = catalog->databases; ok && node; node = node->next)
+    {
+        int created = 0;
+        for (TableNode *tableNode = node->db.tables; ok && tableNode; tableNode = tableNode->next)
+        {
+            Table *table = &tableNode->table;
+            StoredFile *stored = &written[next++];
+            strncpy(stored->database, node->db.name, SEGMENT_NAME_SIZE - 1);
+            strncpy(stored->table.name, table->name, SEGMENT_NAME_SIZE - 1);
+            if (table->storedFile != 0 && !table->dirty)
+            {
+                stored->table.file = table->storedFile;
+                stored->table.bytes = table->storedBytes;
+                continue;
+            }
+
+            if (!created)
+            {
+                char path[FILENAME_MAX];
+                ok = database_path(directory, node->db.name, path, sizeof(path)) && make_directory(path);
+                created = 1;
+            }
+            stored->table.file = files->nextFile++;
+            writes[numWrites].table = table;
+            writes[numWrites].entry = &stored->table;
+            if (!table_file_path(directory, stored, writes[numWrites].path, sizeof(writes[numWrites].path)))
+            {
+                ok = 0;
+            }
+            numWrites++;
+        }
+    }
+
+    ok = ok && write_table_files(writes, numWrites) && write_manifest(catalog, written, filename);
+    free(writes);
+    free(files->written);
+    files->written = ok ? written : NULL;
+    files->numWritten = ok ? numTables : 0;
+    if (!ok)
+    {
+        free(written);
+    }
+    return ok;
+}
+
+// Map a whole file read-only for sharing, but writable as private copy-on-write pages
+static void *map_file(const char *filename, size_t *size)
+{
+#ifdef _WIN32
+    // No mmap, read the file into one buffer instead
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void *base = length > 0 ? malloc(length) : NULL;
+    if (base && fread(base, 1, length, file) != (size_t)length)
+    {
+        free(base);
+        base = NULL;
+    }
+    fclose(file);
+    *size = base ? (size_t)length : 0;
+    return base;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    *size = st.st_size;
+    return base;
+#endif
+}
+
+static void unmap_file(void *base, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    free(base);
+#else
+    munmap(base, size);
+#endif
+}
+
+// Bounds-checked cursor over the mapped file
+typedef struct
+{
+    char *base;
+    size_t size;
+    size_t offset;
+} Reader;
+
+static void *take(Reader *reader, size_t bytes)
+{
+    if (bytes > reader->size - reader->offset)
+    {
+        return NULL;
+    }
+    void *at = reader->base + reader->offset;
+    reader->offset += padded(bytes);
+    if (reader->offset > reader->size)
+    {
+        reader->offset = reader->size;
+    }
+    return at;
+}
+
+// A block's values or heap as stored, and once decoded
+typedef struct
+{
+    const uint8_t *stored; // Encoded bytes, NULL for a raw block
+    uint64_t storedBytes;
+    Codec codec;
+    CodecValues kind;
+    size_t bytes;  // Decoded
+    void *values;  // The mapped bytes of a raw block, or memory of its own an encoded one is decoded into
+    int owned;
+    int ok;
+} BlockRead;
+
+// Take the bytes of a block's values or heap, of the given size once decoded.
+// A raw block's are used as they are, an encoded one is left for decode_block.
+// Returns 0 if they do not match.
+static int take_encoded(Reader *reader, size_t bytes, CodecValues kind, uint32_t version, BlockRead *read)
+{
+    memset(read, 0, sizeof(BlockRead));
+    read->kind = kind;
+    read->bytes = bytes;
+    if (version < 6)
+    {
+        read->values = take(reader, bytes);
+        return bytes == 0 || read->values;
+    }
+
+    BlockEncoding *encoding = take(reader, sizeof(BlockEncoding));
+    const uint8_t *stored = encoding ? take(reader, encoding->bytes) : NULL;
+    if (!encoding || (encoding->bytes > 0 && !stored))
+    {
+        return 0;
+    }
+    if (encoding->codec == CODEC_RAW)
+    {
+        read->values = (void *)stored;
+        return encoding->bytes == bytes;
+    }
+    read->stored = stored;
+    read->storedBytes = encoding->bytes;
+    read->codec = (Codec)encoding->codec;
+    return bytes > 0;
+}
+
+// Decode a block taken by take_encoded into memory of its own, if it is encoded
+static int decode_block(BlockRead *read)
+{
+    if (!read->stored)
+    {
+        return 1;
+    }
+    read->values = malloc(read->bytes);
+    if (!read->values || !codec_decode(read->codec, read->stored, read->storedBytes, read->kind, read->values,
+                                       read->bytes))
+    {
+        free(read->values);
+        read->values = NULL;
+        return 0;
+    }
+    read->owned = 1;
+    return 1;
+}
+
+typedef struct
+{
+    BlockRead *reads;
+    int numReads;
+    int next; // Next block a thread decodes
+} DecodeQueue;
+
+static void *run_block_decodes(void *argument)
+{
+    DecodeQueue *queue = argument;
+    for (;;)
+    {
+        int i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= queue->numReads)
+        {
+            return NULL;
+        }
+        queue->reads[i].ok = decode_block(&queue->reads[i]);
+    }
+}
+
+// Decode a table's encoded blocks, on up to SEGMENT_DECODE_THREADS threads once
+// there are enough bytes to be worth it. Returns 0 if any could not be decoded.
+static int decode_blocks(BlockRead *reads, int numReads)
+{
+    DecodeQueue queue = {reads, numReads, 0};
+    size_t encodedBytes = 0;
+    int numEncoded = 0;
+    for (int i = 0; i < numReads; i++)
+    {
+        encodedBytes += reads[i].stored ? reads[i].bytes : 0;
+        numEncoded += reads[i].stored != NULL;
+    }
+#ifdef _WIN32
+    run_block_decodes(&queue);
+#else
+    pthread_t threads[SEGMENT_DECODE_THREADS];
+    int numThreads = 0;
+    while (encodedBytes >= SEGMENT_PARALLEL_DECODE_BYTES && numThreads < SEGMENT_DECODE_THREADS - 1 &&
+           numThreads < numEncoded - 1 && pthread_create(&threads[numThreads], NULL, run_block_decodes, &queue) == 0)
+    {
+        numThreads++;
+    }
+    run_block_decodes(&queue);
+    for (int i = 0; i < numThreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+
+    for (int i = 0; i < numReads; i++)
+    {
+        if (!reads[i].ok)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Free the memory blocks were decoded into, for those not given to a column
+static void free_block_reads(BlockRead *reads, int numReads)
+{
+    for (int i = 0; i < numReads; i++)
+    {
+        if (reads[i].owned)
+        {
+            free(reads[i].values);
+        }
+    }
+    free(reads);
+}
+
+// Take one block of fixed size values from the reader and decode it, returns
+// 0 if it does not match
+static int take_values(Reader *reader, ColumnType type, uint32_t numRows, uint32_t version, BlockRead *read)
+{
+    BlockHeader *block = take(reader, sizeof(BlockHeader));
+    return block && block->dataBytes == value_bytes(type, numRows) && block->heapBytes == 0 &&
+           take_encoded(reader, block->dataBytes, codec_values(type), version, read) && decode_block(read);
+}
+
+// Point a column's arrays at a block's values and heap, either both in the
+// mapped file or both decoded into memory the column then owns
+static void set_column_arrays(ColumnData *data, ColumnType type, void *values, char *heap, size_t heapBytes,
+                              uint32_t numRows, int owned)
+{
+    switch (type)
+    {
+    case INTEGER:
+        data->ints = values;
+        break;
+    case FLOAT:
+        data->floats = values;
+        break;
+    case BOOLEAN:
+        data->bits = values;
+        break;
+    case STRING:
+        data->offsets = values;
+        data->heap = heap;
+        data->heapSize = heapBytes;
+        data->heapCapacity = heapBytes;
+        break;
+    }
+    if (owned)
+    {
+        data->arrayBytes = value_bytes(type, numRows);
+        data->allocations = (values != NULL) + (heap != NULL);
+    }
+    else
+    {
+        data->mapped = 1;
+        data->mappedRows = numRows;
+    }
+}
+
+// Point the table's row ids and deleted slots at the row section
+static int load_rows(Reader *reader, Table *table, uint32_t numRows, uint32_t version)
+{
+    RowHeader *rows = take(reader, sizeof(RowHeader));
+    if (!rows || rows->numDeleted > numRows)
+    {
+        return 0;
+    }
+    BlockRead ids, deleted;
+    if (!take_values(reader, INTEGER, numRows, version, &ids))
+    {
+        return 0;
+    }
+    if (!take_values(reader, BOOLEAN, numRows, version, &deleted))
+    {
+        if (ids.owned)
+            free(ids.values);
+        return 0;
+    }
+
+    if (numRows > 0)
+    {
+        set_column_arrays(&table->rowIds, INTEGER, ids.values, NULL, 0, numRows, ids.owned);
+        set_column_arrays(&table->deleted, BOOLEAN, deleted.values, NULL, 0, numRows, deleted.owned);
+    }
+    table->nextRowId = rows->nextRowId;
+    table->numDeleted = rows->numDeleted; // Free list is built from the bits on first insert
+    return 1;
+}
+
+// Copy mapped bytes into memory of their own
+static void *copy_bytes(const void *bytes, size_t size)
+{
+    void *copy = malloc(size > 0 ? size : 1);
+    if (copy && size > 0)
+    {
+        memcpy(copy, bytes, size);
+    }
+    return copy;
+}
+
+// Keep the saved key orders of ordered columns, their indexes are built from them on first use
+static int load_key_orders(Reader *reader, Table *table)
+{
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        if (!table->columns[i].isOrdered)
+        {
+            continue;
+        }
+        BlockHeader *block = take(reader, sizeof(BlockHeader));
+        if (!block || block->dataBytes % sizeof(uint32_t) != 0 || block->heapBytes != 0 ||
+            block->dataBytes / sizeof(uint32_t) > table->numRows)
+        {
+            return 0;
+        }
+        const uint32_t *slots = take(reader, block->dataBytes);
+        if (block->dataBytes > 0 && !slots)
+        {
+            return 0;
+        }
+
+        if (!table->savedOrders)
+        {
+            // Without the memory the index is sorted instead
+            table->savedOrders = calloc(table->numColumns, sizeof(SavedOrder));
+        }
+        if (table->savedOrders)
+        {
+            table->savedOrders[i].slots = slots;
+            table->savedOrders[i].count = (int)(block->dataBytes / sizeof(uint32_t));
+        }
+    }
+    return 1;
+}
+
+// Whether every STRING offset of a column starts a value inside its heap
+static int offsets_in_heap(const uint32_t *offsets, uint32_t numRows, size_t heapBytes)
+{
+    for (uint32_t i = 0; i < numRows; i++)
+    {
+        if (offsets[i] >= heapBytes)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Read a table's columns and rows into a blank table, pointing its arrays at
+// the mapped file, or at memory its encoded blocks are decoded into
+static int read_table(Reader *reader, const TableHeader *header, Table *table, uint32_t version)
+{
+    // Columns are only counted once their data is in place, so a damaged file
+    // leaves a valid table that free_table can free
+    if (header->numColumns > (reader->size - reader->offset) / sizeof(ColumnHeader))
+    {
+        return 0;
+    }
+    int numColumns = header->numColumns;
+    if (numColumns > 0)
+    {
+        table->columns = malloc(header->numColumns * sizeof(Column));
+        table->data = malloc(header->numColumns * sizeof(ColumnData));
+        if (!table->columns || !table->data)
+        {
+            return 0;
+        }
+    }
+    for (int i = 0; i < numColumns; i++)
+    {
+        column_data_init(&table->data[i]);
+    }
+
+    for (uint32_t i = 0; i < header->numColumns; i++)
+    {
+        ColumnHeader *column = take(reader, sizeof(ColumnHeader));
+        if (!column || column->type > FLOAT)
+        {
+            return 0;
+        }
+        memcpy(table->columns[i].name, column->name, MAX_INPUT - 1);
+        table->columns[i].name[MAX_INPUT - 1] = '\0';
+        table->columns[i].type = (ColumnType)column->type;
+        set_column_flags(&table->columns[i], column->flags);
+    }
+
+    if (version >= 2 && !load_rows(reader, table, header->numRows, version))
+    {
+        return 0;
+    }
+
+    // Every column's values at 2 * i and heap at 2 * i + 1, taken before any
+    // is decoded so their decoding can be spread over threads
+    BlockRead *reads = calloc(2 * (numColumns > 0 ? numColumns : 1), sizeof(BlockRead));
+    if (!reads)
+    {
+        return 0;
+    }
+    for (int i = 0; i < numColumns; i++)
+    {
+        ColumnType type = table->columns[i].type;
+        BlockHeader *block = take(reader, sizeof(BlockHeader));
+        if (!block || block->dataBytes != value_bytes(type, header->numRows) || block->heapBytes > UINT32_MAX ||
+            !take_encoded(reader, block->dataBytes, codec_values(type), version, &reads[2 * i]) ||
+            (block->heapBytes > 0 &&
+             !take_encoded(reader, block->heapBytes, CODEC_BYTES, version, &reads[2 * i + 1])))
+        {
+            free(reads);
+            return 0;
+        }
+    }
+    if (!decode_blocks(reads, 2 * numColumns))
+    {
+        free_block_reads(reads, 2 * numColumns);
+        return 0;
+    }
+
+    for (int i = 0; i < numColumns; i++)
+    {
+        BlockRead *values = &reads[2 * i];
+        BlockRead *heap = &reads[2 * i + 1];
+        // Strings must end inside the heap, so cells never read past it
+        if ((heap->bytes > 0 && ((char *)heap->values)[heap->bytes - 1] != '\0') ||
+            (table->columns[i].type == STRING && !offsets_in_heap(values->values, header->numRows, heap->bytes)))
+        {
+            free_block_reads(reads, 2 * numColumns);
+            return 0;
+        }
+
+        // A column's arrays are all mapped or all owned
+        if (heap->bytes > 0 && values->owned != heap->owned)
+        {
+            BlockRead *mapped = values->owned ? heap : values;
+            void *copy = copy_bytes(mapped->values, mapped->bytes);
+            if (!copy)
+            {
+                free_block_reads(reads, 2 * numColumns);
+                return 0;
+            }
+            mapped->values = copy;
+            mapped->owned = 1;
+        }
+
+        ColumnData *data = &table->data[i];
+        set_column_arrays(data, table->columns[i].type, values->values, heap->values, heap->bytes, header->numRows,
+                          values->owned);
+        values->owned = heap->owned = 0; // The column's now
+
+        // Without the memory for the dictionary the column is only slower to filter
+        if (table->columns[i].isDictionary)
+        {
+            column_data_encode(data, header->numRows);
+        }
+        table->numColumns = i + 1;
+    }
+    free(reads);
+
+    table->numRows = header->numRows;
+    table->capacity = header->numRows;
+    if (version >= 3 && !load_key_orders(reader, table))
+    {
+        return 0;
+    }
+    return version >= 2 || reset_row_ids(table);
+}
+
+// Read one table of a file without a directory and add it at the end of the database's tables
+static int load_table(Reader *reader, DatabaseNode *dbNode, uint32_t version, SegmentMapping *mapping)
+{
+    TableHeader *header = take(reader, sizeof(TableHeader));
+    if (!header)
+    {
+        return 0;
+    }
+
+    char tableName[MAX_INPUT];
+    memcpy(tableName, header->name, MAX_INPUT - 1);
+    tableName[MAX_INPUT - 1] = '\0';
+    TableNode *tableNode = catalog_add_table(dbNode, tableName, 1);
+    if (!tableNode)
+    {
+        return 0;
+    }
+
+    Table *table = &tableNode->table;
+    table->source = mapping;
+    mapping->users++;
+    return read_table(reader, header, table, version);
+}
+
+// Take the next directory entry and check that its table lies within the file
+static TableEntry *take_entry(Reader *reader)
+{
+    TableEntry *entry = take(reader, sizeof(TableEntry));
+    if (!entry || entry->offset % 8 != 0 || entry->offset > reader->size ||
+        entry->bytes > reader->size - entry->offset)
+    {
+        return NULL;
+    }
+    return entry;
+}
+
+// Add the tables listed in a database's directory, each to be read on first use
+static int load_directory(Reader *reader, DatabaseNode *dbNode, uint32_t numTables, SegmentMapping *mapping)
+{
+    for (uint32_t i = 0; i < numTables; i++)
+    {
+        TableEntry *entry = take_entry(reader);
+        if (!entry)
+        {
+            return 0;
+        }
+
+        char tableName[MAX_INPUT];
+        memcpy(tableName, entry->name, MAX_INPUT - 1);
+        tableName[MAX_INPUT - 1] = '\0';
+        TableNode *tableNode = catalog_add_table(dbNode, tableName, 1);
+        if (!tableNode)
+        {
+            return 0;
+        }
+
+        Table *table = &tableNode->table;
+        table->stored = mapping;
+        table->storedOffset = entry->offset;
+        table->storedBytes = entry->bytes;
+        table->unloaded = 1;
+        mapping->users++;
+    }
+    return 1;
+}
+
+// Map a table's own file and check its header, returns NULL if it is missing
+// or does not hold bytes of table after the header
+static SegmentMapping *map_table_file(Catalog *catalog, const char *path, uint64_t bytes)
+{
+    size_t size;
+    void *base = map_file(path, &size);
+    if (!base)
+    {
+        return NULL;
+    }
+
+    Reader reader = {base, size, 0};
+    SegmentHeader *header = take(&reader, sizeof(SegmentHeader));
+    SegmentMapping *mapping = NULL;
+    if (header && memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == 0 && header->version >= 4 &&
+        header->version <= SEGMENT_VERSION && header->byteOrder == SEGMENT_BYTE_ORDER &&
+        bytes <= size - sizeof(SegmentHeader))
+    {
+        mapping = malloc(sizeof(SegmentMapping));
+    }
+    if (!mapping)
+    {
+        unmap_file(base, size);
+        return NULL;
+    }
+    mapping->base = base;
+    mapping->size = size;
+    mapping->version = header->version;
+    mapping->users = 0;
+    mapping->next = catalog->mappings;
+    catalog->mappings = mapping;
+    return mapping;
+}
+
+// Point a table at its own file, to be read on first use
+static void store_table(Table *table, SegmentMapping *mapping, const TableFile *entry)
+{
+    table->stored = mapping;
+    table->storedOffset = sizeof(SegmentHeader);
+    table->storedBytes = entry->bytes;
+    table->storedFile = entry->file;
+    __atomic_add_fetch(&mapping->users, 1, __ATOMIC_RELAXED);
+}
+
+// Add the tables of a database listed in the snapshot, mapping their files
+static int load_table_files(Reader *reader, Catalog *catalog, DatabaseNode *dbNode, uint32_t numTables,
+                            const char *directory)
+{
+    SegmentFiles *files = catalog_files(catalog);
+    StoredFile *committed = files ? realloc(files->committed, (files->numCommitted + numTables + 1) * sizeof(StoredFile))
+                                  : NULL;
+    if (!committed)
+    {
+        return 0;
+    }
+    files->committed = committed;
+
+    for (uint32_t i = 0; i < numTables; i++)
+    {
+        TableFile *entry = take(reader, sizeof(TableFile));
+        if (!entry)
+        {
+            return 0;
+        }
+        StoredFile *stored = &files->committed[files->numCommitted];
+        memset(stored, 0, sizeof(StoredFile));
+        strncpy(stored->database, dbNode->db.name, SEGMENT_NAME_SIZE - 1);
+        stored->table = *entry;
+        stored->table.name[SEGMENT_NAME_SIZE - 1] = '\0';
+
+        char path[FILENAME_MAX];
+        SegmentMapping *mapping =
+            table_file_path(directory, stored, path, sizeof(path)) ? map_table_file(catalog, path, entry->bytes) : NULL;
+        TableNode *tableNode = mapping ? catalog_add_table(dbNode, stored->table.name, 1) : NULL;
+        if (!tableNode)
+        {
+            return 0;
+        }
+        files->numCommitted++;
+        store_table(&tableNode->table, mapping, entry);
+        tableNode->table.unloaded = 1;
+        if (entry->file >= files->nextFile)
+        {
+            files->nextFile = entry->file + 1;
+        }
+    }
+    return 1;
+}
+
+// Map a binary snapshot and add its databases and tables to the catalog.
+// Returns 0 if the file is missing or damaged.
+int segment_load(const char *filename, Catalog *catalog)
+{
+    size_t size;
+    void *base = map_file(filename, &size);
+    if (!base)
+    {
+        return 0;
+    }
+
+    Reader reader = {base, size, 0};
+    SegmentHeader *header = take(&reader, sizeof(SegmentHeader));
+    if (!header || memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+        header->version < 1 || header->version > SEGMENT_VERSION || header->byteOrder != SEGMENT_BYTE_ORDER)
+    {
+        unmap_file(base, size);
+        return 0;
+    }
+
+    SegmentMapping *mapping = malloc(sizeof(SegmentMapping));
+    if (!mapping)
+    {
+        unmap_file(base, size);
+        return 0;
+    }
+    mapping->base = base;
+    mapping->size = size;
+    mapping->version = header->version;
+    mapping->users = 0;
+    mapping->next = catalog->mappings;
+    catalog->mappings = mapping;
+
+    for (uint32_t i = 0; i < header->numDatabases; i++)
+    {
+        DatabaseHeader *dbHeader = take(&reader, sizeof(DatabaseHeader));
+        if (!dbHeader)
+        {
+            return 0;
+        }
+
+        char dbName[MAX_INPUT];
+        memcpy(dbName, dbHeader->name, MAX_INPUT - 1);
+        dbName[MAX_INPUT - 1] = '\0';
+        DatabaseNode *dbNode = catalog_add_database(catalog, dbName, 1);
+        if (!dbNode)
+        {
+            return 0;
+        }
+
+        if (header->version >= 5)
+        {
+            char directory[FILENAME_MAX];
+            snapshot_directory(filename, directory, sizeof(directory));
+            if (!load_table_files(&reader, catalog, dbNode, dbHeader->numTables, directory))
+            {
+                return 0;
+            }
+            continue;
+        }
+        if (header->version == 4)
+        {
+            if (!load_directory(&reader, dbNode, dbHeader->numTables, mapping))
+            {
+                return 0;
+            }
+            continue;
+        }
+        for (uint32_t j = 0; j < dbHeader->numTables; j++)
+        {
+            if (!load_table(&reader, dbNode, header->version, mapping))
+            {
+                return 0;
+            }
+        }
+    }
+
+    // The list of tables is not needed once their files are mapped
+    segment_release_unused(catalog);
+    return 1;
+}
+
+// Read a stored table in from its snapshot, returns 0 if that is damaged or
+// memory ran out, leaving the table unloaded. Readers and the writer may ask
+// for the same table at once, the first one reads it.
+int segment_read_table(Table *table)
+{
+    mutex_lock(&loadLock);
+    int read = !table->unloaded;
+    if (!read)
+    {
+        SegmentMapping *mapping = table->stored;
+        Reader reader = {(char *)mapping->base + table->storedOffset, table->storedBytes, 0};
+        TableHeader *header = take(&reader, sizeof(TableHeader));
+        read = header && read_table(&reader, header, table, mapping->version);
+        if (read)
+        {
+            table->source = mapping;
+            __atomic_add_fetch(&mapping->users, 1, __ATOMIC_RELAXED);
+            table->loads++;
+            __atomic_add_fetch(&loads, 1, __ATOMIC_RELAXED);
+            atomic_store_release(&table->unloaded, 0);
+        }
+        else
+        {
+            unload_table(table);
+        }
+    }
+    mutex_unlock(&loadLock);
+    return read;
+}
+
+static int is_written(const SegmentFiles *files, const StoredFile *stored)
+{
+    for (size_t i = 0; i < files->numWritten; i++)
+    {
+        if (files->written[i].table.file == stored->table.file &&
+            strcmp(files->written[i].database, stored->database) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int has_database(const SegmentFiles *files, const char *database)
+{
+    for (size_t i = 0; i < files->numWritten; i++)
+    {
+        if (strcmp(files->written[i].database, database) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Once the snapshot segment_write wrote to filename has replaced the old one,
+// point the tables written to new files at them, so they are clean and can be
+// evicted, and delete the files and directories the old one had and the new
+// one does not. A table whose new file cannot be mapped is written again by
+// the next snapshot. Returns 0 if there is no written snapshot to put in place.
+int segment_rebind(Catalog *catalog, const char *filename)
+{
+    SegmentFiles *files = catalog->files;
+    if (!files || !files->written)
+    {
+        return 0;
+    }
+
+    char directory[FILENAME_MAX];
+    snapshot_directory(filename, directory, sizeof(directory));
+    mutex_lock(&loadLock);
+    size_t next = 0;
+    for (DatabaseNode *node = catalog->databases; node; node = node->next)
+    {
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
+        {
+            Table *table = &tableNode->table;
+            StoredFile *stored = &files->written[next++];
+            if (table->storedFile == stored->table.file)
+            {
+                continue;
+            }
+
+            char path[FILENAME_MAX];
+            SegmentMapping *mapping = table_file_path(directory, stored, path, sizeof(path))
+                                          ? map_table_file(catalog, path, stored->table.bytes)
+                                          : NULL;
+            if (!mapping)
+            {
+                table->storedFile = 0;
+                continue;
+            }
+            segment_unuse(table->stored);
+            store_table(table, mapping, &stored->table);
+            table->dirty = 0;
+        }
+    }
+
+    for (size_t i = 0; i < files->numCommitted; i++)
+    {
+        char path[FILENAME_MAX];
+        StoredFile *stored = &files->committed[i];
+        if (!is_written(files, stored) && table_file_path(directory, stored, path, sizeof(path)))
+        {
+            remove(path);
+        }
+        if (!has_database(files, stored->database) && database_path(directory, stored->database, path, sizeof(path)))
+        {
+            remove_directory(path);
+        }
+    }
+    free(files->committed);
+    files->committed = files->written;
+    files->numCommitted = files->numWritten;
+    files->written = NULL;
+    files->numWritten = 0;
+
+    segment_release_unused(catalog);
+    mutex_unlock(&loadLock);
+    return 1;
+}
+
+// Drop a table's use of a snapshot, which stays mapped until segment_release_unused
+void segment_unuse(SegmentMapping *mapping)
+{
+    if (mapping)
+    {
+        __atomic_sub_fetch(&mapping->users, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Unmap the snapshots no table is stored in or reads from anymore. Nothing may
+// read a table in meanwhile.
+void segment_release_unused(Catalog *catalog)
+{
+    SegmentMapping **link = &catalog->mappings;
+    while (*link)
+    {
+        SegmentMapping *mapping = *link;
+        if (__atomic_load_n(&mapping->users, __ATOMIC_RELAXED) == 0)
+        {
+            *link = mapping->next;
+            unmap_file(mapping->base, mapping->size);
+            free(mapping);
+        }
+        else
+        {
+            link = &mapping->next;
+        }
+    }
+}
+
+// Tables read in from snapshots so far, by every handle
+int64_t segment_loads(void)
+{
+    return __atomic_load_n(&loads, __ATOMIC_RELAXED);
+}
+
+// Unmap every snapshot loaded into the catalog, only safe once no table uses its data anymore
+void segment_release(Catalog *catalog)
+{
+    if (catalog->files)
+    {
+        free(catalog->files->committed);
+        free(catalog->files->written);
+        free(catalog->files);
+        catalog->files = NULL;
+    }
+    while (catalog->mappings)
+    {
+        SegmentMapping *next = catalog->mappings->next;
+        unmap_file(catalog->mappings->base, catalog->mappings->size);
+        free(catalog->mappings);
+        catalog->mappings = next;
+    }
+}
+
+// Delete a snapshot file and the table files it lists, returns 0 if it could not be deleted
+int segment_remove(const char *filename)
+{
+    size_t size;
+    void *base = map_file(filename, &size);
+    Reader reader = {base, base ? size : 0, 0};
+    SegmentHeader *header = base ? take(&reader, sizeof(SegmentHeader)) : NULL;
+    if (header && memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == 0 && header->version >= 5)
+    {
+        char directory[FILENAME_MAX];
+        snapshot_directory(filename, directory, sizeof(directory));
+        for (uint32_t i = 0; i < header->numDatabases; i++)
+        {
+            DatabaseHeader *dbHeader = take(&reader, sizeof(DatabaseHeader));
+            if (!dbHeader)
+            {
+                break;
+            }
+            StoredFile stored;
+            memset(&stored, 0, sizeof(stored));
+            memcpy(stored.database, dbHeader->name, SEGMENT_NAME_SIZE - 1);
+            char path[FILENAME_MAX];
+            for (uint32_t j = 0; j < dbHeader->numTables; j++)
+            {
+                TableFile *entry = take(&reader, sizeof(TableFile));
+                if (!entry)
+                {
+                    break;
+                }
+                stored.table = *entry;
+                stored.table.name[SEGMENT_NAME_SIZE - 1] = '\0';
+                if (table_file_path(directory, &stored, path, sizeof(path)))
+                {
+                    remove(path);
+                }
+            }
+            if (database_path(directory, stored.database, path, sizeof(path)))
+            {
+                remove_directory(path);
+            }
+        }
+    }
+    if (base)
+    {
+        unmap_file(base, size);
+    }
+    return remove(filename) == 0;
+}
@@ -0,0 +1,905 @@
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+#include "wire.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define MAX_EVENTS 64
+
+// Bytes read from a connection at a time
+#define READ_BYTES ((size_t)64 << 10)
+
+typedef struct Connection
+{
+    int fd;
+    WireBuffer input;  // Received bytes, unprocessed from inputStart on
+    size_t inputStart;
+    WireBuffer output; // Responses, unsent from outputSent on
+    size_t outputSent;
+    uint32_t events;   // Registered with epoll
+    int ended;         // The client will send nothing more
+    int closed;        // To be closed once the current events are handled
+    SavvyStatement **statements; // Prepared on the connection by id, NULL once finalized
+    uint32_t numStatements;
+    struct Connection *next;
+} Connection;
+
+typedef struct
+{
+    SavvyDB *db;
+    int epollFd;
+    int listenFd;
+    Connection *connections;
+    Connection *owner; // Connection with a transaction open, NULL without
+    int resumed;       // A transaction ended, the requests that waited for it may run
+    const char **values; // Values of the request being run
+    size_t valueCapacity;
+} Server;
+
+// A decoded request, its strings point into the frame it came in
+typedef struct
+{
+    WireOp op;
+    const char *database;
+    const char *table;
+    const char *text;
+    int64_t rowId;
+    uint32_t statement; // Id of EXECUTE and FINALIZE
+    uint32_t numRows;
+    uint16_t numColumns;
+    const char **values;
+} Request;
+
+static const char *const typeNames[] = {"INTEGER", "STRING", "BOOLEAN", "FLOAT"};
+
+static size_t unsent(const Connection *conn)
+{
+    return conn->output.length - conn->outputSent;
+}
+
+// Decode the fields of a request, see wire.h. Returns 0 if it is malformed.
+static int decode_request(Server *server, WireReader *in, Request *request)
+{
+    memset(request, 0, sizeof(*request));
+    request->op = (WireOp)wire_get_u8(in);
+    request->rowId = -1;
+    switch (request->op)
+    {
+    case WIRE_PING:
+    case WIRE_CHECKPOINT:
+    case WIRE_LIST_DATABASES:
+        break;
+    case WIRE_CREATE_DATABASE:
+    case WIRE_DROP_DATABASE:
+    case WIRE_LIST_TABLES:
+        request->database = wire_get_string(in);
+        break;
+    case WIRE_QUERY:
+    case WIRE_PREPARE:
+        request->database = wire_get_string(in);
+        request->text = wire_get_string(in);
+        break;
+    case WIRE_EXECUTE:
+    case WIRE_FINALIZE:
+        request->statement = wire_get_u32(in);
+        if (request->op == WIRE_EXECUTE)
+        {
+            request->numRows = 1;
+            request->numColumns = wire_get_u16(in);
+        }
+        break;
+    case WIRE_CREATE_TABLE:
+    case WIRE_DROP_TABLE:
+    case WIRE_DESCRIBE:
+    case WIRE_SET_SCHEMA:
+    case WIRE_INSERT:
+    case WIRE_GET:
+    case WIRE_UPDATE:
+    case WIRE_DELETE:
+        request->database = wire_get_string(in);
+        request->table = wire_get_string(in);
+        if (request->op == WIRE_SET_SCHEMA)
+        {
+            request->text = wire_get_string(in);
+        }
+        if (request->op == WIRE_GET || request->op == WIRE_UPDATE || request->op == WIRE_DELETE)
+        {
+            request->rowId = wire_get_i64(in);
+        }
+        if (request->op == WIRE_INSERT)
+        {
+            request->numRows = wire_get_u32(in);
+        }
+        if (request->op == WIRE_INSERT || request->op == WIRE_UPDATE)
+        {
+            request->numRows = request->op == WIRE_UPDATE ? 1 : request->numRows;
+            request->numColumns = wire_get_u16(in);
+        }
+        break;
+    default:
+        return 0;
+    }
+
+    // Every value takes at least its NUL, so the count is checked before allocating
+    size_t count = (size_t)request->numRows * request->numColumns;
+    if (in->failed || count > (size_t)(in->end - in->pos))
+    {
+        return 0;
+    }
+    if (count > server->valueCapacity)
+    {
+        const char **values = realloc(server->values, count * sizeof(char *));
+        if (!values)
+        {
+            return 0;
+        }
+        server->values = values;
+        server->valueCapacity = count;
+    }
+    request->values = server->values;
+    for (size_t i = 0; i < count; i++)
+    {
+        request->values[i] = wire_get_string(in);
+    }
+    return !in->failed && in->pos == in->end;
+}
+
+// Write the header of a successful result, returns where its row count is to patch it
+static size_t put_result(WireBuffer *out, int64_t rowId, int affected, int width, const char *const *names)
+{
+    wire_put_u8(out, SAVVY_OK);
+    wire_put_i64(out, rowId);
+    wire_put_u32(out, (uint32_t)affected);
+    wire_put_u16(out, (uint16_t)width);
+    for (int i = 0; i < width; i++)
+    {
+        wire_put_string(out, names[i]);
+    }
+    size_t rowsAt = out->length;
+    wire_put_u32(out, 0);
+    return rowsAt;
+}
+
+// Names as a result of one column, one row each
+static void put_names(WireBuffer *out, const char *heading, const char **names, int count)
+{
+    size_t rowsAt = put_result(out, -1, count, 1, &heading);
+    for (int i = 0; i < count; i++)
+    {
+        wire_put_i64(out, -1);
+        wire_put_string(out, names[i]);
+    }
+    wire_patch_u32(out, rowsAt, (uint32_t)count);
+}
+
+static SavvyStatus list_names(Server *server, const Request *request, WireBuffer *out)
+{
+    int capacity = 64;
+    const char **names = NULL;
+    SavvyStatus status = SAVVY_OK;
+    int count = capacity;
+    while (status == SAVVY_OK && count == capacity)
+    {
+        capacity *= 2;
+        const char **grown = realloc(names, capacity * sizeof(char *));
+        if (!grown)
+        {
+            free(names);
+            return SAVVY_ERR_NO_MEMORY;
+        }
+        names = grown;
+        if (request->op == WIRE_LIST_DATABASES)
+        {
+            count = savvy_list_databases(server->db, names, capacity);
+        }
+        else
+        {
+            status = savvy_list_tables(server->db, request->database, names, capacity, &count);
+        }
+    }
+    if (status == SAVVY_OK)
+    {
+        put_names(out, request->op == WIRE_LIST_DATABASES ? "database" : "table", names, count);
+    }
+    free(names);
+    return status;
+}
+
+// Columns of a table, returns NULL with the status if there is no such table
+static SavvyColumn *describe(Server *server, const Request *request, int *count, SavvyStatus *status)
+{
+    int capacity = 16;
+    SavvyColumn *columns = NULL;
+    while (1)
+    {
+        SavvyColumn *grown = realloc(columns, capacity * sizeof(SavvyColumn));
+        if (!grown)
+        {
+            free(columns);
+            *status = SAVVY_ERR_NO_MEMORY;
+            return NULL;
+        }
+        columns = grown;
+        *status = savvy_describe(server->db, request->database, request->table, columns, capacity, count);
+        if (*status != SAVVY_OK)
+        {
+            free(columns);
+            return NULL;
+        }
+        if (*count <= capacity)
+        {
+            return columns;
+        }
+        capacity = *count;
+    }
+}
+
+static SavvyStatus run_describe(Server *server, const Request *request, WireBuffer *out)
+{
+    static const char *const headings[] = {"name", "type", "unique", "ordered", "dictionary"};
+    int count;
+    SavvyStatus status;
+    SavvyColumn *columns = describe(server, request, &count, &status);
+    if (!columns)
+    {
+        return status;
+    }
+    size_t rowsAt = put_result(out, -1, count, 5, headings);
+    for (int i = 0; i < count; i++)
+    {
+        wire_put_i64(out, -1);
+        wire_put_string(out, columns[i].name);
+        wire_put_string(out, typeNames[columns[i].type]);
+        wire_put_string(out, columns[i].isUnique ? "true" : "false");
+        wire_put_string(out, columns[i].isOrdered ? "true" : "false");
+        wire_put_string(out, columns[i].isDictionary ? "true" : "false");
+    }
+    wire_patch_u32(out, rowsAt, (uint32_t)count);
+    free(columns);
+    return SAVVY_OK;
+}
+
+// INSERT, UPDATE and GET take or return a value per column, checked against the table first
+static SavvyStatus run_row(Server *server, const Request *request, WireBuffer *out, char *error, size_t errorSize)
+{
+    int count;
+    SavvyStatus status;
+    SavvyColumn *columns = describe(server, request, &count, &status);
+    if (!columns)
+    {
+        return status;
+    }
+    if (request->op != WIRE_GET && request->numColumns != count)
+    {
+        snprintf(error, errorSize, "Table '%s' has %d columns, rows have %d values", request->table, count,
+                 request->numColumns);
+        free(columns);
+        return SAVVY_ERR_INVALID;
+    }
+
+    if (request->op == WIRE_INSERT)
+    {
+        int64_t firstRowId = -1;
+        status = savvy_insert(server->db, request->database, request->table, request->values, request->numRows,
+                              &firstRowId);
+        if (status == SAVVY_OK)
+        {
+            put_result(out, firstRowId, (int)request->numRows, 0, NULL);
+        }
+    }
+    else if (request->op == WIRE_UPDATE)
+    {
+        status = savvy_update(server->db, request->database, request->table, request->rowId, request->values);
+        if (status == SAVVY_OK)
+        {
+            put_result(out, -1, 1, 0, NULL);
+        }
+    }
+    else
+    {
+        char *buffer = malloc((size_t)(count > 0 ? count : 1) * SAVVY_MAX_VALUE);
+        char **values = malloc((count > 0 ? count : 1) * sizeof(char *));
+        const char **names = malloc((count > 0 ? count : 1) * sizeof(char *));
+        status = buffer && values && names ? SAVVY_OK : SAVVY_ERR_NO_MEMORY;
+        for (int i = 0; status == SAVVY_OK && i < count; i++)
+        {
+            values[i] = buffer + (size_t)i * SAVVY_MAX_VALUE;
+            names[i] = columns[i].name;
+        }
+        if (status == SAVVY_OK)
+        {
+            status = savvy_get(server->db, request->database, request->table, request->rowId, values,
+                               SAVVY_MAX_VALUE);
+        }
+        if (status == SAVVY_OK)
+        {
+            size_t rowsAt = put_result(out, -1, 1, count, names);
+            wire_put_i64(out, request->rowId);
+            for (int i = 0; i < count; i++)
+            {
+                wire_put_string(out, values[i]);
+            }
+            wire_patch_u32(out, rowsAt, 1);
+        }
+        free(buffer);
+        free(values);
+        free(names);
+    }
+    free(columns);
+    return status;
+}
+
+// Run a prepared statement. A SELECT is read through a cursor into the
+// response, which may not grow past a frame. Transaction control also moves
+// the ownership of the server's transaction.
+static SavvyStatus run_statement(Server *server, Connection *conn, SavvyStatement *statement, WireBuffer *out,
+                                 size_t frame, char *error, size_t errorSize)
+{
+    SavvyStatementKind kind = savvy_statement_kind(statement);
+    if (kind != SAVVY_STATEMENT_SELECT)
+    {
+        int affected = 0;
+        SavvyStatus status = savvy_execute(statement, NULL, NULL, &affected, error, errorSize);
+        if (status == SAVVY_OK && kind == SAVVY_STATEMENT_BEGIN)
+        {
+            server->owner = conn;
+        }
+        else if (status == SAVVY_OK && (kind == SAVVY_STATEMENT_COMMIT || kind == SAVVY_STATEMENT_ROLLBACK))
+        {
+            server->owner = NULL;
+            server->resumed = 1;
+        }
+        if (status == SAVVY_OK)
+        {
+            put_result(out, -1, affected, 0, NULL);
+        }
+        return status;
+    }
+
+    SavvyCursor *cursor;
+    SavvyStatus status = savvy_cursor_open_statement(statement, &cursor, error, errorSize);
+    if (status != SAVVY_OK)
+    {
+        return status;
+    }
+    int width = savvy_cursor_width(cursor);
+    wire_put_u8(out, SAVVY_OK);
+    wire_put_i64(out, -1);
+    size_t affectedAt = out->length;
+    wire_put_u32(out, 0);
+    wire_put_u16(out, (uint16_t)width);
+    for (int i = 0; i < width; i++)
+    {
+        wire_put_string(out, savvy_cursor_name(cursor, i));
+    }
+    size_t rowsAt = out->length;
+    wire_put_u32(out, 0);
+
+    int total = 0;
+    int numRows;
+    while ((status = savvy_cursor_next(cursor, SERVER_BATCH_ROWS, &numRows)) == SAVVY_OK && numRows > 0)
+    {
+        for (int row = 0; row < numRows; row++)
+        {
+            wire_put_i64(out, savvy_cursor_row_id(cursor, row));
+            for (int i = 0; i < width; i++)
+            {
+                wire_put_string(out, savvy_cursor_value(cursor, row, i));
+            }
+        }
+        total += numRows;
+        if (out->failed)
+        {
+            status = SAVVY_ERR_NO_MEMORY;
+            break;
+        }
+        if (out->length - frame - WIRE_HEADER_BYTES > WIRE_MAX_FRAME)
+        {
+            snprintf(error, errorSize, "Result is larger than %u MiB, narrow it with WHERE or LIMIT",
+                     (unsigned)(WIRE_MAX_FRAME >> 20));
+            status = SAVVY_ERR_INVALID;
+            break;
+        }
+    }
+    savvy_cursor_close(cursor);
+    wire_patch_u32(out, affectedAt, (uint32_t)total);
+    wire_patch_u32(out, rowsAt, (uint32_t)total);
+    return status;
+}
+
+// Run a statement from its text. It is prepared only to be run once, which
+// takes it from the plan cache when it ran before.
+static SavvyStatus run_query(Server *server, Connection *conn, const Request *request, WireBuffer *out,
+                             size_t frame, char *error, size_t errorSize)
+{
+    SavvyStatement *statement;
+    SavvyStatus status = savvy_prepare(server->db, request->database, request->text, &statement, error, errorSize);
+    if (status == SAVVY_OK)
+    {
+        status = run_statement(server, conn, statement, out, frame, error, errorSize);
+        savvy_finalize(statement);
+    }
+    return status;
+}
+
+// Keep a statement on the connection, in the first free slot
+static SavvyStatus prepare(Server *server, Connection *conn, const Request *request, WireBuffer *out, char *error,
+                           size_t errorSize)
+{
+    uint32_t id = 0;
+    while (id < conn->numStatements && conn->statements[id])
+    {
+        id++;
+    }
+    if (id == SERVER_MAX_STATEMENTS)
+    {
+        snprintf(error, errorSize, "A connection keeps at most %d prepared statements", SERVER_MAX_STATEMENTS);
+        return SAVVY_ERR_INVALID;
+    }
+    if (id == conn->numStatements)
+    {
+        SavvyStatement **statements = realloc(conn->statements, (id + 1) * sizeof(SavvyStatement *));
+        if (!statements)
+        {
+            return SAVVY_ERR_NO_MEMORY;
+        }
+        conn->statements = statements;
+        conn->statements[conn->numStatements++] = NULL;
+    }
+    SavvyStatus status =
+        savvy_prepare(server->db, request->database, request->text, &conn->statements[id], error, errorSize);
+    if (status == SAVVY_OK)
+    {
+        put_result(out, id, savvy_statement_params(conn->statements[id]), 0, NULL);
+    }
+    return status;
+}
+
+static SavvyStatement *find_statement(Connection *conn, const Request *request, char *error, size_t errorSize)
+{
+    if (request->statement >= conn->numStatements || !conn->statements[request->statement])
+    {
+        snprintf(error, errorSize, "No prepared statement %u", (unsigned)request->statement);
+        return NULL;
+    }
+    return conn->statements[request->statement];
+}
+
+// Bind the request's values to parameters 1 on and run the statement
+static SavvyStatus execute(Server *server, Connection *conn, const Request *request, WireBuffer *out,
+                           size_t frame, char *error, size_t errorSize)
+{
+    SavvyStatement *statement = find_statement(conn, request, error, errorSize);
+    if (!statement)
+    {
+        return SAVVY_ERR_NOT_FOUND;
+    }
+    for (int i = 0; i < request->numColumns; i++)
+    {
+        SavvyStatus status = savvy_bind(statement, i + 1, request->values[i]);
+        if (status == SAVVY_ERR_NOT_FOUND)
+        {
+            snprintf(error, errorSize, "Statement takes at most %d values, not %d", savvy_statement_params(statement),
+                     request->numColumns);
+            return SAVVY_ERR_INVALID;
+        }
+        if (status != SAVVY_OK)
+        {
+            snprintf(error, errorSize, "Value of parameter %d is not valid for its column", i + 1);
+            return status;
+        }
+    }
+    return run_statement(server, conn, statement, out, frame, error, errorSize);
+}
+
+static SavvyStatus run_request(Server *server, Connection *conn, const Request *request, WireBuffer *out,
+                               size_t frame, char *error, size_t errorSize)
+{
+    SavvyStatus status = SAVVY_OK;
+    switch (request->op)
+    {
+    case WIRE_PING:
+        break;
+    case WIRE_CHECKPOINT:
+        status = savvy_checkpoint(server->db);
+        break;
+    case WIRE_CREATE_DATABASE:
+        status = savvy_create_database(server->db, request->database);
+        break;
+    case WIRE_DROP_DATABASE:
+        status = savvy_drop_database(server->db, request->database);
+        break;
+    case WIRE_CREATE_TABLE:
+        status = savvy_create_table(server->db, request->database, request->table);
+        break;
+    case WIRE_DROP_TABLE:
+        status = savvy_drop_table(server->db, request->database, request->table);
+        break;
+    case WIRE_SET_SCHEMA:
+        status = savvy_set_schema(server->db, request->database, request->table, request->text);
+        break;
+    case WIRE_DELETE:
+        status = savvy_delete(server->db, request->database, request->table, request->rowId);
+        break;
+    case WIRE_LIST_DATABASES:
+    case WIRE_LIST_TABLES:
+        return list_names(server, request, out);
+    case WIRE_DESCRIBE:
+        return run_describe(server, request, out);
+    case WIRE_INSERT:
+    case WIRE_UPDATE:
+    case WIRE_GET:
+        return run_row(server, request, out, error, errorSize);
+    case WIRE_QUERY:
+        return run_query(server, conn, request, out, frame, error, errorSize);
+    case WIRE_PREPARE:
+        return prepare(server, conn, request, out, error, errorSize);
+    case WIRE_EXECUTE:
+        return execute(server, conn, request, out, frame, error, errorSize);
+    case WIRE_FINALIZE:
+        if (!find_statement(conn, request, error, errorSize))
+        {
+            return SAVVY_ERR_NOT_FOUND;
+        }
+        savvy_finalize(conn->statements[request->statement]);
+        conn->statements[request->statement] = NULL;
+        break;
+    }
+    if (status == SAVVY_OK)
+    {
+        put_result(out, -1, request->op == WIRE_DELETE, 0, NULL);
+    }
+    return status;
+}
+
+// Run one request and append its response. A failed request's partial
+// result is replaced by its status and message.
+static void handle_request(Server *server, Connection *conn, const uint8_t *data, size_t length)
+{
+    WireBuffer *out = &conn->output;
+    size_t frame = wire_begin_frame(out);
+    char error[256] = "";
+    WireReader in;
+    wire_reader_init(&in, data, length);
+    Request request;
+    SavvyStatus status = SAVVY_ERR_INVALID;
+    if (!decode_request(server, &in, &request))
+    {
+        snprintf(error, sizeof(error), "%s", "Malformed request");
+    }
+    else
+    {
+        status = run_request(server, conn, &request, out, frame, error, sizeof(error));
+    }
+    if (status == SAVVY_OK && out->failed)
+    {
+        status = SAVVY_ERR_NO_MEMORY;
+    }
+
+    if (status != SAVVY_OK)
+    {
+        // Memory still holds the frame header, reallocation failures keep the old block
+        out->failed = 0;
+        out->length = frame + WIRE_HEADER_BYTES;
+        wire_put_u8(out, (uint8_t)status);
+        wire_put_string(out, error[0] ? error : savvy_status_message(status));
+    }
+    wire_end_frame(out, frame);
+}
+
+// Run the complete requests a connection has buffered, unless another one
+// holds the transaction or the responses are not being read. Returns the
+// number run.
+static int process_requests(Server *server, Connection *conn)
+{
+    int handled = 0;
+    while (!conn->closed && (!server->owner || server->owner == conn) && unsent(conn) < SERVER_BUFFER_BYTES)
+    {
+        const uint8_t *data = conn->input.data + conn->inputStart;
+        size_t available = conn->input.length - conn->inputStart;
+        int64_t length = wire_frame_length(data, available);
+        if (length == 0 || length > WIRE_MAX_FRAME)
+        {
+            // Framing is lost, nothing after this can be trusted
+            conn->closed = 1;
+            break;
+        }
+        if (length < 0 || available < WIRE_HEADER_BYTES + (size_t)length)
+        {
+            break;
+        }
+        handle_request(server, conn, data + WIRE_HEADER_BYTES, (size_t)length);
+        conn->inputStart += WIRE_HEADER_BYTES + (size_t)length;
+        handled++;
+        if (conn->output.failed)
+        {
+            conn->closed = 1;
+        }
+    }
+
+    // Keep the unprocessed bytes at the start of the buffer
+    size_t rest = conn->input.length - conn->inputStart;
+    if (conn->inputStart > 0 && (rest == 0 || conn->inputStart >= rest))
+    {
+        memmove(conn->input.data, conn->input.data + conn->inputStart, rest);
+        conn->input.length = rest;
+        conn->inputStart = 0;
+    }
+    return handled;
+}
+
+// Send what the socket takes without blocking, returns 0 if the connection failed
+static int write_output(Connection *conn)
+{
+    // Drop what was sent before the unsent part outgrows it
+    if (conn->outputSent > unsent(conn))
+    {
+        memmove(conn->output.data, conn->output.data + conn->outputSent, unsent(conn));
+        conn->output.length = unsent(conn);
+        conn->outputSent = 0;
+    }
+    while (unsent(conn) > 0)
+    {
+        ssize_t sent = send(conn->fd, conn->output.data + conn->outputSent, unsent(conn), MSG_NOSIGNAL);
+        if (sent > 0)
+        {
+            conn->outputSent += (size_t)sent;
+        }
+        else if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    conn->output.length = 0;
+    conn->outputSent = 0;
+    return 1;
+}
+
+// Read what has arrived, returns 0 if the connection failed
+static int read_input(Connection *conn)
+{
+    if (!wire_reserve(&conn->input, READ_BYTES))
+    {
+        return 0;
+    }
+    ssize_t received = recv(conn->fd, conn->input.data + conn->input.length, READ_BYTES, 0);
+    if (received > 0)
+    {
+        conn->input.length += (size_t)received;
+    }
+    else if (received == 0)
+    {
+        conn->ended = 1;
+    }
+    return received >= 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+// Run and answer requests until no more can run now. Sending responses makes
+// room for those of requests held back until then.
+static void serve(Server *server, Connection *conn)
+{
+    while (!conn->closed)
+    {
+        size_t before = unsent(conn);
+        int handled = process_requests(server, conn);
+        if (!write_output(conn))
+        {
+            conn->closed = 1;
+        }
+        if (handled == 0 && unsent(conn) == before)
+        {
+            break;
+        }
+    }
+}
+
+static int has_request(const Connection *conn)
+{
+    size_t available = conn->input.length - conn->inputStart;
+    int64_t length = wire_frame_length(conn->input.data + conn->inputStart, available);
+    return length >= 0 && available >= WIRE_HEADER_BYTES + (size_t)length;
+}
+
+// Read only while the client's responses are being taken and its requests are
+// not piling up, write while responses are unsent
+static void update_events(Server *server, Connection *conn)
+{
+    uint32_t events = 0;
+    size_t buffered = conn->input.length - conn->inputStart;
+    if (!conn->ended && unsent(conn) < SERVER_BUFFER_BYTES && (buffered < SERVER_BUFFER_BYTES || !has_request(conn)))
+    {
+        events |= EPOLLIN;
+    }
+    if (unsent(conn) > 0)
+    {
+        events |= EPOLLOUT;
+    }
+    // A client that is done sending is closed once every request it sent is answered
+    if (conn->ended && unsent(conn) == 0 && (!has_request(conn) || conn->closed))
+    {
+        conn->closed = 1;
+        return;
+    }
+    if (events != conn->events)
+    {
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = conn;
+        epoll_ctl(server->epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = events;
+    }
+}
+
+static void accept_connections(Server *server)
+{
+    while (1)
+    {
+        int fd = accept(server->listenFd, NULL, NULL);
+        if (fd < 0)
+        {
+            return;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        Connection *conn = calloc(1, sizeof(Connection));
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (!conn || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0 ||
+            epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        wire_buffer_init(&conn->input);
+        wire_buffer_init(&conn->output);
+        conn->events = EPOLLIN;
+        conn->next = server->connections;
+        server->connections = conn;
+    }
+}
+
+// Close a connection, rolling back the transaction it left open and
+// finalizing its statements
+static void close_connection(Server *server, Connection *conn)
+{
+    if (server->owner == conn)
+    {
+        savvy_rollback(server->db);
+        server->owner = NULL;
+        server->resumed = 1;
+    }
+    for (uint32_t i = 0; i < conn->numStatements; i++)
+    {
+        savvy_finalize(conn->statements[i]);
+    }
+    free(conn->statements);
+    close(conn->fd);
+    wire_buffer_free(&conn->input);
+    wire_buffer_free(&conn->output);
+    free(conn);
+}
+
+// Serve clients connecting to a listening socket until stop is set, normally
+// by a signal handler. Returns 0 if the event loop could not be set up or failed.
+int server_run(SavvyDB *db, int listenFd, volatile sig_atomic_t *stop)
+{
+    Server server;
+    memset(&server, 0, sizeof(server));
+    server.db = db;
+    server.listenFd = listenFd;
+    server.epollFd = epoll_create1(0);
+    struct epoll_event listening;
+    listening.events = EPOLLIN;
+    listening.data.ptr = NULL;
+    if (server.epollFd < 0 || fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK) != 0 ||
+        epoll_ctl(server.epollFd, EPOLL_CTL_ADD, listenFd, &listening) != 0)
+    {
+        if (server.epollFd >= 0)
+        {
+            close(server.epollFd);
+        }
+        return 0;
+    }
+
+    int ok = 1;
+    struct epoll_event events[MAX_EVENTS];
+    while (!*stop)
+    {
+        int numEvents = epoll_wait(server.epollFd, events, MAX_EVENTS, -1);
+        if (numEvents < 0)
+        {
+            ok = errno == EINTR;
+            if (!ok)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // Connections are only freed after the batch, later events may name them
+        for (int i = 0; i < numEvents; i++)
+        {
+            Connection *conn = events[i].data.ptr;
+            if (!conn)
+            {
+                accept_connections(&server);
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                conn->closed = 1;
+            }
+            if (!conn->closed && (events[i].events & EPOLLIN) && !read_input(conn))
+            {
+                conn->closed = 1;
+            }
+            serve(&server, conn);
+        }
+
+        // Requests held back by a transaction that has now ended
+        while (server.resumed)
+        {
+            server.resumed = 0;
+            for (Connection *conn = server.connections; conn; conn = conn->next)
+            {
+                serve(&server, conn);
+            }
+        }
+
+        Connection **link = &server.connections;
+        while (*link)
+        {
+            Connection *conn = *link;
+            if (!conn->closed)
+            {
+                update_events(&server, conn);
+            }
+            if (conn->closed)
+            {
+                *link = conn->next;
+                close_connection(&server, conn);
+                continue;
+            }
+            link = &conn->next;
+        }
+
+        // A rollback on close lets the others go on
+        while (server.resumed)
+        {
+            server.resumed = 0;
+            for (Connection *conn = server.connections; conn; conn = conn->next)
+            {
+                serve(&server, conn);
+                if (!conn->closed)
+                {
+                    update_events(&server, conn);
+                }
+            }
+        }
+    }
+
+    while (server.connections)
+    {
+        Connection *conn = server.connections;
+        server.connections = conn->next;
+        close_connection(&server, conn);
+    }
+    free(server.values);
+    close(server.epollFd);
+    return ok;
+}
@@ -0,0 +1,712 @@
+#include "wal.h"
+#include <stdarg.h>
+
+// Append-only redo log of row and schema operations. Each transaction keeps
+// its records in memory and appends them on commit, framed by BEGIN and
+// COMMIT, instead of rewriting the snapshot; after WAL_CHECKPOINT_THRESHOLD
+// records the snapshot is rewritten once and the log is truncated.
+//
+// Committers that append while another one syncs the file wait for it and
+// then sync once for all of them (group commit), so concurrent transactions
+// share the cost of each fsync.
+//
+// Record formats (one per line, tokens separated by spaces):
+//   BEGIN
+//   COMMIT <numRecords> <hash>
+//   CREATE_DB <db>
+//   DROP_DB <db>
+//   CREATE_TABLE <db> <table>
+//   DROP_TABLE <db> <table>
+//   SCHEMA <db> <table> <numColumns> (<name> <type> <flags>)...   (older logs only)
+//   COLUMNS <db> <table> <numColumns> (<name> <type> <flags> <source> [<default>])...
+//   INSERT <db> <table> <rowId> <numColumns> <value>...
+//   UPDATE <db> <table> <rowId> <numColumns> <value>...
+//   DELETE <db> <table> <rowId>
+//
+// Rows are addressed by their stable ids, which survive slot reuse and compaction.
+// A COMMIT counts the records of its group and holds their FNV-1a hash, so a
+// damaged group is found before any of it is applied. Logs written before
+// transactions were framed hold records outside of any BEGIN and COMMIT, which
+// replay applies one by one, and older COMMIT records hold neither.
+
+#define WAL_MIN_RECORDS_CAPACITY 4096
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static const char beginRecord[] = "BEGIN\n";
+
+// Set up a closed log for the given log and snapshot files
+void wal_init(Wal *wal, const char *logFilename, const char *snapshotFilename)
+{
+    wal->file = NULL;
+    snprintf(wal->path, sizeof(wal->path), "%s", logFilename);
+    snprintf(wal->snapshotPath, sizeof(wal->snapshotPath), "%s", snapshotFilename);
+    wal->replayEnd = -1;
+    wal->pendingRecords = 0;
+    wal->records = NULL;
+    wal->recordsSize = 0;
+    wal->recordsCapacity = 0;
+    wal->numRecords = 0;
+    wal->recordsLost = 0;
+    mutex_init(&wal->lock);
+    cond_init(&wal->synced);
+    wal->writtenLsn = 0;
+    wal->durableLsn = 0;
+    wal->syncing = 0;
+    wal->failed = 0;
+    wal->broken = 0;
+}
+
+int wal_open(Wal *wal)
+{
+    wal->file = fopen(wal->path, "a");
+    return wal->file != NULL;
+}
+
+// Close the file once no committer is syncing it
+void wal_close(Wal *wal)
+{
+    mutex_lock(&wal->lock);
+    while (wal->syncing)
+    {
+        cond_wait(&wal->synced, &wal->lock);
+    }
+    if (wal->file)
+    {
+        fclose(wal->file);
+        wal->file = NULL;
+    }
+    mutex_unlock(&wal->lock);
+}
+
+// Free a closed log
+void wal_destroy(Wal *wal)
+{
+    free(wal->records);
+    wal->records = NULL;
+    mutex_destroy(&wal->lock);
+    cond_destroy(&wal->synced);
+}
+
+// Count a record about to be written, returns 0 if no log is open
+static int start_record(Wal *wal)
+{
+    if (!wal->file)
+        return 0;
+    wal->numRecords++;
+    return 1;
+}
+
+// Append text to the records of the running transaction
+static void append_record(Wal *wal, const char *format, ...)
+{
+    while (!wal->recordsLost)
+    {
+        size_t room = wal->recordsCapacity - wal->recordsSize;
+        int length = 0;
+        if (room > 0)
+        {
+            va_list args;
+            va_start(args, format);
+            length = vsnprintf(wal->records + wal->recordsSize, room, format, args);
+            va_end(args);
+            if (length >= 0 && (size_t)length < room)
+            {
+                wal->recordsSize += length;
+                return;
+            }
+        }
+
+        size_t capacity = wal->recordsCapacity ? wal->recordsCapacity : WAL_MIN_RECORDS_CAPACITY;
+        while (length >= 0 && capacity - wal->recordsSize <= (size_t)length)
+        {
+            capacity *= 2;
+        }
+        char *grown = length >= 0 ? realloc(wal->records, capacity) : NULL;
+        if (!grown)
+        {
+            wal->recordsLost = 1;
+            return;
+        }
+        wal->records = grown;
+        wal->recordsCapacity = capacity;
+    }
+}
+
+void wal_log_create_database(Wal *wal, const char *dbName)
+{
+    if (start_record(wal))
+        append_record(wal, "CREATE_DB %s\n", dbName);
+}
+
+void wal_log_delete_database(Wal *wal, const char *dbName)
+{
+    if (start_record(wal))
+        append_record(wal, "DROP_DB %s\n", dbName);
+}
+
+void wal_log_create_table(Wal *wal, const char *dbName, const char *tableName)
+{
+    if (start_record(wal))
+        append_record(wal, "CREATE_TABLE %s %s\n", dbName, tableName);
+}
+
+void wal_log_delete_table(Wal *wal, const char *dbName, const char *tableName)
+{
+    if (start_record(wal))
+        append_record(wal, "DROP_TABLE %s %s\n", dbName, tableName);
+}
+
+// Log a column change of remap_table_columns, with the position each column
+// came from or -1 for new ones. A new column's default follows its source,
+// marked by COLUMN_DEFAULT in its flags.
+void wal_log_columns(Wal *wal, const char *dbName, const Table *table, const int *sources,
+                     const char *const *defaults)
+{
+    if (!start_record(wal))
+        return;
+
+    append_record(wal, "COLUMNS %s %s %d", dbName, table->name, table->numColumns);
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        const char *value = defaults && sources[i] < 0 ? defaults[i] : NULL;
+        append_record(wal, " %s %d %d %d", table->columns[i].name, table->columns[i].type,
+                      column_flags(&table->columns[i]) | (value ? COLUMN_DEFAULT : 0), sources[i]);
+        if (value)
+        {
+            append_record(wal, " %s", value);
+        }
+    }
+    append_record(wal, "\n");
+}
+
+void wal_log_insert(Wal *wal, const char *dbName, const char *tableName, int64_t rowId,
+                    const char *const *values, int numValues)
+{
+    if (!start_record(wal))
+        return;
+
+    append_record(wal, "INSERT %s %s %lld %d", dbName, tableName, (long long)rowId, numValues);
+    for (int i = 0; i < numValues; i++)
+    {
+        append_record(wal, " %s", values[i]);
+    }
+    append_record(wal, "\n");
+}
+
+void wal_log_update(Wal *wal, const char *dbName, const Table *table, int slot)
+{
+    if (!start_record(wal))
+        return;
+
+    char value[MAX_INPUT];
+    append_record(wal, "UPDATE %s %s %lld %d", dbName, table->name, (long long)row_id(table, slot), table->numColumns);
+    for (int i = 0; i < table->numColumns; i++)
+    {
+        format_cell(table, slot, i, value, sizeof(value));
+        append_record(wal, " %s", value);
+    }
+    append_record(wal, "\n");
+}
+
+void wal_log_delete_row(Wal *wal, const char *dbName, const char *tableName, int64_t rowId)
+{
+    if (start_record(wal))
+        append_record(wal, "DELETE %s %s %lld\n", dbName, tableName, (long long)rowId);
+}
+
+// Number of records logged since the last checkpoint
+int wal_pending(const Wal *wal)
+{
+    return wal->pendingRecords;
+}
+
+// Forget the records of the running transaction, which rolled back
+void wal_discard(Wal *wal)
+{
+    wal->recordsSize = 0;
+    wal->numRecords = 0;
+    wal->recordsLost = 0;
+}
+
+// Write a snapshot of every table. That builds ordered indexes, which readers
+// may be using, so each table is latched meanwhile; only checkpoints pay for
+// that, not every commit.
+static int write_snapshot(Catalog *catalog, const char *path)
+{
+    for (DatabaseNode *node = catalog->databases; node; node = node->next)
+    {
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
+        {
+            mutex_lock(&tableNode->table.latch);
+        }
+    }
+    int written = write_all_databases_to_file(catalog, path);
+    for (DatabaseNode *node = catalog->databases; node; node = node->next)
+    {
+        for (TableNode *tableNode = node->db.tables; tableNode; tableNode = tableNode->next)
+        {
+            mutex_unlock(&tableNode->table.latch);
+        }
+    }
+    return written;
+}
+
+// Whether a sync failed. The system may have dropped the pages it could not
+// write, so neither the log nor a snapshot of memory holding changes the
+// callers were told failed can be trusted to be on disk anymore.
+static int is_broken(Wal *wal)
+{
+    mutex_lock(&wal->lock);
+    int broken = wal->broken;
+    mutex_unlock(&wal->lock);
+    return broken;
+}
+
+// Start a new, empty log once the snapshot holds every appended group.
+// Returns 0 if the log could not be truncated on disk.
+static int truncate_log(Wal *wal)
+{
+    if (!wal->file)
+        return 1;
+
+    // Every appended group is in the snapshot now, which is on disk
+    mutex_lock(&wal->lock);
+    while (wal->syncing)
+    {
+        cond_wait(&wal->synced, &wal->lock);
+    }
+    fclose(wal->file);
+    wal->file = fopen(wal->path, "w");
+    wal->durableLsn = wal->writtenLsn;
+    wal->failed = 0;
+    cond_broadcast(&wal->synced);
+    mutex_unlock(&wal->lock);
+
+    // The log is truncated on disk too, or it would be replayed over the new snapshot
+    if (!wal->file || !sync_file(wal->file))
+    {
+        return 0;
+    }
+    wal->pendingRecords = 0;
+    return 1;
+}
+
+// FNV-1a over the records of a group, each with its newline
+static unsigned int hash_records(const char *records, size_t size, unsigned int hash)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ (unsigned char)records[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Append the running transaction's records to the log as one group, and
+// checkpoint once the log grows large. The group is on disk only after
+// wal_sync. Returns 0 if the records could not be written, nor a snapshot
+// holding their changes, or if a sync failed before; a failed checkpoint of a
+// long log keeps the records.
+int wal_commit(Wal *wal, Catalog *catalog)
+{
+    if (is_broken(wal))
+    {
+        return 0;
+    }
+    if (!wal->file)
+    {
+        // No log open, fall back to rewriting the snapshot
+        return write_snapshot(catalog, wal->snapshotPath);
+    }
+    if (wal->numRecords == 0 && !wal->recordsLost)
+    {
+        return 1;
+    }
+
+    // A group cut short by a failed write would swallow the ones after it, and
+    // the changes of lost records are only in memory: the snapshot holds both
+    mutex_lock(&wal->lock);
+    int failed = wal->failed;
+    mutex_unlock(&wal->lock);
+    char commitRecord[64];
+    size_t commitSize = (size_t)snprintf(commitRecord, sizeof(commitRecord), "COMMIT %d %u\n", wal->numRecords,
+                                         hash_records(wal->records, wal->recordsSize, FNV_OFFSET));
+    int written = !failed && !wal->recordsLost &&
+                  fwrite(beginRecord, 1, sizeof(beginRecord) - 1, wal->file) == sizeof(beginRecord) - 1 &&
+                  fwrite(wal->records, 1, wal->recordsSize, wal->file) == wal->recordsSize &&
+                  fwrite(commitRecord, 1, commitSize, wal->file) == commitSize && fflush(wal->file) == 0;
+    size_t bytes = sizeof(beginRecord) - 1 + wal->recordsSize + commitSize;
+    wal->pendingRecords += wal->numRecords;
+    wal_discard(wal);
+
+    mutex_lock(&wal->lock);
+    wal->writtenLsn += bytes;
+    if (!written)
+    {
+        wal->failed = 1;
+    }
+    mutex_unlock(&wal->lock);
+
+    if (!written)
+    {
+        // The changes are kept once the snapshot holds them, even if the log is not truncated
+        if (!write_snapshot(catalog, wal->snapshotPath))
+        {
+            return 0;
+        }
+        truncate_log(wal);
+        return 1;
+    }
+    if (wal->pendingRecords >= WAL_CHECKPOINT_THRESHOLD)
+    {
+        wal_checkpoint(wal, catalog);
+    }
+    return 1;
+}
+
+// End of the records appended so far, wal_sync(wal_written(wal)) waits for all of them
+uint64_t wal_written(Wal *wal)
+{
+    mutex_lock(&wal->lock);
+    uint64_t lsn = wal->writtenLsn;
+    mutex_unlock(&wal->lock);
+    return lsn;
+}
+
+// Wait until the log is on disk up to lsn. The first committer to wait syncs
+// the file for every group appended until then, the others wait for it and
+// only sync again for groups appended later. Returns 0 if the sync failed,
+// this time or any time before.
+int wal_sync(Wal *wal, uint64_t lsn)
+{
+    mutex_lock(&wal->lock);
+    while (wal->durableLsn < lsn && !wal->failed)
+    {
+        if (wal->syncing)
+        {
+            cond_wait(&wal->synced, &wal->lock);
+            continue;
+        }
+
+        wal->syncing = 1;
+        uint64_t target = wal->writtenLsn;
+        FILE *file = wal->file;
+        mutex_unlock(&wal->lock);
+        int synced = !file || sync_file(file);
+        mutex_lock(&wal->lock);
+        wal->syncing = 0;
+        if (synced && target > wal->durableLsn)
+        {
+            wal->durableLsn = target;
+        }
+        else if (!synced)
+        {
+            wal->failed = 1;
+            wal->broken = 1;
+        }
+        cond_broadcast(&wal->synced);
+    }
+    int durable = !wal->broken && wal->durableLsn >= lsn;
+    mutex_unlock(&wal->lock);
+    return durable;
+}
+
+// Fold the log into the snapshot file and start a new, empty log. Sparse tables
+// are compacted by the caller first, when no reader can be using their slots.
+// Returns 0 if the snapshot could not be written, the log is kept then, or
+// if a sync failed, which leaves both as they are.
+int wal_checkpoint(Wal *wal, Catalog *catalog)
+{
+    return !is_broken(wal) && write_snapshot(catalog, wal->snapshotPath) && truncate_log(wal);
+}
+
+// Read "<numColumns> <value>..." into a buffer of MAX_INPUT sized strings,
+// returns the buffer (to be freed by the caller) and fills the values array
+static char *read_row_values(FILE *file, const Table *table, const char **values)
+{
+    int numValues;
+    if (fscanf(file, "%d", &numValues) != 1 || numValues != table->numColumns)
+    {
+        return NULL;
+    }
+
+    char *buffer = malloc((numValues > 0 ? numValues : 1) * MAX_INPUT);
+    if (!buffer)
+    {
+        return NULL;
+    }
+
+    for (int i = 0; i < numValues; i++)
+    {
+        char *value = buffer + i * MAX_INPUT;
+        if (fscanf(file, "%49s", value) != 1 || !validate_value(value, table->columns[i].type))
+        {
+            free(buffer);
+            return NULL;
+        }
+        values[i] = value;
+    }
+    return buffer;
+}
+
+// Apply one record to the in-memory databases, returns 0 if it could not be read
+static int replay_record(FILE *file, const char *op, Catalog *catalog)
+{
+    char dbName[MAX_INPUT];
+    char tableName[MAX_INPUT];
+
+    if (fscanf(file, "%49s", dbName) != 1)
+        return 0;
+
+    if (strcmp(op, "CREATE_DB") == 0)
+    {
+        return insert_database(catalog, dbName) != NULL;
+    }
+    if (strcmp(op, "DROP_DB") == 0)
+    {
+        remove_database(catalog, dbName);
+        return 1;
+    }
+
+    if (fscanf(file, "%49s", tableName) != 1)
+        return 0;
+
+    DatabaseNode *dbNode = find_database(catalog, dbName);
+    if (!dbNode)
+        return 0;
+
+    if (strcmp(op, "CREATE_TABLE") == 0)
+    {
+        return insert_table(dbNode, tableName) != NULL;
+    }
+    if (strcmp(op, "DROP_TABLE") == 0)
+    {
+        remove_table(dbNode, tableName);
+        return 1;
+    }
+
+    Table *table = find_table(dbNode, tableName);
+    if (!table)
+        return 0;
+
+    if (strcmp(op, "SCHEMA") == 0 || strcmp(op, "COLUMNS") == 0)
+    {
+        int remapped = strcmp(op, "COLUMNS") == 0;
+        int numColumns;
+        if (fscanf(file, "%d", &numColumns) != 1 || numColumns < 0)
+            return 0;
+
+        int count = numColumns > 0 ? numColumns : 1;
+        Column *columns = malloc(count * sizeof(Column));
+        int *sources = malloc(count * sizeof(int));
+        char(*values)[MAX_INPUT] = malloc(count * sizeof(*values));
+        const char **defaults = malloc(count * sizeof(char *));
+        int parsed = columns && sources && values && defaults;
+        for (int i = 0; parsed && i < numColumns; i++)
+        {
+            int type, flags;
+            Value value;
+            sources[i] = -1;
+            defaults[i] = NULL;
+            parsed = fscanf(file, "%49s %d %d", columns[i].name, &type, &flags) == 3 &&
+                     (!remapped || fscanf(file, "%d", &sources[i]) == 1);
+            if (!parsed)
+                break;
+            columns[i].type = (ColumnType)type;
+            set_column_flags(&columns[i], flags);
+
+            // Only a new column has a default, which must be of its type
+            if (flags & COLUMN_DEFAULT)
+            {
+                defaults[i] = values[i];
+                parsed = remapped && sources[i] < 0 && fscanf(file, "%49s", values[i]) == 1 &&
+                         parse_value(values[i], columns[i].type, &value);
+            }
+
+            // A source must be a column of the table's type, named once
+            for (int j = 0; parsed && sources[i] >= 0 && j < i; j++)
+            {
+                parsed = sources[j] != sources[i];
+            }
+            parsed = parsed && sources[i] < table->numColumns &&
+                     (sources[i] < 0 || table->columns[sources[i]].type == columns[i].type);
+        }
+        if (parsed && remapped)
+        {
+            remap_table_columns(table, columns, sources, defaults, numColumns);
+        }
+        else if (parsed)
+        {
+            set_table_columns(table, columns, numColumns);
+        }
+        free(columns);
+        free(sources);
+        free(values);
+        free(defaults);
+        return parsed;
+    }
+    if (strcmp(op, "INSERT") == 0 || strcmp(op, "UPDATE") == 0)
+    {
+        int isInsert = strcmp(op, "INSERT") == 0;
+        long long rowId;
+        if (fscanf(file, "%lld", &rowId) != 1 || rowId < 0)
+            return 0;
+
+        // Inserted ids must be new, updated ones must exist
+        int slot = find_row_slot(table, rowId);
+        if ((isInsert && slot >= 0) || (!isInsert && slot < 0))
+            return 0;
+
+        const char **values = malloc((table->numColumns > 0 ? table->numColumns : 1) * sizeof(char *));
+        char *buffer = values ? read_row_values(file, table, values) : NULL;
+        int applied = buffer != NULL;
+        if (applied && isInsert)
+        {
+            applied = append_row_with_id(table, values, rowId) >= 0;
+        }
+        else if (applied)
+        {
+            for (int i = 0; i < table->numColumns && applied; i++)
+            {
+                applied = replace_row_value(table, slot, i, values[i]);
+            }
+        }
+        free(buffer);
+        free(values);
+        return applied;
+    }
+    if (strcmp(op, "DELETE") == 0)
+    {
+        long long rowId;
+        if (fscanf(file, "%lld", &rowId) != 1)
+            return 0;
+        return remove_row(table, find_row_slot(table, rowId));
+    }
+    return 0;
+}
+
+// Skip the rest of the current line
+static void skip_line(FILE *file)
+{
+    int c = fgetc(file);
+    while (c != EOF && c != '\n')
+    {
+        c = fgetc(file);
+    }
+}
+
+// Whether the group whose BEGIN was just read can be applied: it ends with a
+// COMMIT record whose count and hash match its records, or one of an older log
+// that holds neither. A crash while a group was appended leaves it without a
+// COMMIT, it is then the last thing in the log. Leaves the file where it was.
+static int is_group_intact(FILE *file)
+{
+    long start = ftell(file);
+    char head[64];
+    unsigned int hash = FNV_OFFSET;
+    int numRecords = 0;
+    int intact = 0;
+    skip_line(file);
+    for (;;)
+    {
+        // Read a line, hashing it in case it is a record
+        unsigned int lineHash = hash;
+        size_t length = 0;
+        int c;
+        while ((c = fgetc(file)) != EOF && c != '\n')
+        {
+            if (length < sizeof(head) - 1)
+            {
+                head[length] = (char)c;
+            }
+            length++;
+            lineHash = (lineHash ^ (unsigned char)c) * FNV_PRIME;
+        }
+        head[length < sizeof(head) ? length : sizeof(head) - 1] = '\0';
+        if (c == EOF || strncmp(head, "BEGIN", 5) == 0)
+        {
+            break;
+        }
+        if (strncmp(head, "COMMIT", 6) == 0 && (head[6] == '\0' || head[6] == ' '))
+        {
+            int count;
+            unsigned int expected;
+            char extra;
+            intact = head[6] == '\0' || (sscanf(head + 6, "%d %u %c", &count, &expected, &extra) == 2 &&
+                                          count == numRecords && expected == hash);
+            break;
+        }
+        hash = (lineHash ^ (unsigned char)'\n') * FNV_PRIME;
+        numRecords++;
+    }
+    fseek(file, start, SEEK_SET);
+    return intact;
+}
+
+// Re-apply every committed record of the log on top of the loaded snapshot.
+// A group is checked against its COMMIT before any of it is applied, and
+// replay stops at the first one that is damaged or has no COMMIT. Returns the
+// number of records applied, or -1 if replay stopped early, in which case the
+// caller should checkpoint before logging anything new. damagedRecord
+// receives the number of the damaged record, or of the first one of the group
+// dropped, counted from 1, or 0 if there is none.
+//
+// Should a record of an intact group still fail, the records of the group
+// applied before it are in memory already. Returns WAL_REPLAY_PARTIAL then,
+// and replaying again on a freshly loaded snapshot stops before that group.
+int wal_replay(Wal *wal, Catalog *catalog, int *damagedRecord)
+{
+    *damagedRecord = 0;
+    FILE *file = fopen(wal->path, "r");
+    if (!file)
+    {
+        return 0; // No log yet
+    }
+
+    int applied = 0;
+    int damaged = 0;
+    long group = -1; // Offset of the running group's BEGIN, -1 outside of a group
+    int groupApplied = 0;
+    char op[MAX_INPUT];
+    while (fscanf(file, "%49s", op) == 1)
+    {
+        if (strcmp(op, "COMMIT") == 0)
+        {
+            skip_line(file);
+            group = -1;
+            continue;
+        }
+        if (strcmp(op, "BEGIN") == 0)
+        {
+            // The uncommitted tail of a crashed commit is dropped, as is a
+            // damaged group and everything after it
+            group = ftell(file);
+            groupApplied = 0;
+            if ((wal->replayEnd >= 0 && group >= wal->replayEnd) || !is_group_intact(file))
+            {
+                *damagedRecord = applied + 1;
+                damaged = 1;
+                break;
+            }
+            continue;
+        }
+        if (!replay_record(file, op, catalog))
+        {
+            *damagedRecord = applied + 1;
+            damaged = group >= 0 && groupApplied > 0 ? WAL_REPLAY_PARTIAL : 1;
+            break;
+        }
+        applied++;
+        groupApplied++;
+    }
+
+    fclose(file);
+    if (damaged == WAL_REPLAY_PARTIAL)
+    {
+        wal->replayEnd = group;
+        return WAL_REPLAY_PARTIAL;
+    }
+    wal->pendingRecords = applied;
+    return damaged ? -1 : applied;
+}
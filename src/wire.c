@@ -0,0 +1,348 @@
+#define _POSIX_C_SOURCE 200809L
+#include "wire.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define UNIX_PREFIX "unix:"
+
+void wire_buffer_init(WireBuffer *buffer)
+{
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+    buffer->failed = 0;
+}
+
+void wire_buffer_free(WireBuffer *buffer)
+{
+    free(buffer->data);
+    wire_buffer_init(buffer);
+}
+
+// Make room for bytes more, returns 0 if memory runs out
+int wire_reserve(WireBuffer *buffer, size_t bytes)
+{
+    if (buffer->failed)
+    {
+        return 0;
+    }
+    if (buffer->length + bytes <= buffer->capacity)
+    {
+        return 1;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity < buffer->length + bytes)
+    {
+        capacity *= 2;
+    }
+    uint8_t *data = realloc(buffer->data, capacity);
+    if (!data)
+    {
+        buffer->failed = 1;
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static void put_bytes(WireBuffer *buffer, const void *bytes, size_t length)
+{
+    if (wire_reserve(buffer, length))
+    {
+        memcpy(buffer->data + buffer->length, bytes, length);
+        buffer->length += length;
+    }
+}
+
+static void put_le(WireBuffer *buffer, uint64_t value, int bytes)
+{
+    uint8_t encoded[8];
+    for (int i = 0; i < bytes; i++)
+    {
+        encoded[i] = (uint8_t)(value >> (8 * i));
+    }
+    put_bytes(buffer, encoded, bytes);
+}
+
+void wire_put_u8(WireBuffer *buffer, uint8_t value)
+{
+    put_le(buffer, value, 1);
+}
+
+void wire_put_u16(WireBuffer *buffer, uint16_t value)
+{
+    put_le(buffer, value, 2);
+}
+
+void wire_put_u32(WireBuffer *buffer, uint32_t value)
+{
+    put_le(buffer, value, 4);
+}
+
+void wire_put_i64(WireBuffer *buffer, int64_t value)
+{
+    put_le(buffer, (uint64_t)value, 8);
+}
+
+void wire_put_string(WireBuffer *buffer, const char *value)
+{
+    put_bytes(buffer, value, strlen(value) + 1);
+}
+
+// Overwrite a u32 written earlier, such as a count only known at the end
+void wire_patch_u32(WireBuffer *buffer, size_t at, uint32_t value)
+{
+    if (buffer->failed || at + 4 > buffer->length)
+    {
+        return;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        buffer->data[at + i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+// Start a frame, returns where it starts for wire_end_frame
+size_t wire_begin_frame(WireBuffer *buffer)
+{
+    size_t start = buffer->length;
+    wire_put_u32(buffer, 0);
+    return start;
+}
+
+void wire_end_frame(WireBuffer *buffer, size_t start)
+{
+    wire_patch_u32(buffer, start, (uint32_t)(buffer->length - start - WIRE_HEADER_BYTES));
+}
+
+void wire_reader_init(WireReader *reader, const uint8_t *data, size_t length)
+{
+    reader->pos = data;
+    reader->end = data + length;
+    reader->failed = 0;
+}
+
+static uint64_t get_le(WireReader *reader, int bytes)
+{
+    if (reader->failed || reader->end - reader->pos < bytes)
+    {
+        reader->failed = 1;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)reader->pos[i] << (8 * i);
+    }
+    reader->pos += bytes;
+    return value;
+}
+
+uint8_t wire_get_u8(WireReader *reader)
+{
+    return (uint8_t)get_le(reader, 1);
+}
+
+uint16_t wire_get_u16(WireReader *reader)
+{
+    return (uint16_t)get_le(reader, 2);
+}
+
+uint32_t wire_get_u32(WireReader *reader)
+{
+    return (uint32_t)get_le(reader, 4);
+}
+
+int64_t wire_get_i64(WireReader *reader)
+{
+    return (int64_t)get_le(reader, 8);
+}
+
+// String in place in the decoded bytes, valid as long as they are
+const char *wire_get_string(WireReader *reader)
+{
+    const uint8_t *nul = reader->failed ? NULL : memchr(reader->pos, '\0', reader->end - reader->pos);
+    if (!nul)
+    {
+        reader->failed = 1;
+        return "";
+    }
+    const char *value = (const char *)reader->pos;
+    reader->pos = nul + 1;
+    return value;
+}
+
+// Length of the frame at the start of data, without its header, or -1 until
+// the header has arrived
+int64_t wire_frame_length(const uint8_t *data, size_t available)
+{
+    if (available < WIRE_HEADER_BYTES)
+    {
+        return -1;
+    }
+    WireReader reader;
+    wire_reader_init(&reader, data, WIRE_HEADER_BYTES);
+    return wire_get_u32(&reader);
+}
+
+// Fill a Unix socket address from unix:PATH, returns 0 if the path is too long
+static int unix_address(const char *address, struct sockaddr_un *addr)
+{
+    const char *path = address + strlen(UNIX_PREFIX);
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+// Resolve HOST:PORT, the host may be bracketed like [::1]:7431
+static struct addrinfo *resolve(const char *address, int passive)
+{
+    char host[256];
+    const char *colon = strrchr(address, ':');
+    if (!colon || (size_t)(colon - address) >= sizeof(host))
+    {
+        return NULL;
+    }
+    const char *start = address;
+    size_t length = colon - address;
+    if (length >= 2 && address[0] == '[' && address[length - 1] == ']')
+    {
+        start++;
+        length -= 2;
+    }
+    memcpy(host, start, length);
+    host[length] = '\0';
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    struct addrinfo *result;
+    return getaddrinfo(length > 0 ? host : NULL, colon + 1, &hints, &result) == 0 ? result : NULL;
+}
+
+// Remove the socket file a server that is gone left at a Unix address. Only
+// a socket nobody accepts connections on is removed: returns 0 with errno
+// EADDRINUSE if the path is something else or a server still listens there.
+static int remove_stale_socket(const struct sockaddr_un *addr)
+{
+    struct stat info;
+    if (lstat(addr->sun_path, &info) != 0)
+    {
+        return errno == ENOENT;
+    }
+    int stale = 0;
+    if (S_ISSOCK(info.st_mode))
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        stale = fd >= 0 && connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0 && errno == ECONNREFUSED;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    if (!stale)
+    {
+        errno = EADDRINUSE;
+        return 0;
+    }
+    return unlink(addr->sun_path) == 0 || errno == ENOENT;
+}
+
+// Open a listening socket on HOST:PORT or unix:PATH, returns -1 on failure,
+// with errno set. A Unix socket file a stopped server left is replaced.
+int wire_listen(const char *address)
+{
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+    {
+        struct sockaddr_un addr;
+        int fd = unix_address(address, &addr) ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (!remove_stale_socket(&addr) || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(fd, SOMAXCONN) != 0)
+        {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+        return fd;
+    }
+
+    struct addrinfo *addresses = resolve(address, 1);
+    int fd = -1;
+    for (struct addrinfo *info = addresses; info && fd < 0; info = info->ai_next)
+    {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        int on = 1;
+        if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+                        bind(fd, info->ai_addr, info->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0))
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (addresses)
+    {
+        freeaddrinfo(addresses);
+    }
+    return fd;
+}
+
+// Connect to HOST:PORT or unix:PATH, returns a blocking socket or -1.
+// Small frames go out at once instead of waiting to be coalesced.
+int wire_connect(const char *address)
+{
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+    {
+        struct sockaddr_un addr;
+        int fd = unix_address(address, &addr) ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    struct addrinfo *addresses = resolve(address, 0);
+    int fd = -1;
+    for (struct addrinfo *info = addresses; info && fd < 0; info = info->ai_next)
+    {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd >= 0 && connect(fd, info->ai_addr, info->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (addresses)
+    {
+        freeaddrinfo(addresses);
+    }
+    int on = 1;
+    if (fd >= 0)
+    {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
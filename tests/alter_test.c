@@ -0,0 +1,69 @@
+#include "test.h"
+
+// Rows already in a table hold an added column's declared default, also after
+// the log is replayed, and a STRING column needs one to be added to rows
+static int read_row(SavvyDB *db, const char *query, char values[][32], int numValues)
+{
+    SavvyCursor *cursor;
+    int numRows = 0;
+    if (savvy_cursor_open(db, "shop", query, &cursor, NULL, 0) != SAVVY_OK)
+    {
+        return 0;
+    }
+    if (savvy_cursor_next(cursor, 1, &numRows) == SAVVY_OK && numRows == 1)
+    {
+        for (int i = 0; i < numValues; i++)
+        {
+            snprintf(values[i], sizeof(values[i]), "%s", savvy_cursor_value(cursor, 0, i));
+        }
+    }
+    savvy_cursor_close(cursor);
+    return numRows == 1;
+}
+
+static void check_defaults(SavvyDB *db)
+{
+    char values[5][32];
+    CHECK(read_row(db, "SELECT * FROM items WHERE name = 'apple'", values, 5));
+    CHECK(strcmp(values[2], "none") == 0);
+    CHECK(strcmp(values[3], "7") == 0);
+    CHECK(strcmp(values[4], "0") == 0);
+    CHECK(read_row(db, "SELECT note FROM items WHERE name = 'pear'", values, 1));
+    CHECK(strcmp(values[0], "ripe") == 0);
+}
+
+int main(void)
+{
+    char directory[64];
+    SavvyDB *db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "items", "name STRING unique:qty INTEGER") == SAVVY_OK);
+    const char *values[] = {"apple", "3", "pear", "5"};
+    CHECK(savvy_insert(db, "shop", "items", values, 2, NULL) == SAVVY_OK);
+
+    CHECK(savvy_query(db, "shop", "ALTER TABLE items ADD note STRING", NULL, NULL, NULL, NULL, 0) ==
+          SAVVY_ERR_INVALID);
+    CHECK(savvy_set_schema(db, "shop", "items", "name STRING unique:qty INTEGER:note STRING") == SAVVY_ERR_INVALID);
+    CHECK(savvy_add_column(db, "shop", "items", "rating INTEGER", "high") == SAVVY_ERR_INVALID);
+
+    CHECK(savvy_query(db, "shop", "ALTER TABLE items ADD COLUMN note STRING DEFAULT none", NULL, NULL, NULL, NULL,
+                      0) == SAVVY_OK);
+    CHECK(savvy_add_column(db, "shop", "items", "rating INTEGER ordered", "7") == SAVVY_OK);
+    CHECK(savvy_add_column(db, "shop", "items", "weight FLOAT", NULL) == SAVVY_OK);
+    CHECK(savvy_query(db, "shop", "UPDATE items SET note = ripe WHERE name = 'pear'", NULL, NULL, NULL, NULL, 0) ==
+          SAVVY_OK);
+    check_defaults(db);
+
+    // A second handle replays the log the first one has not checkpointed yet
+    SavvyDB *replayed = NULL;
+    CHECK(savvy_open(directory, &replayed) == SAVVY_OK);
+    if (replayed)
+    {
+        check_defaults(replayed);
+        CHECK(savvy_close(replayed) == SAVVY_OK);
+    }
+
+    test_close(db, directory);
+    return testFailures;
+}
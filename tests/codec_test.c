@@ -0,0 +1,289 @@
+#include "test.h"
+#include <stdint.h>
+#include "codec.h"
+
+// Every codec gives back the block it encoded, for each kind of values, and
+// decoding input that is cut short or followed by more fails without writing
+// past the bytes asked for
+#define GUARD_BYTES 64
+#define GUARD 0xa5
+
+// Decode into a buffer with guard bytes after the block, returns what
+// codec_decode did and checks the guard was left alone
+static int decode_guarded(Codec codec, const uint8_t *encoded, size_t size, CodecValues kind, uint8_t *values,
+                          size_t bytes)
+{
+    // Copied so that reading past size is caught under a sanitizer
+    uint8_t *input = malloc(size > 0 ? size : 1);
+    uint8_t *output = malloc(bytes + GUARD_BYTES);
+    if (!input || !output)
+    {
+        free(input);
+        free(output);
+        CHECK(!"out of memory");
+        return 0;
+    }
+    if (size > 0)
+    {
+        memcpy(input, encoded, size);
+    }
+    memset(output, GUARD, bytes + GUARD_BYTES);
+    int decoded = codec_decode(codec, input, size, kind, output, bytes);
+    int guarded = 1;
+    for (size_t i = bytes; i < bytes + GUARD_BYTES; i++)
+    {
+        guarded = guarded && output[i] == GUARD;
+    }
+    CHECK(guarded);
+    if (values && bytes > 0)
+    {
+        memcpy(values, output, bytes);
+    }
+    free(input);
+    free(output);
+    return decoded;
+}
+
+// Encode a block and decode it again, also cut short and with a byte more.
+// Returns the codec used, CODEC_RAW if the block was left as it was.
+static Codec round_trip(const void *values, size_t bytes, CodecValues kind)
+{
+    Codec codec = CODEC_RAW;
+    uint8_t *encoded = NULL;
+    size_t size = codec_encode(values, bytes, kind, &codec, &encoded);
+    if (size == 0)
+    {
+        CHECK(encoded == NULL);
+        CHECK(decode_guarded(CODEC_RAW, values, bytes, kind, NULL, bytes));
+        return CODEC_RAW;
+    }
+    CHECK(size <= bytes / 4 * 3);
+
+    uint8_t *decoded = malloc(bytes);
+    CHECK(decoded != NULL);
+    if (decoded)
+    {
+        CHECK(decode_guarded(codec, encoded, size, kind, decoded, bytes));
+        CHECK(memcmp(decoded, values, bytes) == 0);
+    }
+    free(decoded);
+
+    for (size_t cut = 0; cut < size; cut++)
+    {
+        CHECK(!decode_guarded(codec, encoded, cut, kind, NULL, bytes));
+    }
+    uint8_t *longer = malloc(size + 1);
+    if (longer)
+    {
+        memcpy(longer, encoded, size);
+        longer[size] = 0;
+        CHECK(!decode_guarded(codec, longer, size + 1, kind, NULL, bytes));
+    }
+    free(longer);
+
+    // Into fewer bytes than were encoded whatever is returned stays in them
+    size_t step = kind == CODEC_INT64 ? sizeof(int64_t) : kind == CODEC_UINT32 ? sizeof(uint32_t) : 1;
+    decode_guarded(codec, encoded, size, kind, NULL, bytes - step);
+    free(encoded);
+    return codec;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void check_int64(void)
+{
+    enum
+    {
+        COUNT = 1000
+    };
+    int64_t values[COUNT];
+    uint64_t state = 88172645463325252ull;
+
+    // Small offsets from a large base, in no order
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = 1000000007 + (int64_t)(next_random(&state) % 200);
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_INT64) == CODEC_FRAME);
+
+    // Ascending with uneven steps
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = (i > 0 ? values[i - 1] : -500000) + (int64_t)(next_random(&state) % 3);
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_INT64) == CODEC_DELTA);
+
+    // Long runs
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = i / 100 * 7 - 30;
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_INT64) == CODEC_RUNS);
+
+    // Spans of the whole range, where offsets and differences wrap around
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = i % 2 ? INT64_MAX : INT64_MIN;
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_INT64) != CODEC_RAW);
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = i < COUNT / 2 ? INT64_MIN : INT64_MAX;
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_INT64) == CODEC_RUNS);
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = i % 3 == 0 ? INT64_MIN : i % 3 == 1 ? INT64_MAX : 0;
+    }
+    round_trip(values, sizeof(values), CODEC_INT64);
+
+    // Random values and single values stay raw
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = (int64_t)next_random(&state);
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_INT64) == CODEC_RAW);
+    CHECK(round_trip(values, sizeof(int64_t), CODEC_INT64) == CODEC_RAW);
+    values[0] = INT64_MIN;
+    CHECK(round_trip(values, sizeof(int64_t), CODEC_INT64) == CODEC_RAW);
+}
+
+static void check_uint32(void)
+{
+    enum
+    {
+        COUNT = 777
+    };
+    uint32_t values[COUNT];
+    uint64_t state = 2463534242ull;
+
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = 4000000000u + (uint32_t)(next_random(&state) % 5000);
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_UINT32) == CODEC_FRAME);
+
+    // String offsets grow by the length of each string
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = (i > 0 ? values[i - 1] : 0) + 3 + (uint32_t)(next_random(&state) % 4);
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_UINT32) == CODEC_DELTA);
+
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = i < 400 ? 0 : UINT32_MAX;
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_UINT32) == CODEC_RUNS);
+
+    for (int i = 0; i < COUNT; i++)
+    {
+        values[i] = (uint32_t)next_random(&state);
+    }
+    CHECK(round_trip(values, sizeof(values), CODEC_UINT32) == CODEC_RAW);
+    CHECK(round_trip(values, sizeof(uint32_t), CODEC_UINT32) == CODEC_RAW);
+
+    // A block that is not whole values is never encoded
+    Codec codec;
+    uint8_t *encoded;
+    CHECK(codec_encode(values, sizeof(values) - 1, CODEC_UINT32, &codec, &encoded) == 0 && encoded == NULL);
+}
+
+static void check_bits(void)
+{
+    uint8_t bits[512];
+    memset(bits, 0, sizeof(bits));
+    CHECK(round_trip(bits, sizeof(bits), CODEC_BITS) == CODEC_RUNS);
+    memset(bits, 0xff, sizeof(bits));
+    CHECK(round_trip(bits, sizeof(bits), CODEC_BITS) == CODEC_RUNS);
+
+    // A few deleted rows, one of them in the first bit and one in the last
+    memset(bits, 0, sizeof(bits));
+    bits[0] = 0x01;
+    bits[100] = 0x24;
+    bits[200] = 0xf0;
+    bits[201] = 0x0f;
+    bits[sizeof(bits) - 1] = 0x80;
+    CHECK(round_trip(bits, sizeof(bits), CODEC_BITS) == CODEC_RUNS);
+
+    uint64_t state = 1234567ull;
+    for (size_t i = 0; i < sizeof(bits); i++)
+    {
+        bits[i] = (uint8_t)next_random(&state);
+    }
+    CHECK(round_trip(bits, sizeof(bits), CODEC_BITS) == CODEC_RAW);
+    CHECK(round_trip(bits, 1, CODEC_BITS) == CODEC_RAW);
+}
+
+static void check_bytes(void)
+{
+    char text[4096];
+    size_t length = 0;
+    for (int i = 0; length + 32 < sizeof(text); i++)
+    {
+        length += (size_t)snprintf(text + length, sizeof(text) - length, "name%d%c", i % 50, '\0') + 1;
+    }
+    CHECK(round_trip(text, length, CODEC_BYTES) == CODEC_LZ);
+
+    // One long overlapping copy, and literals past the token's four bits
+    memset(text, 'a', sizeof(text));
+    CHECK(round_trip(text, sizeof(text), CODEC_BYTES) == CODEC_LZ);
+    for (int i = 0; i < 40; i++)
+    {
+        text[i] = (char)('A' + i % 26 + i / 26);
+    }
+    CHECK(round_trip(text, sizeof(text), CODEC_BYTES) == CODEC_LZ);
+
+    uint64_t state = 99991ull;
+    for (size_t i = 0; i < sizeof(text); i++)
+    {
+        text[i] = (char)next_random(&state);
+    }
+    CHECK(round_trip(text, sizeof(text), CODEC_BYTES) == CODEC_RAW);
+    CHECK(round_trip(text, 1, CODEC_BYTES) == CODEC_RAW);
+}
+
+// Empty blocks are stored raw, and only the raw codec decodes one
+static void check_empty(void)
+{
+    static const CodecValues kinds[] = {CODEC_INT64, CODEC_UINT32, CODEC_BITS, CODEC_BYTES};
+    uint8_t none[1] = {0};
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++)
+    {
+        Codec codec;
+        uint8_t *encoded;
+        CHECK(codec_encode(none, 0, kinds[k], &codec, &encoded) == 0 && encoded == NULL);
+        CHECK(decode_guarded(CODEC_RAW, none, 0, kinds[k], NULL, 0));
+        CHECK(!decode_guarded(CODEC_RAW, none, 1, kinds[k], NULL, 0));
+    }
+
+    // A codec only decodes the kinds it encodes
+    int64_t values[64];
+    for (int i = 0; i < 64; i++)
+    {
+        values[i] = i;
+    }
+    Codec codec;
+    uint8_t *encoded;
+    size_t size = codec_encode(values, sizeof(values), CODEC_INT64, &codec, &encoded);
+    CHECK(size > 0);
+    CHECK(!decode_guarded(codec, encoded, size, CODEC_BYTES, NULL, sizeof(values)));
+    CHECK(!decode_guarded(CODEC_LZ, encoded, size, CODEC_INT64, NULL, sizeof(values)));
+    free(encoded);
+}
+
+int main(void)
+{
+    check_int64();
+    check_uint32();
+    check_bits();
+    check_bytes();
+    check_empty();
+    return testFailures;
+}
@@ -0,0 +1,75 @@
+#include "test.h"
+
+// FLOAT columns take finite values only, so a unique one cannot hold NaN twice
+// and an ordered one's index finds the rows a scan finds
+
+// Sum of the row ids a query returns, with their count
+typedef struct
+{
+    int64_t idSum;
+    int numRows;
+} Rows;
+
+static int add_row(void *context, int64_t rowId, const char *const *values, const char *const *names, int numValues)
+{
+    (void)values;
+    (void)names;
+    (void)numValues;
+    Rows *rows = context;
+    rows->idSum += rowId;
+    rows->numRows++;
+    return 0;
+}
+
+// A condition answered through the ordered index, and its negated opposite,
+// which is scanned, must return the same rows
+static void check_index_matches_scan(SavvyDB *db, const char *indexed, const char *scanned)
+{
+    char query[128];
+    char plan[512];
+    Rows fromIndex = {0, 0};
+    Rows fromScan = {0, 0};
+    snprintf(query, sizeof(query), "SELECT * FROM prices WHERE %s", indexed);
+    CHECK(savvy_explain(db, "shop", query, plan, sizeof(plan)) == SAVVY_OK && strstr(plan, "Ordered index"));
+    CHECK(savvy_query(db, "shop", query, add_row, &fromIndex, NULL, NULL, 0) == SAVVY_OK);
+    snprintf(query, sizeof(query), "SELECT * FROM prices WHERE %s", scanned);
+    CHECK(savvy_explain(db, "shop", query, plan, sizeof(plan)) == SAVVY_OK && strstr(plan, "Full scan"));
+    CHECK(savvy_query(db, "shop", query, add_row, &fromScan, NULL, NULL, 0) == SAVVY_OK);
+    CHECK(fromIndex.numRows > 0 && fromIndex.numRows == fromScan.numRows && fromIndex.idSum == fromScan.idSum);
+}
+
+int main(void)
+{
+    char directory[64];
+    SavvyDB *db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "items", "price FLOAT unique") == SAVVY_OK);
+
+    static const char *const invalid[] = {"nan", "NaN", "-nan", "inf", "-inf", "infinity", "1e999"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        CHECK(savvy_insert(db, "shop", "items", &invalid[i], 1, NULL) == SAVVY_ERR_INVALID);
+    }
+    CHECK(savvy_query(db, "shop", "INSERT INTO items VALUES (nan)", NULL, NULL, NULL, NULL, 0) == SAVVY_ERR_INVALID);
+
+    const char *price = "2.5";
+    CHECK(savvy_insert(db, "shop", "items", &price, 1, NULL) == SAVVY_OK);
+    CHECK(savvy_insert(db, "shop", "items", &price, 1, NULL) == SAVVY_ERR_NOT_UNIQUE);
+    CHECK(savvy_query(db, "shop", "UPDATE items SET price = inf", NULL, NULL, NULL, NULL, 0) == SAVVY_ERR_INVALID);
+
+    CHECK(savvy_create_table(db, "shop", "prices") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "prices", "f FLOAT ordered") == SAVVY_OK);
+    static const char *const prices[] = {"-3.5", "0", "-0.0", "0.25", "1e300", "-1e300", "7", "7", "nan", "2.5"};
+    for (size_t i = 0; i < sizeof(prices) / sizeof(prices[0]); i++)
+    {
+        CHECK(savvy_insert(db, "shop", "prices", &prices[i], 1, NULL) == (i == 8 ? SAVVY_ERR_INVALID : SAVVY_OK));
+    }
+    check_index_matches_scan(db, "f >= 0", "NOT f < 0");
+    check_index_matches_scan(db, "f < 0", "NOT f >= 0");
+    check_index_matches_scan(db, "f > 0.25", "NOT f <= 0.25");
+    check_index_matches_scan(db, "f <= 7", "NOT f > 7");
+
+    test_close(db, directory);
+    return testFailures;
+}
@@ -0,0 +1,141 @@
+#include "test.h"
+
+// A join spilled to temporary files returns the same rows as one held in
+// memory, also when many rows share a key and a partition does not fit in
+// the memory limit either
+typedef struct
+{
+    char **rows;
+    int numRows;
+    int capacity;
+} Rows;
+
+static int add_row(void *context, int64_t rowId, const char *const *values, const char *const *names, int numValues)
+{
+    Rows *rows = context;
+    char row[256] = "";
+    (void)rowId;
+    (void)names;
+    for (int i = 0; i < numValues; i++)
+    {
+        size_t length = strlen(row);
+        snprintf(row + length, sizeof(row) - length, "%s|", values[i]);
+    }
+    if (rows->numRows == rows->capacity)
+    {
+        int capacity = rows->capacity ? rows->capacity * 2 : 256;
+        char **grown = realloc(rows->rows, capacity * sizeof(char *));
+        if (!grown)
+        {
+            return 1;
+        }
+        rows->rows = grown;
+        rows->capacity = capacity;
+    }
+    rows->rows[rows->numRows] = malloc(strlen(row) + 1);
+    if (rows->rows[rows->numRows])
+    {
+        strcpy(rows->rows[rows->numRows++], row);
+    }
+    return 0;
+}
+
+static int compare_rows(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void free_rows(Rows *rows)
+{
+    for (int i = 0; i < rows->numRows; i++)
+    {
+        free(rows->rows[i]);
+    }
+    free(rows->rows);
+    memset(rows, 0, sizeof(*rows));
+}
+
+// Run a join with the given memory limit, its rows sorted
+static int run_join(SavvyDB *db, const char *query, size_t memory, Rows *rows)
+{
+    memset(rows, 0, sizeof(*rows));
+    int affected = -1;
+    if (savvy_set_join_memory(db, memory) != SAVVY_OK ||
+        savvy_query(db, "shop", query, add_row, rows, &affected, NULL, 0) != SAVVY_OK || affected != rows->numRows)
+    {
+        return 0;
+    }
+    qsort(rows->rows, rows->numRows, sizeof(char *), compare_rows);
+    return 1;
+}
+
+static void check_spilled_join(SavvyDB *db, const char *query, int expected)
+{
+    Rows held, spilled;
+    CHECK(run_join(db, query, 0, &held));
+    CHECK(held.numRows == expected);
+
+    // A few rows per pass, then a partition's worth of them
+    static const size_t limits[] = {64, 1024, 16 << 10};
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++)
+    {
+        CHECK(run_join(db, query, limits[i], &spilled));
+        CHECK(spilled.numRows == held.numRows);
+        for (int row = 0; row < spilled.numRows && row < held.numRows; row++)
+        {
+            CHECK(strcmp(spilled.rows[row], held.rows[row]) == 0);
+        }
+        free_rows(&spilled);
+    }
+    free_rows(&held);
+}
+
+int main(void)
+{
+    char directory[64];
+    SavvyDB *db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "users") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "orders") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "users", "id INTEGER:team INTEGER:city STRING") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "orders", "id INTEGER:user INTEGER:city STRING") == SAVVY_OK);
+
+    // Half the users are in team 0, the rest in teams 1 to 49, and orders
+    // reference teams 0 to 59
+    char row[3][32];
+    const char *values[3] = {row[0], row[1], row[2]};
+    int teams[400];
+    int cities[400];
+    for (int i = 0; i < 400; i++)
+    {
+        teams[i] = i < 200 ? 0 : 1 + i % 49;
+        cities[i] = i % 7;
+        snprintf(row[0], sizeof(row[0]), "%d", i);
+        snprintf(row[1], sizeof(row[1]), "%d", teams[i]);
+        snprintf(row[2], sizeof(row[2]), "city%d", cities[i]);
+        CHECK(savvy_insert(db, "shop", "users", values, 1, NULL) == SAVVY_OK);
+    }
+    int byTeam = 0;
+    int byCity = 0;
+    for (int i = 0; i < 600; i++)
+    {
+        snprintf(row[0], sizeof(row[0]), "%d", i);
+        snprintf(row[1], sizeof(row[1]), "%d", i % 60);
+        snprintf(row[2], sizeof(row[2]), "city%d", i % 11);
+        CHECK(savvy_insert(db, "shop", "orders", values, 1, NULL) == SAVVY_OK);
+        for (int user = 0; user < 400; user++)
+        {
+            byTeam += teams[user] == i % 60;
+            byCity += cities[user] == i % 11 && teams[user] < 3;
+        }
+    }
+
+    check_spilled_join(db, "SELECT orders.id, users.id FROM orders JOIN users ON orders.user = users.team", byTeam);
+    check_spilled_join(db,
+                       "SELECT orders.id, users.id, users.city FROM orders JOIN users ON orders.city = users.city "
+                       "WHERE users.team < 3",
+                       byCity);
+
+    test_close(db, directory);
+    return testFailures;
+}
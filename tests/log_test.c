@@ -0,0 +1,359 @@
+#include "test.h"
+
+// A handle opens only where its log can be written and reports what replay
+// dropped, and a change whose log record cannot be written is not kept in
+// memory either
+static int count_rows(SavvyDB *db, const char *table)
+{
+    char query[64];
+    char count[32] = "";
+    snprintf(query, sizeof(query), "SELECT COUNT(*) FROM %s", table);
+    SavvyCursor *cursor;
+    int numRows = 0;
+    if (savvy_cursor_open(db, "shop", query, &cursor, NULL, 0) != SAVVY_OK)
+    {
+        return -1;
+    }
+    if (savvy_cursor_next(cursor, 1, &numRows) == SAVVY_OK && numRows == 1)
+    {
+        snprintf(count, sizeof(count), "%s", savvy_cursor_value(cursor, 0, 0));
+    }
+    savvy_cursor_close(cursor);
+    return numRows == 1 ? atoi(count) : -1;
+}
+
+// Read the log of a directory into text, returns its length
+static size_t read_log(const char *directory, char *text, size_t size)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/db.log", directory);
+    FILE *file = fopen(path, "rb");
+    size_t length = file ? fread(text, 1, size - 1, file) : 0;
+    if (file)
+    {
+        fclose(file);
+    }
+    text[length] = '\0';
+    return length;
+}
+
+// Open a new directory holding length bytes of a log, as a crash left them
+static SavvyDB *open_crashed(const char *log, size_t length, char *directory)
+{
+    char path[128];
+    strcpy(directory, "/tmp/savvy_test_XXXXXX");
+    SavvyDB *db = NULL;
+    if (!mkdtemp(directory))
+    {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/db.log", directory);
+    FILE *file = fopen(path, "wb");
+    int written = file && fwrite(log, 1, length, file) == length;
+    if (!file || fclose(file) != 0 || !written || savvy_open(directory, &db) != SAVVY_OK)
+    {
+        remove_tree(directory);
+        return NULL;
+    }
+    return db;
+}
+
+// A handle that never closes leaves only its log: reopening replays every
+// committed transaction, drops a record torn by the crash and, past a damaged
+// record, everything from its transaction on
+static void check_crash_recovery(void)
+{
+    char directory[64];
+    SavvyDB *db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "items", "name STRING unique:qty INTEGER") == SAVVY_OK);
+    const char *apple[] = {"apple", "3"};
+    const char *pear[] = {"pear", "5"};
+    const char *plum[] = {"plum", "7"};
+    CHECK(savvy_insert(db, "shop", "items", apple, 1, NULL) == SAVVY_OK);
+    CHECK(savvy_begin(db) == SAVVY_OK);
+    CHECK(savvy_insert(db, "shop", "items", pear, 1, NULL) == SAVVY_OK);
+    CHECK(savvy_query(db, "shop", "UPDATE items SET qty = 4 WHERE name = 'apple'", NULL, NULL, NULL, NULL, 0) ==
+          SAVVY_OK);
+    CHECK(savvy_commit(db) == SAVVY_OK);
+    CHECK(savvy_insert(db, "shop", "items", plum, 1, NULL) == SAVVY_OK);
+
+    // The files as they are before savvy_close, which is never called on them
+    char log[2048];
+    size_t length = read_log(directory, log, sizeof(log));
+    char path[128];
+    snprintf(path, sizeof(path), "%s/db.svdb", directory);
+    CHECK(access(path, F_OK) != 0);
+    CHECK(length > 0 && length < sizeof(log) - 1);
+    test_close(db, directory);
+
+    char crashed[64];
+    SavvyRecoveryStats recovery;
+    db = open_crashed(log, length, crashed);
+    CHECK(db != NULL);
+    if (db)
+    {
+        savvy_recovery_stats(db, &recovery);
+        CHECK(recovery.damagedRecord == 0);
+        CHECK(recovery.replayedRecords == 7);
+        CHECK(count_rows(db, "items") == 3);
+        CHECK(count_rows(db, "items WHERE qty = 4") == 1);
+        test_close(db, crashed);
+    }
+
+    // Torn inside the last record: the last transaction is lost, and new
+    // changes are kept after the ones recovered
+    const char *last = strstr(log, "plum");
+    CHECK(last != NULL);
+    db = last ? open_crashed(log, (size_t)(last - log) + 2, crashed) : NULL;
+    CHECK(db != NULL);
+    if (db)
+    {
+        savvy_recovery_stats(db, &recovery);
+        CHECK(recovery.damagedRecord == 7);
+        CHECK(recovery.replayedRecords == 6);
+        CHECK(count_rows(db, "items") == 2);
+        CHECK(count_rows(db, "items WHERE name = 'plum'") == 0);
+        CHECK(savvy_insert(db, "shop", "items", plum, 1, NULL) == SAVVY_OK);
+        CHECK(savvy_close(db) == SAVVY_OK);
+        db = NULL;
+        CHECK(savvy_open(crashed, &db) == SAVVY_OK);
+        if (db)
+        {
+            savvy_recovery_stats(db, &recovery);
+            CHECK(recovery.damagedRecord == 0);
+            CHECK(count_rows(db, "items") == 3);
+            test_close(db, crashed);
+        }
+    }
+
+    // A damaged record in the middle: its transaction and the ones after it
+    // are dropped, the ones before it kept
+    char damaged[sizeof(log)];
+    memcpy(damaged, log, length + 1);
+    char *middle = strstr(damaged, "pear");
+    CHECK(middle != NULL);
+    if (middle)
+    {
+        middle[1] = 'x';
+    }
+    db = open_crashed(damaged, length, crashed);
+    CHECK(db != NULL);
+    if (db)
+    {
+        savvy_recovery_stats(db, &recovery);
+        CHECK(recovery.damagedRecord == 5);
+        CHECK(recovery.replayedRecords == 4);
+        CHECK(count_rows(db, "items") == 1);
+        CHECK(count_rows(db, "items WHERE qty = 3") == 1);
+        test_close(db, crashed);
+    }
+}
+
+int main(void)
+{
+    check_crash_recovery();
+
+    SavvyDB *db = NULL;
+    CHECK(savvy_open("/tmp/savvy_test_missing/data", &db) == SAVVY_ERR_IO);
+    CHECK(db == NULL);
+
+    // Replay stops at a damaged record, which savvy_open reports instead of printing
+    char directory[64];
+    char log[128];
+    strcpy(directory, "/tmp/savvy_test_XXXXXX");
+    CHECK(mkdtemp(directory) != NULL);
+    snprintf(log, sizeof(log), "%s/db.log", directory);
+    FILE *file = fopen(log, "w");
+    CHECK(file != NULL);
+    if (file)
+    {
+        fputs("CREATE_DB shop\nCREATE_TABLE nowhere items\nCREATE_DB other\n", file);
+        fclose(file);
+    }
+    CHECK(savvy_open(directory, &db) == SAVVY_OK);
+    if (db)
+    {
+        SavvyRecoveryStats recovery;
+        savvy_recovery_stats(db, &recovery);
+        CHECK(recovery.replayedRecords == 1);
+        CHECK(recovery.damagedRecord == 2);
+        CHECK(recovery.defaultedValues == 0);
+        test_close(db, directory);
+        db = NULL;
+    }
+
+    // A group a record fails in is dropped whole, with what follows it
+    strcpy(directory, "/tmp/savvy_test_XXXXXX");
+    CHECK(mkdtemp(directory) != NULL);
+    snprintf(log, sizeof(log), "%s/db.log", directory);
+    file = fopen(log, "w");
+    CHECK(file != NULL);
+    if (file)
+    {
+        fputs("CREATE_DB shop\nBEGIN\nCREATE_DB other\nCREATE_TABLE nowhere items\nCOMMIT\nCREATE_DB late\n", file);
+        fclose(file);
+    }
+    CHECK(savvy_open(directory, &db) == SAVVY_OK);
+    if (db)
+    {
+        SavvyRecoveryStats recovery;
+        savvy_recovery_stats(db, &recovery);
+        CHECK(recovery.replayedRecords == 1);
+        CHECK(recovery.damagedRecord == 2);
+        const char *names[4];
+        CHECK(savvy_list_databases(db, names, 4) == 1 && strcmp(names[0], "shop") == 0);
+        test_close(db, directory);
+        db = NULL;
+    }
+
+    // A damaged value is found by the hash of its group, before any of it is applied
+    db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "items", "name STRING:qty INTEGER") == SAVVY_OK);
+    const char *pair[] = {"apple", "3", "pear", "5"};
+    CHECK(savvy_insert(db, "shop", "items", pair, 2, NULL) == SAVVY_OK);
+    snprintf(log, sizeof(log), "%s/db.log", directory);
+    char text[1024] = "";
+    file = fopen(log, "r");
+    size_t length = file ? fread(text, 1, sizeof(text) - 1, file) : 0;
+    if (file)
+    {
+        fclose(file);
+    }
+    text[length] = '\0';
+    char *pear = strstr(text, "pear");
+    CHECK(pear != NULL);
+    if (pear)
+    {
+        pear[1] = 'x';
+    }
+    char damagedDirectory[64];
+    char damagedLog[128];
+    strcpy(damagedDirectory, "/tmp/savvy_test_XXXXXX");
+    CHECK(mkdtemp(damagedDirectory) != NULL);
+    snprintf(damagedLog, sizeof(damagedLog), "%s/db.log", damagedDirectory);
+    file = fopen(damagedLog, "w");
+    CHECK(file != NULL);
+    if (file)
+    {
+        fputs(text, file);
+        fclose(file);
+    }
+    SavvyDB *damaged = NULL;
+    CHECK(savvy_open(damagedDirectory, &damaged) == SAVVY_OK);
+    if (damaged)
+    {
+        SavvyRecoveryStats recovery;
+        savvy_recovery_stats(damaged, &recovery);
+        CHECK(recovery.replayedRecords == 3);
+        CHECK(recovery.damagedRecord == 4);
+        CHECK(count_rows(damaged, "items") == 0);
+        test_close(damaged, damagedDirectory);
+    }
+    test_close(db, directory);
+    db = NULL;
+
+    // Writes to /dev/full fail, and with the directory gone no snapshot can
+    // be written instead
+    if (access("/dev/full", W_OK) != 0)
+    {
+        return testFailures;
+    }
+    strcpy(directory, "/tmp/savvy_test_XXXXXX");
+    CHECK(mkdtemp(directory) != NULL);
+    snprintf(log, sizeof(log), "%s/db.log", directory);
+    CHECK(symlink("/dev/full", log) == 0);
+    CHECK(savvy_open(directory, &db) == SAVVY_OK);
+    if (!db)
+    {
+        return testFailures;
+    }
+    remove_tree(directory);
+
+    const char *values[] = {"apple", "3"};
+    CHECK(savvy_create_database(db, "shop") == SAVVY_ERR_IO);
+    const char *names[4];
+    CHECK(savvy_list_databases(db, names, 4) == 0);
+
+    // Recreate the directory for the setup, then lose it again
+    CHECK(mkdir(directory, 0700) == 0);
+    CHECK(symlink("/dev/full", log) == 0);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "items", "name STRING unique:qty INTEGER") == SAVVY_OK);
+    CHECK(savvy_insert(db, "shop", "items", values, 1, NULL) == SAVVY_OK);
+    remove_tree(directory);
+
+    const char *more[] = {"pear", "5"};
+    CHECK(savvy_insert(db, "shop", "items", more, 1, NULL) == SAVVY_ERR_IO);
+    CHECK(count_rows(db, "items") == 1);
+    CHECK(savvy_query(db, "shop", "UPDATE items SET qty = 9", NULL, NULL, NULL, NULL, 0) == SAVVY_ERR_IO);
+    CHECK(savvy_query(db, "shop", "SELECT * FROM items WHERE qty = 3", NULL, NULL, NULL, NULL, 0) == SAVVY_OK);
+    CHECK(count_rows(db, "items") == 1);
+    CHECK(savvy_query(db, "shop", "DELETE FROM items", NULL, NULL, NULL, NULL, 0) == SAVVY_ERR_IO);
+    CHECK(count_rows(db, "items") == 1);
+
+    CHECK(savvy_begin(db) == SAVVY_OK);
+    CHECK(savvy_insert(db, "shop", "items", more, 1, NULL) == SAVVY_OK);
+    CHECK(savvy_commit(db) == SAVVY_ERR_IO);
+    CHECK(count_rows(db, "items") == 1);
+
+    CHECK(savvy_create_table(db, "shop", "other") == SAVVY_ERR_IO);
+    CHECK(savvy_drop_table(db, "shop", "items") == SAVVY_ERR_IO);
+    CHECK(savvy_drop_database(db, "shop") == SAVVY_ERR_IO);
+    int count = -1;
+    CHECK(savvy_list_tables(db, "shop", names, 4, &count) == SAVVY_OK && count == 1);
+    CHECK(savvy_add_column(db, "shop", "items", "note STRING", "none") == SAVVY_ERR_IO);
+    CHECK(savvy_rename_column(db, "shop", "items", "qty", "amount") == SAVVY_ERR_IO);
+    CHECK(savvy_set_schema(db, "shop", "items", "name STRING:qty INTEGER:note INTEGER") == SAVVY_ERR_IO);
+    SavvyColumn columns[4];
+    CHECK(savvy_describe(db, "shop", "items", columns, 4, &count) == SAVVY_OK);
+    CHECK(count == 2 && strcmp(columns[1].name, "qty") == 0 && columns[0].isUnique);
+
+    // The unique index still holds the row that was kept
+    CHECK(savvy_insert(db, "shop", "items", values, 1, NULL) == SAVVY_ERR_NOT_UNIQUE);
+
+    CHECK(mkdir(directory, 0700) == 0);
+    CHECK(count_rows(db, "items") == 1);
+    test_close(db, directory);
+
+    // Writes to /dev/null succeed but syncing it fails: the change is never
+    // visible, the handle refuses every later one, and reopening with a
+    // working log finds what was synced before
+    db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "items", "name STRING unique:qty INTEGER") == SAVVY_OK);
+    CHECK(savvy_insert(db, "shop", "items", values, 1, NULL) == SAVVY_OK);
+    CHECK(savvy_close(db) == SAVVY_OK);
+    snprintf(log, sizeof(log), "%s/db.log", directory);
+    unlink(log);
+    CHECK(symlink("/dev/null", log) == 0);
+    db = NULL;
+    CHECK(savvy_open(directory, &db) == SAVVY_OK);
+    if (!db)
+    {
+        return testFailures;
+    }
+    CHECK(savvy_insert(db, "shop", "items", more, 1, NULL) == SAVVY_ERR_IO);
+    CHECK(count_rows(db, "items") == 1);
+    CHECK(savvy_query(db, "shop", "UPDATE items SET qty = 9", NULL, NULL, NULL, NULL, 0) == SAVVY_ERR_IO);
+    CHECK(count_rows(db, "items WHERE qty = 3") == 1);
+    CHECK(savvy_create_table(db, "shop", "other") == SAVVY_ERR_IO);
+    CHECK(savvy_checkpoint(db) == SAVVY_ERR_IO);
+    CHECK(savvy_close(db) == SAVVY_ERR_IO);
+
+    unlink(log);
+    db = NULL;
+    CHECK(savvy_open(directory, &db) == SAVVY_OK);
+    if (db)
+    {
+        CHECK(count_rows(db, "items") == 1);
+        CHECK(count_rows(db, "items WHERE qty = 3") == 1);
+        test_close(db, directory);
+    }
+    return testFailures;
+}
@@ -0,0 +1,33 @@
+#include "test.h"
+
+// Schemas and column definitions with an unknown flag or a repeated name are refused
+int main(void)
+{
+    char directory[64];
+    SavvyDB *db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+
+    CHECK(savvy_set_schema(db, "shop", "items", "s STRING bogus") == SAVVY_ERR_INVALID);
+    CHECK(savvy_set_schema(db, "shop", "items", "s STRING uniqe") == SAVVY_ERR_INVALID);
+    CHECK(savvy_set_schema(db, "shop", "items", "s STRING unique ordered dictionary extra") == SAVVY_ERR_INVALID);
+    CHECK(savvy_set_schema(db, "shop", "items", "s STRING:s INTEGER") == SAVVY_ERR_INVALID);
+    CHECK(savvy_set_schema(db, "shop", "items", "a INTEGER:s STRING:s STRING") == SAVVY_ERR_INVALID);
+
+    SavvyColumn columns[4];
+    int count = -1;
+    CHECK(savvy_describe(db, "shop", "items", columns, 4, &count) == SAVVY_OK);
+    CHECK(count == 0);
+
+    CHECK(savvy_set_schema(db, "shop", "items", "s STRING dictionary unique:n INTEGER ordered") == SAVVY_OK);
+    CHECK(savvy_describe(db, "shop", "items", columns, 4, &count) == SAVVY_OK);
+    CHECK(count == 2);
+    CHECK(count == 2 && columns[0].isUnique && columns[0].isDictionary && columns[1].isOrdered);
+
+    CHECK(savvy_add_column(db, "shop", "items", "t STRING bogus", NULL) == SAVVY_ERR_INVALID);
+    CHECK(savvy_add_column(db, "shop", "items", "s INTEGER", NULL) == SAVVY_ERR_EXISTS);
+    CHECK(savvy_add_column(db, "shop", "items", "t STRING ordered", NULL) == SAVVY_OK);
+
+    test_close(db, directory);
+    return testFailures;
+}
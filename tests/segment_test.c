@@ -0,0 +1,145 @@
+#include "test.h"
+
+// A damaged table file is refused or read as something, never read outside
+// of its arrays. Bytes of a saved table file are overwritten at random (with a
+// fixed seed) and every query on the copy must return; run under a sanitizer
+// to catch reads that do not crash.
+#define DAMAGED_COPIES 300
+
+static size_t read_file(const char *path, unsigned char **bytes)
+{
+    FILE *file = fopen(path, "rb");
+    long size = -1;
+    if (file && fseek(file, 0, SEEK_END) == 0)
+    {
+        size = ftell(file);
+        rewind(file);
+    }
+    *bytes = size > 0 ? malloc(size) : NULL;
+    if (!*bytes || fread(*bytes, 1, size, file) != (size_t)size)
+    {
+        size = 0;
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+    return size > 0 ? (size_t)size : 0;
+}
+
+static int write_file(const char *path, const unsigned char *bytes, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    int ok = file && (size == 0 || fwrite(bytes, 1, size, file) == size);
+    return file && fclose(file) == 0 && ok;
+}
+
+// Find the saved file of table items
+static int table_file(const char *directory, char *name, size_t size)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/shop", directory);
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    int found = 0;
+    while (dir && !found && (entry = readdir(dir)))
+    {
+        found = strncmp(entry->d_name, "items.", 6) == 0 && strlen(entry->d_name) < size;
+        if (found)
+        {
+            strcpy(name, entry->d_name);
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    return found;
+}
+
+static int ignore_row(void *context, int64_t rowId, const char *const *values, const char *const *names,
+                      int numValues)
+{
+    (void)context;
+    (void)rowId;
+    (void)values;
+    (void)names;
+    (void)numValues;
+    return 0;
+}
+
+int main(void)
+{
+    char directory[64];
+    SavvyDB *db = test_open(directory);
+    CHECK(savvy_create_database(db, "shop") == SAVVY_OK);
+    CHECK(savvy_create_table(db, "shop", "items") == SAVVY_OK);
+    CHECK(savvy_set_schema(db, "shop", "items", "id INTEGER ordered:name STRING:tag STRING dictionary:price FLOAT") ==
+          SAVVY_OK);
+    char row[4][32];
+    const char *values[4] = {row[0], row[1], row[2], row[3]};
+    for (int i = 0; i < 300; i++)
+    {
+        snprintf(row[0], sizeof(row[0]), "%d", i);
+        snprintf(row[1], sizeof(row[1]), "name%d", i * 7919 % 1000);
+        snprintf(row[2], sizeof(row[2]), "tag%d", i % 4);
+        snprintf(row[3], sizeof(row[3]), "%d.5", i);
+        CHECK(savvy_insert(db, "shop", "items", values, 1, NULL) == SAVVY_OK);
+    }
+    CHECK(savvy_close(db) == SAVVY_OK);
+
+    // The saved files, the table's to be damaged in each copy
+    static const char *const names[] = {"db.svdb", "db.log", NULL};
+    unsigned char *files[3];
+    size_t sizes[3];
+    char tableName[64];
+    char path[256];
+    CHECK(table_file(directory, tableName, sizeof(tableName)));
+    for (int i = 0; i < 3; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s%s", directory, names[i] ? "" : "shop/", names[i] ? names[i] : tableName);
+        sizes[i] = read_file(path, &files[i]);
+    }
+    CHECK(sizes[0] > 0 && sizes[2] > 0);
+
+    srand(4);
+    for (int copy = 0; copy < DAMAGED_COPIES && sizes[2] > 0; copy++)
+    {
+        char damaged[64];
+        strcpy(damaged, "/tmp/savvy_test_XXXXXX");
+        CHECK(mkdtemp(damaged) != NULL);
+        snprintf(path, sizeof(path), "%s/shop", damaged);
+        CHECK(mkdir(path, 0700) == 0);
+
+        unsigned char *table = malloc(sizes[2]);
+        memcpy(table, files[2], sizes[2]);
+        for (int flips = 1 + rand() % 4; flips > 0; flips--)
+        {
+            table[rand() % sizes[2]] = (unsigned char)rand();
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            snprintf(path, sizeof(path), "%s/%s%s", damaged, names[i] ? "" : "shop/", names[i] ? names[i] : tableName);
+            CHECK(write_file(path, i == 2 ? table : files[i], sizes[i]));
+        }
+        free(table);
+
+        SavvyDB *opened = NULL;
+        if (savvy_open(damaged, &opened) == SAVVY_OK)
+        {
+            savvy_query(opened, "shop", "SELECT * FROM items", ignore_row, NULL, NULL, NULL, 0);
+            savvy_query(opened, "shop", "SELECT * FROM items WHERE tag = tag1", ignore_row, NULL, NULL, NULL, 0);
+            savvy_query(opened, "shop", "SELECT name FROM items WHERE id > 100 ORDER BY id", ignore_row, NULL, NULL,
+                        NULL, 0);
+            savvy_close(opened);
+        }
+        remove_tree(damaged);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        free(files[i]);
+    }
+    remove_tree(directory);
+    return testFailures;
+}
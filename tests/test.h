@@ -0,0 +1,70 @@
+#ifndef TEST_H
+#define TEST_H
+
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "savvydb.h"
+
+// Checks for the test programs run by ctest. A failed check is reported and
+// counted, and the program's exit status is the number of failures.
+
+static int testFailures;
+
+#define CHECK(condition)                                                                                         \
+    do                                                                                                           \
+    {                                                                                                            \
+        if (!(condition))                                                                                        \
+        {                                                                                                        \
+            testFailures++;                                                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                      \
+        }                                                                                                        \
+    } while (0)
+
+// Open a handle on a new empty directory, which test_close removes
+static inline SavvyDB *test_open(char *directory)
+{
+    strcpy(directory, "/tmp/savvy_test_XXXXXX");
+    SavvyDB *db = NULL;
+    if (!mkdtemp(directory) || savvy_open(directory, &db) != SAVVY_OK)
+    {
+        fprintf(stderr, "could not open a database in %s\n", directory);
+        exit(1);
+    }
+    return db;
+}
+
+// Remove a directory and everything in it
+static inline void remove_tree(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        unlink(path);
+        return;
+    }
+    struct dirent *entry;
+    char child[1024];
+    while ((entry = readdir(dir)))
+    {
+        int length = snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0 && length < (int)sizeof(child))
+        {
+            remove_tree(child);
+        }
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+static inline void test_close(SavvyDB *db, const char *directory)
+{
+    CHECK(savvy_close(db) == SAVVY_OK);
+    remove_tree(directory);
+}
+
+#endif